@@ -206,6 +206,7 @@ OBJS = strlcat.obj &
 	$(SYSOBJ_CDA) &
 	$(SYSOBJ_NET) &
 	net_dgrm.obj &
+	net_loadgen.obj &
 	net_loop.obj &
 	net_main.obj &
 	chase.obj &
@@ -234,11 +235,14 @@ OBJS = strlcat.obj &
 	pr_ext.obj &
 	pr_edict.obj &
 	pr_exec.obj &
+	pr_jit.obj &
+	pr_profile.obj &
 	pmove.obj &
 	pmovetxt.obj &
 	sv_main.obj &
 	sv_move.obj &
 	sv_phys.obj &
+	sv_profile.obj &
 	sv_user.obj &
 	world.obj &
 	zone.obj &
@@ -1568,6 +1568,7 @@ static void SV_DecodeUserInfo(client_t *client)
 			Con_Printf ("%s renamed to %s\n", host_client->name, tmp);
 		Q_strcpy (host_client->name, tmp);
 		client->edict->v.netname = PR_SetEngineString(client->name);
+		ED_FindIndexTouchEdict (client->edict);
 	}
 }
 void SV_UpdateInfo(int edict, const char *keyname, const char *value)
@@ -2327,7 +2327,7 @@ static void CL_ParseStuffText(const char *msg)
 			memcpy(tmp, cl.stuffcmdbuf, str-cl.stuffcmdbuf);
 			tmp[str-cl.stuffcmdbuf-1] = '\n';	//put the terminator back, for lazy localcmds.
 			tmp[str-cl.stuffcmdbuf] = 0;	//null terminate it.
-			G_INT(OFS_PARM0) = PR_SetEngineString(tmp);
+			G_INT(OFS_PARM0) = PR_CommitTempString(tmp, str-cl.stuffcmdbuf);
 			PR_ExecuteProgram(cl.qcvm.extfuncs.CSQC_Parse_StuffCmd);
 			handled = true;	//unfortunately the mod is expected to localcmd unknown things.
 			PR_SwitchQCVM(NULL);
@@ -2442,7 +2442,7 @@ static void CL_ParsePrint(const char *msg)
 			tmp = PR_GetTempString();
 			memcpy(tmp, cl.printbuffer, str-cl.printbuffer);
 			tmp[str-cl.printbuffer] = 0;
-			G_INT(OFS_PARM0) = PR_SetEngineString(tmp);
+			G_INT(OFS_PARM0) = PR_CommitTempString(tmp, str-cl.printbuffer);
 			G_FLOAT(OFS_PARM1) = ((*tmp=='\1')?3:2);	//guess at the print level. we don't really have them in NQ.
 			PR_ExecuteProgram(qcvm->extfuncs.CSQC_Parse_Print);
 			PR_SwitchQCVM(NULL);
@@ -2461,13 +2461,10 @@ static void CL_ParsePrint(const char *msg)
 
 static void CL_ParseCenterPrint(const char *msg)
 {
-	char *tmp;
 	if (cl.qcvm.extfuncs.CSQC_Parse_CenterPrint)
 	{	//let the csqc do it.
 		PR_SwitchQCVM(&cl.qcvm);
-		tmp = PR_GetTempString();
-		q_strlcpy(tmp, msg, STRINGTEMP_LENGTH);
-		G_INT(OFS_PARM0) = PR_SetEngineString(tmp);
+		G_INT(OFS_PARM0) = PR_MakeTempString(msg);
 		PR_ExecuteProgram(qcvm->extfuncs.CSQC_Parse_CenterPrint);
 		//qc calls cprint if it wants the legacy behaviour...
 		PR_SwitchQCVM(NULL);
@@ -76,6 +76,8 @@ Cbuf_Init
 */
 void Cbuf_Init (void)
 {
+	Host_InstanceGlobal (&cmd_text, sizeof(cmd_text));	//-instances each have their own, and call this again for it
+	Host_InstanceGlobal (&cmd_wait, sizeof(cmd_wait));
 	SZ_Alloc (&cmd_text, 1<<18);		// space for commands and script files. spike -- was 8192, but modern configs can be _HUGE_, at least if they contain lots of comments/docs for things.
 }
 
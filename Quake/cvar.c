@@ -774,6 +774,74 @@ void Cvar_SetCallback (cvar_t *var, cvarcallback_t func)
 	else	var->flags &= ~CVAR_CALLBACK;
 }
 
+struct cvarinstance_s
+{
+	int		numvars;
+	struct
+	{
+		cvar_t		*var;
+		const char	*string;
+		float		value;
+	} vars[1];
+};
+
+/*
+============
+Cvar_NewInstance
+
+For -instances. Takes a copy of the current values of the CVAR_SERVERINFO cvars,
+which each server keeps its own of, for Cvar_SwapInstance to put in place.
+============
+*/
+cvarinstance_t *Cvar_NewInstance (void)
+{
+	cvarinstance_t	*ci;
+	cvar_t	*var;
+	int		n = 0;
+
+	for (var = cvar_vars ; var ; var = var->next)
+	{
+		if (var->flags & CVAR_SERVERINFO)
+			n++;
+	}
+	ci = (cvarinstance_t *) Z_Malloc (sizeof(cvarinstance_t) + n*sizeof(ci->vars[0]));
+	for (var = cvar_vars ; var ; var = var->next)
+	{
+		if (var->flags & CVAR_SERVERINFO)
+		{
+			ci->vars[ci->numvars].var = var;
+			ci->vars[ci->numvars].string = Z_Strdup (var->string);
+			ci->vars[ci->numvars].value = var->value;
+			ci->numvars++;
+		}
+	}
+	return ci;
+}
+
+/*
+============
+Cvar_SwapInstance
+
+Swaps the current values with the ones held in ci, without calling any callbacks.
+============
+*/
+void Cvar_SwapInstance (cvarinstance_t *ci)
+{
+	const char	*string;
+	float		value;
+	int			i;
+
+	for (i = 0; i < ci->numvars; i++)
+	{
+		string = ci->vars[i].var->string;
+		value = ci->vars[i].var->value;
+		ci->vars[i].var->string = ci->vars[i].string;
+		ci->vars[i].var->value = ci->vars[i].value;
+		ci->vars[i].string = string;
+		ci->vars[i].value = value;
+	}
+}
+
 /*
 ============
 Cvar_Command
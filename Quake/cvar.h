@@ -102,6 +102,11 @@ cvar_t *Cvar_Create (const char *name, const char *value);
 void Cvar_SetCallback (cvar_t *var, cvarcallback_t func);
 // set a callback function to the var
 
+typedef struct cvarinstance_s cvarinstance_t;
+cvarinstance_t *Cvar_NewInstance (void);
+void Cvar_SwapInstance (cvarinstance_t *ci);
+// for -instances, which each have their own values of the CVAR_SERVERINFO cvars
+
 void	Cvar_Set (const char *var_name, const char *value);
 // equivelant to "<name> <variable>" typed at the console
 
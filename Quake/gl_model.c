@@ -39,6 +39,9 @@ void Mod_LoadIQMModel (qmodel_t *mod, const void *buffer);
 static qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash);
 
 static void Mod_Print (void);
+static void Mod_PVSCache_f (cvar_t *var);
+static void Mod_PVSStats_f (void);
+static void Mod_FreePVSCache (qmodel_t *mod);
 
 static cvar_t	external_ents = {"external_ents", "1", CVAR_ARCHIVE};
 cvar_t	gl_load24bit = {"gl_load24bit", "1", CVAR_ARCHIVE};
@@ -54,6 +57,10 @@ static int	mod_novis_capacity;
 static byte	*mod_decompressed;
 static int	mod_decompressed_capacity;
 
+static cvar_t	mod_pvscache = {"mod_pvscache", "1024", CVAR_NONE};	//kb of decompressed pvs rows to keep per model. 0 to decompress every time.
+static cvar_t	mod_fatpvscache = {"mod_fatpvscache", "256", CVAR_NONE};	//kb of merged fatpvs rows to keep per model.
+static int		mod_pvscache_generation;
+
 #define	MAX_MOD_KNOWN	8192 /*spike -- new value, was 2048 in qs, 512 in vanilla. Needs to be big for big maps with many many inline models. */
 static qmodel_t	mod_known[MAX_MOD_KNOWN];
 static int		mod_numknown;
@@ -76,8 +83,13 @@ void Mod_Init (void)
 	Cvar_RegisterVariable (&mod_ignorelmscale);
 	Cvar_RegisterVariable (&mod_lightscale_broken);
 	Cvar_RegisterVariable (&mod_lightgrid);
+	Cvar_RegisterVariable (&mod_pvscache);
+	Cvar_SetCallback (&mod_pvscache, Mod_PVSCache_f);
+	Cvar_RegisterVariable (&mod_fatpvscache);
+	Cvar_SetCallback (&mod_fatpvscache, Mod_PVSCache_f);
 
 	Cmd_AddCommand ("mcache", Mod_Print);
+	Cmd_AddCommand ("mod_pvsstats", Mod_PVSStats_f);
 
 	//johnfitz -- create notexture miptex
 	r_notexture_mip = (texture_t *) Hunk_AllocName (sizeof(texture_t), "r_notexture_mip");
@@ -145,10 +157,12 @@ mleaf_t *Mod_PointInLeaf (vec3_t p, qmodel_t *model)
 
 /*
 ===================
-Mod_DecompressVis
+Mod_DecompressVisRow
+
+Decompresses a leaf's vis into the row at 'decompressed'.
 ===================
 */
-static byte *Mod_DecompressVis (byte *in, qmodel_t *model)
+static byte *Mod_DecompressVisRow (byte *in, qmodel_t *model, byte *decompressed)
 {
 	int		c;
 	byte	*out;
@@ -156,15 +170,8 @@ static byte *Mod_DecompressVis (byte *in, qmodel_t *model)
 	int		row;
 
 	row = (model->numleafs+7)>>3;
-	if (mod_decompressed == NULL || row > mod_decompressed_capacity)
-	{
-		mod_decompressed_capacity = row;
-		mod_decompressed = (byte *) realloc (mod_decompressed, mod_decompressed_capacity);
-		if (!mod_decompressed)
-			Sys_Error ("Mod_DecompressVis: realloc() failed on %d bytes", mod_decompressed_capacity);
-	}
-	out = mod_decompressed;
-	outend = mod_decompressed + row;
+	out = decompressed;
+	outend = decompressed + row;
 
 	if (!in)
 	{	// no vis info, so make all visible
@@ -173,7 +180,7 @@ static byte *Mod_DecompressVis (byte *in, qmodel_t *model)
 			*out++ = 0xff;
 			row--;
 		}
-		return mod_decompressed;
+		return decompressed;
 	}
 
 	do
@@ -186,8 +193,8 @@ static byte *Mod_DecompressVis (byte *in, qmodel_t *model)
 
 		c = in[1];
 		in += 2;
-		if (c > row - (out - mod_decompressed))
-			c = row - (out - mod_decompressed);	//now that we're dynamically allocating pvs buffers, we have to be more careful to avoid heap overflows with buggy maps.
+		if (c > row - (out - decompressed))
+			c = row - (out - decompressed);	//now that we're dynamically allocating pvs buffers, we have to be more careful to avoid heap overflows with buggy maps.
 		while (c)
 		{
 			if (out == outend)
@@ -196,23 +203,303 @@ static byte *Mod_DecompressVis (byte *in, qmodel_t *model)
 					model->viswarn = true;
 					Con_Warning("Mod_DecompressVis: output overrun on model \"%s\"\n", model->name);
 				}
-				return mod_decompressed;
+				return decompressed;
 			}
 			*out++ = 0;
 			c--;
 		}
-	} while (out - mod_decompressed < row);
+	} while (out - decompressed < row);
 
-	return mod_decompressed;
+	return decompressed;
+}
+
+/*
+===================
+Mod_DecompressVis
+
+Decompresses into a shared buffer that is only valid until the next call.
+===================
+*/
+static byte *Mod_DecompressVis (byte *in, qmodel_t *model)
+{
+	int		row;
+
+	row = (model->numleafs+7)>>3;
+	if (mod_decompressed == NULL || row > mod_decompressed_capacity)
+	{
+		mod_decompressed_capacity = row;
+		mod_decompressed = (byte *) realloc (mod_decompressed, mod_decompressed_capacity);
+		if (!mod_decompressed)
+			Sys_Error ("Mod_DecompressVis: realloc() failed on %d bytes", mod_decompressed_capacity);
+	}
+	return Mod_DecompressVisRow (in, model, mod_decompressed);
+}
+
+/*
+=============================================================================
+
+PVS CACHE
+
+Servers decompress the same few rows for every client every frame, so each
+model keeps an lru list of its recently decompressed rows, plus a small
+set-associative table of fatpvs rows keyed by the leafs that were merged to
+make them. Both are sized by cvar, and thrown away when the cvars change or
+the model is reloaded.
+The returned rows stay valid until at least the next lookup, same as the
+single shared buffer used to. Not thread safe.
+
+=============================================================================
+*/
+
+#define FATPVS_WAYS	4
+
+typedef struct
+{
+	int		prev, next;	//lru list, most recently used first
+	int		leafnum;
+} pvsrow_t;
+
+typedef struct
+{
+	unsigned int	hash;
+	unsigned int	lastused;
+	int				numleafs;	//0 when unused
+	int				leafnums[MAX_FATPVS_LEAFS];
+} fatpvsentry_t;
+
+struct pvscache_s
+{
+	int				generation;
+	int				rowbytes;
+	int				numleafs;
+
+	int				*leafrow;	//[numleafs+1] row holding each leaf's pvs, or -1
+	pvsrow_t		*rows;
+	byte			*rowdata;
+	int				numrows, maxrows;
+	int				mru, lru;
+
+	fatpvsentry_t	*fat;
+	byte			*fatdata;
+	int				fatsets;	//each holding FATPVS_WAYS entries
+	unsigned int	fatclock;
+
+	unsigned int	hits, misses, evictions;
+	unsigned int	fathits, fatmisses, fatevictions;
+};
+
+static void Mod_FreePVSCache (qmodel_t *mod)
+{
+	free (mod->pvscache);
+	mod->pvscache = NULL;
+}
+
+static void Mod_PVSCache_f (cvar_t *var)
+{
+	mod_pvscache_generation++;	//everything gets rebuilt at its new size next time its used
+}
+
+static struct pvscache_s *Mod_GetPVSCache (qmodel_t *model)
+{
+	struct pvscache_s *c = model->pvscache;
+	int rowbytes = (model->numleafs+7)>>3;
+	size_t maxrows, fatsets, size;
+	byte *p;
+
+	if (c && c->generation == mod_pvscache_generation && c->numleafs == model->numleafs)
+		return c;
+	Mod_FreePVSCache (model);
+
+	maxrows = (size_t)q_max(0, mod_pvscache.value) * 1024 / (rowbytes + sizeof(pvsrow_t));
+	if (maxrows > (size_t)model->numleafs+1)
+		maxrows = model->numleafs+1;
+	if (maxrows < 2)	//one row would get evicted while the caller is still using it.
+		maxrows = 0;
+	fatsets = (size_t)q_max(0, mod_fatpvscache.value) * 1024 / ((rowbytes + sizeof(fatpvsentry_t)) * FATPVS_WAYS);
+
+	size = sizeof(*c);
+	if (maxrows)
+		size += sizeof(*c->leafrow)*(model->numleafs+1) + sizeof(*c->rows)*maxrows;
+	size += sizeof(*c->fat)*fatsets*FATPVS_WAYS;
+	size += rowbytes*(maxrows + fatsets*FATPVS_WAYS);
+	c = (struct pvscache_s *) calloc (1, size);
+	if (!c)
+		Sys_Error ("Mod_GetPVSCache: calloc() failed on %d bytes", (int)size);
+
+	c->generation = mod_pvscache_generation;
+	c->rowbytes = rowbytes;
+	c->numleafs = model->numleafs;
+	c->maxrows = maxrows;
+	c->fatsets = fatsets;
+	c->mru = c->lru = -1;
+	p = (byte *)(c+1);
+	if (maxrows)
+	{
+		c->leafrow = (int *)p;
+		memset (c->leafrow, 0xff, sizeof(*c->leafrow)*(model->numleafs+1));
+		p += sizeof(*c->leafrow)*(model->numleafs+1);
+		c->rows = (pvsrow_t *)p;
+		p += sizeof(*c->rows)*maxrows;
+	}
+	c->fat = (fatpvsentry_t *)p;
+	p += sizeof(*c->fat)*fatsets*FATPVS_WAYS;
+	c->rowdata = p;
+	c->fatdata = p + rowbytes*maxrows;
+
+	model->pvscache = c;
+	return c;
+}
+
+static byte *Mod_CachedLeafPVS (struct pvscache_s *c, mleaf_t *leaf, qmodel_t *model)
+{
+	int leafnum = leaf - model->leafs;
+	int r = c->leafrow[leafnum];
+	pvsrow_t *row;
+
+	if (r >= 0)
+	{
+		c->hits++;
+		if (r == c->mru)
+			return c->rowdata + r*c->rowbytes;
+		//unlink it, to move it to the front
+		row = &c->rows[r];
+		c->rows[row->prev].next = row->next;
+		if (row->next >= 0)
+			c->rows[row->next].prev = row->prev;
+		else
+			c->lru = row->prev;
+	}
+	else
+	{
+		c->misses++;
+		if (c->numrows < c->maxrows)
+			r = c->numrows++;
+		else
+		{	//reuse the oldest
+			r = c->lru;
+			row = &c->rows[r];
+			c->lru = row->prev;
+			c->rows[c->lru].next = -1;
+			c->leafrow[row->leafnum] = -1;
+			c->evictions++;
+		}
+		row = &c->rows[r];
+		row->leafnum = leafnum;
+		c->leafrow[leafnum] = r;
+		Mod_DecompressVisRow (leaf->compressed_vis, model, c->rowdata + r*c->rowbytes);
+	}
+
+	row->prev = -1;
+	row->next = c->mru;
+	if (c->mru >= 0)
+		c->rows[c->mru].prev = r;
+	else
+		c->lru = r;
+	c->mru = r;
+	return c->rowdata + r*c->rowbytes;
 }
 
 byte *Mod_LeafPVS (mleaf_t *leaf, qmodel_t *model)
 {
+	struct pvscache_s *c;
 	if (leaf == model->leafs)
 		return Mod_NoVisPVS (model);
+	c = Mod_GetPVSCache (model);
+	if (c->maxrows && leaf - model->leafs <= model->numleafs)	//some bsps have more leafs than they have vis for
+		return Mod_CachedLeafPVS (c, leaf, model);
 	return Mod_DecompressVis (leaf->compressed_vis, model);
 }
 
+/*
+===================
+Mod_MergeLeafPVS
+
+Writes the union of the given leafs' pvs rows into 'out', remembering the
+result so the next query for the same leafs is just a copy.
+===================
+*/
+void Mod_MergeLeafPVS (qmodel_t *model, const int *leafnums, int numleafs, byte *out)
+{
+	struct pvscache_s *c = Mod_GetPVSCache (model);
+	fatpvsentry_t *set, *e, *best;
+	unsigned int hash = 2166136261u;
+	byte *pvs, *data;
+	int i, j;
+
+	for (i = 0; i < numleafs; i++)
+		hash = (hash ^ (unsigned int)leafnums[i]) * 16777619u;
+
+	best = NULL;
+	if (c->fatsets && numleafs > 0 && numleafs <= MAX_FATPVS_LEAFS)
+	{
+		set = &c->fat[(hash % c->fatsets)*FATPVS_WAYS];
+		for (i = 0, e = set; i < FATPVS_WAYS; i++, e++)
+		{
+			if (e->hash == hash && e->numleafs == numleafs && !memcmp(e->leafnums, leafnums, sizeof(*leafnums)*numleafs))
+			{
+				c->fathits++;
+				e->lastused = ++c->fatclock;
+				memcpy (out, c->fatdata + (e-c->fat)*c->rowbytes, c->rowbytes);
+				return;
+			}
+			if (!best || e->lastused < best->lastused)
+				best = e;
+		}
+		c->fatmisses++;
+		if (best->numleafs)
+			c->fatevictions++;
+	}
+
+	Q_memset (out, 0, c->rowbytes);
+	for (i = 0; i < numleafs; i++)
+	{
+		pvs = Mod_LeafPVS (&model->leafs[leafnums[i]], model);
+		for (j = 0; j < c->rowbytes; j++)
+			out[j] |= pvs[j];
+	}
+
+	if (best)
+	{
+		best->hash = hash;
+		best->numleafs = numleafs;
+		best->lastused = ++c->fatclock;
+		memcpy (best->leafnums, leafnums, sizeof(*leafnums)*numleafs);
+		data = c->fatdata + (best-c->fat)*c->rowbytes;
+		memcpy (data, out, c->rowbytes);
+	}
+}
+
+/*
+===================
+Mod_PVSStats_f
+===================
+*/
+static void Mod_PVSStats_f (void)
+{
+	int		i;
+	qmodel_t	*mod;
+	struct pvscache_s *c;
+	qboolean reset = Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset");
+
+	for (i=0, mod=mod_known ; i < mod_numknown ; i++, mod++)
+	{
+		c = mod->pvscache;
+		if (!c)
+			continue;
+		if (reset)
+		{
+			c->hits = c->misses = c->evictions = 0;
+			c->fathits = c->fatmisses = c->fatevictions = 0;
+			continue;
+		}
+		Con_SafePrintf ("%s: %i leafs, %i bytes per row\n", mod->name, c->numleafs, c->rowbytes);
+		Con_SafePrintf ("  rows:   %i/%i cached, %u hits, %u misses (%.1f%%), %u evictions\n", c->numrows, c->maxrows,
+			c->hits, c->misses, (c->hits+c->misses)?100.0*c->hits/(c->hits+c->misses):0, c->evictions);
+		Con_SafePrintf ("  fatpvs: %i slots, %u hits, %u misses (%.1f%%), %u evictions\n", c->fatsets*FATPVS_WAYS,
+			c->fathits, c->fatmisses, (c->fathits+c->fatmisses)?100.0*c->fathits/(c->fathits+c->fatmisses):0, c->fatevictions);
+	}
+}
+
 byte *Mod_NoVisPVS (qmodel_t *model)
 {
 	int pvsbytes;
@@ -235,11 +522,18 @@ byte *Mod_NoVisPVS (qmodel_t *model)
 Mod_ClearAll
 ===================
 */
+static void Mod_ClearInstance (void);
 void Mod_ClearAll (void)
 {
 	int		i;
 	qmodel_t	*mod;
 
+	if (host_numinstances > 1)
+	{
+		Mod_ClearInstance ();
+		return;
+	}
+
 	for (i=0 , mod=mod_known ; i<mod_numknown ; i++, mod++)
 	{
 		if (mod->type != mod_alias)
@@ -252,6 +546,71 @@ void Mod_ClearAll (void)
 	}
 }
 
+/*
+===================
+Mod_ClearInstance
+
+-instances share their models, which only get unloaded once none of them are using them
+===================
+*/
+static void Mod_ClearInstance (void)
+{
+	uint64_t	bit = (uint64_t)1<<host_instance;
+	int		i, j;
+	qmodel_t	*mod, *sub;
+
+	Hunk_SwitchArena (NULL);	// in case a Host_Error cut a load short
+
+	for (i=0 , mod=mod_known ; i<mod_numknown ; i++, mod++)
+	{
+		mod->instances &= ~bit;
+		if (mod->type == mod_alias || mod->needload || !mod->name[0])
+			continue;
+		if (mod->submodelof && mod->submodelof != mod)
+			continue;	// goes along with the model it's part of
+		if (mod->instances)
+			continue;	// another server's still using it
+
+		mod->needload = true;
+		TexMgr_FreeTexturesForOwner (mod); //johnfitz
+		PScript_ClearSurfaceParticles(mod);
+		RSceneCache_Cleanup(mod);
+		Mod_FreePVSCache (mod);
+		Hunk_FreeArena (mod->arena);
+		mod->arena = NULL;
+
+		for (j=0 , sub=mod_known ; j<mod_numknown ; j++, sub++)
+		{	// its inline models are named after it, so they can't be found again anyway
+			if (sub != mod && sub->submodelof == mod)
+			{
+				Mod_FreePVSCache (sub);
+				memset (sub, 0, sizeof(qmodel_t));
+			}
+		}
+	}
+}
+
+/*
+================
+Mod_SharedMemory
+
+Bytes of models loaded for -instances server inst, or for all of them with -1
+================
+*/
+size_t Mod_SharedMemory (int inst)
+{
+	int		i;
+	qmodel_t	*mod;
+	size_t	total = 0;
+
+	for (i=0 , mod=mod_known ; i<mod_numknown ; i++, mod++)
+	{
+		if (mod->arena && (inst < 0 || (mod->instances & ((uint64_t)1<<inst))))
+			total += Hunk_ArenaSize (mod->arena);
+	}
+	return total;
+}
+
 void Mod_ResetAll (void)
 {
 	int		i;
@@ -268,6 +627,8 @@ void Mod_ResetAll (void)
 			PScript_ClearSurfaceParticles(mod);
 			RSceneCache_Cleanup(mod);
 		}
+		Mod_FreePVSCache (mod);
+		Hunk_FreeArena (mod->arena);
 		memset(mod, 0, sizeof(qmodel_t));
 	}
 	mod_numknown = 0;
@@ -292,11 +653,18 @@ Mod_FindName
 static qmodel_t *Mod_FindName (const char *name)
 {
 	int		i;
-	qmodel_t	*mod;
+	qmodel_t	*mod, *unused = NULL;
+	char	scopedname[MAX_QPATH];
 
 	if (!name[0])
 		Sys_Error ("Mod_FindName: NULL name"); //johnfitz -- was "Mod_ForName"
 
+	if (host_numinstances > 1 && name[0] == '*' && name[1] >= '0' && name[1] <= '9')
+	{	// -instances can have different maps loaded at once, so inline models are named after their map
+		q_snprintf (scopedname, sizeof(scopedname), "%s%s", sv.modelname, name);
+		name = scopedname;
+	}
+
 //
 // search the currently loaded models
 //
@@ -304,15 +672,20 @@ static qmodel_t *Mod_FindName (const char *name)
 	{
 		if (!strcmp (mod->name, name) )
 			break;
+		if (!unused && !mod->name[0])
+			unused = mod;	// left by Mod_ClearInstance
 	}
 
 	if (i == mod_numknown)
 	{
-		if (mod_numknown == MAX_MOD_KNOWN)
+		if (unused)
+			mod = unused;
+		else if (mod_numknown == MAX_MOD_KNOWN)
 			Sys_Error ("mod_numknown == MAX_MOD_KNOWN");
+		else
+			mod_numknown++;
 		q_strlcpy (mod->name, name, MAX_QPATH);
 		mod->needload = true;
-		mod_numknown++;
 	}
 
 	return mod;
@@ -349,6 +722,7 @@ static qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 	byte	*buf;
 	byte	stackbuf[1024];		// avoid dirtying the cache heap
 	int	mod_type;
+	hunkarena_t	*oldarena = NULL;
 
 	if (!mod->needload)
 	{
@@ -364,8 +738,8 @@ static qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 //
 // load the file
 //
-	if (*mod->name == '*')
-		buf = NULL;
+	if (*mod->name == '*' || (host_numinstances > 1 && strchr (mod->name, '*')))
+		buf = NULL;	// inline models only come from loading their map, see Mod_FindName
 	else
 	{
 		const char *exts = r_replacemodels.string;
@@ -428,6 +802,14 @@ static qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 
 // call the apropriate loader
 	mod->needload = false;
+	Mod_FreePVSCache (mod);
+
+	if (host_numinstances > 1)
+	{	// -instances share models, so they can't go in any one server's hunk
+		Hunk_FreeArena (mod->arena);
+		mod->arena = Hunk_NewArena (com_filesize*2);
+		oldarena = Hunk_SwitchArena (mod->arena);
+	}
 
 	mod_type = (buf[0] | (buf[1] << 8) | (buf[2] << 16) | (buf[3] << 24));
 	switch (mod_type)
@@ -487,6 +869,16 @@ static qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 		break;
 	}
 
+	if (mod->arena)
+	{
+		Hunk_SwitchArena (oldarena);
+		if (mod->type == mod_alias || mod->type == mod_ext_invalid)
+		{	// those go in the cache, or nowhere
+			Hunk_FreeArena (mod->arena);
+			mod->arena = NULL;
+		}
+	}
+
 	if (crash && mod->type == mod_ext_invalid)
 	{	//any of those formats for a world map will be screwed up.
 		Sys_Error ("Mod_LoadModel: couldn't load %s", mod->name); //johnfitz -- was "Mod_NumForName"
@@ -510,8 +902,16 @@ qmodel_t *Mod_ForName (const char *name, qboolean crash)
 	qmodel_t	*mod;
 
 	mod = Mod_FindName (name);
+	mod = Mod_LoadModel (mod, crash);
 
-	return Mod_LoadModel (mod, crash);
+	if (mod && host_numinstances > 1)
+	{	// note which -instances are using it, so Mod_ClearInstance knows when it can go
+		if (mod->submodelof)
+			mod->submodelof->instances |= (uint64_t)1<<host_instance;
+		else
+			mod->instances |= (uint64_t)1<<host_instance;
+	}
+	return mod;
 }
 
 
@@ -2900,12 +3300,18 @@ visdone:
 
 		if (i < mod->numsubmodels-1)
 		{	// duplicate the basic information
-			char	name[12];
+			char	name[MAX_QPATH];
 
-			sprintf (name, "*%i", i+1);
+			if (host_numinstances > 1)	// named after their map, see Mod_FindName
+				q_snprintf (name, sizeof(name), "%s*%i", mod->submodelof->name, i+1);
+			else
+				sprintf (name, "*%i", i+1);
 			loadmodel = Mod_FindName (name);
+			Mod_FreePVSCache (loadmodel);
 			*loadmodel = *mod;
 			strcpy (loadmodel->name, name);
+			loadmodel->arena = NULL;	// it's part of mod's
+			loadmodel->instances = 0;
 			mod = loadmodel;
 
 			Mod_SetExtraFlags(mod);
@@ -3872,7 +4278,8 @@ static void Mod_Print (void)
 	Con_SafePrintf ("Cached models:\n"); //johnfitz -- safeprint instead of print
 	for (i=0, mod=mod_known ; i < mod_numknown ; i++, mod++)
 	{
-		Con_SafePrintf ("%8p : %s\n", mod->cache.data, mod->name); //johnfitz -- safeprint instead of print
+		if (mod->name[0])
+			Con_SafePrintf ("%8p : %s\n", mod->cache.data, mod->name); //johnfitz -- safeprint instead of print
 	}
 	Con_Printf ("%i models\n",mod_numknown); //johnfitz -- print the total too
 }
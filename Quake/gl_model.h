@@ -541,6 +541,7 @@ typedef struct qmodel_s
 	char		*entities;
 
 	qboolean	viswarn; // for Mod_DecompressVis()
+	struct pvscache_s *pvscache;	// decompressed rows, see Mod_LeafPVS
 
 	int			bspversion;
 	int			contentstransparent;	//spike -- added this so we can disable glitchy wateralpha where its not supported.
@@ -554,6 +555,12 @@ typedef struct qmodel_s
 	GLuint		 meshindexesvbo;
 	byte		*meshindexesvboptr;	//for non-ebo fallback.
 
+//
+// -instances
+//
+	hunkarena_t	*arena;		// where everything that isn't in the cache went
+	uint64_t	instances;	// bit for each server using it
+
 //
 // additional model data
 //
@@ -570,10 +577,13 @@ qmodel_t *Mod_ForName (const char *name, qboolean crash);
 void	Mod_ForEachModel(void(*callback)(qmodel_t *mod));
 void	*Mod_Extradata (qmodel_t *mod);	// handles caching
 void	Mod_TouchModel (const char *name);
+size_t	Mod_SharedMemory (int inst);
 
 mleaf_t *Mod_PointInLeaf (vec3_t p, qmodel_t *model);
 byte	*Mod_LeafPVS (mleaf_t *leaf, qmodel_t *model);
 byte	*Mod_NoVisPVS (qmodel_t *model);
+#define MAX_FATPVS_LEAFS	16	// fatpvs queries touching more leafs than this are not remembered
+void	Mod_MergeLeafPVS (qmodel_t *model, const int *leafnums, int numleafs, byte *out);
 
 void Mod_SetExtraFlags (qmodel_t *mod);
 void BSPX_LightGridLoad(qmodel_t *model, void *lgdata, size_t lgsize);
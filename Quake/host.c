@@ -160,9 +160,11 @@ void Host_EndGame (const char *message, ...)
 		Host_ShutdownServer (false);
 
 	if (cls.state == ca_dedicated)
-		Sys_Error ("Host_EndGame: %s\n",string);	// dedicated servers exit
-
-	if (cls.demonum != -1 && !cls.timedemo)
+	{
+		if (host_numinstances <= 1 || !host_initialized)
+			Sys_Error ("Host_EndGame: %s\n",string);	// dedicated servers exit
+	}	// unless they're one of several -instances, which just lose that server
+	else if (cls.demonum != -1 && !cls.timedemo)
 		CL_NextDemo ();
 	else
 		CL_Disconnect ();
@@ -206,7 +208,12 @@ void Host_Error (const char *error, ...)
 		Host_ShutdownServer (false);
 
 	if (cls.state == ca_dedicated)
-		Sys_Error ("Host_Error: %s\n",string);	// dedicated servers exit
+	{
+		if (host_numinstances <= 1 || !host_initialized)
+			Sys_Error ("Host_Error: %s\n",string);	// dedicated servers exit
+		inerror = false;	// unless they're one of several -instances, which just lose that server
+		longjmp (host_abortserver, 1);
+	}
 
 	CL_Disconnect ();
 	cls.demonum = -1;
@@ -285,6 +292,495 @@ void Host_Version_f (void)
 #endif
 }
 
+/*
+===============================================================================
+
+WORKER POOL
+
+A few threads that Host_ParallelFor can split independent items across.
+The calling thread joins in too, and doesn't return until every item is done.
+
+===============================================================================
+*/
+
+cvar_t	host_workers = {"host_workers", "0", CVAR_ARCHIVE};	//total threads for Host_ParallelFor, 0 for one per cpu, 1 to keep everything on the main thread
+
+static struct
+{
+	SDL_mutex		*mutex;
+	SDL_cond		*wake;		//signalled when a new job is posted
+	SDL_cond		*done;		//signalled when the last worker finishes its share
+	SDL_Thread		*threads[MAX_HOST_WORKERS-1];
+	int				numthreads;
+	qboolean		die;
+	qboolean		running;
+
+	int				generation;	//bumped for each job, so workers can tell they've not started it yet
+	hostjobfunc_t	func;
+	void			*ctx;
+	int				count;
+	int				grain;
+	SDL_atomic_t	next;		//first item that nobody has claimed yet
+	int				busy;		//threads still working on the current job
+} hostjobs;
+
+static void Host_RunJobItems (int worker)
+{
+	int first;
+	while ((first = SDL_AtomicAdd (&hostjobs.next, hostjobs.grain)) < hostjobs.count)
+		hostjobs.func (hostjobs.ctx, first, q_min(hostjobs.grain, hostjobs.count-first), worker);
+}
+
+static int Host_WorkerThread (void *arg)
+{
+	int worker = (int)(intptr_t)arg;
+	int seen = 0;
+
+	SDL_LockMutex (hostjobs.mutex);
+	for (;;)
+	{
+		while (!hostjobs.die && hostjobs.generation == seen)
+			SDL_CondWait (hostjobs.wake, hostjobs.mutex);
+		if (hostjobs.die)
+			break;
+		seen = hostjobs.generation;
+		SDL_UnlockMutex (hostjobs.mutex);
+
+		Host_RunJobItems (worker);
+
+		SDL_LockMutex (hostjobs.mutex);
+		if (!--hostjobs.busy)
+			SDL_CondSignal (hostjobs.done);
+	}
+	SDL_UnlockMutex (hostjobs.mutex);
+	return 0;
+}
+
+static void Host_StopWorkers (void)
+{
+	int i;
+
+	if (!hostjobs.mutex)
+		return;
+	SDL_LockMutex (hostjobs.mutex);
+	hostjobs.die = true;
+	SDL_CondBroadcast (hostjobs.wake);
+	SDL_UnlockMutex (hostjobs.mutex);
+	for (i = 0; i < hostjobs.numthreads; i++)
+		SDL_WaitThread (hostjobs.threads[i], NULL);
+	SDL_DestroyCond (hostjobs.wake);
+	SDL_DestroyCond (hostjobs.done);
+	SDL_DestroyMutex (hostjobs.mutex);
+	memset (&hostjobs, 0, sizeof(hostjobs));
+}
+
+static void Host_StartWorkers (void)
+{
+	int wanted = host_workers.value;
+
+	if (wanted <= 0)
+		wanted = host_parms ? host_parms->numcpus : 1;
+	wanted = CLAMP(1, wanted, MAX_HOST_WORKERS) - 1;	//the main thread is one of them
+
+	hostjobs.mutex = SDL_CreateMutex ();
+	hostjobs.wake = SDL_CreateCond ();
+	hostjobs.done = SDL_CreateCond ();
+	for (hostjobs.numthreads = 0; hostjobs.numthreads < wanted; hostjobs.numthreads++)
+	{
+		hostjobs.threads[hostjobs.numthreads] = SDL_CreateThread (Host_WorkerThread, "worker", (void *)(intptr_t)hostjobs.numthreads);
+		if (!hostjobs.threads[hostjobs.numthreads])
+			break;	//make do with what we've got.
+	}
+}
+
+static void Host_Workers_f (cvar_t *var)
+{
+	Host_StopWorkers ();	//restarted with the new count on next use
+}
+
+qboolean Host_JobsRunning (void)
+{
+	return hostjobs.running;
+}
+
+/*
+===============
+Host_ParallelFor
+
+Calls func for every item in [0, count), handing out grain items at a time.
+Items may run in any order, on any thread, so func must only touch its own
+items' data, plus per-worker scratch indexed by the worker argument
+(always less than MAX_HOST_WORKERS). Jobs can't start more jobs.
+===============
+*/
+void Host_ParallelFor (hostjobfunc_t func, void *ctx, int count, int grain)
+{
+	if (hostjobs.running)
+		Sys_Error ("Host_ParallelFor: nested call");
+	if (grain < 1)
+		grain = 1;
+	if (!hostjobs.mutex && count > grain)
+		Host_StartWorkers ();
+	if (!hostjobs.numthreads || count <= grain)
+	{
+		if (count > 0)
+			func (ctx, 0, count, 0);
+		return;
+	}
+
+	SDL_LockMutex (hostjobs.mutex);
+	hostjobs.running = true;
+	hostjobs.func = func;
+	hostjobs.ctx = ctx;
+	hostjobs.count = count;
+	hostjobs.grain = grain;
+	SDL_AtomicSet (&hostjobs.next, 0);
+	hostjobs.busy = hostjobs.numthreads;
+	hostjobs.generation++;
+	SDL_CondBroadcast (hostjobs.wake);
+	SDL_UnlockMutex (hostjobs.mutex);
+
+	Host_RunJobItems (hostjobs.numthreads);
+
+	SDL_LockMutex (hostjobs.mutex);
+	while (hostjobs.busy)
+		SDL_CondWait (hostjobs.done, hostjobs.mutex);
+	hostjobs.running = false;
+	SDL_UnlockMutex (hostjobs.mutex);
+}
+
+/*
+===============================================================================
+
+SERVER INSTANCES
+
+-instances N runs N dedicated servers in this one process, on consecutive ports.
+Each has its own sv, svs, hunk, command buffer, serverinfo cvars and listening
+sockets, which Host_SwitchInstance swaps in before anything touches them. The
+filesystem, pak handles and world models are shared between them. They take
+turns on the main thread, and share the worker threads, so that nothing else
+needs to know about them.
+
+===============================================================================
+*/
+
+#define MAX_INSTANCES			64
+#define MAX_INSTANCEGLOBALS		64
+#define INSTANCE_STATSINTERVAL	1.0
+
+int		host_instance;			// the one that's switched in
+int		host_numinstances = 1;
+
+static struct
+{
+	void	*ptr;
+	size_t	size;
+	size_t	ofs;
+} instanceglobals[MAX_INSTANCEGLOBALS];
+static int		numinstanceglobals;
+static size_t	instanceglobalsize;
+static byte		instanceglobaldefaults[8192];
+static qboolean	instancesstarted;
+
+typedef struct
+{
+	server_t		*server;
+	server_static_t	*serverstatic;
+	hunkstate_t		*hunk;		// NULL for the main one
+	cvarinstance_t	*cvars;		// NULL while switched in
+	byte			*globals;	// the registered globals, while switched out
+	qboolean		startmap;	// check that it got a map once the configs have run
+
+	double			total;		// seconds spent in its server frames since the last report
+	double			peak;
+	int				frames;
+	double			avgms, peakms;
+} instance_t;
+static instance_t	instances[MAX_INSTANCES];
+static double		instancestatstime;
+
+/*
+===============
+Host_InstanceGlobal
+
+Registers a global that each of the -instances servers needs its own copy of.
+New instances start out with whatever value it has when this is called.
+===============
+*/
+void Host_InstanceGlobal (void *global, size_t size)
+{
+	int		i;
+
+	for (i = 0; i < numinstanceglobals; i++)
+	{
+		if (instanceglobals[i].ptr == global)
+			return;
+	}
+	if (instancesstarted)
+		Sys_Error ("Host_InstanceGlobal: instances already started");
+	if (numinstanceglobals == MAX_INSTANCEGLOBALS || instanceglobalsize + size > sizeof(instanceglobaldefaults))
+		Sys_Error ("Host_InstanceGlobal: too many globals");
+
+	instanceglobals[numinstanceglobals].ptr = global;
+	instanceglobals[numinstanceglobals].size = size;
+	instanceglobals[numinstanceglobals].ofs = instanceglobalsize;
+	memcpy (instanceglobaldefaults + instanceglobalsize, global, size);
+	instanceglobalsize += size;
+	numinstanceglobals++;
+}
+
+// where inst's copy of a registered global is
+static void *Host_InstanceGlobalPtr (int inst, void *global)
+{
+	int		i;
+
+	if (inst == host_instance)
+		return global;
+	for (i = 0; i < numinstanceglobals; i++)
+	{
+		if (instanceglobals[i].ptr == global)
+			return instances[inst].globals + instanceglobals[i].ofs;
+	}
+	return global;
+}
+
+/*
+===============
+Host_SwitchInstance
+
+Makes inst the server that everything works on. Not while any qc is running.
+===============
+*/
+void Host_SwitchInstance (int inst)
+{
+	instance_t	*from = &instances[host_instance];
+	instance_t	*to = &instances[inst];
+	int			i;
+
+	if (inst == host_instance)
+		return;
+	if (qcvm)
+		Sys_Error ("Host_SwitchInstance: qc is running");
+
+	for (i = 0; i < numinstanceglobals; i++)
+	{
+		memcpy (from->globals + instanceglobals[i].ofs, instanceglobals[i].ptr, instanceglobals[i].size);
+		memcpy (instanceglobals[i].ptr, to->globals + instanceglobals[i].ofs, instanceglobals[i].size);
+	}
+	sv_current = to->server;
+	svs_current = to->serverstatic;
+	Hunk_Switch (to->hunk);
+	Cvar_SwapInstance (to->cvars);
+	from->cvars = to->cvars;	// now holding from's values
+	to->cvars = NULL;
+
+	host_instance = inst;
+}
+
+/*
+===============
+Host_InitInstances
+
+Sets up the rest of the -instances servers, once everything they share has been.
+===============
+*/
+static void Host_InitInstances (void)
+{
+	instance_t	*inst;
+	int			i, hunksize;
+
+	if (host_numinstances <= 1)
+		return;
+
+	Host_InstanceGlobal (&host_hunklevel, sizeof(host_hunklevel));
+	Host_InstanceGlobal (&current_skill, sizeof(current_skill));
+
+	hunksize = host_parms->memsize;
+	i = COM_CheckParm ("-instancemem");
+	if (i && i < com_argc-1)
+		hunksize = q_max(Q_atoi (com_argv[i+1]), 8) * 1024 * 1024;
+
+	instances[0].server = sv_current;
+	instances[0].serverstatic = svs_current;
+	instances[0].globals = (byte *) malloc (instanceglobalsize);
+	if (!instances[0].globals)
+		Sys_Error ("Host_InitInstances: out of memory");
+	instancesstarted = true;
+
+	for (i = 1; i < host_numinstances; i++)
+	{
+		inst = &instances[i];
+		inst->globals = (byte *) malloc (instanceglobalsize);
+		if (!inst->globals)
+			Sys_Error ("Host_InitInstances: out of memory");
+		memcpy (inst->globals, instanceglobaldefaults, instanceglobalsize);
+		inst->hunk = Hunk_Create (hunksize);
+		inst->cvars = Cvar_NewInstance ();
+		inst->serverstatic = (server_static_t *) calloc (1, sizeof(server_static_t));
+		inst->server = (server_t *) calloc (1, sizeof(server_t));	//last, Host_Shutdown only touches ones that got this far
+		if (!inst->server || !inst->serverstatic)
+			Sys_Error ("Host_InitInstances: out of memory");
+		q_strlcpy (inst->serverstatic->serverinfo, svs.serverinfo, sizeof(inst->serverstatic->serverinfo));
+
+		Host_SwitchInstance (i);
+		Cbuf_Init ();
+		Host_FindMaxClients ();
+		Hunk_AllocName (0, "-HOST_HUNKLEVEL-");
+		host_hunklevel = Hunk_LowMark ();
+		NET_ListenOn (DEFAULTnet_hostport + i);
+		Host_SwitchInstance (0);
+	}
+	Con_Printf ("%i server instances on ports %i-%i\n", host_numinstances, net_hostport, net_hostport + host_numinstances - 1);
+}
+
+/*
+===============
+Host_InstanceFrames
+
+Runs a server frame for each instance in turn, timing each one.
+===============
+*/
+static void Host_InstanceFrames (void)
+{
+	instance_t	*inst;
+	double		start, time;
+	int			i;
+
+	for (i = 0; i < host_numinstances; i++)
+	{
+		inst = &instances[i];
+		Host_SwitchInstance (i);
+		if (i)
+		{	// instance 0's commands already ran, along with the console's
+			Cbuf_Execute ();
+			if (inst->startmap)
+			{
+				inst->startmap = false;
+				if (!sv.active)
+					Cbuf_AddText ("startmap_dm\n");
+			}
+		}
+
+		start = Sys_DoubleTime ();
+		if (sv.active)
+		{
+			PR_SwitchQCVM(&sv.qcvm);
+			Host_ServerFrame ();
+			PR_SwitchQCVM(NULL);
+		}
+		time = Sys_DoubleTime () - start;
+		inst->total += time;
+		inst->peak = q_max(inst->peak, time);
+		inst->frames++;
+
+		if (i)
+		{	// instance 0 does these along with everything else at the end of the frame
+			Cbuf_Waited ();
+			PR_ProfileFrame ();
+			PR_StringsFrame ();
+		}
+	}
+	Host_SwitchInstance (0);
+
+	if (realtime < instancestatstime)
+		return;
+	instancestatstime = realtime + INSTANCE_STATSINTERVAL;
+	for (i = 0; i < host_numinstances; i++)
+	{
+		inst = &instances[i];
+		inst->avgms = inst->frames ? inst->total * 1000 / inst->frames : 0;
+		inst->peakms = inst->peak * 1000;
+		inst->total = inst->peak = 0;
+		inst->frames = 0;
+	}
+}
+
+/*
+===============
+Host_Instances_f
+===============
+*/
+static void Host_Instances_f (void)
+{
+	instance_t	*inst;
+	int			i, j, clients;
+
+	if (host_numinstances <= 1)
+	{
+		Con_Printf ("Not running -instances\n");
+		return;
+	}
+	Con_Printf ("inst port  map              clients   hunk    edicts  models  avgms  peakms\n");
+	for (i = 0; i < host_numinstances; i++)
+	{
+		inst = &instances[i];
+		for (j = clients = 0; j < inst->serverstatic->maxclients; j++)
+		{
+			if (inst->serverstatic->clients[j].active)
+				clients++;
+		}
+		Con_Printf ("%4i %5i %-16s %3i/%-3i %6iK %6iK %6iK %6.2f %6.2f\n",
+				i, *(int *)Host_InstanceGlobalPtr (i, &net_hostport),
+				inst->server->active ? inst->server->name : "-", clients, inst->serverstatic->maxclients,
+				Hunk_Used (inst->hunk) / 1024,
+				inst->server->active ? (int)((size_t)inst->server->qcvm.max_edicts*inst->server->qcvm.edict_size / 1024) : 0,
+				(int)(Mod_SharedMemory (i) / 1024),
+				inst->avgms, inst->peakms);
+	}
+	Con_Printf ("%iK of models, shared between them\n", (int)(Mod_SharedMemory (-1) / 1024));
+}
+
+/*
+===============
+Host_Instance_f
+
+instance <num|all> <command>
+===============
+*/
+static void Host_Instance_f (void)
+{
+	const char	*args;
+	int			i, first, last, old;
+
+	if (Cmd_Argc () < 3)
+	{
+		Con_Printf ("instance <num|all> <command>: runs a command on another server instance\n");
+		return;
+	}
+	if (!strcmp (Cmd_Argv (1), "all"))
+	{
+		first = 0;
+		last = host_numinstances - 1;
+	}
+	else
+	{
+		first = last = Q_atoi (Cmd_Argv (1));
+		if (first < 0 || first >= host_numinstances)
+		{
+			Con_Printf ("No instance %s\n", Cmd_Argv (1));
+			return;
+		}
+	}
+
+	//skip past the instance number to get the rest of the line
+	args = Cmd_Args ();
+	while (*args && *args <= ' ')
+		args++;
+	while (*args > ' ')
+		args++;
+	while (*args && *args <= ' ')
+		args++;
+
+	old = host_instance;
+	for (i = first; i <= last; i++)
+	{
+		Host_SwitchInstance (i);
+		Cbuf_AddText (args);
+		Cbuf_AddText ("\n");
+	}
+	Host_SwitchInstance (old);
+}
+
 /* cvar callback functions : */
 void Host_Callback_Notify (cvar_t *var)
 {
@@ -299,6 +795,8 @@ Host_InitLocal
 */
 void Host_InitLocal (void)
 {
+	int		i;
+
 	Cmd_AddCommand ("version", Host_Version_f);
 
 	Host_InitCommands ();
@@ -317,6 +815,10 @@ void Host_InitLocal (void)
 
 	Cvar_RegisterVariable (&sys_ticrate);
 	Cvar_RegisterVariable (&sys_throttle);
+	Cvar_RegisterVariable (&host_workers);
+	Cvar_SetCallback (&host_workers, Host_Workers_f);
+	Cmd_AddCommand ("instances", Host_Instances_f);
+	Cmd_AddCommand ("instance", Host_Instance_f);
 	Cvar_RegisterVariable (&serverprofile);
 
 	Cvar_RegisterVariable (&fraglimit);
@@ -342,6 +844,15 @@ void Host_InitLocal (void)
 	Cvar_RegisterVariable (&temp1);
 
 	Host_FindMaxClients ();
+
+	i = COM_CheckParm ("-instances");
+	if (i && i < com_argc-1)
+	{	//the rest get set up by Host_InitInstances, but the network needs to know how many sockets to make
+		if (cls.state == ca_dedicated)
+			host_numinstances = CLAMP (1, Q_atoi (com_argv[i+1]), MAX_INSTANCES);
+		else
+			Con_Warning ("-instances needs -dedicated\n");
+	}
 }
 
 
@@ -633,6 +1144,8 @@ void Host_ClearMemory (void)
 	PR_ClearProgs(&sv.qcvm);
 	free(sv.static_entities);	//spike -- this is dynamic too, now
 	free(sv.ambientsounds);
+	free(sv.entdirty);
+	free(sv.checkpvs);
 	memset (&sv, 0, sizeof(sv));
 
 	CL_FreeState();
@@ -712,6 +1225,8 @@ void Host_ServerFrame (void)
 	int		i, active; //johnfitz
 	edict_t	*ent; //johnfitz
 
+	SV_ProfileBeginFrame ();
+
 // run the world state
 	pr_global_struct->frametime = host_frametime;
 
@@ -721,12 +1236,16 @@ void Host_ServerFrame (void)
 //respond to cvar changes
 	PMSV_UpdateMovevars ();
 
+	SV_ProfileEnter (SVPROF_CLIENTS);
+
 // check for new clients
 	SV_CheckForNewClients ();
 
 // read client messages
 	SV_RunClients ();
 
+	SV_ProfileLeave ();
+
 // move things around and think
 // always pause in single player if in console or menus
 	if (!sv.paused && (svs.maxclients > 1 || key_dest == key_game) )
@@ -749,7 +1268,13 @@ void Host_ServerFrame (void)
 //johnfitz
 
 // send all messages to the clients
+	SV_ProfileEnter (SVPROF_SEND);
+	NET_BatchSends (true);
 	SV_SendClientMessages ();
+	NET_BatchSends (false);
+	SV_ProfileLeave ();
+
+	SV_ProfileEndFrame ();
 }
 
 //used for cl.qcvm.GetModel (so ssqc+csqc can share builtins)
@@ -893,7 +1418,10 @@ void _Host_Frame (double time)
 	int			pass1, pass2, pass3;
 
 	if (setjmp (host_abortserver) )
+	{
+		Host_SwitchInstance (0);
 		return;			// something bad happened, or the server disconnected
+	}
 
 // keep the random time dependent
 	rand ();
@@ -952,7 +1480,9 @@ void _Host_Frame (double time)
 		else
 			accumtime -= host_netinterval;
 		CL_SendCmd ();
-		if (sv.active)
+		if (host_numinstances > 1)
+			Host_InstanceFrames ();
+		else if (sv.active)
 		{
 			PR_SwitchQCVM(&sv.qcvm);
 			Host_ServerFrame ();
@@ -1010,6 +1540,9 @@ void _Host_Frame (double time)
 					pass1+pass2+pass3, pass1, pass2, pass3);
 	}
 
+	PR_ProfileFrame();
+	PR_StringsFrame();
+
 	host_framecount++;
 
 }
@@ -1125,6 +1658,8 @@ void Host_Init (void)
 	Hunk_AllocName (0, "-HOST_HUNKLEVEL-");
 	host_hunklevel = Hunk_LowMark ();
 
+	Host_InitInstances ();
+
 	host_initialized = true;
 	Con_Printf ("\n========= Quake Initialized =========\n\n");
 
@@ -1139,7 +1674,10 @@ void Host_Init (void)
 	if (cls.state != ca_dedicated)
 		M_Init ();
 	if (setjmp (host_abortserver) )
+	{
+		Host_SwitchInstance (0);
 		return;			// don't do the above twice if the following Cbuf_Execute does bad things.
+	}
 
 	if (cls.state != ca_dedicated)
 	{
@@ -1153,14 +1691,42 @@ void Host_Init (void)
 
 	if (cls.state == ca_dedicated)
 	{
+		int bench, loadgen, i;
 		Cbuf_AddText ("cl_warncmd 0\n");
 		Cbuf_AddText ("exec default.cfg\n");	//spike -- someone decided that quake.rc shouldn't be execed on dedicated servers, but that means you'll get bad defaults
 		Cbuf_AddText ("cl_warncmd 1\n");
 		Cbuf_AddText ("exec server.cfg\n");		//spike -- for people who want things explicit.
 		Cbuf_AddText ("exec autoexec.cfg\n");
 		Cbuf_AddText ("stuffcmds\n");
+		for (i = host_numinstances-1; i >= 0; i--)
+		{	//-instances each run the configs for themselves
+			Host_SwitchInstance (i);
+			if (i)
+			{
+				Cbuf_AddText ("cl_warncmd 0\n");
+				Cbuf_AddText ("exec default.cfg\n");
+				Cbuf_AddText ("cl_warncmd 1\n");
+				Cbuf_AddText ("exec server.cfg\n");
+				Cbuf_AddText ("exec autoexec.cfg\n");
+				Cbuf_AddText ("stuffcmds\n");
+				instances[i].startmap = true;
+			}
+			if (host_numinstances > 1)
+				Cbuf_AddText (va("exec instance%i.cfg\n", i));	//for anything that should differ between them
+		}
 		Cbuf_Execute ();
-		if (!sv.active)
+		bench = COM_CheckParm ("-benchmark_server");
+		loadgen = COM_CheckParm ("-loadgen");
+		if (bench && bench+3 < com_argc)	//-benchmark_server <map> <ticks> <clients>
+			Cbuf_AddText (va("maxplayers %s\nmap %s\nsv_benchmark %s %s\nquit\n", com_argv[bench+3], com_argv[bench+1], com_argv[bench+2], com_argv[bench+3]));
+		else if (loadgen)	//-loadgen <server> <clients> [seconds] [rate] [nq]
+		{
+			Cbuf_AddText ("loadgen");
+			while (++loadgen < com_argc && *com_argv[loadgen] != '-' && *com_argv[loadgen] != '+')
+				Cbuf_AddText (va(" \"%s\"", com_argv[loadgen]));
+			Cbuf_AddText ("\nquit\n");
+		}
+		else if (!sv.active)
 			Cbuf_AddText ("startmap_dm\n");
 	}
 }
@@ -1177,6 +1743,7 @@ to run quit through here before the final handoff to the sys code.
 void Host_Shutdown(void)
 {
 	static qboolean isdown = false;
+	int		i;
 
 	if (isdown)
 	{
@@ -1190,7 +1757,20 @@ void Host_Shutdown(void)
 
 	Host_WriteConfiguration ();
 
+	if (instancesstarted)
+	{	//the other -instances' connections and ports, NET_Shutdown does instance 0's
+		PR_SwitchQCVM (NULL);	//we might have come from a Sys_Error in the middle of some qc
+		for (i = host_numinstances-1; i > 0; i--)
+		{
+			if (!instances[i].server)
+				continue;	//didn't get that far
+			Host_SwitchInstance (i);
+			NET_ShutdownInstance ();
+		}
+		Host_SwitchInstance (0);
+	}
 	NET_Shutdown ();
+	Host_StopWorkers ();
 
 	if (cls.state != ca_dedicated)
 	{
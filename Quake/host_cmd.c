@@ -1454,6 +1454,7 @@ static void Host_Loadgame_f (void)
 
 	qcvm->num_edicts = entnum;
 	qcvm->time = time;
+	ED_FreeListInvalidate ();	// the save's free edicts were flagged directly, not through ED_Free
 
 	free (start);
 	start = NULL;
@@ -1821,6 +1822,7 @@ static void Host_Spawn_f (void)
 		ent->v.colormap = NUM_FOR_EDICT(ent);
 		ent->v.team = (host_client->colors & 15) + 1;
 		ent->v.netname = PR_SetEngineString(host_client->name);
+		ED_FindIndexTouchEdict (ent);
 
 		// copy spawn parms out of the client_t
 		for (i=0 ; i< NUM_BASIC_SPAWN_PARMS ; i++)
@@ -2347,6 +2349,7 @@ static void Host_Viewmodel_f (void)
 	e->v.modelindex = m?SV_Precache_Model(m->name):0;
 	e->v.model = PR_SetEngineString(sv.model_precache[(int)e->v.modelindex]);
 	e->v.frame = 0;
+	ED_FindIndexTouchEdict (e);
 	PR_SwitchQCVM(NULL);
 }
 
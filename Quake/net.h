@@ -50,6 +50,8 @@ typedef char qhostaddr_t[NET_NAMELEN];
 
 void	NET_Init (void);
 void	NET_Shutdown (void);
+void	NET_ListenOn (int port);
+void	NET_ShutdownInstance (void);
 
 struct qsocket_s	*NET_CheckNewConnections (void);
 // returns a new connection number if there is one pending, else -1
@@ -89,10 +91,21 @@ int	NET_SendUnreliableMessage (struct qsocket_s *sock, sizebuf_t *data);
 // returns 1 if the message was sent properly
 // returns -1 if the connection died
 
+void	NET_BatchSends (qboolean batch);
+// while true, the lan drivers may hold back datagrams and send them all together
+// when it's set false again. the server wraps each frame's sends in this.
+
 int	NET_SendToAll(sizebuf_t *data, double blocktime);
 // This is a reliable *blocking* send to all attached clients.
 
 void	NET_Close (struct qsocket_s *sock);
+
+struct qsocket_s *NET_FakeConnection (const char *name);
+void	NET_FakeInput (struct qsocket_s *sock, const sizebuf_t *data);
+void	NET_FakeTraffic (const struct qsocket_s *sock, int *reliablebytes, int *unreliablebytes, int *packets);
+// in-process connections with nobody on the other end, for benchmarking the server.
+// NET_FakeInput queues a message as if the client had sent it, and NET_FakeTraffic
+// reports how much the server has sent to it. closed with NET_Close like any other.
 // if a dead connection is returned by a get or send function, this function
 // should be called when it is convenient
 
@@ -117,6 +130,7 @@ extern	enum slistScope_e
 extern	size_t		hostCacheCount;
 
 void	NET_Slist_f (void);
+void	NET_LoadGen_f (void);
 void	NET_SlistSort (void);
 const char *NET_SlistPrintServer (size_t n);
 const char *NET_SlistPrintServerName (size_t n);
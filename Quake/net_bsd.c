@@ -64,6 +64,24 @@ net_driver_t net_drivers[] =
 		Datagram_CanSendUnreliableMessage,
 		Datagram_Close,
 		Datagram_Shutdown
+	},
+
+	{	"Fake",
+		false,
+		Fake_Init,
+		Fake_Listen,
+		Fake_QueryAddresses,
+		Fake_SearchForHosts,
+		Fake_Connect,
+		Fake_CheckNewConnections,
+		Fake_GetAnyMessage,
+		Fake_GetMessage,
+		Fake_SendMessage,
+		Fake_SendUnreliableMessage,
+		Fake_CanSendMessage,
+		Fake_CanSendUnreliableMessage,
+		Fake_Close,
+		Fake_Shutdown
 	}
 };
 
@@ -94,7 +112,8 @@ net_landriver_t	net_landrivers[] =
 		UDP4_GetAddrFromName,
 		UDP_AddrCompare,
 		UDP_GetSocketPort,
-		UDP_SetSocketPort
+		UDP_SetSocketPort,
+		UDP_BatchSends
 	},
 	{	"UDP6",
 		false,
@@ -117,7 +136,8 @@ net_landriver_t	net_landrivers[] =
 		UDP6_GetAddrFromName,
 		UDP_AddrCompare,
 		UDP_GetSocketPort,
-		UDP_SetSocketPort
+		UDP_SetSocketPort,
+		UDP_BatchSends
 	}
 };
 
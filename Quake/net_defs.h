@@ -53,6 +53,10 @@ struct qsockaddr
 
 #define NET_PROTOCOL_VERSION	3
 
+// reliable fragments that can be in flight at once, see Datagram_SendWindow
+#define NET_MAXWINDOW		32
+#define NETEXT_WINDOW		(('W'<<24)|('N'<<16)|('D'<<8)|'W')	//trails the proquake fields of CCREQ_CONNECT and CCREP_ACCEPT
+
 /**
 
 This is the network info/connection protocol.  It is used to find Quake
@@ -67,6 +71,14 @@ General notes:
 CCREQ_CONNECT
 		string	game_name		"QUAKE"
 		byte	net_protocol_version	NET_PROTOCOL_VERSION
+	proquake clients add
+		byte	mod			1
+		byte	mod_version
+		byte	mod_flags
+		long	password
+	and ones that can take several reliable fragments at once then add
+		long	NETEXT_WINDOW
+		byte	window			most fragments it will buffer
 
 CCREQ_SERVER_INFO
 		string	game_name		"QUAKE"
@@ -80,6 +92,10 @@ CCREQ_RULE_INFO
 
 CCREP_ACCEPT
 		long	port
+	with the same proquake fields if the client sent them, then if both
+	ends are using a reliable window
+		long	NETEXT_WINDOW
+		byte	window			fragments that may be in flight each way
 
 CCREP_REJECT
 		string	reason
@@ -132,6 +148,7 @@ CCREP_RULE_INFO
 typedef struct qsocket_s
 {
 	struct qsocket_s	*next;
+	struct qsocket_s	*hashnext;	//datagram driver's address lookup, for virtual qsockets
 	double		connecttime;
 	double		lastMessageTime;
 	double		lastSendTime;
@@ -164,6 +181,17 @@ typedef struct qsocket_s
 	qboolean proquake_angle_hack;	//1 if we're trying, 2 if the server acked.
 	int		max_datagram;			//32000 for local, 1442 for 666, 1024 for 15. this is for reliable fragments.
 	int		pending_max_datagram;	//don't change the mtu if we're resending, as that would confuse the peer.
+
+	int		reliableWindow;			//reliable fragments in flight at once. 1 is vanilla's stop-and-wait
+	unsigned int	sendBase;		//sequences of sendMessage's first fragment, and the one after its last
+	unsigned int	sendEnd;
+	double		rtt;				//smoothed, from fragments that didn't need resending. 0 until there is one
+	double		fragmentSendTime[NET_MAXWINDOW];	//by sequence%NET_MAXWINDOW, 0 once acked
+	qboolean	fragmentResent[NET_MAXWINDOW];
+	unsigned int	receiveFragmentSequence[NET_MAXWINDOW];	//fragments that arrived before an earlier one
+	unsigned int	receiveFragmentFlags[NET_MAXWINDOW];	//0 if the slot is free
+	int		receiveFragmentLength[NET_MAXWINDOW];
+	byte		receiveFragment[NET_MAXWINDOW][DATAGRAM_MTU];
 } qsocket_t;
 
 extern qsocket_t	*net_activeSockets;
@@ -194,6 +222,7 @@ typedef struct
 	int		(*AddrCompare) (struct qsockaddr *addr1, struct qsockaddr *addr2);
 	int		(*GetSocketPort) (struct qsockaddr *addr);
 	int		(*SetSocketPort) (struct qsockaddr *addr, int port);
+	void		(*BatchSends) (qboolean batch);	//may be NULL
 
 	sys_socket_t	listeningSock;
 } net_landriver_t;
@@ -229,6 +258,8 @@ extern const int	net_numdrivers;
 #define IS_LOOP_DRIVER(p)	((p) == 0)
 
 extern int		net_driverlevel;
+extern cvar_t	net_fakelag;
+extern double	net_packettime;		//when the packet a landriver's Read just returned arrived, if it knows. 0 otherwise
 
 extern int		messagesSent;
 extern int		messagesReceived;
@@ -178,6 +178,239 @@ static void NET_Ban_f (void)
 #endif	// BAN_TEST
 
 
+/*
+Vanilla sends each reliable one fragment at a time, waiting for the ack before sending the
+next, so a big signon buffer takes a round trip per kilobyte or so. When both ends say they
+can (NETEXT_WINDOW in the connection handshake), up to reliableWindow fragments of a message
+are in flight at once instead. The packets look just the same, each fragment is still acked
+on its own, but the receiver holds on to fragments that arrive early rather than dropping
+them, and only the fragments whose acks are overdue get resent.
+*/
+static cvar_t net_reliablewindow = {"net_reliablewindow", "16", CVAR_NONE};	//1 to stick to stop-and-wait
+
+static int SendFragment (qsocket_t *sock, unsigned int sequence)
+{
+	unsigned int	packetLen;
+	unsigned int	offset;
+	unsigned int	dataLen;
+	unsigned int	eom;
+
+	offset = (sequence - sock->sendBase) * sock->max_datagram;
+	dataLen = q_min((unsigned int)sock->sendMessageLength - offset, (unsigned int)sock->max_datagram);
+	eom = (sequence + 1 == sock->sendEnd) ? NETFLAG_EOM : 0;
+	packetLen = NET_HEADERSIZE + dataLen;
+
+	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom));
+	packetBuffer.sequence = BigLong(sequence);
+	Q_memcpy (packetBuffer.data, sock->sendMessage + offset, dataLen);
+
+	sock->fragmentSendTime[sequence % NET_MAXWINDOW] = net_time;
+	sock->lastSendTime = net_time;
+	return sfunc.Write (sock->socket, (byte *)&packetBuffer, packetLen, &sock->addr);
+}
+
+/*
+=================
+Datagram_SendWindow
+
+Sends the message's next fragments, as many as the window has room for.
+=================
+*/
+static int Datagram_SendWindow (qsocket_t *sock)
+{
+	sock->sendNext = false;
+	while (sock->sendSequence != sock->sendEnd && sock->sendSequence - sock->ackSequence < (unsigned int)sock->reliableWindow)
+	{
+		sock->fragmentResent[sock->sendSequence % NET_MAXWINDOW] = false;
+		if (SendFragment (sock, sock->sendSequence++) == -1)
+			return -1;
+		packetsSent++;
+	}
+	return 1;
+}
+
+/*
+=================
+Datagram_ResendWindow
+
+Resends whichever fragments have gone unacked for longer than the round trip should take.
+=================
+*/
+static int Datagram_ResendWindow (qsocket_t *sock)
+{
+	unsigned int	sequence;
+	double			timeout;
+
+	if (sock->rtt)
+		timeout = CLAMP(0.1, sock->rtt * 2, 1.0);
+	else
+		timeout = 1.0;	//no idea yet, so as patient as vanilla is
+	for (sequence = sock->ackSequence; sequence != sock->sendSequence; sequence++)
+	{
+		double sent = sock->fragmentSendTime[sequence % NET_MAXWINDOW];
+		if (!sent || net_time - sent <= timeout)
+			continue;
+		sock->fragmentResent[sequence % NET_MAXWINDOW] = true;
+		if (SendFragment (sock, sequence) == -1)
+			return -1;
+		packetsReSent++;
+	}
+	return 1;
+}
+
+/*
+=================
+Datagram_ReceiveAck
+=================
+*/
+static void Datagram_ReceiveAck (qsocket_t *sock, unsigned int sequence)
+{
+	int slot;
+
+	if (sock->reliableWindow > 1)
+	{
+		if ((int)(sequence - sock->ackSequence) < 0 || (int)(sequence - sock->sendSequence) >= 0)
+		{
+			Con_DPrintf("Stale ACK received\n");
+			return;
+		}
+		slot = sequence % NET_MAXWINDOW;
+		if (!sock->fragmentSendTime[slot])
+		{
+			Con_DPrintf("Duplicate ACK received\n");
+			return;
+		}
+		if (!sock->fragmentResent[slot])
+		{	//can't tell which copy a resent one's ack was for
+			double rtt = net_time - sock->fragmentSendTime[slot];
+			sock->rtt = sock->rtt ? sock->rtt * 0.875 + rtt * 0.125 : rtt;
+		}
+		sock->fragmentSendTime[slot] = 0;
+		while (sock->ackSequence != sock->sendSequence && !sock->fragmentSendTime[sock->ackSequence % NET_MAXWINDOW])
+			sock->ackSequence++;
+		if (sock->ackSequence == sock->sendEnd)
+		{
+			sock->sendMessageLength = 0;
+			sock->canSend = true;
+		}
+		else
+			sock->sendNext = true;
+		return;
+	}
+
+	if (sequence != (sock->sendSequence - 1))
+	{
+		Con_DPrintf("Stale ACK received\n");
+		return;
+	}
+	if (sequence == sock->ackSequence)
+	{
+		sock->ackSequence++;
+		if (sock->ackSequence != sock->sendSequence)
+			Con_DPrintf("ack sequencing error\n");
+	}
+	else
+	{
+		Con_DPrintf("Duplicate ACK received\n");
+		return;
+	}
+	sock->sendMessageLength -= sock->max_datagram;
+	if (sock->sendMessageLength > 0)
+	{
+		memmove (sock->sendMessage, sock->sendMessage + sock->max_datagram, sock->sendMessageLength);
+		sock->sendNext = true;
+	}
+	else
+	{
+		sock->sendMessageLength = 0;
+		sock->canSend = true;
+	}
+}
+
+static int ReceiveFragment (qsocket_t *sock, byte *data, unsigned int length, unsigned int flags)
+{
+	if (flags & NETFLAG_EOM)
+	{
+		if (sock->receiveMessageLength + length > (unsigned int)net_message.maxsize)
+		{
+			Con_Printf("Over-sized reliable\n");
+			return -1;
+		}
+		SZ_Clear(&net_message);
+		SZ_Write(&net_message, sock->receiveMessage, sock->receiveMessageLength);
+		SZ_Write(&net_message, data, length);
+		sock->receiveMessageLength = 0;
+		return 1;	//parse this reliable!
+	}
+
+	if (sock->receiveMessageLength + length > sizeof(sock->receiveMessage))
+	{
+		Con_Printf("Over-sized reliable\n");
+		return -1;
+	}
+	Q_memcpy(sock->receiveMessage + sock->receiveMessageLength, data, length);
+	sock->receiveMessageLength += length;
+	return 0;	//still waiting for the eom
+}
+
+/*
+=================
+Datagram_ReceiveData
+
+Acks a reliable fragment that's in packetBuffer and adds it to the message.
+Returns 1 when that completes a message, which is then in net_message.
+=================
+*/
+static int Datagram_ReceiveData (qsocket_t *sock, unsigned int sequence, unsigned int flags, unsigned int length, struct qsockaddr *addr)
+{
+	int slot, ret;
+
+	length -= NET_HEADERSIZE;
+	if (sock->reliableWindow > 1 && sequence != sock->receiveSequence)
+	{
+		if ((int)(sequence - sock->receiveSequence) < 0)
+			receivedDuplicateCount++;	//our ack got lost, so send it again
+		else if (sequence - sock->receiveSequence >= (unsigned int)sock->reliableWindow || length > sizeof(sock->receiveFragment[0]))
+			return 0;	//can't keep it, so don't ack it either. it'll be resent
+		else
+		{	//early. keep it until the ones before it turn up
+			slot = sequence % NET_MAXWINDOW;
+			sock->receiveFragmentSequence[slot] = sequence;
+			sock->receiveFragmentFlags[slot] = flags;
+			sock->receiveFragmentLength[slot] = length;
+			Q_memcpy(sock->receiveFragment[slot], packetBuffer.data, length);
+		}
+		packetBuffer.length = BigLong(NET_HEADERSIZE | NETFLAG_ACK);
+		packetBuffer.sequence = BigLong(sequence);
+		sfunc.Write (sock->socket, (byte *)&packetBuffer, NET_HEADERSIZE, addr);
+		return 0;
+	}
+
+	packetBuffer.length = BigLong(NET_HEADERSIZE | NETFLAG_ACK);
+	packetBuffer.sequence = BigLong(sequence);
+	sfunc.Write (sock->socket, (byte *)&packetBuffer, NET_HEADERSIZE, addr);
+
+	if (sequence != sock->receiveSequence)
+	{
+		receivedDuplicateCount++;
+		return 0;
+	}
+	sock->receiveSequence++;
+
+	ret = ReceiveFragment (sock, packetBuffer.data, length, flags);
+	while (!ret && sock->reliableWindow > 1)
+	{	//catch up with the ones that arrived early
+		slot = sock->receiveSequence % NET_MAXWINDOW;
+		if (!sock->receiveFragmentFlags[slot] || sock->receiveFragmentSequence[slot] != sock->receiveSequence)
+			break;
+		sock->receiveSequence++;
+		ret = ReceiveFragment (sock, sock->receiveFragment[slot], sock->receiveFragmentLength[slot], sock->receiveFragmentFlags[slot]);
+		sock->receiveFragmentFlags[slot] = 0;
+	}
+	return ret;
+}
+
+
 int Datagram_SendMessage (qsocket_t *sock, sizebuf_t *data)
 {
 	unsigned int	packetLen;
@@ -200,6 +433,14 @@ int Datagram_SendMessage (qsocket_t *sock, sizebuf_t *data)
 
 	sock->max_datagram = sock->pending_max_datagram;	//this can apply only at the start of a reliable, to avoid issues with acks if its resized later.
 
+	if (sock->reliableWindow > 1)
+	{
+		sock->sendBase = sock->sendSequence;
+		sock->sendEnd = sock->sendBase + q_max(1, (data->cursize + sock->max_datagram - 1) / sock->max_datagram);
+		sock->canSend = false;
+		return Datagram_SendWindow (sock);
+	}
+
 	if (data->cursize <= sock->max_datagram)
 	{
 		dataLen = data->cursize;
@@ -233,6 +474,9 @@ static int SendMessageNext (qsocket_t *sock)
 	unsigned int	dataLen;
 	unsigned int	eom;
 
+	if (sock->reliableWindow > 1)
+		return Datagram_SendWindow (sock);
+
 	if (sock->sendMessageLength <= sock->max_datagram)
 	{
 		dataLen = sock->sendMessageLength;
@@ -266,6 +510,9 @@ static int ReSendMessage (qsocket_t *sock)
 	unsigned int	dataLen;
 	unsigned int	eom;
 
+	if (sock->reliableWindow > 1)
+		return Datagram_ResendWindow (sock);
+
 	if (sock->sendMessageLength <= sock->max_datagram)
 	{
 		dataLen = sock->sendMessageLength;
@@ -387,79 +634,102 @@ qboolean Datagram_ProcessPacket(unsigned int length, qsocket_t *sock)
 
 	if (flags & NETFLAG_ACK)
 	{
-		if (sequence != (sock->sendSequence - 1))
-		{
-			Con_DPrintf("Stale ACK received\n");
-			return false;
-		}
-		if (sequence == sock->ackSequence)
-		{
-			sock->ackSequence++;
-			if (sock->ackSequence != sock->sendSequence)
-				Con_DPrintf("ack sequencing error\n");
-		}
-		else
-		{
-			Con_DPrintf("Duplicate ACK received\n");
-			return false;
-		}
-		sock->sendMessageLength -= sock->max_datagram;
-		if (sock->sendMessageLength > 0)
-		{
-			memmove (sock->sendMessage, sock->sendMessage + sock->max_datagram, sock->sendMessageLength);
-			sock->sendNext = true;
-		}
-		else
-		{
-			sock->sendMessageLength = 0;
-			sock->canSend = true;
-		}
+		Datagram_ReceiveAck (sock, sequence);
 		return false;
 	}
 
 	if (flags & NETFLAG_DATA)
 	{
-		packetBuffer.length = BigLong(NET_HEADERSIZE | NETFLAG_ACK);
-		packetBuffer.sequence = BigLong(sequence);
-		sfunc.Write (sock->socket, (byte *)&packetBuffer, NET_HEADERSIZE, &sock->addr);
+		int ret = Datagram_ReceiveData (sock, sequence, flags, length, &sock->addr);
+		if (ret == 1)
+			messagesReceived++;	//parse this reliable!
+		return ret;	//or still waiting for the eom
+	}
+	//unknown flags
+	Con_DPrintf("Unknown packet flags\n");
+	return false;
+}
 
-		if (sequence != sock->receiveSequence)
-		{
-			receivedDuplicateCount++;
-			return false;
-		}
-		sock->receiveSequence++;
+/*
+Virtual qsockets all share a listening socket, so every packet that arrives on it has to
+be matched up with its qsocket by address. They're hashed on that address while they're
+connected, so that doesn't get any slower as clients and pending connections pile up.
+*/
+#define QSOCKET_HASHSIZE	256	//power of two
 
-		length -= NET_HEADERSIZE;
+static qsocket_t *qsockethash[QSOCKET_HASHSIZE];
 
-		if (flags & NETFLAG_EOM)
-		{
-			if (sock->receiveMessageLength + length > (unsigned int)net_message.maxsize)
-			{
-				Con_Printf("Over-sized reliable\n");
-				return -1;
-			}
-			SZ_Clear(&net_message);
-			SZ_Write(&net_message, sock->receiveMessage, sock->receiveMessageLength);
-			SZ_Write(&net_message, packetBuffer.data, length);
-			sock->receiveMessageLength = 0;
+static unsigned int Datagram_AddrHash (struct qsockaddr *addr)
+{
+	const byte		*key;
+	int				i, len;
+	unsigned short	port;
+	unsigned int	hash = 2166136261u;	//fnv-1a
 
-			messagesReceived++;
-			return true;	//parse this reliable!
-		}
+	if (addr->qsa_family == AF_INET)
+	{
+		key = (const byte *)&((struct sockaddr_in *)addr)->sin_addr;
+		len = sizeof(((struct sockaddr_in *)addr)->sin_addr);
+		port = ((struct sockaddr_in *)addr)->sin_port;
+	}
+	else if (addr->qsa_family == AF_INET6)
+	{	//same parts that UDP_AddrCompare looks at, so no scope id
+		key = (const byte *)&((struct sockaddr_in6 *)addr)->sin6_addr;
+		len = sizeof(((struct sockaddr_in6 *)addr)->sin6_addr);
+		port = ((struct sockaddr_in6 *)addr)->sin6_port;
+	}
+	else
+		return 0;	//ipx or something. they'll all share a bucket, but AddrCompare still sorts them out
 
-		if (sock->receiveMessageLength + length > sizeof(sock->receiveMessage))
+	for (i = 0; i < len; i++)
+		hash = (hash ^ key[i]) * 16777619u;
+	hash = (hash ^ (port & 0xff)) * 16777619u;
+	hash = (hash ^ (port >> 8)) * 16777619u;
+	return hash & (QSOCKET_HASHSIZE-1);
+}
+
+static void Datagram_HashQSocket (qsocket_t *sock)
+{
+	qsocket_t **link = &qsockethash[Datagram_AddrHash (&sock->addr)];
+	sock->hashnext = *link;
+	*link = sock;
+}
+
+static void Datagram_UnhashQSocket (qsocket_t *sock)
+{
+	qsocket_t **link;
+	for (link = &qsockethash[Datagram_AddrHash (&sock->addr)]; *link; link = &(*link)->hashnext)
+	{
+		if (*link == sock)
 		{
-			Con_Printf("Over-sized reliable\n");
-			return -1;
+			*link = sock->hashnext;
+			break;
 		}
-		Q_memcpy(sock->receiveMessage + sock->receiveMessageLength, packetBuffer.data, length);
-		sock->receiveMessageLength += length;
-		return false;	//still watiting for the eom
 	}
-	//unknown flags
-	Con_DPrintf("Unknown packet flags\n");
-	return false;
+	sock->hashnext = NULL;
+}
+
+/*
+==================
+Datagram_FindQSocket
+
+Returns the connected virtual qsocket on the current landriver for addr, if there is one.
+==================
+*/
+static qsocket_t *Datagram_FindQSocket (struct qsockaddr *addr)
+{
+	qsocket_t *s;
+
+	for (s = qsockethash[Datagram_AddrHash (addr)]; s; s = s->hashnext)
+	{
+		if (s->landriver != net_landriverlevel)
+			continue;
+		if (s->disconnected)
+			continue;
+		if (dfunc.AddrCompare(addr, &s->addr) == 0)
+			return s;
+	}
+	return NULL;
 }
 
 qsocket_t *Datagram_GetAnyMessage(void)
@@ -478,6 +748,7 @@ qsocket_t *Datagram_GetAnyMessage(void)
 
 		while(1)
 		{
+			net_packettime = 0;
 			length = dfunc.Read(sock, (byte *)&packetBuffer, NET_DATAGRAMSIZE, &addr);
 			if (length == -1 || !length)
 			{
@@ -498,24 +769,12 @@ qsocket_t *Datagram_GetAnyMessage(void)
 				continue;
 			}
 
-			//figure out which qsocket it was for
-			for (s = net_activeSockets; s; s = s->next)
+			//figure out which qsocket it was for. try to process it, and if there's new data
+			s = Datagram_FindQSocket (&addr);
+			if (s && Datagram_ProcessPacket(length, s))
 			{
-				if (s->driver != net_driverlevel)
-					continue;
-				if (s->disconnected)
-					continue;
-				if (!s->isvirtual)
-					continue;
-				if (dfunc.AddrCompare(&addr, &s->addr) == 0)
-				{
-					//okay, looks like this is us. try to process it, and if there's new data
-					if (Datagram_ProcessPacket(length, s))
-					{
-						s->lastMessageTime = net_time;
-						return s;	//the server needs to parse that packet.
-					}
-				}
+				s->lastMessageTime = net_packettime ? net_packettime : net_time;
+				return s;	//the server needs to parse that packet.
 			}
 			//stray packet... ignore it and just try the next
 		}
@@ -528,7 +787,7 @@ qsocket_t *Datagram_GetAnyMessage(void)
 			continue;
 
 		if (!s->canSend)
-			if ((net_time - s->lastSendTime) > 1.0)
+			if (s->reliableWindow > 1 || (net_time - s->lastSendTime) > 1.0)	//windows time each fragment
 				ReSendMessage (s);
 		if (s->sendNext)
 			SendMessageNext (s);
@@ -562,7 +821,7 @@ int	Datagram_GetMessage (qsocket_t *sock)
 	unsigned int	count;
 
 	if (!sock->canSend)
-		if ((net_time - sock->lastSendTime) > 1.0)
+		if (sock->reliableWindow > 1 || (net_time - sock->lastSendTime) > 1.0)	//windows time each fragment
 			ReSendMessage (sock);
 
 	while (1)
@@ -646,74 +905,17 @@ int	Datagram_GetMessage (qsocket_t *sock)
 
 		if (flags & NETFLAG_ACK)
 		{
-			if (sequence != (sock->sendSequence - 1))
-			{
-				Con_DPrintf("Stale ACK received\n");
-				continue;
-			}
-			if (sequence == sock->ackSequence)
-			{
-				sock->ackSequence++;
-				if (sock->ackSequence != sock->sendSequence)
-					Con_DPrintf("ack sequencing error\n");
-			}
-			else
-			{
-				Con_DPrintf("Duplicate ACK received\n");
-				continue;
-			}
-			sock->sendMessageLength -= sock->max_datagram;
-			if (sock->sendMessageLength > 0)
-			{
-				memmove (sock->sendMessage, sock->sendMessage + sock->max_datagram, sock->sendMessageLength);
-				sock->sendNext = true;
-			}
-			else
-			{
-				sock->sendMessageLength = 0;
-				sock->canSend = true;
-			}
+			Datagram_ReceiveAck (sock, sequence);
 			continue;
 		}
 
 		if (flags & NETFLAG_DATA)
 		{
-			packetBuffer.length = BigLong(NET_HEADERSIZE | NETFLAG_ACK);
-			packetBuffer.sequence = BigLong(sequence);
-			sfunc.Write (sock->socket, (byte *)&packetBuffer, NET_HEADERSIZE, &readaddr);
-
-			if (sequence != sock->receiveSequence)
-			{
-				receivedDuplicateCount++;
-				continue;
-			}
-			sock->receiveSequence++;
-
-			length -= NET_HEADERSIZE;
-
-			if (flags & NETFLAG_EOM)
-			{
-				if (sock->receiveMessageLength + length > (unsigned int)net_message.maxsize)
-				{
-					Con_Printf("Over-sized reliable\n");
-					return -1;
-				}
-				SZ_Clear(&net_message);
-				SZ_Write(&net_message, sock->receiveMessage, sock->receiveMessageLength);
-				SZ_Write(&net_message, packetBuffer.data, length);
-				sock->receiveMessageLength = 0;
-
-				ret = 1;
-				break;
-			}
-
-			if (sock->receiveMessageLength + length > sizeof(sock->receiveMessage))
-			{
-				Con_Printf("Over-sized reliable\n");
+			ret = Datagram_ReceiveData (sock, sequence, flags, length, &readaddr);
+			if (ret == -1)
 				return -1;
-			}
-			Q_memcpy(sock->receiveMessage + sock->receiveMessageLength, packetBuffer.data, length);
-			sock->receiveMessageLength += length;
+			if (ret == 1)
+				break;
 			continue;
 		}
 	}
@@ -730,6 +932,8 @@ static void PrintStats(qsocket_t *s)
 	Con_Printf("canSend = %4u   \n", s->canSend);
 	Con_Printf("sendSeq = %4u   ", s->sendSequence);
 	Con_Printf("recvSeq = %4u   \n", s->receiveSequence);
+	Con_Printf("window  = %4i   ", s->reliableWindow);
+	Con_Printf("rtt     = %4.0fms\n", s->rtt * 1000);
 	Con_Printf("\n");
 }
 
@@ -1072,10 +1276,79 @@ JustDoIt:
 	SchedulePollProcedure(&test2PollProcedure, 0.05);
 }
 
-void NET_Rcon_f(void)
+void NET_BatchSends (qboolean batch)
 {
-	qsocket_t *sock = cls.netcon;
+	for (net_landriverlevel = 0; net_landriverlevel < net_numlandrivers; net_landriverlevel++)
+	{
+		if (dfunc.initialized && dfunc.BatchSends)
+			dfunc.BatchSends (batch);
+	}
+}
+
+/*
+===============
+NET_PacketBench_f
+
+"net_packetbench [packets] [size]" throws packets at our own listening socket over loopback,
+in bursts about the size of a busy server's frame, and reports how many a second got through.
+Best done on an empty server, with and without -nommsg to compare.
+===============
+*/
+#define PACKETBENCH_BURST	64
+static void NET_PacketBench_f (void)
+{
+	byte		data[NET_DATAGRAMSIZE];
+	struct qsockaddr addr, from;
+	sys_socket_t sock, listensock;
+	int			packets, size, sent, received, i;
+	double		start, last;
+
+	packets = (Cmd_Argc() > 1) ? atoi(Cmd_Argv(1)) : 1000000;
+	size = (Cmd_Argc() > 2) ? atoi(Cmd_Argv(2)) : 100;
+	size = CLAMP ((int)NET_HEADERSIZE, size, NET_DATAGRAMSIZE);
+	memset (data, 0, size);	//a zero header, so any stragglers look like strays to Datagram_GetAnyMessage
+
+	for (net_landriverlevel = 0; net_landriverlevel < net_numlandrivers; net_landriverlevel++)
+	{
+		listensock = dfunc.listeningSock;
+		if (!dfunc.initialized || listensock == INVALID_SOCKET)
+			continue;
+		if (dfunc.GetSocketAddr (listensock, &addr) == -1)
+			continue;
+		sock = dfunc.Open_Socket (0);
+		if (sock == INVALID_SOCKET)
+			continue;
+
+		start = last = Sys_DoubleTime ();
+		for (sent = received = 0; sent < packets; )
+		{
+			if (dfunc.BatchSends)
+				dfunc.BatchSends (true);
+			for (i = 0; i < PACKETBENCH_BURST && sent < packets; i++, sent++)
+				dfunc.Write (sock, data, size, &addr);
+			if (dfunc.BatchSends)
+				dfunc.BatchSends (false);
+			while (dfunc.Read (listensock, (byte *)&packetBuffer, NET_DATAGRAMSIZE, &from) > 0)
+				received++;
+		}
+		last = Sys_DoubleTime ();
+		while (Sys_DoubleTime () - last < 0.1)
+		{	//give the stragglers a chance
+			if (dfunc.Read (listensock, (byte *)&packetBuffer, NET_DATAGRAMSIZE, &from) > 0)
+			{
+				received++;
+				last = Sys_DoubleTime ();
+			}
+		}
+		dfunc.Close_Socket (sock);
+
+		Con_Printf ("%s: %i of %i packets of %i bytes in %.3f seconds, %.0f a second\n", dfunc.name,
+				received, sent, size, last - start, received / q_max(last - start, 0.001));
+	}
+}
 
+void Datagram_Rcon (qsocket_t *sock, const char *command)
+{	//the reply gets printed when the socket next reads its messages
 	if (!sock || !net_drivers[sock->driver].initialized || net_drivers[sock->driver].SendUnreliableMessage != Datagram_SendUnreliableMessage)
 		return;	//not dgram. probably loopback. just use the proper command or something.
 
@@ -1083,7 +1356,7 @@ void NET_Rcon_f(void)
 	MSG_WriteLong(&net_message, 0);
 	MSG_WriteByte(&net_message, CCREQ_RCON);
 	MSG_WriteString(&net_message, rcon_password.string);
-	MSG_WriteString(&net_message, Cmd_Args());
+	MSG_WriteString(&net_message, command);
 
 	*(int*)net_message.data = BigLong(NETFLAG_CTL | (net_message.cursize & NETFLAG_LENGTH_MASK));
 
@@ -1091,6 +1364,11 @@ void NET_Rcon_f(void)
 		return;
 }
 
+static void NET_Rcon_f(void)
+{
+	Datagram_Rcon (cls.netcon, Cmd_Args());
+}
+
 int Datagram_Init (void)
 {
 	int	i, num_inited;
@@ -1103,6 +1381,7 @@ int Datagram_Init (void)
 	myDriverLevel = net_driverlevel;
 
 	Cmd_AddCommand ("net_stats", NET_Stats_f);
+	Cvar_RegisterVariable (&net_reliablewindow);
 
 	if (safemode || COM_CheckParm("-nolan"))
 		return -1;
@@ -1116,17 +1395,23 @@ int Datagram_Init (void)
 		net_landrivers[i].initialized = true;
 		net_landrivers[i].controlSock = csock;
 		net_landrivers[i].listeningSock = INVALID_SOCKET;
+		Host_InstanceGlobal (&net_landrivers[i].listeningSock, sizeof(net_landrivers[i].listeningSock));	//-instances each listen on their own port
 		num_inited++;
 	}
 
 	if (num_inited == 0)
 		return -1;
 
+	Host_InstanceGlobal (qsockethash, sizeof(qsockethash));
+	Host_InstanceGlobal (&heartbeat_time, sizeof(heartbeat_time));
+	Host_InstanceGlobal (&heartbeatctx, sizeof(heartbeatctx));
+
 #ifdef BAN_TEST
 	Cmd_AddCommand_ClientCommand ("ban", NET_Ban_f);
 #endif
 	Cmd_AddCommand ("test", Test_f);
 	Cmd_AddCommand ("test2", Test2_f);
+	Cmd_AddCommand ("net_packetbench", NET_PacketBench_f);
 	Cmd_AddCommand ("rcon", NET_Rcon_f);
 
 	return 0;
@@ -1157,6 +1442,7 @@ void Datagram_Close (qsocket_t *sock)
 {
 	if (sock->isvirtual)
 	{
+		Datagram_UnhashQSocket (sock);
 		sock->isvirtual = false;
 		sock->socket = INVALID_SOCKET;
 	}
@@ -1191,6 +1477,7 @@ void Datagram_Listen (qboolean state)
 			{
 				if (s->isvirtual)
 				{
+					Datagram_UnhashQSocket (s);
 					s->isvirtual = false;
 					s->socket = INVALID_SOCKET;
 				}
@@ -1233,9 +1520,9 @@ static void _Datagram_ServerControlPacket (sys_socket_t acceptsock, struct qsock
 	qsocket_t	*s;
 	int			command;
 	int			control;
-	int			ret;
 	int plnum;
 	int mod, /*mod_ver, mod_flags,*/ mod_passwd;	//proquake extensions
+	int window;
 
 	control = BigLong(*((int *)data));
 	if (control == -1)
@@ -1489,6 +1776,10 @@ static void _Datagram_ServerControlPacket (sys_socket_t acceptsock, struct qsock
 	/*if (msg_badread) mod_flags = 0;*/
 	mod_passwd = MSG_ReadLong();
 	if (msg_badread) mod_passwd = 0;
+	window = 1;
+	if (MSG_ReadLong() == NETEXT_WINDOW)
+		window = MSG_ReadByte();
+	if (msg_badread || mod != MOD_PROQUAKE) window = 1;	//needs the proquake fields in the reply to come after
 
 	if (*password.string && strcmp(password.string, "none"))
 	{	//FIXME: if this protocol is ever updated, this needs a nonce (eg based on client's IP+time, but requires round-trips to find that out, and confines of proquake's protocol makes it awkward)
@@ -1537,60 +1828,58 @@ static void _Datagram_ServerControlPacket (sys_socket_t acceptsock, struct qsock
 #endif
 
 	// see if this guy is already connected
-	for (s = net_activeSockets; s; s = s->next)
+	s = Datagram_FindQSocket (clientaddr);
+	if (s)
 	{
-		if (s->driver != net_driverlevel)
-			continue;
-		if (s->disconnected)
-			continue;
-		ret = dfunc.AddrCompare(clientaddr, &s->addr);
-		if (ret == 0)
-		{
-			int i;
+		int i;
 
-			// is this a duplicate connection reqeust?
-			if (ret == 0 && net_time - s->connecttime < 2.0)
+		// is this a duplicate connection reqeust?
+		if (net_time - s->connecttime < 2.0)
+		{
+			// yes, so send a duplicate reply
+			SZ_Clear(&net_message);
+			// save space for the header, filled in later
+			MSG_WriteLong(&net_message, 0);
+			MSG_WriteByte(&net_message, CCREP_ACCEPT);
+			dfunc.GetSocketAddr(s->socket, &newaddr);
+			MSG_WriteLong(&net_message, dfunc.GetSocketPort(&newaddr));
+			if (s->proquake_angle_hack)
 			{
-				// yes, so send a duplicate reply
-				SZ_Clear(&net_message);
-				// save space for the header, filled in later
-				MSG_WriteLong(&net_message, 0);
-				MSG_WriteByte(&net_message, CCREP_ACCEPT);
-				dfunc.GetSocketAddr(s->socket, &newaddr);
-				MSG_WriteLong(&net_message, dfunc.GetSocketPort(&newaddr));
-				if (s->proquake_angle_hack)
+				MSG_WriteByte(&net_message, 1);	//proquake
+				MSG_WriteByte(&net_message, 30);//ver 30 should be safe. 34 screws with our single-server-socket stuff.
+				MSG_WriteByte(&net_message, PQF_IGNOREPORT);	//flags: 0x80==ignore port
+				if (s->reliableWindow > 1)
 				{
-					MSG_WriteByte(&net_message, 1);	//proquake
-					MSG_WriteByte(&net_message, 30);//ver 30 should be safe. 34 screws with our single-server-socket stuff.
-					MSG_WriteByte(&net_message, PQF_IGNOREPORT);	//flags: 0x80==ignore port
+					MSG_WriteLong(&net_message, NETEXT_WINDOW);
+					MSG_WriteByte(&net_message, s->reliableWindow);
 				}
-				*((int *)net_message.data) = BigLong(NETFLAG_CTL | (net_message.cursize & NETFLAG_LENGTH_MASK));
-				dfunc.Write (acceptsock, net_message.data, net_message.cursize, clientaddr);
-				SZ_Clear(&net_message);
-				return;
 			}
-			// it's somebody coming back in from a crash/disconnect
-			// so close the old qsocket and let their retry get them back in
-//			NET_Close(s);
-//			return;
-
-			//FIXME: ideally we would just switch the connection over and restart it with a serverinfo packet.
-			//warning: there might be packets in-flight which might mess up unreliable sequences.
-			//so we attempt to ignore the request, and let the user restart.
-			//FIXME: if this is an issue, it should be possible to reuse the previous connection's outgoing unreliable sequence. reliables should be less of an issue as stray ones will be ignored anyway.
-			//FIXME: needs challenges, so that other clients can't determine ip's and spoof a reconnect.
-			for (i = 0; i < svs.maxclients; i++)
+			*((int *)net_message.data) = BigLong(NETFLAG_CTL | (net_message.cursize & NETFLAG_LENGTH_MASK));
+			dfunc.Write (acceptsock, net_message.data, net_message.cursize, clientaddr);
+			SZ_Clear(&net_message);
+			return;
+		}
+		// it's somebody coming back in from a crash/disconnect
+		// so close the old qsocket and let their retry get them back in
+//		NET_Close(s);
+//		return;
+
+		//FIXME: ideally we would just switch the connection over and restart it with a serverinfo packet.
+		//warning: there might be packets in-flight which might mess up unreliable sequences.
+		//so we attempt to ignore the request, and let the user restart.
+		//FIXME: if this is an issue, it should be possible to reuse the previous connection's outgoing unreliable sequence. reliables should be less of an issue as stray ones will be ignored anyway.
+		//FIXME: needs challenges, so that other clients can't determine ip's and spoof a reconnect.
+		for (i = 0; i < svs.maxclients; i++)
+		{
+			if (svs.clients[i].netconnection == s)
 			{
-				if (svs.clients[i].netconnection == s)
-				{
-					NET_Close(s);	//close early, to avoid svc_disconnects confusing things.
-					host_client = &svs.clients[i];
-					SV_DropClient(false);
-					break;
-				}
+				NET_Close(s);	//close early, to avoid svc_disconnects confusing things.
+				host_client = &svs.clients[i];
+				SV_DropClient(false);
+				break;
 			}
-			return;
 		}
+		return;
 	}
 
 	//find a free player slot
@@ -1616,12 +1905,14 @@ static void _Datagram_ServerControlPacket (sys_socket_t acceptsock, struct qsock
 	}
 
 	sock->proquake_angle_hack = (mod == 1);
+	sock->reliableWindow = CLAMP(1, q_min(window, (int)net_reliablewindow.value), NET_MAXWINDOW);
 
 	// everything is allocated, just fill in the details
 	sock->isvirtual = true;
 	sock->socket = acceptsock;
 	sock->landriver = net_landriverlevel;
 	sock->addr = *clientaddr;
+	Datagram_HashQSocket (sock);
 	Q_strcpy(sock->trueaddress, dfunc.AddrToString(clientaddr, false));
 	Q_strcpy(sock->maskedaddress, dfunc.AddrToString(clientaddr, true));
 
@@ -1638,6 +1929,11 @@ static void _Datagram_ServerControlPacket (sys_socket_t acceptsock, struct qsock
 		MSG_WriteByte(&net_message, 1);	//proquake
 		MSG_WriteByte(&net_message, 30);//ver 30 should be safe. 34 screws with our single-server-socket stuff.
 		MSG_WriteByte(&net_message, PQF_IGNOREPORT);
+		if (sock->reliableWindow > 1)
+		{
+			MSG_WriteLong(&net_message, NETEXT_WINDOW);
+			MSG_WriteByte(&net_message, sock->reliableWindow);
+		}
 	}
 	*((int *)net_message.data) = BigLong(NETFLAG_CTL | (net_message.cursize & NETFLAG_LENGTH_MASK));
 	dfunc.Write (acceptsock, net_message.data, net_message.cursize, clientaddr);
@@ -2190,6 +2486,11 @@ static qsocket_t *_Datagram_Connect (struct qsockaddr *serveraddr)
 			MSG_WriteByte(&net_message, 34); /*'mod' version*/
 			MSG_WriteByte(&net_message, 0); /*flags*/
 			MSG_WriteLong(&net_message, pwd); /*password*/
+			if (net_reliablewindow.value > 1)
+			{
+				MSG_WriteLong(&net_message, NETEXT_WINDOW);
+				MSG_WriteByte(&net_message, q_min((int)net_reliablewindow.value, NET_MAXWINDOW));
+			}
 		}
 		*((int *)net_message.data) = BigLong(NETFLAG_CTL | (net_message.cursize & NETFLAG_LENGTH_MASK));
 		dfunc.Write (newsock, net_message.data, net_message.cursize, serveraddr);
@@ -2337,6 +2638,8 @@ static qsocket_t *_Datagram_Connect (struct qsockaddr *serveraddr)
 			if (flags & PQF_IGNOREPORT)
 				port = 0; //don't switch it, for non-identity port forwarding.
 			sock->proquake_angle_hack = true;
+			if (net_message.cursize - msg_readcount >= 5 && MSG_ReadLong() == NETEXT_WINDOW)
+				sock->reliableWindow = CLAMP(1, MSG_ReadByte(), q_min((int)net_reliablewindow.value, NET_MAXWINDOW));
 		}
 		else
 			sock->proquake_angle_hack = false;
@@ -36,6 +36,7 @@ qboolean	Datagram_CanSendMessage (qsocket_t *sock);
 qboolean	Datagram_CanSendUnreliableMessage (qsocket_t *sock);
 void		Datagram_Close (qsocket_t *sock);
 void		Datagram_Shutdown (void);
+void		Datagram_Rcon (qsocket_t *sock, const char *command);
 
 #endif	/* __NET_DATAGRAM_H */
 
@@ -0,0 +1,628 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// net_loadgen.c -- synthetic udp clients for loading up a server
+
+/*
+"loadgen <server> <clients> [seconds] [rate] [nq]" connects that many clients to a server,
+walks them through the signon and then has them wander about and shoot at <rate> moves a
+second (72 by default) for [seconds] (30). It reports round trip times, how many of the
+server's packets went missing, and the server's own frame times from sv_tickstats if our
+rcon_password is good on the server (which leaves sv_tickprofile on there).
+Clients ask for fte's entity deltas like any quakespasm client would, unless "nq" is given.
+
+Only enough of what the server sends is parsed to get through the signon, so this can't
+tell whether the server is sending anything sensible. Datagram_Connect also blocks until the
+server answers, so it has to be run from a different process to the server, eg:
+	quakespasm -dedicated 16 +rcon_password foo +map e1m1
+	quakespasm -dedicated -loadgen 127.0.0.1 16 60 +rcon_password foo
+The report is one "loadgen <key> <value>" per line, like sv_benchmark's.
+Setting net_fakelag first makes the server look that many milliseconds further away, eg to
+see how long the signon takes over a slow link with and without net_reliablewindow.
+*/
+
+#include "q_stdinc.h"
+#include "arch_def.h"
+#include "net_sys.h"
+#include "quakedef.h"
+#include "net_defs.h"
+#include "net_dgrm.h"
+
+#define LOADGEN_PEXT2			(PEXT2_REPLACEMENTDELTAS|PEXT2_PREDINFO)
+#define LOADGEN_SIGNONTIME		10		//seconds to wait for everyone to get in
+#define LOADGEN_PINGINTERVAL	0.25	//seconds between round trip samples for each client
+#define LOADGEN_RCONTIME		2		//seconds to wait for the server's frame times
+#define LOADGEN_MAXACKS			16
+
+extern cvar_t rcon_password;
+
+typedef enum
+{
+	LG_SERVERINFO,	//waiting for 'cmd pext' or the serverinfo
+	LG_PRESPAWN,	//waiting for signon 2
+	LG_SPAWN,		//waiting for signon 3
+	LG_ACTIVE,
+	LG_DEAD
+} lgstage_t;
+
+typedef struct
+{
+	struct qsocket_s	*sock;
+	int			index;
+	lgstage_t	stage;
+	qboolean	nq;
+	double		connecttime;	//when it started connecting
+	double		signontime;		//seconds from then until it was spawned
+
+	int			pext2;
+	int			protocolflags;
+	qboolean	angle16;
+
+	sizebuf_t	message;		//reliable commands waiting for the last lot to be acked
+	byte		msgbuf[1024];
+	double		sendtime;		//when the reliable that's in flight went out, 0 if none is
+	double		nextping;
+
+	float		servertime;		//from the last packet that had it, to stamp moves with
+	double		servertimeat;
+	int			acks[LOADGEN_MAXACKS], numacks;
+	unsigned int movemessages;
+
+	unsigned int random;
+	double		nextchange;
+	vec3_t		angles;
+	float		yawspeed;
+	int			forwardmove, sidemove, buttons, impulse;
+
+	int			firstsequence, lastsequence, received;	//server's unreliables while measuring
+} loadclient_t;
+
+static struct
+{
+	qboolean	measuring;
+	float		*rtts;			//milliseconds
+	int			numrtts, maxrtts;
+	char		rcon[8192];		//captured console text while waiting on rcon
+} lg;
+
+static unsigned int LoadGen_Random (loadclient_t *lc)
+{	//xorshift, so each client wanders the same way every run no matter what the others did
+	lc->random ^= lc->random << 13;
+	lc->random ^= lc->random >> 17;
+	lc->random ^= lc->random << 5;
+	return lc->random;
+}
+
+static void LoadGen_Command (loadclient_t *lc, const char *text)
+{
+	MSG_WriteByte (&lc->message, clc_stringcmd);
+	MSG_WriteString (&lc->message, text);
+}
+
+static void LoadGen_Drop (loadclient_t *lc)
+{
+	NET_Close (lc->sock);	//may already have been closed by NET_GetMessage's timeout
+	lc->sock = NULL;
+	lc->stage = LG_DEAD;
+}
+
+/*
+===============
+LoadGen_Connect
+
+NET_Connect would do a server list before every connection, so go to the drivers directly.
+===============
+*/
+static struct qsocket_s *LoadGen_Connect (const char *host)
+{
+	struct qsocket_s *sock;
+
+	SetNetTime ();
+	for (net_driverlevel = 0; net_driverlevel < net_numdrivers; net_driverlevel++)
+	{
+		if (!net_drivers[net_driverlevel].initialized || IS_LOOP_DRIVER(net_driverlevel))
+			continue;
+		sock = net_drivers[net_driverlevel].Connect (host);
+		if (sock)
+			return sock;
+	}
+	return NULL;
+}
+
+/*
+===============
+LoadGen_ParseServerinfo
+
+Only as much of the first signon message as it takes to know how to write a clc_move.
+===============
+*/
+static void LoadGen_ParseServerinfo (loadclient_t *lc)
+{
+	int cmd, protocol;
+
+	MSG_BeginReading ();
+	while (msg_readcount < net_message.cursize && !msg_badread)
+	{
+		cmd = MSG_ReadByte ();
+		if (cmd == svc_print)
+			MSG_ReadString ();
+		else if (cmd == svc_stufftext)
+		{	//the server wants to know our extensions before it'll send the serverinfo
+			if (!strcmp (MSG_ReadString (), "cmd pext\n"))
+				LoadGen_Command (lc, lc->nq ? "pext" : va("pext %#x %#x", PROTOCOL_FTE_PEXT2, LOADGEN_PEXT2));
+		}
+		else if (cmd == svc_serverinfo)
+		{
+			for (;;)
+			{
+				protocol = MSG_ReadLong ();
+				if (protocol == PROTOCOL_FTE_PEXT1)
+					MSG_ReadLong ();
+				else if (protocol == PROTOCOL_FTE_PEXT2)
+					lc->pext2 = MSG_ReadLong ();
+				else
+					break;
+			}
+			lc->protocolflags = (protocol == PROTOCOL_RMQ) ? MSG_ReadLong () : 0;
+			//same rules as CL_SendMove
+			lc->angle16 = (protocol != PROTOCOL_NETQUAKE && protocol != PROTOCOL_VERSION_BJP3) || NET_QSocketGetProQuakeAngleHack (lc->sock) || (lc->pext2 & PEXT2_PREDINFO);
+
+			LoadGen_Command (lc, "prespawn");
+			lc->stage = LG_PRESPAWN;
+			return;
+		}
+		else
+			return;	//not something that comes before the serverinfo
+	}
+}
+
+static qboolean LoadGen_FindSignon (int num)
+{	//the signon number ends the message the server builds, but anything broadcast can follow it.
+	//a false match just sends the next command a bit early, which the server copes with.
+	int i;
+	for (i = net_message.cursize-2; i >= 0; i--)
+	{
+		if (net_message.data[i] == svc_signonnum && net_message.data[i+1] == num)
+			return true;
+	}
+	return false;
+}
+
+/*
+===============
+LoadGen_ReadPackets
+===============
+*/
+static void LoadGen_ReadPackets (loadclient_t *lc, double now)
+{
+	int ret, cmd, sequence;
+
+	while ((ret = NET_GetMessage (lc->sock)) > 0)
+	{
+		if (ret == 1)
+		{
+			switch (lc->stage)
+			{
+			case LG_SERVERINFO:
+				LoadGen_ParseServerinfo (lc);
+				break;
+			case LG_PRESPAWN:
+				if (LoadGen_FindSignon (2))
+				{
+					LoadGen_Command (lc, va("name \"loadgen%i\"", lc->index));
+					LoadGen_Command (lc, "spawn");
+					lc->stage = LG_SPAWN;
+				}
+				break;
+			case LG_SPAWN:
+				if (LoadGen_FindSignon (3))
+				{
+					LoadGen_Command (lc, "begin");
+					lc->stage = LG_ACTIVE;
+					lc->signontime = now - lc->connecttime;
+				}
+				break;
+			default:
+				break;
+			}
+			continue;
+		}
+
+		//an unreliable. both kinds of snapshot normally lead with the server's time.
+		MSG_BeginReading ();
+		cmd = MSG_ReadByte ();
+		if (cmd == svc_time)
+		{
+			lc->servertime = MSG_ReadFloat ();
+			lc->servertimeat = now;
+		}
+		else if (cmd == svcfte_updateentities)
+		{
+			if (lc->pext2 & PEXT2_PREDINFO)
+				MSG_ReadShort ();
+			lc->servertime = MSG_ReadFloat ();
+			lc->servertimeat = now;
+		}
+
+		sequence = NET_QSocketGetSequenceIn (lc->sock);
+		if ((lc->pext2 & PEXT2_REPLACEMENTDELTAS) && lc->numacks < LOADGEN_MAXACKS)
+			lc->acks[lc->numacks++] = sequence;
+		if (lg.measuring)
+		{
+			if (!lc->received++)
+				lc->firstsequence = sequence;
+			lc->lastsequence = sequence;
+		}
+	}
+	if (ret == -1)
+	{
+		Con_Printf ("loadgen%i lost its connection\n", lc->index);
+		LoadGen_Drop (lc);
+		return;
+	}
+
+	if (lc->sendtime && NET_CanSendMessage (lc->sock))
+	{	//the server acks reliables as soon as it reads them, so this includes waiting for its next frame
+		if (lg.measuring && lg.numrtts < lg.maxrtts)
+			lg.rtts[lg.numrtts++] = (now - lc->sendtime) * 1000;
+		lc->sendtime = 0;
+	}
+}
+
+/*
+===============
+LoadGen_SendMove
+
+Random movement that changes every so often, like someone wandering about and shooting at things.
+===============
+*/
+static void LoadGen_SendMove (loadclient_t *lc, double now, double frametime)
+{
+	byte		buf[MAX_DATAGRAM];
+	sizebuf_t	msg;
+	unsigned int r;
+	int			i;
+
+	if (now >= lc->nextchange)
+	{
+		r = LoadGen_Random (lc);
+		lc->forwardmove = ((int)(r % 3) - 1) * 320;
+		lc->sidemove = ((int)((r >> 2) % 3) - 1) * 350;
+		lc->yawspeed = (int)((r >> 4) % 361) - 180;		//degrees a second
+		lc->angles[PITCH] = (int)((r >> 13) % 61) - 30;
+		lc->buttons = ((r >> 19) % 4) ? 0 : 1;			//attacking a quarter of the time
+		if ((r >> 21) % 8 == 0)
+			lc->buttons |= 2;							//and jumping now and then
+		if ((r >> 24) % 8 == 0)
+			lc->impulse = 1 + (r >> 27) % 8;			//switch weapons
+		lc->nextchange = now + 0.25 + (LoadGen_Random (lc) % 1000) / 1000.0;
+	}
+	lc->angles[YAW] = anglemod (lc->angles[YAW] + lc->yawspeed * frametime);
+
+	memset (&msg, 0, sizeof(msg));
+	msg.data = buf;
+	msg.maxsize = sizeof(buf);
+
+	for (i = 0; i < lc->numacks; i++)
+	{
+		MSG_WriteByte (&msg, clcdp_ackframe);
+		MSG_WriteLong (&msg, lc->acks[i]);
+	}
+	lc->numacks = 0;
+
+	MSG_WriteByte (&msg, clc_move);
+	if (lc->pext2 & PEXT2_PREDINFO)
+		MSG_WriteShort (&msg, ++lc->movemessages & 0xffff);
+	MSG_WriteFloat (&msg, lc->servertime + (now - lc->servertimeat));
+	for (i = 0; i < 3; i++)
+	{
+		if (lc->angle16)
+			MSG_WriteAngle16 (&msg, lc->angles[i], lc->protocolflags);
+		else
+			MSG_WriteAngle (&msg, lc->angles[i], lc->protocolflags);
+	}
+	MSG_WriteShort (&msg, lc->forwardmove);
+	MSG_WriteShort (&msg, lc->sidemove);
+	MSG_WriteShort (&msg, 0);
+	MSG_WriteByte (&msg, lc->buttons);
+	MSG_WriteByte (&msg, lc->impulse);
+	lc->impulse = 0;
+
+	if (NET_SendUnreliableMessage (lc->sock, &msg) == -1)
+	{
+		Con_Printf ("loadgen%i lost its connection\n", lc->index);
+		LoadGen_Drop (lc);
+	}
+}
+
+static void LoadGen_Flush (loadclient_t *lc, double now)
+{
+	if (lc->stage == LG_ACTIVE && lg.measuring && !lc->message.cursize && !lc->sendtime && now >= lc->nextping)
+	{	//keep a reliable going now and then just to time it
+		MSG_WriteByte (&lc->message, clc_nop);
+		lc->nextping = now + LOADGEN_PINGINTERVAL;
+	}
+	if (!lc->message.cursize || !NET_CanSendMessage (lc->sock))
+		return;
+	if (NET_SendMessage (lc->sock, &lc->message) == -1)
+	{
+		Con_Printf ("loadgen%i lost its connection\n", lc->index);
+		LoadGen_Drop (lc);
+		return;
+	}
+	SZ_Clear (&lc->message);
+	lc->sendtime = now;
+}
+
+static void LoadGen_RconReply (const char *text)
+{
+	q_strlcat (lg.rcon, text, sizeof(lg.rcon));
+}
+
+static int LoadGen_CompareFloats (const void *a, const void *b)
+{
+	float fa = *(const float *)a, fb = *(const float *)b;
+	return (fa > fb) - (fa < fb);
+}
+
+/*
+===============
+LoadGen_ServerStats
+
+Asks the server for its frame times over rcon and picks the total out of what comes back.
+===============
+*/
+static qboolean LoadGen_ServerStats (loadclient_t *clients, int numclients, float *out)
+{
+	loadclient_t	*lc;
+	const char		*line;
+	double			start, now;
+	int				i;
+
+	for (i = 0; i < numclients && !clients[i].sock; i++)
+		;
+	if (i == numclients || !*rcon_password.string)
+		return false;
+
+	*lg.rcon = 0;
+	Con_Redirect (LoadGen_RconReply);
+	Datagram_Rcon (clients[i].sock, "sv_tickstats");
+	for (start = now = Sys_DoubleTime (); now - start < LOADGEN_RCONTIME; now = Sys_DoubleTime ())
+	{
+		for (i = 0, lc = clients; i < numclients; i++, lc++)
+		{
+			if (lc->sock)
+				LoadGen_ReadPackets (lc, now);
+		}
+		Con_Redirect (LoadGen_RconReply);	//flushes what was printed so far
+		for (line = lg.rcon; line; line = strchr (line, '\n'))
+		{
+			if (*line == '\n')
+				line++;
+			if (sscanf (line, "total %f %f %f %f %f", &out[0], &out[1], &out[2], &out[3], &out[4]) == 5)
+			{
+				Con_Redirect (NULL);
+				return true;
+			}
+		}
+		Sys_Sleep (1);
+	}
+	Con_Redirect (NULL);
+	return false;
+}
+
+/*
+===============
+NET_LoadGen_f
+===============
+*/
+void NET_LoadGen_f (void)
+{
+	loadclient_t	*clients, *lc;
+	const char		*host;
+	int				numclients, i, active, connected, dropped, expected;
+	float			seconds, rate, server[5];
+	double			start, now, nexttick, measurestart = 0;
+	qboolean		nq, measured;
+
+	if (Cmd_Argc() < 3 || (numclients = atoi(Cmd_Argv(2))) < 1)
+	{
+		Con_Printf ("usage: loadgen <server> <clients> [seconds] [rate] [nq]\n");
+		return;
+	}
+	host = Cmd_Argv(1);
+	seconds = (Cmd_Argc() > 3) ? atof(Cmd_Argv(3)) : 30;
+	rate = (Cmd_Argc() > 4) ? atof(Cmd_Argv(4)) : 72;
+	nq = Cmd_Argc() > 5 && !strcmp(Cmd_Argv(5), "nq");
+	if (seconds <= 0)
+		seconds = 30;
+	if (rate <= 0)
+		rate = 72;
+
+	clients = (loadclient_t *) calloc (numclients, sizeof(*clients));
+	lg.maxrtts = numclients * (seconds / LOADGEN_PINGINTERVAL + 1);
+	lg.rtts = (float *) malloc (lg.maxrtts * sizeof(*lg.rtts));
+	lg.numrtts = 0;
+	lg.measuring = false;
+
+	for (i = 0, connected = 0, lc = clients; i < numclients; i++, lc++)
+	{
+		lc->index = i;
+		lc->nq = nq;
+		lc->random = 0x9e3779b9 * (i+1);
+		lc->message.data = lc->msgbuf;
+		lc->message.maxsize = sizeof(lc->msgbuf);
+		lc->stage = LG_DEAD;
+		lc->connecttime = Sys_DoubleTime ();
+		lc->sock = LoadGen_Connect (host);
+		if (!lc->sock)
+		{
+			Con_Printf ("loadgen%i couldn't connect to %s\n", i, host);
+			continue;
+		}
+		lc->stage = LG_SERVERINFO;
+		connected++;
+	}
+
+	start = nexttick = Sys_DoubleTime ();
+	for (;;)
+	{
+		now = Sys_DoubleTime ();
+		for (i = 0, active = 0, lc = clients; i < numclients; i++, lc++)
+		{
+			if (lc->stage == LG_DEAD)
+				continue;
+			LoadGen_ReadPackets (lc, now);
+			if (lc->stage == LG_ACTIVE)
+				active++;
+		}
+
+		if (now >= nexttick)
+		{
+			for (i = 0, lc = clients; i < numclients; i++, lc++)
+			{
+				if (lc->stage == LG_ACTIVE)
+					LoadGen_SendMove (lc, now, 1.0 / rate);
+			}
+			nexttick += 1.0 / rate;
+			if (nexttick < now)
+				nexttick = now;	//fell behind. don't try to catch up.
+		}
+
+		for (i = 0, lc = clients; i < numclients; i++, lc++)
+		{
+			if (lc->stage != LG_DEAD)
+				LoadGen_Flush (lc, now);
+		}
+
+		if (!lg.measuring)
+		{
+			if (active < connected && now - start < LOADGEN_SIGNONTIME)
+				;	//still waiting for some
+			else if (!active)
+				break;
+			else
+			{
+				if (active < connected)
+					Con_Printf ("only %i of %i clients spawned\n", active, connected);
+				lg.measuring = true;
+				measurestart = now;
+				for (i = 0; i < numclients && !clients[i].sock; i++)
+					;
+				if (*rcon_password.string)
+				{
+					Datagram_Rcon (clients[i].sock, "sv_tickprofile 1");
+					Datagram_Rcon (clients[i].sock, "sv_tickstats reset");
+				}
+			}
+		}
+		else if (now - measurestart >= seconds)
+			break;
+
+		Sys_Sleep (1);
+	}
+
+	measured = lg.measuring;
+	lg.measuring = false;
+	if (!measured)
+		Con_Printf ("no clients spawned\n");
+	else
+	{
+		double received = 0, sent = 0, signon = 0, signonmax = 0;
+		int window = 1, signons = 0;
+
+		for (i = 0, dropped = 0, lc = clients; i < numclients; i++, lc++)
+		{
+			dropped += (lc->stage == LG_DEAD && lc->received);
+			if (lc->signontime)
+			{
+				signon += lc->signontime;
+				signonmax = q_max(signonmax, lc->signontime);
+				signons++;
+			}
+			if (lc->sock)
+				window = lc->sock->reliableWindow;
+			if (lc->received)
+			{
+				expected = lc->lastsequence - lc->firstsequence + 1;
+				sent += expected;
+				received += q_min(lc->received, expected);
+			}
+		}
+		qsort (lg.rtts, lg.numrtts, sizeof(*lg.rtts), LoadGen_CompareFloats);
+
+		Con_Printf ("loadgen server %s\n", host);
+		Con_Printf ("loadgen clients %i\n", active);
+		Con_Printf ("loadgen clients_dropped %i\n", dropped);
+		Con_Printf ("loadgen protocol %s\n", nq ? "nq" : "fte");
+		Con_Printf ("loadgen seconds %.1f\n", now - measurestart);
+		Con_Printf ("loadgen moves_per_second %g\n", rate);
+		Con_Printf ("loadgen reliable_window %i\n", window);
+		if (signons)
+		{
+			Con_Printf ("loadgen signon_ms_mean %.1f\n", 1000 * signon / signons);
+			Con_Printf ("loadgen signon_ms_max %.1f\n", 1000 * signonmax);
+		}
+		if (lg.numrtts)
+		{
+			float total = 0;
+			for (i = 0; i < lg.numrtts; i++)
+				total += lg.rtts[i];
+			Con_Printf ("loadgen rtt_samples %i\n", lg.numrtts);
+			Con_Printf ("loadgen rtt_ms_mean %.3f\n", total / lg.numrtts);
+			Con_Printf ("loadgen rtt_ms_p50 %.3f\n", lg.rtts[(lg.numrtts-1) * 50 / 100]);
+			Con_Printf ("loadgen rtt_ms_p90 %.3f\n", lg.rtts[(lg.numrtts-1) * 90 / 100]);
+			Con_Printf ("loadgen rtt_ms_p99 %.3f\n", lg.rtts[(lg.numrtts-1) * 99 / 100]);
+			Con_Printf ("loadgen rtt_ms_max %.3f\n", lg.rtts[lg.numrtts-1]);
+		}
+		Con_Printf ("loadgen packets_received %.0f\n", received);
+		Con_Printf ("loadgen packet_loss_percent %.3f\n", sent ? 100 * (sent - received) / sent : 0);
+		if (LoadGen_ServerStats (clients, numclients, server))
+		{
+			Con_Printf ("loadgen server_frame_ms_mean %.3f\n", server[0]);
+			Con_Printf ("loadgen server_frame_ms_p50 %.3f\n", server[1]);
+			Con_Printf ("loadgen server_frame_ms_p90 %.3f\n", server[2]);
+			Con_Printf ("loadgen server_frame_ms_p99 %.3f\n", server[3]);
+			Con_Printf ("loadgen server_frame_ms_max %.3f\n", server[4]);
+		}
+		else
+			Con_Printf ("no server frame times%s\n", *rcon_password.string ? "" : ", set rcon_password to get them");
+	}
+
+	//say goodbye properly so the slots free up straight away
+	for (i = 0, lc = clients; i < numclients; i++, lc++)
+	{
+		byte		buf[4];
+		sizebuf_t	msg;
+
+		if (!lc->sock)
+			continue;
+		memset (&msg, 0, sizeof(msg));
+		msg.data = buf;
+		msg.maxsize = sizeof(buf);
+		MSG_WriteByte (&msg, clc_disconnect);
+		NET_SendUnreliableMessage (lc->sock, &msg);
+		NET_Close (lc->sock);
+	}
+
+	free (lg.rtts);
+	lg.rtts = NULL;
+	free (clients);
+}
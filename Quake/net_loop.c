@@ -278,3 +278,143 @@ void Loop_Close (qsocket_t *sock)
 		loop_server = NULL;
 }
 
+
+/*
+=============================================================================
+
+FAKE CONNECTIONS
+
+In-process connections with nobody on the other end, for the server benchmark.
+Whatever the server sends is just counted, and the benchmark hands in the
+messages that the client would have sent.
+
+=============================================================================
+*/
+
+typedef struct
+{
+	int		reliablebytes;
+	int		unreliablebytes;
+	int		packets;
+} fakeconnection_t;
+
+static int	fake_driverlevel = -1;
+
+int Fake_Init (void)
+{
+	fake_driverlevel = net_driverlevel;
+	return -1;	//doesn't count as a network. NET_FakeConnection wakes it up.
+}
+
+void Fake_Shutdown (void)
+{
+}
+
+void Fake_Listen (qboolean state)
+{
+}
+
+qboolean Fake_SearchForHosts (qboolean xmit)
+{
+	return false;
+}
+
+qsocket_t *Fake_Connect (const char *host)
+{
+	return NULL;	//only NET_FakeConnection makes these
+}
+
+qsocket_t *Fake_CheckNewConnections (void)
+{
+	return NULL;
+}
+
+qsocket_t *Fake_GetAnyMessage (void)
+{
+	qsocket_t	*s;
+
+	for (s = net_activeSockets; s; s = s->next)
+	{
+		if (s->driver == fake_driverlevel && !s->disconnected && Fake_GetMessage (s) > 0)
+			return s;
+	}
+	return NULL;
+}
+
+int Fake_GetMessage (qsocket_t *sock)
+{
+	sock->lastMessageTime = net_time;	//never time out, there's nobody to be slow
+	if (!sock->receiveMessageLength)
+		return 0;
+	SZ_Clear (&net_message);
+	SZ_Write (&net_message, sock->receiveMessage, sock->receiveMessageLength);
+	sock->receiveMessageLength = 0;
+	sock->unreliableReceiveSequence++;
+	return 2;
+}
+
+int Fake_SendMessage (qsocket_t *sock, sizebuf_t *data)
+{
+	fakeconnection_t *fake = (fakeconnection_t *)sock->driverdata;
+	sock->sendSequence++;
+	fake->reliablebytes += data->cursize;
+	fake->packets++;
+	return 1;
+}
+
+int Fake_SendUnreliableMessage (qsocket_t *sock, sizebuf_t *data)
+{
+	fakeconnection_t *fake = (fakeconnection_t *)sock->driverdata;
+	sock->unreliableSendSequence++;
+	fake->unreliablebytes += data->cursize;
+	fake->packets++;
+	return 1;
+}
+
+qboolean Fake_CanSendMessage (qsocket_t *sock)
+{
+	return true;
+}
+
+qboolean Fake_CanSendUnreliableMessage (qsocket_t *sock)
+{
+	return true;
+}
+
+void Fake_Close (qsocket_t *sock)
+{
+	free (sock->driverdata);
+	sock->driverdata = NULL;
+	sock->receiveMessageLength = 0;
+}
+
+qsocket_t *NET_FakeConnection (const char *name)
+{
+	qsocket_t	*sock;
+
+	if (fake_driverlevel < 0 || (sock = NET_NewQSocket ()) == NULL)
+		return NULL;
+	net_drivers[fake_driverlevel].initialized = true;	//so the server polls it
+	sock->driver = fake_driverlevel;
+	sock->driverdata = calloc (1, sizeof(fakeconnection_t));
+	q_strlcpy (sock->trueaddress, name, sizeof(sock->trueaddress));
+	q_strlcpy (sock->maskedaddress, name, sizeof(sock->maskedaddress));
+	return sock;
+}
+
+void NET_FakeInput (qsocket_t *sock, const sizebuf_t *data)
+{
+	if (sock->receiveMessageLength + data->cursize > NET_MAXMESSAGE)
+		return;
+	memcpy (sock->receiveMessage + sock->receiveMessageLength, data->data, data->cursize);
+	sock->receiveMessageLength += data->cursize;
+}
+
+void NET_FakeTraffic (const qsocket_t *sock, int *reliablebytes, int *unreliablebytes, int *packets)
+{
+	const fakeconnection_t *fake = (const fakeconnection_t *)sock->driverdata;
+	*reliablebytes = fake->reliablebytes;
+	*unreliablebytes = fake->unreliablebytes;
+	*packets = fake->packets;
+}
+
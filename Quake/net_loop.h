@@ -38,5 +38,20 @@ qboolean	Loop_CanSendUnreliableMessage (qsocket_t *sock);
 void		Loop_Close (qsocket_t *sock);
 void		Loop_Shutdown (void);
 
+int		Fake_Init (void);
+void		Fake_Listen (qboolean state);
+#define		Fake_QueryAddresses NULL
+qboolean	Fake_SearchForHosts (qboolean xmit);
+qsocket_t	*Fake_Connect (const char *host);
+qsocket_t	*Fake_CheckNewConnections (void);
+qsocket_t	*Fake_GetAnyMessage(void);
+int		Fake_GetMessage (qsocket_t *sock);
+int		Fake_SendMessage (qsocket_t *sock, sizebuf_t *data);
+int		Fake_SendUnreliableMessage (qsocket_t *sock, sizebuf_t *data);
+qboolean	Fake_CanSendMessage (qsocket_t *sock);
+qboolean	Fake_CanSendUnreliableMessage (qsocket_t *sock);
+void		Fake_Close (qsocket_t *sock);
+void		Fake_Shutdown (void);
+
 #endif	/* __NET_LOOP_H */
 
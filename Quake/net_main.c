@@ -64,6 +64,7 @@ int		unreliableMessagesReceived	= 0;
 
 cvar_t	net_messagetimeout = {"net_messagetimeout","300",CVAR_NONE};
 cvar_t	net_connecttimeout = {"net_connecttimeout","10",CVAR_NONE};	//this might be a little brief, but we don't have a way to protect against smurf attacks.
+cvar_t	net_fakelag = {"net_fakelag","0",CVAR_NONE};	//milliseconds to hold back every udp packet we send, for testing what a distant server is like
 cvar_t	hostname = {"hostname", "UNNAMED", CVAR_SERVERINFO};
 
 // these two macros are to make the code more readable
@@ -73,6 +74,7 @@ cvar_t	hostname = {"hostname", "UNNAMED", CVAR_SERVERINFO};
 int		net_driverlevel;
 
 double		net_time;
+double		net_packettime;
 
 
 double SetNetTime (void)
@@ -109,6 +111,7 @@ qsocket_t *NET_NewQSocket (void)
 	net_activeSockets = sock;
 
 	sock->isvirtual = false;
+	sock->hashnext = NULL;
 	sock->disconnected = false;
 	sock->connecttime = net_time;
 	Q_strcpy (sock->trueaddress,"UNSET ADDRESS");
@@ -128,6 +131,9 @@ qsocket_t *NET_NewQSocket (void)
 	sock->receiveMessageLength = 0;
 	sock->pending_max_datagram = 1024;
 	sock->proquake_angle_hack = false;
+	sock->reliableWindow = 1;
+	sock->rtt = 0;
+	memset (sock->receiveFragmentFlags, 0, sizeof(sock->receiveFragmentFlags));
 
 	return sock;
 }
@@ -833,6 +839,11 @@ void NET_Init (void)
 	int			i;
 	qsocket_t	*s;
 
+	Host_InstanceGlobal (&net_activeSockets, sizeof(net_activeSockets));	//-instances each have their own connections and port
+	Host_InstanceGlobal (&net_activeconnections, sizeof(net_activeconnections));
+	Host_InstanceGlobal (&net_hostport, sizeof(net_hostport));
+	Host_InstanceGlobal (&listening, sizeof(listening));
+
 	i = COM_CheckParm ("-port");
 	if (!i)
 		i = COM_CheckParm ("-udpport");
@@ -848,10 +859,16 @@ void NET_Init (void)
 	}
 	net_hostport = DEFAULTnet_hostport;
 
-	net_numsockets = svs.maxclientslimit;
+	net_numsockets = svs.maxclientslimit * host_numinstances;
 	if (cls.state != ca_dedicated)
 		net_numsockets++;
-	if (COM_CheckParm("-listen") || cls.state == ca_dedicated)
+	i = COM_CheckParm ("-loadgen");
+	if (i)
+	{	//a qsocket for each fake client, and leave the port alone for the server it's connecting to
+		if (i+2 < com_argc)
+			net_numsockets = q_max(net_numsockets, Q_atoi (com_argv[i+2]));
+	}
+	else if (COM_CheckParm("-listen") || cls.state == ca_dedicated)
 		listening = true;
 
 	SetNetTime();
@@ -869,9 +886,11 @@ void NET_Init (void)
 
 	Cvar_RegisterVariable (&net_messagetimeout);
 	Cvar_RegisterVariable (&net_connecttimeout);
+	Cvar_RegisterVariable (&net_fakelag);
 	Cvar_RegisterVariable (&hostname);
 
 	Cmd_AddCommand ("slist", NET_Slist_f);
+	Cmd_AddCommand ("loadgen", NET_LoadGen_f);
 	Cmd_AddCommand ("listen", NET_Listen_f);
 	Cmd_AddCommand ("maxplayers", MaxPlayers_f);
 	Cmd_AddCommand ("port", NET_Port_f);
@@ -910,6 +929,45 @@ void NET_Init (void)
 	}
 }
 
+/*
+====================
+NET_ListenOn
+
+Starts listening on port, or stops with 0. For -instances, which each have a port of their own.
+====================
+*/
+void NET_ListenOn (int port)
+{
+	if (port)
+		net_hostport = port;
+	listening = port != 0;
+
+	for (net_driverlevel = 0; net_driverlevel < net_numdrivers; net_driverlevel++)
+	{
+		if (net_drivers[net_driverlevel].initialized == false)
+			continue;
+		dfunc.Listen (listening);
+	}
+}
+
+/*
+====================
+NET_ShutdownInstance
+
+Closes the connections and listening sockets of the -instances server that's switched in.
+====================
+*/
+void NET_ShutdownInstance (void)
+{
+	qsocket_t	*sock;
+
+	SetNetTime();
+
+	for (sock = net_activeSockets; sock; sock = sock->next)
+		NET_Close(sock);
+	NET_ListenOn (0);
+}
+
 /*
 ====================
 NET_Shutdown
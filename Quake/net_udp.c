@@ -20,6 +20,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE	/* for recvmmsg and sendmmsg */
+#endif
+
 #include "q_stdinc.h"
 #include "arch_def.h"
 #include "net_sys.h"
@@ -38,8 +42,109 @@ static sys_socket_t net_controlsocket6;
 
 static struct in6_addr	myAddrv6;
 
+#ifdef __linux__
+/*
+recvmmsg and sendmmsg move a whole burst of packets per syscall instead of one.
+Only the listening sockets are read that way, because everything that reads them keeps going
+until they're empty, so nothing gets stuck in a ring that nobody looks at again. Writes are
+only held back between UDP_BatchSends(true) and UDP_BatchSends(false), which the server puts
+around each frame's sends. -nommsg goes back to a syscall per packet, for comparison.
+*/
+#define UDP_MMSG
+#define UDP_BATCH			32	//packets per syscall
+#define UDP_BATCHQUEUES		4	//sockets that can have writes held back at once
+
+typedef struct
+{
+	sys_socket_t		socket;
+	int					count, next;	//packets in the ring, and the next one to read
+	struct mmsghdr		hdr[UDP_BATCH];
+	struct iovec		iov[UDP_BATCH];
+	struct qsockaddr	addr[UDP_BATCH];
+	byte				data[UDP_BATCH][NET_DATAGRAMSIZE];
+} udpbatch_t;
+
+static qboolean		udp_nommsg;
+static qboolean		udp_batching;
+static udpbatch_t	*udp_recv[2];	//for net_acceptsocket4 and net_acceptsocket6
+static udpbatch_t	*udp_send[UDP_BATCHQUEUES];
+static void UDP_FlushBatch (udpbatch_t *b);
+#endif
+
+#if defined(__linux__) || defined(PLATFORM_BSD) || defined(PLATFORM_OSX)
+/*
+With -netthread, each listening socket gets a thread of its own that sits in poll() and
+pulls packets off it as soon as they arrive, noting the time, so they don't pile up in the
+kernel's buffer (and get dropped there) while a slow server frame runs. They wait in a
+ring for UDP_Read instead, which the main thread still calls to work out which qsocket
+each one is for, since only it may walk the socket list. Writes to the listening socket
+(which is everything a server sends) go the other way, through a second ring that the
+thread empties whenever the main thread pokes it: once per frame while sends are batched.
+Each ring has exactly one writer and one reader, so they need no locks.
+*/
+#include <poll.h>
+#include <fcntl.h>
+
+#define UDP_THREAD
+#define UDP_RINGSIZE		(1<<20)	//bytes per ring, a few thousand full-size packets
+#define UDP_RECORDSIZE(len)	((sizeof(udprecord_t) + (len) + 7) & ~7)
+
+typedef struct
+{
+	int					len;		//-1 marks the end of the ring, the next record is at the start
+	int					addrlen;
+	double				time;		//when it arrived, for incoming packets
+	struct qsockaddr	addr;
+} udprecord_t;		//followed by len bytes of data
+
+typedef struct
+{
+	SDL_atomic_t		head, tail;	//byte offsets that only ever grow (and wrap). the writer owns head, the reader tail
+	byte				*data;
+} udpring_t;
+
+typedef struct
+{
+	sys_socket_t		socket;
+	SDL_Thread			*thread;
+	int					wake[2];	//pipe the main thread writes to when there's something to send, or it's time to stop
+	SDL_atomic_t		die;
+	SDL_atomic_t		dropped;	//packets thrown away because the incoming ring was full
+	qboolean			pending;	//main thread only: queued sends that the thread hasn't been poked about
+	qboolean			nommsg;		//thread only
+#ifdef UDP_MMSG
+	udpbatch_t			*batch;		//thread only, for recvmmsg
+#endif
+	udpring_t			in, out;
+	struct
+	{
+		udprecord_t		hdr;
+		byte			data[NET_DATAGRAMSIZE];
+	} discard;		//somewhere to read packets that don't fit in the ring
+} udpthread_t;
+
+static qboolean		udp_usethread;
+static qboolean		udp_threadbatching;
+static udpthread_t	*udp_thread[2];		//for net_acceptsocket4 and net_acceptsocket6
+static void UDP_StartThread (udpthread_t **thread, sys_socket_t socketid);
+static void UDP_StopThread (udpthread_t **thread);
+#endif
+
 #include "net_udp.h"
 
+typedef struct udplagged_s
+{
+	struct udplagged_s	*next;
+	double				time;		//when it really goes out
+	sys_socket_t		socket;
+	socklen_t			addrsize;
+	struct qsockaddr	addr;
+	int					len;
+	byte				data[1];
+} udplagged_t;
+
+static udplagged_t	*udp_lagged, **udp_laggedtail = &udp_lagged;	//held back by net_fakelag, oldest first
+
 //=============================================================================
 
 sys_socket_t UDP4_Init (void)
@@ -50,6 +155,19 @@ sys_socket_t UDP4_Init (void)
 
 	if (COM_CheckParm ("-noudp") || COM_CheckParm ("-noudp4"))
 		return INVALID_SOCKET;
+	Host_InstanceGlobal (&net_acceptsocket4, sizeof(net_acceptsocket4));	//-instances each listen on their own port
+#ifdef UDP_MMSG
+	Host_InstanceGlobal (&udp_recv[0], sizeof(udp_recv[0]));
+#endif
+#ifdef UDP_THREAD
+	Host_InstanceGlobal (&udp_thread[0], sizeof(udp_thread[0]));
+#endif
+#ifdef UDP_MMSG
+	udp_nommsg = COM_CheckParm ("-nommsg");
+#endif
+#ifdef UDP_THREAD
+	udp_usethread = COM_CheckParm ("-netthread");
+#endif
 
 	myAddr4 = htonl(INADDR_LOOPBACK);
 	i = COM_CheckParm ("-ip");
@@ -153,6 +271,10 @@ sys_socket_t UDP4_Listen (qboolean state)
 		{
 			if ((net_acceptsocket4 = UDP4_OpenSocket (net_hostport)) == INVALID_SOCKET)
 				Sys_Error ("UDP4_Listen: Unable to open accept socket");
+#ifdef UDP_THREAD
+			if (udp_usethread)
+				UDP_StartThread (&udp_thread[0], net_acceptsocket4);
+#endif
 		}
 	}
 	else
@@ -204,6 +326,42 @@ ErrorReturn:
 
 int UDP_CloseSocket (sys_socket_t socketid)
 {
+	udplagged_t **link, *lagged;
+#if defined(UDP_MMSG) || defined(UDP_THREAD)
+	int i;
+#endif
+
+	for (link = &udp_lagged; (lagged = *link); )
+	{	//nowhere to send these from now
+		if (lagged->socket == socketid)
+		{
+			*link = lagged->next;
+			free (lagged);
+		}
+		else
+			link = &lagged->next;
+	}
+	for (udp_laggedtail = &udp_lagged; *udp_laggedtail; udp_laggedtail = &(*udp_laggedtail)->next)
+		;
+#ifdef UDP_THREAD
+	for (i = 0; i < 2; i++)
+	{	//flushes whatever it was still sending first
+		if (udp_thread[i] && udp_thread[i]->socket == socketid)
+			UDP_StopThread (&udp_thread[i]);
+	}
+#endif
+#ifdef UDP_MMSG
+	for (i = 0; i < UDP_BATCHQUEUES; i++)
+	{
+		if (udp_send[i] && udp_send[i]->socket == socketid && udp_send[i]->count)
+			UDP_FlushBatch (udp_send[i]);
+	}
+	for (i = 0; i < 2; i++)
+	{	//the descriptor will probably be reused, so don't hand out its leftovers
+		if (udp_recv[i] && udp_recv[i]->socket == socketid)
+			udp_recv[i]->count = udp_recv[i]->next = 0;
+	}
+#endif
 	if (socketid == net_broadcastsocket4)
 		net_broadcastsocket4 = INVALID_SOCKET;
 	return closesocket (socketid);
@@ -298,10 +456,464 @@ sys_socket_t UDP4_CheckNewConnections (void)
 
 //=============================================================================
 
+#ifdef UDP_MMSG
+static udpbatch_t *UDP_AllocBatch (sys_socket_t socketid)
+{
+	udpbatch_t *b = (udpbatch_t *) malloc (sizeof(*b));
+	if (!b)
+		Sys_Error ("UDP_AllocBatch: out of memory");
+	b->socket = socketid;
+	b->count = b->next = 0;
+	return b;
+}
+
+static int UDP_RecvBatch (udpbatch_t *b)
+{
+	int i;
+
+	memset (b->hdr, 0, sizeof(b->hdr));
+	for (i = 0; i < UDP_BATCH; i++)
+	{
+		b->iov[i].iov_base = b->data[i];
+		b->iov[i].iov_len = sizeof(b->data[i]);
+		b->hdr[i].msg_hdr.msg_name = &b->addr[i];
+		b->hdr[i].msg_hdr.msg_namelen = sizeof(b->addr[i]);
+		b->hdr[i].msg_hdr.msg_iov = &b->iov[i];
+		b->hdr[i].msg_hdr.msg_iovlen = 1;
+	}
+	b->next = 0;
+	b->count = recvmmsg (b->socket, b->hdr, UDP_BATCH, MSG_DONTWAIT, NULL);
+	if (b->count == SOCKET_ERROR)
+	{
+		b->count = 0;
+		return SOCKET_ERROR;
+	}
+	return b->count;
+}
+
+/*
+============
+UDP_ReadBatch
+
+Hands out the next packet from the socket's ring, refilling it with one recvmmsg when it's empty.
+============
+*/
+static int UDP_ReadBatch (udpbatch_t **ring, sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr)
+{
+	udpbatch_t *b = *ring;
+	int i, ret;
+
+	if (!b)
+		b = *ring = UDP_AllocBatch (socketid);
+	if (b->socket != socketid)
+	{	//listening again on a new socket
+		b->socket = socketid;
+		b->count = b->next = 0;
+	}
+
+	if (b->next == b->count)
+	{
+		ret = UDP_RecvBatch (b);
+		if (ret == SOCKET_ERROR)
+		{
+			int err = SOCKETERRNO;
+			if (err == NET_EWOULDBLOCK || err == NET_ECONNREFUSED)
+				return 0;
+			if (err == ENOSYS)
+			{	//old kernel, or a sandbox that doesn't know about it
+				udp_nommsg = true;
+				return UDP_Read (socketid, buf, len, addr);
+			}
+			Con_SafePrintf ("UDP_Read, recvmmsg: %s\n", socketerror(err));
+			return ret;
+		}
+	}
+
+	i = b->next++;
+	ret = q_min(len, (int)b->hdr[i].msg_len);
+	memcpy (buf, b->data[i], ret);
+	memcpy (addr, &b->addr[i], sizeof(*addr));
+	return ret;
+}
+#endif
+
+#ifdef UDP_THREAD
+/*
+============
+UDP_RingReserve / UDP_RingCommit
+
+The writer's side of a ring. Reserve room for a record of up to len bytes, fill it in
+(setting its len to what was actually used), then commit it for the reader to see.
+============
+*/
+static udprecord_t *UDP_RingReserve (udpring_t *r, int len)
+{
+	unsigned head = SDL_AtomicGet (&r->head);
+	unsigned used = head - (unsigned)SDL_AtomicGet (&r->tail);
+	unsigned at = head % UDP_RINGSIZE, skip = 0;
+
+	if (at + UDP_RECORDSIZE(len) > UDP_RINGSIZE)
+		skip = UDP_RINGSIZE - at;	//won't fit before the end, so waste what's left there
+	if (used + skip + UDP_RECORDSIZE(len) > UDP_RINGSIZE)
+		return NULL;
+	if (skip)
+	{
+		((udprecord_t *)(r->data + at))->len = -1;
+		at = 0;
+	}
+	return (udprecord_t *)(r->data + at);
+}
+
+static void UDP_RingCommit (udpring_t *r, udprecord_t *rec)
+{
+	unsigned head = SDL_AtomicGet (&r->head);
+	if ((unsigned)((byte *)rec - r->data) != head % UDP_RINGSIZE)
+		head += UDP_RINGSIZE - head % UDP_RINGSIZE;	//it skipped the end
+	SDL_AtomicSet (&r->head, head + UDP_RECORDSIZE(rec->len));
+}
+
+/*
+============
+UDP_RingNext
+
+The reader's side. Returns the record at *pos and moves pos past it, or NULL if the writer
+hasn't committed anything there yet. Setting the ring's tail to pos hands the space back.
+============
+*/
+static udprecord_t *UDP_RingNext (udpring_t *r, unsigned *pos)
+{
+	udprecord_t *rec;
+
+	if (*pos == (unsigned)SDL_AtomicGet (&r->head))
+		return NULL;
+	rec = (udprecord_t *)(r->data + *pos % UDP_RINGSIZE);
+	if (rec->len < 0)
+	{
+		*pos += UDP_RINGSIZE - *pos % UDP_RINGSIZE;
+		rec = (udprecord_t *)r->data;	//always committed along with the marker
+	}
+	*pos += UDP_RECORDSIZE(rec->len);
+	return rec;
+}
+
+static void UDP_ThreadReceive (udpthread_t *t)
+{
+	udprecord_t	*rec;
+	socklen_t	addrlen;
+	int			ret;
+
+#ifdef UDP_MMSG
+	int			i;
+	while (!t->nommsg)
+	{	//copying them over is cheaper than a syscall each
+		if (UDP_RecvBatch (t->batch) == SOCKET_ERROR)
+		{
+			if (SOCKETERRNO == ENOSYS)
+				t->nommsg = true;
+			else if (SOCKETERRNO != NET_ECONNREFUSED)
+				return;
+			continue;
+		}
+		for (i = 0; i < t->batch->count; i++)
+		{
+			rec = UDP_RingReserve (&t->in, t->batch->hdr[i].msg_len);
+			if (!rec)
+			{
+				SDL_AtomicAdd (&t->dropped, 1);
+				continue;
+			}
+			rec->len = t->batch->hdr[i].msg_len;
+			rec->addrlen = t->batch->hdr[i].msg_hdr.msg_namelen;
+			rec->time = Sys_DoubleTime ();
+			memcpy (&rec->addr, &t->batch->addr[i], sizeof(rec->addr));
+			memcpy (rec + 1, t->batch->data[i], rec->len);
+			UDP_RingCommit (&t->in, rec);
+		}
+		if (t->batch->count < UDP_BATCH)
+			return;	//that was everything
+	}
+#endif
+	for (;;)
+	{
+		rec = UDP_RingReserve (&t->in, NET_DATAGRAMSIZE);
+		if (!rec)	//the main thread is way behind. dropping them here at least keeps the newest ones coming
+			rec = &t->discard.hdr;
+		addrlen = sizeof(rec->addr);
+		ret = recvfrom (t->socket, (byte *)(rec + 1), NET_DATAGRAMSIZE, 0, (struct sockaddr *)&rec->addr, &addrlen);
+		if (ret == SOCKET_ERROR)
+		{
+			if (SOCKETERRNO == NET_ECONNREFUSED)
+				continue;
+			return;	//empty, usually. there's no safe way to print anything from here
+		}
+		if (rec == &t->discard.hdr)
+		{
+			SDL_AtomicAdd (&t->dropped, 1);
+			continue;
+		}
+		rec->len = ret;
+		rec->addrlen = addrlen;
+		rec->time = Sys_DoubleTime ();
+		UDP_RingCommit (&t->in, rec);
+	}
+}
+
+static void UDP_ThreadSend (udpthread_t *t)
+{
+	udprecord_t		*rec;
+	unsigned		pos = SDL_AtomicGet (&t->out.tail);
+#ifdef UDP_MMSG
+	struct mmsghdr	hdr[UDP_BATCH];
+	struct iovec	iov[UDP_BATCH];
+	unsigned		end[UDP_BATCH];
+	int				count, sent, ret;
+
+	while (!t->nommsg)
+	{
+		memset (hdr, 0, sizeof(hdr));
+		for (count = 0; count < UDP_BATCH && (rec = UDP_RingNext (&t->out, &pos)); count++)
+		{
+			iov[count].iov_base = rec + 1;
+			iov[count].iov_len = rec->len;
+			hdr[count].msg_hdr.msg_name = &rec->addr;
+			hdr[count].msg_hdr.msg_namelen = rec->addrlen;
+			hdr[count].msg_hdr.msg_iov = &iov[count];
+			hdr[count].msg_hdr.msg_iovlen = 1;
+			end[count] = pos;
+		}
+		if (!count)
+			return;
+		for (sent = 0; sent < count; sent += ret)
+		{
+			ret = sendmmsg (t->socket, hdr + sent, count - sent, 0);
+			if (ret != SOCKET_ERROR)
+				continue;
+			if (SOCKETERRNO == ENOSYS)
+			{	//send these ones again below
+				t->nommsg = true;
+				pos = sent ? end[sent-1] : (unsigned)SDL_AtomicGet (&t->out.tail);
+				break;
+			}
+			if (SOCKETERRNO == NET_EWOULDBLOCK)
+				break;	//the rest would just fail too, same as when the main thread sends
+			ret = 1;	//skip the one that failed
+		}
+		SDL_AtomicSet (&t->out.tail, pos);
+	}
+#endif
+	while ((rec = UDP_RingNext (&t->out, &pos)))
+	{
+		sendto (t->socket, (byte *)(rec + 1), rec->len, 0, (struct sockaddr *)&rec->addr, rec->addrlen);
+		SDL_AtomicSet (&t->out.tail, pos);
+	}
+}
+
+static int UDP_NetThread (void *arg)
+{
+	udpthread_t		*t = (udpthread_t *) arg;
+	struct pollfd	fds[2];
+	char			junk[64];
+
+	while (!SDL_AtomicGet (&t->die))
+	{
+		fds[0].fd = t->socket;
+		fds[0].events = POLLIN;
+		fds[1].fd = t->wake[0];
+		fds[1].events = POLLIN;
+		fds[0].revents = fds[1].revents = 0;
+		if (poll (fds, 2, -1) < 0 && errno != EINTR)
+			break;
+		if (fds[1].revents)
+		{
+			while (read (t->wake[0], junk, sizeof(junk)) > 0)
+				;
+			UDP_ThreadSend (t);
+		}
+		if (fds[0].revents)
+			UDP_ThreadReceive (t);
+	}
+	UDP_ThreadSend (t);	//don't lose anything that was queued just before stopping
+	return 0;
+}
+
+static void UDP_WakeThread (udpthread_t *t)
+{
+	t->pending = false;
+	if (write (t->wake[1], "", 1) < 0)
+	{
+		//full pipe, so it's already been told
+	}
+}
+
+static void UDP_StartThread (udpthread_t **thread, sys_socket_t socketid)
+{
+	udpthread_t *t = (udpthread_t *) calloc (1, sizeof(*t));
+
+	if (!t || !(t->in.data = (byte *) malloc (UDP_RINGSIZE)) || !(t->out.data = (byte *) malloc (UDP_RINGSIZE)))
+		Sys_Error ("UDP_StartThread: out of memory");
+	if (pipe (t->wake) < 0)
+	{
+		Con_SafePrintf ("UDP_StartThread: pipe failed, not using a network thread\n");
+		free (t->in.data);
+		free (t->out.data);
+		free (t);
+		return;
+	}
+	fcntl (t->wake[0], F_SETFL, O_NONBLOCK);
+	fcntl (t->wake[1], F_SETFL, O_NONBLOCK);
+	t->socket = socketid;
+#ifdef UDP_MMSG
+	t->nommsg = udp_nommsg;
+	t->batch = UDP_AllocBatch (socketid);
+#endif
+	t->thread = SDL_CreateThread (UDP_NetThread, "net", t);
+	if (!t->thread)
+	{
+		Con_SafePrintf ("UDP_StartThread: %s, not using a network thread\n", SDL_GetError());
+		t->socket = INVALID_SOCKET;
+		UDP_StopThread (&t);
+		return;
+	}
+	*thread = t;
+}
+
+static void UDP_StopThread (udpthread_t **thread)
+{
+	udpthread_t *t = *thread;
+	int dropped;
+
+	*thread = NULL;
+	if (t->thread)
+	{
+		SDL_AtomicSet (&t->die, 1);
+		UDP_WakeThread (t);
+		SDL_WaitThread (t->thread, NULL);
+	}
+	dropped = SDL_AtomicGet (&t->dropped);
+	if (dropped)
+		Con_DPrintf ("network thread dropped %i packets\n", dropped);
+	close (t->wake[0]);
+	close (t->wake[1]);
+#ifdef UDP_MMSG
+	free (t->batch);
+#endif
+	free (t->in.data);
+	free (t->out.data);
+	free (t);
+}
+
+static udpthread_t *UDP_FindThread (sys_socket_t socketid)
+{
+	if (udp_thread[0] && udp_thread[0]->socket == socketid)
+		return udp_thread[0];
+	if (udp_thread[1] && udp_thread[1]->socket == socketid)
+		return udp_thread[1];
+	return NULL;
+}
+
+static int UDP_ThreadRead (udpthread_t *t, byte *buf, int len, struct qsockaddr *addr)
+{
+	unsigned	pos = SDL_AtomicGet (&t->in.tail);
+	udprecord_t	*rec = UDP_RingNext (&t->in, &pos);
+
+	if (!rec)
+		return 0;
+	len = q_min(len, rec->len);
+	memcpy (buf, rec + 1, len);
+	memset (addr, 0, sizeof(*addr));
+	memcpy (addr, &rec->addr, q_min(rec->addrlen, (int)sizeof(*addr)));
+	net_packettime = rec->time;
+	SDL_AtomicSet (&t->in.tail, pos);
+	return len;
+}
+
+static int UDP_ThreadWrite (udpthread_t *t, byte *buf, int len, struct qsockaddr *addr, socklen_t addrsize)
+{
+	udprecord_t *rec = UDP_RingReserve (&t->out, len);
+
+	if (!rec)
+	{	//the thread can't keep up, so this one's lost just like a full socket buffer would lose it
+		UDP_WakeThread (t);
+		return 0;
+	}
+	rec->len = len;
+	rec->addrlen = addrsize;
+	memcpy (&rec->addr, addr, addrsize);
+	memcpy (rec + 1, buf, len);
+	UDP_RingCommit (&t->out, rec);
+	if (udp_threadbatching)
+		t->pending = true;
+	else
+		UDP_WakeThread (t);
+	return len;
+}
+#endif
+
+/*
+============
+UDP_SendLagged
+
+Sends whatever net_fakelag has held back for long enough. Anything that reads
+or writes a socket checks, so they go out close enough to on time.
+============
+*/
+static void UDP_SendLagged (void)
+{
+	udplagged_t *lagged;
+	double now = Sys_DoubleTime ();
+
+	while ((lagged = udp_lagged) && (lagged->time <= now || net_fakelag.value <= 0))
+	{
+		sendto (lagged->socket, lagged->data, lagged->len, 0, (struct sockaddr *)&lagged->addr, lagged->addrsize);
+		udp_lagged = lagged->next;
+		if (!udp_lagged)
+			udp_laggedtail = &udp_lagged;
+		free (lagged);
+	}
+}
+
+static int UDP_LagWrite (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr, socklen_t addrsize)
+{
+	udplagged_t *lagged = (udplagged_t *) malloc (sizeof(*lagged) + len);
+	if (!lagged)
+		return 0;	//lost, like a full socket buffer would lose it
+	lagged->next = NULL;
+	lagged->time = Sys_DoubleTime () + net_fakelag.value / 1000.0;
+	lagged->socket = socketid;
+	lagged->addrsize = addrsize;
+	memcpy (&lagged->addr, addr, addrsize);
+	lagged->len = len;
+	memcpy (lagged->data, buf, len);
+	*udp_laggedtail = lagged;
+	udp_laggedtail = &lagged->next;
+	return len;
+}
+
 int UDP_Read (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr)
 {
 	socklen_t addrlen = sizeof(struct qsockaddr);
 	int ret;
+#ifdef UDP_THREAD
+	udpthread_t *t;
+#endif
+
+	if (udp_lagged)
+		UDP_SendLagged ();
+#ifdef UDP_THREAD
+	t = UDP_FindThread (socketid);
+	if (t)
+		return UDP_ThreadRead (t, buf, len, addr);
+#endif
+
+#ifdef UDP_MMSG
+	if (!udp_nommsg && socketid != INVALID_SOCKET)
+	{
+		if (socketid == net_acceptsocket4)
+			return UDP_ReadBatch (&udp_recv[0], socketid, buf, len, addr);
+		if (socketid == net_acceptsocket6)
+			return UDP_ReadBatch (&udp_recv[1], socketid, buf, len, addr);
+	}
+#endif
 
 	ret = recvfrom (socketid, buf, len, 0, (struct sockaddr *)addr, &addrlen);
 	if (ret == SOCKET_ERROR)
@@ -356,10 +968,117 @@ int UDP4_Broadcast (sys_socket_t socketid, byte *buf, int len)
 
 //=============================================================================
 
+#ifdef UDP_MMSG
+/*
+============
+UDP_FlushBatch
+
+Sends everything that was held back for a socket. Errors can't get back to whoever wrote the
+packet any more, but the datagram layer only looks at them for reliables, and those get resent.
+============
+*/
+static void UDP_FlushBatch (udpbatch_t *b)
+{
+	int sent, ret, err;
+
+	for (sent = 0; sent < b->count; sent += ret)
+	{
+		ret = sendmmsg (b->socket, b->hdr + sent, b->count - sent, 0);
+		if (ret != SOCKET_ERROR)
+			continue;
+		err = SOCKETERRNO;
+		if (err == NET_EWOULDBLOCK)
+			break;	//the rest would just fail too
+		if (err == ENOSYS)
+		{
+			udp_nommsg = udp_batching = false;
+			for (; sent < b->count; sent++)
+				sendto (b->socket, b->data[sent], b->iov[sent].iov_len, 0, b->hdr[sent].msg_hdr.msg_name, b->hdr[sent].msg_hdr.msg_namelen);
+			break;
+		}
+		if (err == ENETUNREACH)
+			Con_SafePrintf ("UDP_Write: %s (%s)\n", socketerror(err), UDP_AddrToString(&b->addr[sent], false));
+		else
+			Con_SafePrintf ("UDP_Write, sendmmsg: %s\n", socketerror(err));
+		ret = 1;	//skip the one that failed
+	}
+	b->count = 0;
+}
+
+static int UDP_QueueWrite (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr, socklen_t addrsize)
+{
+	udpbatch_t	*b;
+	int			i;
+
+	for (i = 0; i < UDP_BATCHQUEUES; i++)
+	{
+		if (udp_send[i] && udp_send[i]->socket == socketid)
+			break;
+	}
+	if (i == UDP_BATCHQUEUES)
+	{	//take over an idle queue, or make room in the first one
+		for (i = 0; i < UDP_BATCHQUEUES; i++)
+		{
+			if (!udp_send[i] || !udp_send[i]->count)
+				break;
+		}
+		if (i == UDP_BATCHQUEUES)
+			UDP_FlushBatch (udp_send[i = 0]);
+		if (!udp_send[i])
+			udp_send[i] = UDP_AllocBatch (socketid);
+		udp_send[i]->socket = socketid;
+	}
+	b = udp_send[i];
+
+	i = b->count++;
+	memcpy (b->data[i], buf, len);
+	memcpy (&b->addr[i], addr, addrsize);
+	b->iov[i].iov_base = b->data[i];
+	b->iov[i].iov_len = len;
+	memset (&b->hdr[i], 0, sizeof(b->hdr[i]));
+	b->hdr[i].msg_hdr.msg_name = &b->addr[i];
+	b->hdr[i].msg_hdr.msg_namelen = addrsize;
+	b->hdr[i].msg_hdr.msg_iov = &b->iov[i];
+	b->hdr[i].msg_hdr.msg_iovlen = 1;
+	if (b->count == UDP_BATCH)
+		UDP_FlushBatch (b);
+	return len;
+}
+#endif
+
+void UDP_BatchSends (qboolean batch)
+{
+#if defined(UDP_MMSG) || defined(UDP_THREAD)
+	int i;
+#endif
+#ifdef UDP_THREAD
+	udp_threadbatching = batch;
+	for (i = 0; i < 2 && !batch; i++)
+	{
+		if (udp_thread[i] && udp_thread[i]->pending)
+			UDP_WakeThread (udp_thread[i]);
+	}
+#endif
+#ifdef UDP_MMSG
+
+	udp_batching = batch && !udp_nommsg;
+	if (batch)
+		return;
+	for (i = 0; i < UDP_BATCHQUEUES; i++)
+	{
+		if (udp_send[i] && udp_send[i]->count)
+			UDP_FlushBatch (udp_send[i]);
+	}
+#endif
+}
+
 int UDP_Write (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr)
 {
 	int	ret;
 	socklen_t addrsize;
+#ifdef UDP_THREAD
+	udpthread_t *t;
+#endif
 	if (addr->qsa_family == AF_INET)
 		addrsize = sizeof(struct sockaddr_in);
 	else if (addr->qsa_family == AF_INET6)
@@ -370,6 +1089,21 @@ int UDP_Write (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr
 		return -1;	//some kind of error. a few systems get pissy if the size doesn't exactly match the address family
 	}
 
+	if (udp_lagged)
+		UDP_SendLagged ();
+	if (net_fakelag.value > 0)
+		return UDP_LagWrite (socketid, buf, len, addr, addrsize);
+
+#ifdef UDP_THREAD
+	t = UDP_FindThread (socketid);
+	if (t && len <= NET_DATAGRAMSIZE)
+		return UDP_ThreadWrite (t, buf, len, addr, addrsize);
+#endif
+#ifdef UDP_MMSG
+	if (udp_batching && len <= NET_DATAGRAMSIZE)
+		return UDP_QueueWrite (socketid, buf, len, addr, addrsize);
+#endif
+
 	ret = sendto (socketid, buf, len, 0, (struct sockaddr *)addr, addrsize);
 	if (!addr->qsa_family)
 		Con_SafePrintf ("UDP_Write: family was cleared\n");
@@ -623,6 +1357,19 @@ sys_socket_t UDP6_Init (void)
 
 	if (COM_CheckParm ("-noudp") || COM_CheckParm ("-noudp6"))
 		return INVALID_SOCKET;
+	Host_InstanceGlobal (&net_acceptsocket6, sizeof(net_acceptsocket6));
+#ifdef UDP_MMSG
+	Host_InstanceGlobal (&udp_recv[1], sizeof(udp_recv[1]));
+#endif
+#ifdef UDP_THREAD
+	Host_InstanceGlobal (&udp_thread[1], sizeof(udp_thread[1]));
+#endif
+#ifdef UDP_MMSG
+	udp_nommsg = COM_CheckParm ("-nommsg");
+#endif
+#ifdef UDP_THREAD
+	udp_usethread = COM_CheckParm ("-netthread");
+#endif
 
 	// TODO: determine my name & address
 	
@@ -663,6 +1410,10 @@ sys_socket_t UDP6_Listen (qboolean state)
 		{
 			if ((net_acceptsocket6 = UDP6_OpenSocket (net_hostport)) == INVALID_SOCKET)
 				Sys_Error ("UDP6_Listen: Unable to open accept socket");
+#ifdef UDP_THREAD
+			if (udp_usethread)
+				UDP_StartThread (&udp_thread[1], net_acceptsocket6);
+#endif
 		}
 	}
 	else
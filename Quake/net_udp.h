@@ -31,6 +31,7 @@ int  UDP_Connect (sys_socket_t socketid, struct qsockaddr *addr);
 sys_socket_t  UDP4_CheckNewConnections (void);
 int  UDP_Read (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr);
 int  UDP_Write (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr);
+void UDP_BatchSends (qboolean batch);
 int  UDP4_Broadcast (sys_socket_t socketid, byte *buf, int len);
 const char *UDP_AddrToString (struct qsockaddr *addr, qboolean masked);
 int  UDP4_StringToAddr (const char *string, struct qsockaddr *addr);
@@ -52,6 +53,7 @@ int  UDP_Connect (sys_socket_t socketid, struct qsockaddr *addr);
 sys_socket_t  UDP6_CheckNewConnections (void);
 int  UDP_Read (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr);
 int  UDP_Write (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr);
+void UDP_BatchSends (qboolean batch);
 int  UDP6_Broadcast (sys_socket_t socketid, byte *buf, int len);
 const char *UDP_AddrToString (struct qsockaddr *addr, qboolean masked);
 int  UDP6_StringToAddr (const char *string, struct qsockaddr *addr);
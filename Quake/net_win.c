@@ -64,6 +64,24 @@ net_driver_t net_drivers[] =
 		Datagram_CanSendUnreliableMessage,
 		Datagram_Close,
 		Datagram_Shutdown
+	},
+
+	{	"Fake",
+		false,
+		Fake_Init,
+		Fake_Listen,
+		Fake_QueryAddresses,
+		Fake_SearchForHosts,
+		Fake_Connect,
+		Fake_CheckNewConnections,
+		Fake_GetAnyMessage,
+		Fake_GetMessage,
+		Fake_SendMessage,
+		Fake_SendUnreliableMessage,
+		Fake_CanSendMessage,
+		Fake_CanSendUnreliableMessage,
+		Fake_Close,
+		Fake_Shutdown
 	}
 };
 
@@ -96,7 +114,8 @@ net_landriver_t	net_landrivers[] =
 		WINIPv4_GetAddrFromName,
 		WINS_AddrCompare,
 		WINS_GetSocketPort,
-		WINS_SetSocketPort
+		WINS_SetSocketPort,
+		NULL
 	},
 #ifdef IPPROTO_IPV6
 	{	"Winsock IPv6",
@@ -120,7 +139,8 @@ net_landriver_t	net_landrivers[] =
 		WINIPv6_GetAddrFromName,
 		WINS_AddrCompare,
 		WINS_GetSocketPort,
-		WINS_SetSocketPort
+		WINS_SetSocketPort,
+		NULL
 	},
 #endif
 	{	"Winsock IPX",
@@ -144,7 +164,8 @@ net_landriver_t	net_landrivers[] =
 		WIPX_GetAddrFromName,
 		WIPX_AddrCompare,
 		WIPX_GetSocketPort,
-		WIPX_SetSocketPort
+		WIPX_SetSocketPort,
+		NULL
 	}
 };
 
@@ -138,6 +138,7 @@ sys_socket_t WINIPv4_Init (void)
 
 	if (COM_CheckParm ("-noudp") || COM_CheckParm ("-noudp4"))
 		return -1;
+	Host_InstanceGlobal (&netv4_acceptsocket, sizeof(netv4_acceptsocket));	//-instances each listen on their own port
 
 	if (winsock_initialized == 0)
 	{
@@ -800,6 +801,7 @@ sys_socket_t WINIPv6_Init (void)
 
 	if (COM_CheckParm ("-noudp") || COM_CheckParm ("-noudp6"))
 		return -1;
+	Host_InstanceGlobal (&netv6_acceptsocket, sizeof(netv6_acceptsocket));
 
 	qgetaddrinfo = (void*)GetProcAddress(GetModuleHandle("ws2_32.dll"), "getaddrinfo");
 	qfreeaddrinfo = (void*)GetProcAddress(GetModuleHandle("ws2_32.dll"), "freeaddrinfo");
@@ -55,6 +55,7 @@ sys_socket_t WIPX_Init (void)
 
 	if (COM_CheckParm ("-noipx"))
 		return INVALID_SOCKET;
+	Host_InstanceGlobal (&net_acceptsocket, sizeof(net_acceptsocket));	//-instances each listen on their own port
 
 	if (winsock_initialized == 0)
 	{
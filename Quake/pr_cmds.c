@@ -22,16 +22,6 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
-//#define	STRINGTEMP_BUFFERS		16
-//#define	STRINGTEMP_LENGTH		1024
-static	char	pr_string_temp[STRINGTEMP_BUFFERS][STRINGTEMP_LENGTH];
-static	byte	pr_string_tempindex = 0;
-
-char *PR_GetTempString (void)
-{
-	return pr_string_temp[(STRINGTEMP_BUFFERS-1) & ++pr_string_tempindex];
-}
-
 #define	RETURN_EDICT(e) (((int *)qcvm->globals)[OFS_RETURN] = EDICT_TO_PROG(e))
 
 /*
@@ -303,6 +293,7 @@ static void PF_sv_setmodel (void)
 	}
 	e->v.model = PR_SetEngineString(*check);
 	e->v.modelindex = i; //SV_ModelIndex (m);
+	ED_FindIndexTouchEdict (e);
 
 	mod = sv.models[ (int)e->v.modelindex];  // Mod_ForName (m, true);
 
@@ -796,9 +787,6 @@ static void PF_checkpos (void)
 
 //============================================================================
 
-static byte	*checkpvs;	//ericw -- changed to malloc
-static int	checkpvs_capacity;
-
 static int PF_newcheckclient (int check)
 {
 	int		i;
@@ -847,14 +835,14 @@ static int PF_newcheckclient (int check)
 	pvs = Mod_LeafPVS (leaf, qcvm->worldmodel);
 	
 	pvsbytes = (qcvm->worldmodel->numleafs+7)>>3;
-	if (checkpvs == NULL || pvsbytes > checkpvs_capacity)
+	if (sv.checkpvs == NULL || pvsbytes > sv.checkpvs_capacity)
 	{
-		checkpvs_capacity = pvsbytes;
-		checkpvs = (byte *) realloc (checkpvs, checkpvs_capacity);
-		if (!checkpvs)
-			Sys_Error ("PF_newcheckclient: realloc() failed on %d bytes", checkpvs_capacity);
+		sv.checkpvs_capacity = pvsbytes;
+		sv.checkpvs = (byte *) realloc (sv.checkpvs, sv.checkpvs_capacity);
+		if (!sv.checkpvs)
+			Sys_Error ("PF_newcheckclient: realloc() failed on %d bytes", sv.checkpvs_capacity);
 	}
-	memcpy (checkpvs, pvs, pvsbytes);
+	memcpy (sv.checkpvs, pvs, pvsbytes);
 
 	return i;
 }
@@ -903,7 +891,7 @@ static void PF_sv_checkclient (void)
 	VectorAdd (self->v.origin, self->v.view_ofs, view);
 	leaf = Mod_PointInLeaf (view, qcvm->worldmodel);
 	l = (leaf - qcvm->worldmodel->leafs) - 1;
-	if ( (l < 0) || !(checkpvs[l>>3] & (1 << (l & 7))) )
+	if ( (l < 0) || !(sv.checkpvs[l>>3] & (1 << (l & 7))) )
 	{
 		c_notvis++;
 		RETURN_EDICT(qcvm->edicts);
@@ -994,6 +982,33 @@ static void PF_cvar_set (void)
 	Cvar_Set (var, val);
 }
 
+cvar_t	sv_findradius_areanodes = {"sv_findradius_areanodes", "0", CVAR_NONE};	//1 to only check edicts linked near the sphere. misses anything whose origin or solid qc changed without relinking it
+
+static qboolean PF_InRadius (edict_t *ent, const float *org, float rad)
+{
+	float d, lensq;
+
+	d = org[0] - (ent->v.origin[0] + (ent->v.mins[0] + ent->v.maxs[0]) * 0.5);
+	lensq = d * d;
+	if (lensq > rad)
+		return false;
+	d = org[1] - (ent->v.origin[1] + (ent->v.mins[1] + ent->v.maxs[1]) * 0.5);
+	lensq += d * d;
+	if (lensq > rad)
+		return false;
+	d = org[2] - (ent->v.origin[2] + (ent->v.mins[2] + ent->v.maxs[2]) * 0.5);
+	lensq += d * d;
+	if (lensq > rad)
+		return false;
+	return true;
+}
+
+static int PF_SortEdicts (const void *a, const void *b)
+{
+	const edict_t *ea = *(edict_t *const *)a, *eb = *(edict_t *const *)b;
+	return (ea > eb) - (ea < eb);
+}
+
 /*
 =================
 PF_findradius
@@ -1005,10 +1020,12 @@ findradius (origin, radius)
 */
 static void PF_findradius (void)
 {
+	edict_t	**list;
 	edict_t	*ent, *chain;
 	float	rad;
 	float	*org;
-	int		i;
+	vec3_t	mins, maxs;
+	int		i, count, found;
 
 	chain = (edict_t *)qcvm->edicts;
 
@@ -1016,26 +1033,48 @@ static void PF_findradius (void)
 	rad = G_FLOAT(OFS_PARM1);
 	rad *= rad;
 
+	if (sv_findradius_areanodes.value && qcvm->numareanodes && rad < 1e30)
+	{	//only look at entities linked near the sphere. they're chained in the same order as the full scan below.
+		for (i = 0; i < 3; i++)
+		{
+			mins[i] = org[i] - sqrt(rad) - 1;
+			maxs[i] = org[i] + sqrt(rad) + 1;
+		}
+		if (qcvm->findradiuslistsize < qcvm->num_edicts)
+		{
+			qcvm->findradiuslistsize = qcvm->max_edicts;
+			qcvm->findradiuslist = (edict_t **) realloc(qcvm->findradiuslist, qcvm->findradiuslistsize * sizeof(*qcvm->findradiuslist));
+			if (!qcvm->findradiuslist)
+				Sys_Error ("PF_findradius: realloc() failed on %i edicts", qcvm->findradiuslistsize);
+		}
+		list = qcvm->findradiuslist;
+		count = SV_AreaEdicts(mins, maxs, list, qcvm->findradiuslistsize);
+		for (i = 0, found = 0; i < count; i++)
+		{
+			ent = list[i];
+			if (ent->free || ent->v.solid == SOLID_NOT || ent == qcvm->edicts)
+				continue;
+			if (PF_InRadius(ent, org, rad))
+				list[found++] = ent;
+		}
+		qsort(list, found, sizeof(*list), PF_SortEdicts);
+		for (i = 0; i < found; i++)
+		{
+			list[i]->v.chain = EDICT_TO_PROG(chain);
+			chain = list[i];
+		}
+		RETURN_EDICT(chain);
+		return;
+	}
+
 	ent = NEXT_EDICT(qcvm->edicts);
 	for (i = 1; i < qcvm->num_edicts; i++, ent = NEXT_EDICT(ent))
 	{
-		float d, lensq;
 		if (ent->free)
 			continue;
 		if (ent->v.solid == SOLID_NOT)
 			continue;
-
-		d = org[0] - (ent->v.origin[0] + (ent->v.mins[0] + ent->v.maxs[0]) * 0.5);
-		lensq = d * d;
-		if (lensq > rad)
-			continue;
-		d = org[1] - (ent->v.origin[1] + (ent->v.mins[1] + ent->v.maxs[1]) * 0.5);
-		lensq += d * d;
-		if (lensq > rad)
-			continue;
-		d = org[2] - (ent->v.origin[2] + (ent->v.mins[2] + ent->v.maxs[2]) * 0.5);
-		lensq += d * d;
-		if (lensq > rad)
+		if (!PF_InRadius(ent, org, rad))
 			continue;
 
 		ent->v.chain = EDICT_TO_PROG(chain);
@@ -1045,6 +1084,101 @@ static void PF_findradius (void)
 	RETURN_EDICT(chain);
 }
 
+/*
+=================
+PR_FindRadiusBenchmark_f
+
+Fills the server with extra edicts and compares findradius with and without the areanodes.
+=================
+*/
+void PR_FindRadiusBenchmark_f (void)
+{
+	int		numedicts = (Cmd_Argc() > 1)?atoi(Cmd_Argv(1)):4096;
+	float	radius = (Cmd_Argc() > 2)?atof(Cmd_Argv(2)):512;
+	int		iterations = (Cmd_Argc() > 3)?atoi(Cmd_Argv(3)):1000;
+	int		*spawned, numspawned = 0;
+	vec3_t	*points;
+	int		i, j, method, found[2];
+	unsigned int	checksum[2];
+	double	start, elapsed[2];
+	float	oldsetting;
+	eval_t	savedparms[3];
+	edict_t	*ent;
+
+	if (!sv.active)
+	{
+		Con_Printf("%s: server is not active\n", Cmd_Argv(0));
+		return;
+	}
+	if (iterations < 1)
+		iterations = 1;
+
+	PR_SwitchQCVM(&sv.qcvm);
+	if (numedicts > qcvm->max_edicts)
+		numedicts = qcvm->max_edicts;
+
+	//scatter boxes around the map
+	spawned = (int *) malloc(sizeof(*spawned) * numedicts);
+	while (qcvm->num_edicts < numedicts)
+	{
+		ent = ED_Alloc();
+		spawned[numspawned++] = NUM_FOR_EDICT(ent);
+		for (j = 0; j < 3; j++)
+		{
+			ent->v.origin[j] = qcvm->worldmodel->mins[j] + (qcvm->worldmodel->maxs[j]-qcvm->worldmodel->mins[j]) * (rand()/(float)RAND_MAX);
+			ent->v.mins[j] = -16;
+			ent->v.maxs[j] = 16;
+		}
+		ent->v.solid = SOLID_TRIGGER;
+		SV_LinkEdict(ent, false);
+	}
+
+	points = (vec3_t *) malloc(sizeof(*points) * iterations);
+	for (i = 0; i < iterations; i++)
+		for (j = 0; j < 3; j++)
+			points[i][j] = qcvm->worldmodel->mins[j] + (qcvm->worldmodel->maxs[j]-qcvm->worldmodel->mins[j]) * (rand()/(float)RAND_MAX);
+
+	memcpy(savedparms, &G_FLOAT(OFS_PARM0), sizeof(savedparms[0]));
+	memcpy(savedparms+1, &G_FLOAT(OFS_PARM1), sizeof(savedparms[0]));
+	memcpy(savedparms+2, &G_FLOAT(OFS_RETURN), sizeof(savedparms[0]));
+	oldsetting = sv_findradius_areanodes.value;
+	for (method = 0; method < 2; method++)
+	{
+		sv_findradius_areanodes.value = method;	//temporarily, without notifying anything.
+		found[method] = 0;
+		checksum[method] = 0;
+		start = Sys_DoubleTime();
+		for (i = 0; i < iterations; i++)
+		{
+			VectorCopy(points[i], G_VECTOR(OFS_PARM0));
+			G_FLOAT(OFS_PARM1) = radius;
+			PF_findradius();
+			for (ent = G_EDICT(OFS_RETURN), j = 1; ent != qcvm->edicts; ent = PROG_TO_EDICT(ent->v.chain), j++)
+			{
+				found[method]++;
+				checksum[method] = checksum[method]*31 + NUM_FOR_EDICT(ent)*j;
+			}
+		}
+		elapsed[method] = Sys_DoubleTime() - start;
+	}
+	sv_findradius_areanodes.value = oldsetting;
+	memcpy(&G_FLOAT(OFS_PARM0), savedparms, sizeof(savedparms[0]));
+	memcpy(&G_FLOAT(OFS_PARM1), savedparms+1, sizeof(savedparms[0]));
+	memcpy(&G_FLOAT(OFS_RETURN), savedparms+2, sizeof(savedparms[0]));
+
+	Con_Printf("%i edicts, radius %g, %i queries\n", qcvm->num_edicts, radius, iterations);
+	Con_Printf("scan     : %.3f ms, %i found\n", elapsed[0]*1000, found[0]);
+	Con_Printf("areanodes: %.3f ms, %i found\n", elapsed[1]*1000, found[1]);
+	if (found[0] != found[1] || checksum[0] != checksum[1])
+		Con_Warning("results differ!\n");
+
+	for (i = 0; i < numspawned; i++)
+		ED_Free(EDICT_NUM(spawned[i]));
+	free(spawned);
+	free(points);
+	PR_SwitchQCVM(NULL);
+}
+
 /*
 =========
 PF_dprint
@@ -1068,7 +1202,7 @@ static void PF_ftos (void)
 		sprintf (s, "%5.1f",v);	//dodgy path
 	else
 		Q_ftoa (s, v);	//what's normally expected
-	G_INT(OFS_RETURN) = PR_SetEngineString(s);
+	G_INT(OFS_RETURN) = PR_CommitTempString(s, strlen(s));
 }
 
 static void PF_fabs (void)
@@ -1093,7 +1227,7 @@ static void PF_vtos (void)
 		Q_ftoa(z, G_VECTOR(OFS_PARM0)[2]);
 		sprintf (s, "'%s %s %s'", x, y, z);
 	}
-	G_INT(OFS_RETURN) = PR_SetEngineString(s);
+	G_INT(OFS_RETURN) = PR_CommitTempString(s, strlen(s));
 }
 
 static void PF_Spawn (void)
@@ -1117,7 +1251,7 @@ static void PF_Remove (void)
 // entity (entity start, .string field, string match) find = #5;
 static void PF_Find (void)
 {
-	int		e;
+	int		e, i;
 	int		f;
 	const char	*s, *t;
 	edict_t	*ed;
@@ -1128,6 +1262,13 @@ static void PF_Find (void)
 	if (!s)
 		PR_RunError ("PF_Find: bad search string");
 
+	i = ED_FindIndexLookup (f, s, e);
+	if (i >= 0)
+	{
+		RETURN_EDICT(EDICT_NUM(i));
+		return;
+	}
+
 	for (e++ ; e < qcvm->num_edicts ; e++)
 	{
 		ed = EDICT_NUM(e);
@@ -1789,6 +1930,7 @@ void PR_spawnfunc_misc_model(edict_t *self)
 		self->v.model = val->string;
 	if (!*PR_GetString(self->v.model)) //must have a model, because otherwise various things will assume its not valid at all.
 		self->v.model = PR_SetEngineString("*null");
+	ED_FindIndexTouchEdict (self);
 
 	if (self->v.angles[1] < 0)	//mimic AD. shame there's no avelocity clientside.
 		self->v.angles[1] = (rand()*(360.0f/RAND_MAX));
@@ -2022,6 +2164,7 @@ static void PF_cl_setmodel (void)
 	mod = qcvm->GetModel(i);
 	e->v.model = mod?PR_SetEngineString(mod->name):0;	//I believe this to be safe in QS.
 	e->v.modelindex = i;
+	ED_FindIndexTouchEdict (e);
 	if (mod)
 	//johnfitz -- correct physics cullboxes for bmodels
 	/*	Spike -- THIS IS A HUGE CLUSTERFUCK.
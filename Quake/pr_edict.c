@@ -35,6 +35,8 @@ int		type_size[8] = {
 };
 
 static ddef_t	*ED_FieldAtOfs (int ofs);
+static void PR_StringsShutdown (void);
+static void PR_StringStats_f (void);
 
 cvar_t	nomonsters = {"nomonsters", "0", CVAR_NONE};
 cvar_t	gamecfg = {"gamecfg", "0", CVAR_NONE};
@@ -47,6 +49,7 @@ cvar_t	saved1 = {"saved1", "0", CVAR_ARCHIVE};
 cvar_t	saved2 = {"saved2", "0", CVAR_ARCHIVE};
 cvar_t	saved3 = {"saved3", "0", CVAR_ARCHIVE};
 cvar_t	saved4 = {"saved4", "0", CVAR_ARCHIVE};
+static cvar_t	pr_findindex = {"pr_findindex", "1", CVAR_NONE};	//hash string fields that find() searches. 2 checks the results against a scan.
 
 /*
 =================
@@ -59,40 +62,205 @@ void ED_ClearEdict (edict_t *e)
 {
 	memset (&e->v, 0, qcvm->progs->entityfields * 4);
 	e->free = false;
+	ED_FindIndexTouchEdict (e);
 }
 
 /*
 =================
-ED_Alloc
+ED_CanReuse
 
-Either finds a free edict, or allocates a new one.
 Try to avoid reusing an entity that was recently freed, because it
 can cause the client to think the entity morphed into something else
 instead of being removed and recreated, which can cause interpolated
 angles and bad trails.
 =================
 */
+static qboolean ED_CanReuse (edict_t *e)
+{
+	// the first couple seconds of server time can involve a lot of
+	// freeing and allocating, so relax the replacement policy
+	return e->free && ( e->freetime < 2 || qcvm->time - e->freetime > 0.5 );
+}
+
+static void ED_FreeListPushReady (edictfreelist_t *fl, int num)
+{	//sift up
+	int i, parent;
+
+	if (fl->numready == fl->maxready)
+	{
+		fl->maxready = fl->maxready*2 + 64;
+		fl->ready = (int *) realloc(fl->ready, fl->maxready * sizeof(*fl->ready));
+	}
+	for (i = fl->numready++; i > 0; i = parent)
+	{
+		parent = (i-1)/2;
+		if (fl->ready[parent] <= num)
+			break;
+		fl->ready[i] = fl->ready[parent];
+	}
+	fl->ready[i] = num;
+}
+
+static int ED_FreeListPopReady (edictfreelist_t *fl)
+{	//takes the lowest edict number, then sifts down
+	int result = fl->ready[0];
+	int last = fl->ready[--fl->numready];
+	int i, child;
+
+	for (i = 0; (child = i*2+1) < fl->numready; i = child)
+	{
+		if (child+1 < fl->numready && fl->ready[child+1] < fl->ready[child])
+			child++;
+		if (last <= fl->ready[child])
+			break;
+		fl->ready[i] = fl->ready[child];
+	}
+	fl->ready[i] = last;
+	return result;
+}
+
+static void ED_FreeListQueue (edictfreelist_t *fl, int num, float freetime)
+{
+	if (fl->pendinghead + fl->numpending == fl->maxpending)
+	{
+		if (fl->pendinghead > fl->numpending)
+		{	//lots of room at the start, move everything back there
+			memmove(fl->pending, fl->pending + fl->pendinghead, fl->numpending * sizeof(*fl->pending));
+			fl->pendinghead = 0;
+		}
+		else
+		{
+			fl->maxpending = fl->maxpending*2 + 64;
+			fl->pending = (struct edictpending_s *) realloc(fl->pending, fl->maxpending * sizeof(*fl->pending));
+		}
+	}
+	fl->pending[fl->pendinghead + fl->numpending].num = num;
+	fl->pending[fl->pendinghead + fl->numpending].freetime = freetime;
+	fl->numpending++;
+}
+
+static int ED_FreeListSortPending (const void *va, const void *vb)
+{
+	const struct edictpending_s *a = va, *b = vb;
+	if (a->freetime != b->freetime)
+		return (a->freetime < b->freetime) ? -1 : 1;
+	return a->num - b->num;
+}
+
+/*
+=================
+ED_FreeListSync
+
+Rebuilds the free list if something other than ED_Alloc/ED_Free changed the edicts
+(new maps, loading saved games, etc).
+Only a different edict count or time going backwards is noticed here, anything that sets
+->free directly must call ED_FreeListInvalidate as well.
+=================
+*/
+static void ED_FreeListSync (void)
+{
+	edictfreelist_t *fl = &qcvm->freelist;
+	edict_t *e;
+	int i;
+
+	if (fl->num_edicts == qcvm->num_edicts && fl->time <= qcvm->time)
+	{
+		fl->time = qcvm->time;
+		return;
+	}
+
+	fl->numready = 0;
+	fl->numpending = 0;
+	fl->pendinghead = 0;
+	for (i = qcvm->reserved_edicts; i < qcvm->num_edicts; i++)
+	{
+		e = EDICT_NUM(i);
+		if (ED_CanReuse(e))
+			ED_FreeListPushReady(fl, i);
+		else if (e->free)
+			ED_FreeListQueue(fl, i, e->freetime);
+	}
+	qsort(fl->pending, fl->numpending, sizeof(*fl->pending), ED_FreeListSortPending);
+
+	fl->num_edicts = qcvm->num_edicts;
+	fl->time = qcvm->time;
+	fl->rescans++;
+}
+
+/*
+=================
+ED_FreeListInvalidate
+
+Forces the next ED_Alloc to rebuild the free list from the edicts' own free flags.
+=================
+*/
+void ED_FreeListInvalidate (void)
+{
+	qcvm->freelist.num_edicts = -1;
+}
+
+/*
+=================
+ED_Alloc
+
+Either finds a free edict, or allocates a new one.
+Edicts that were freed recently enough to still be in ED_CanReuse's grace period wait in a
+queue ordered by freetime. Once they're old enough they move to a heap, and the lowest numbered
+edict in the heap is used first. This picks the same edict as scanning all of them would.
+=================
+*/
 edict_t *ED_Alloc (void)
 {
+	edictfreelist_t *fl = &qcvm->freelist;
+	struct edictpending_s *p;
 	int			i;
 	edict_t		*e;
 
-	for (i = qcvm->reserved_edicts; i < qcvm->num_edicts; i++)
+	ED_FreeListSync ();
+	fl->allocs++;
+
+	// anything that's been free for long enough can now be reused
+	while (fl->numpending)
 	{
+		p = &fl->pending[fl->pendinghead];
+		if (p->num < qcvm->num_edicts)
+		{
+			e = EDICT_NUM(p->num);
+			if (e->free && e->freetime == p->freetime)
+			{
+				if (!ED_CanReuse(e))
+					break;	// nothing after this one will be ready either
+				ED_FreeListPushReady(fl, p->num);
+			}
+			//else it was reused or freed again since, and has a newer entry.
+		}
+		fl->pendinghead++;
+		fl->numpending--;
+	}
+	if (!fl->numpending)
+		fl->pendinghead = 0;
+
+	while (fl->numready)
+	{
+		i = ED_FreeListPopReady(fl);
+		if (i < qcvm->reserved_edicts || i >= qcvm->num_edicts)
+			continue;
 		e = EDICT_NUM(i);
-		// the first couple seconds of server time can involve a lot of
-		// freeing and allocating, so relax the replacement policy
-		if (e->free && ( e->freetime < 2 || qcvm->time - e->freetime > 0.5 ) )
+		if (ED_CanReuse(e))
 		{
 			ED_ClearEdict (e);
+			fl->reused++;
 			return e;
 		}
+		//stale. if it was freed again then its pending entry will bring it back.
 	}
 
+	i = qcvm->num_edicts;
 	if (i == qcvm->max_edicts) //johnfitz -- use sv.max_edicts instead of MAX_EDICTS
 		Host_Error ("ED_Alloc: no free edicts (max_edicts is %i)", qcvm->max_edicts);
 
 	qcvm->num_edicts++;
+	fl->num_edicts = qcvm->num_edicts;
 	e = EDICT_NUM(i);
 	memset(e, 0, qcvm->edict_size); // ericw -- switched sv.edicts to malloc(), so we are accessing uninitialized memory and must fully zero it, not just ED_ClearEdict
 	e->baseline = nullentitystate;
@@ -109,6 +277,8 @@ FIXME: walk all entities and NULL out references to this entity
 */
 void ED_Free (edict_t *ed)
 {
+	edictfreelist_t *fl = &qcvm->freelist;
+
 	SV_UnlinkEdict (ed);		// unlink from world bsp
 
 	ed->free = true;
@@ -125,6 +295,327 @@ void ED_Free (edict_t *ed)
 	ed->alpha = ENTALPHA_DEFAULT; //johnfitz -- reset alpha for next entity
 
 	ed->freetime = qcvm->time;
+	ED_FindIndexTouchEdict (ed);
+
+	fl->frees++;
+	if (fl->time > qcvm->time)
+		fl->num_edicts = -1;	// time went backwards, the queue would be out of order. ED_Alloc will rebuild it.
+	else
+		ED_FreeListQueue(fl, ((byte *)ed - (byte *)qcvm->edicts) / qcvm->edict_size, ed->freetime);
+}
+
+/*
+=================
+ED_FindIndexLink
+
+Adds an edict to the bucket for its current value, keeping the bucket sorted.
+Free edicts and empty strings are left out, find() handles those by scanning.
+=================
+*/
+static void ED_FindIndexLink (edictfindindex_t *idx, int num)
+{
+	edict_t *ed = EDICT_NUM(num);
+	const char *s;
+	unsigned int b;
+	int p;
+
+	if (ed->free)
+		return;
+	s = E_STRING(ed, idx->ofs);
+	if (!s || !*s)
+		return;
+
+	idx->hash[num] = COM_HashString(s);
+	b = idx->hash[num] & idx->hashmask;
+
+	//new edicts are usually the highest numbered, so search from the end
+	for (p = idx->tails[b]; p && p > num; p = idx->prev[p])
+		;
+	idx->prev[num] = p;
+	if (p)
+	{
+		idx->next[num] = idx->next[p];
+		idx->next[p] = num;
+	}
+	else
+	{
+		idx->next[num] = idx->heads[b];
+		idx->heads[b] = num;
+	}
+	if (idx->next[num])
+		idx->prev[idx->next[num]] = num;
+	else
+		idx->tails[b] = num;
+	idx->flags[num] |= FINDINDEX_LINKED;
+}
+
+static void ED_FindIndexUnlink (edictfindindex_t *idx, int num)
+{
+	unsigned int b = idx->hash[num] & idx->hashmask;
+
+	if (idx->prev[num])
+		idx->next[idx->prev[num]] = idx->next[num];
+	else
+		idx->heads[b] = idx->next[num];
+	if (idx->next[num])
+		idx->prev[idx->next[num]] = idx->prev[num];
+	else
+		idx->tails[b] = idx->prev[num];
+	idx->flags[num] &= ~FINDINDEX_LINKED;
+}
+
+/*
+=================
+ED_FindIndexSync
+
+Brings an index up to date: relinks edicts whose field may have been written, and adds
+any edicts that were spawned since the last lookup.
+=================
+*/
+static void ED_FindIndexSync (edictfindindex_t *idx)
+{
+	int i, num;
+
+	if (idx->maxedicts != qcvm->max_edicts || idx->numlinked > qcvm->num_edicts)
+	{	//first use, or the edicts were reset underneath us
+		if (idx->maxedicts != qcvm->max_edicts)
+		{
+			idx->maxedicts = qcvm->max_edicts;
+			for (idx->hashmask = 64; idx->hashmask < (unsigned int)idx->maxedicts; idx->hashmask <<= 1)
+				;
+			idx->hashmask -= 1;
+			idx->heads = (int *) realloc(idx->heads, (idx->hashmask+1) * sizeof(*idx->heads));
+			idx->tails = (int *) realloc(idx->tails, (idx->hashmask+1) * sizeof(*idx->tails));
+			idx->next = (int *) realloc(idx->next, idx->maxedicts * sizeof(*idx->next));
+			idx->prev = (int *) realloc(idx->prev, idx->maxedicts * sizeof(*idx->prev));
+			idx->hash = (unsigned int *) realloc(idx->hash, idx->maxedicts * sizeof(*idx->hash));
+			idx->flags = (byte *) realloc(idx->flags, idx->maxedicts * sizeof(*idx->flags));
+			idx->dirty = (int *) realloc(idx->dirty, idx->maxedicts * sizeof(*idx->dirty));
+			if (!idx->heads || !idx->tails || !idx->next || !idx->prev || !idx->hash || !idx->flags || !idx->dirty)
+				Sys_Error ("ED_FindIndexSync: out of memory");
+		}
+		memset(idx->heads, 0, (idx->hashmask+1) * sizeof(*idx->heads));
+		memset(idx->tails, 0, (idx->hashmask+1) * sizeof(*idx->tails));
+		memset(idx->flags, 0, idx->maxedicts * sizeof(*idx->flags));
+		idx->numdirty = 0;
+		idx->numlinked = 1;	//the world is never returned by find
+	}
+
+	for (i = 0; i < idx->numdirty; i++)
+	{
+		num = idx->dirty[i];
+		if (idx->flags[num] & FINDINDEX_LINKED)
+			ED_FindIndexUnlink(idx, num);
+		idx->flags[num] &= ~FINDINDEX_DIRTY;
+		ED_FindIndexLink(idx, num);
+	}
+	qcvm->findindex.relinks += idx->numdirty;
+	idx->numdirty = 0;
+
+	for ( ; idx->numlinked < qcvm->num_edicts; idx->numlinked++)
+		ED_FindIndexLink(idx, idx->numlinked);
+}
+
+/*
+=================
+ED_FindIndexForField
+
+Returns the index for a field, creating it if there's room and the field is a string.
+=================
+*/
+static edictfindindex_t *ED_FindIndexForField (int ofs)
+{
+	edictfindindexes_t *fi = &qcvm->findindex;
+	edictfindindex_t *idx;
+	int i;
+
+	if (!fi->numfields)
+	{
+		fi->numfields = qcvm->progs->entityfields;
+		fi->fieldslot = (byte *) calloc(fi->numfields, sizeof(*fi->fieldslot));
+		if (!fi->fieldslot)
+			Sys_Error ("ED_FindIndexForField: out of memory");
+	}
+	if ((unsigned int)ofs >= fi->numfields)
+		return NULL;
+	if (fi->fieldslot[ofs])
+		return (fi->fieldslot[ofs] <= fi->numindexes) ? &fi->indexes[fi->fieldslot[ofs]-1] : NULL;
+	if (fi->numindexes == MAX_FIND_INDEXES)
+		return NULL;
+
+	//only index string fields. the engine writes to plenty of the others behind qc's back.
+	for (i = 0; i < qcvm->progs->numfielddefs; i++)
+	{
+		if (qcvm->fielddefs[i].ofs == ofs && (qcvm->fielddefs[i].type & ~DEF_SAVEGLOBAL) == ev_string)
+			break;
+	}
+	if (i == qcvm->progs->numfielddefs)
+	{
+		fi->fieldslot[ofs] = 0xff;	//don't check again
+		return NULL;
+	}
+
+	idx = &fi->indexes[fi->numindexes++];
+	memset(idx, 0, sizeof(*idx));
+	idx->ofs = ofs;
+	fi->fieldslot[ofs] = fi->numindexes;
+	return idx;
+}
+
+static void ED_FindIndexMark (edictfindindex_t *idx, edict_t *ed)
+{
+	unsigned int num = ((byte *)ed - (byte *)qcvm->edicts) / qcvm->edict_size;
+
+	//edicts that haven't been linked yet will be read fresh anyway
+	if (num < (unsigned int)idx->numlinked && !(idx->flags[num] & FINDINDEX_DIRTY))
+	{
+		idx->flags[num] |= FINDINDEX_DIRTY;
+		idx->dirty[idx->numdirty++] = num;
+	}
+}
+
+/*
+=================
+ED_FindIndexTouch
+
+Flags an edict's indexed field as possibly changed.
+QC's string stores go through ED_FindIndexTouchPointer, the engine calls this directly.
+=================
+*/
+void ED_FindIndexTouch (edict_t *ed, int ofs)
+{
+	edictfindindexes_t *fi = &qcvm->findindex;
+
+	if ((unsigned int)ofs < fi->numfields && fi->fieldslot[ofs] && fi->fieldslot[ofs] <= fi->numindexes)
+		ED_FindIndexMark(&fi->indexes[fi->fieldslot[ofs]-1], ed);
+}
+
+/*
+=================
+ED_FindIndexTouchPointer
+
+Flags the field that an OP_STOREP_S just wrote to, given the pointer qc stored through.
+This has to happen after the store. A sync between OP_ADDRESS and the store (qcc evaluates
+the value in between, which can call find()) would otherwise rehash the old value.
+=================
+*/
+void ED_FindIndexTouchPointer (int ptr)
+{
+	int ofs;
+
+	if (ptr < 0)
+		return;
+	ofs = ptr % qcvm->edict_size - (int)offsetof(edict_t, v);
+	if (ofs >= 0)
+		ED_FindIndexTouch ((edict_t *)((byte *)qcvm->edicts + ptr - ptr % qcvm->edict_size), ofs / 4);
+}
+
+/*
+=================
+ED_FindIndexTouchEdict
+
+For when the engine rewrites more than one field at once.
+=================
+*/
+void ED_FindIndexTouchEdict (edict_t *ed)
+{
+	edictfindindexes_t *fi = &qcvm->findindex;
+	int i;
+
+	for (i = 0; i < fi->numindexes; i++)
+		ED_FindIndexMark(&fi->indexes[i], ed);
+}
+
+static int ED_FindIndexScan (int ofs, const char *s, int after)
+{
+	edict_t *ed;
+	const char *t;
+	int e;
+
+	for (e = after+1; e < qcvm->num_edicts; e++)
+	{
+		ed = EDICT_NUM(e);
+		if (ed->free)
+			continue;
+		t = E_STRING(ed, ofs);
+		if (t && !strcmp(t, s))
+			return e;
+	}
+	return 0;
+}
+
+/*
+=================
+ED_FindIndexLookup
+
+Returns the lowest numbered edict after 'after' whose string field matches s, or 0 for none.
+Returns -1 when there's no index for the field, in which case the caller should scan.
+=================
+*/
+int ED_FindIndexLookup (int ofs, const char *s, int after)
+{
+	edictfindindex_t *idx;
+	edict_t *ed;
+	unsigned int h;
+	int num;
+
+	if (!pr_findindex.value || !*s || !(idx = ED_FindIndexForField(ofs)))
+	{
+		qcvm->findindex.scans++;
+		return -1;
+	}
+	ED_FindIndexSync(idx);
+	qcvm->findindex.lookups++;
+
+	h = COM_HashString(s);
+	if (after > 0 && after < idx->numlinked && (idx->flags[after] & FINDINDEX_LINKED) && idx->hash[after] == h)
+		num = idx->next[after];	//continuing a find loop, no need to walk the bucket again
+	else
+	{
+		for (num = idx->heads[h & idx->hashmask]; num && num <= after; num = idx->next[num])
+			;
+	}
+	for ( ; num; num = idx->next[num])
+	{
+		if (idx->hash[num] != h)
+			continue;
+		ed = EDICT_NUM(num);
+		if (!ed->free && !strcmp(E_STRING(ed, ofs), s))
+			break;
+	}
+
+	if (pr_findindex.value >= 2)
+	{	//paranoid mode, compare with what a scan would have found
+		int scan = ED_FindIndexScan(ofs, s, after);
+		if (scan != num)
+		{
+			ddef_t *def = ED_FieldAtOfs(ofs);
+			Con_Warning ("find index on %s returned %i instead of %i for \"%s\"\n", def?PR_GetString(def->s_name):"?", num, scan, s);
+			num = scan;
+		}
+	}
+	return num;
+}
+
+static void ED_FindIndexShutdown (void)
+{
+	edictfindindexes_t *fi = &qcvm->findindex;
+	edictfindindex_t *idx;
+	int i;
+
+	for (i = 0; i < fi->numindexes; i++)
+	{
+		idx = &fi->indexes[i];
+		free(idx->heads);
+		free(idx->tails);
+		free(idx->next);
+		free(idx->prev);
+		free(idx->hash);
+		free(idx->flags);
+		free(idx->dirty);
+	}
+	free(fi->fieldslot);
+	memset(fi, 0, sizeof(*fi));
 }
 
 //===========================================================================
@@ -169,21 +660,79 @@ static ddef_t *ED_FieldAtOfs (int ofs)
 
 /*
 ============
-ED_FindField
+PR_BuildNameHash
+
+Indexes a table of defs or functions by name, so lookups don't need to strcmp their way through
+the entire table. Earlier entries win when names are duplicated, same as a linear search.
 ============
 */
-ddef_t *ED_FindField (const char *name)
+static void PR_BuildNameHash (prnamehash_t *hash, const void *table, size_t stride, size_t nameofs, int count)
 {
-	ddef_t		*def;
+	const char	*name;
+	unsigned int	i, pos;
+
+	free(hash->indices);
+	hash->indices = NULL;
+	hash->size = 0;
+	if (count <= 0)
+		return;
+
+	hash->size = count * 2;	// 50% load factor
+	hash->indices = (unsigned int *) calloc(hash->size, sizeof(*hash->indices));
+	for (i = 0; i < (unsigned int)count; i++)
+	{
+		name = PR_GetString(*(const int *)((const byte *)table + i*stride + nameofs));
+		for (pos = COM_HashString(name) % hash->size; hash->indices[pos]; )
+		{
+			if (++pos == hash->size)
+				pos = 0;
+		}
+		hash->indices[pos] = i + 1;
+	}
+}
+
+/*
+============
+PR_FindName
+
+Returns the index of the named entry, or -1.
+Tables without a hash (eg: while still loading) are searched the slow way.
+============
+*/
+static int PR_FindName (const prnamehash_t *hash, const void *table, size_t stride, size_t nameofs, int count, const char *name)
+{
+	unsigned int	pos, idx;
 	int			i;
 
-	for (i = 0; i < qcvm->progs->numfielddefs; i++)
+	if (!hash->size)
 	{
-		def = &qcvm->fielddefs[i];
-		if ( !strcmp(PR_GetString(def->s_name), name) )
-			return def;
+		for (i = 0; i < count; i++)
+		{
+			if (!strcmp(PR_GetString(*(const int *)((const byte *)table + i*stride + nameofs)), name))
+				return i;
+		}
+		return -1;
 	}
-	return NULL;
+
+	for (pos = COM_HashString(name) % hash->size; (idx = hash->indices[pos]); )
+	{
+		if (!strcmp(PR_GetString(*(const int *)((const byte *)table + (idx-1)*stride + nameofs)), name))
+			return idx - 1;
+		if (++pos == hash->size)
+			pos = 0;
+	}
+	return -1;
+}
+
+/*
+============
+ED_FindField
+============
+*/
+ddef_t *ED_FindField (const char *name)
+{
+	int i = PR_FindName(&qcvm->fieldhash, qcvm->fielddefs, sizeof(ddef_t), offsetof(ddef_t, s_name), qcvm->progs->numfielddefs, name);
+	return (i < 0) ? NULL : &qcvm->fielddefs[i];
 }
 
 /*
@@ -203,16 +752,8 @@ ED_FindGlobal
 */
 ddef_t *ED_FindGlobal (const char *name)
 {
-	ddef_t		*def;
-	int			i;
-
-	for (i = 0; i < qcvm->progs->numglobaldefs; i++)
-	{
-		def = &qcvm->globaldefs[i];
-		if ( !strcmp(PR_GetString(def->s_name), name) )
-			return def;
-	}
-	return NULL;
+	int i = PR_FindName(&qcvm->globalhash, qcvm->globaldefs, sizeof(ddef_t), offsetof(ddef_t, s_name), qcvm->progs->numglobaldefs, name);
+	return (i < 0) ? NULL : &qcvm->globaldefs[i];
 }
 
 
@@ -223,16 +764,8 @@ ED_FindFunction
 */
 dfunction_t *ED_FindFunction (const char *fn_name)
 {
-	dfunction_t		*func;
-	int				i;
-
-	for (i = 0; i < qcvm->progs->numfunctions; i++)
-	{
-		func = &qcvm->functions[i];
-		if ( !strcmp(PR_GetString(func->s_name), fn_name) )
-			return func;
-	}
-	return NULL;
+	int i = PR_FindName(&qcvm->functionhash, qcvm->functions, sizeof(dfunction_t), offsetof(dfunction_t, s_name), qcvm->progs->numfunctions, fn_name);
+	return (i < 0) ? NULL : &qcvm->functions[i];
 }
 
 /*
@@ -641,6 +1174,10 @@ static void ED_Count (void)
 	Con_Printf ("view      :%3i\n", models);
 	Con_Printf ("touch     :%3i\n", solid);
 	Con_Printf ("step      :%3i\n", step);
+	Con_Printf ("allocs    :%3u (%u reused)\n", qcvm->freelist.allocs, qcvm->freelist.reused);
+	Con_Printf ("frees     :%3u\n", qcvm->freelist.frees);
+	Con_Printf ("rescans   :%3u\n", qcvm->freelist.rescans);
+	Con_Printf ("find index:%3u lookups, %u scans, %u relinks\n", qcvm->findindex.lookups, qcvm->findindex.scans, qcvm->findindex.relinks);
 	PR_SwitchQCVM(NULL);
 }
 
@@ -774,15 +1311,15 @@ static void ED_RezoneString (string_t *ref, const char *str)
 			qcvm->knownzone[id>>3] &= ~(1u<<(id&7));
 			buf = (char*)PR_GetString(*ref);
 			PR_ClearEngineString(*ref);
-			Z_Free(buf);
+			PR_StrzoneFree(buf);
 		}
 //		else
 //			Con_Warning("ED_RezoneString: string wasn't strzoned\n");	//warnings would trigger from the default cvar value that autocvars are initialised with
 	}
 
-	buf = Z_Malloc(len);
+	buf = PR_StrzoneAlloc(len);
 	memcpy(buf, str, len);
-	id = -1-(*ref = PR_SetEngineString(buf));
+	id = -1-(*ref = PR_NewEngineString(buf));
 	//make sure its flagged as zoned so we can clean up properly after.
 	if (id >= qcvm->knownzonesize)
 	{
@@ -1037,9 +1574,13 @@ const char *ED_ParseEdict (const char *data, edict_t *ent)
 		if (!ED_ParseEpair ((void *)&ent->v, key, com_token, qcvm != &sv.qcvm))
 			Host_Error ("ED_ParseEdict: parse error");
 	}
+	ED_FindIndexTouchEdict (ent);
 
 	if (!init)
+	{
 		ent->free = true;
+		ED_FreeListInvalidate ();
+	}
 
 	return data;
 }
@@ -1171,10 +1712,23 @@ void PR_ClearProgs(qcvm_t *vm)
 	qcvm = NULL;
 	PR_SwitchQCVM(vm);
 	PR_ShutdownExtensions();
+	PR_StringsShutdown();
 
 	if (qcvm->knownstrings)
 		Z_Free ((void *)qcvm->knownstrings);
+	PR_ProfileShutdown();
+	PR_JIT_Shutdown();
+	free(qcvm->mstatements);
+	free(qcvm->fieldhash.indices);
+	free(qcvm->globalhash.indices);
+	free(qcvm->functionhash.indices);
+	free(qcvm->freelist.pending);
+	free(qcvm->freelist.ready);
+	ED_FindIndexShutdown();
 	free(qcvm->edicts); // ericw -- sv.edicts switched to use malloc()
+	free(qcvm->aabbtree.nodes);
+	free(qcvm->aabbtree.entleaf);
+	free(qcvm->findradiuslist);
 	if (qcvm->fielddefs != (ddef_t *)((byte *)qcvm->progs + qcvm->progs->ofs_fielddefs))
 		free(qcvm->fielddefs);
 	free(qcvm->progs);	// spike -- pr_progs switched to use malloc (so menuqc doesn't end up stuck on the early hunk nor wiped on every map change)
@@ -1395,11 +1949,17 @@ qboolean PR_LoadProgs (const char *filename, qboolean fatal, unsigned int needcr
 	for (i = 0; i < qcvm->progs->numglobals; i++)
 		((int *)qcvm->globals)[i] = LittleLong (((int *)qcvm->globals)[i]);
 
+	PR_BuildNameHash(&qcvm->globalhash, qcvm->globaldefs, sizeof(ddef_t), offsetof(ddef_t, s_name), qcvm->progs->numglobaldefs);
+	PR_BuildNameHash(&qcvm->functionhash, qcvm->functions, sizeof(dfunction_t), offsetof(dfunction_t, s_name), qcvm->progs->numfunctions);
+
+	PR_DecodeStatements();
+
 	memcpy(qcvm->builtins, builtins, numbuiltins*sizeof(qcvm->builtins[0]));
 	qcvm->numbuiltins = numbuiltins;
 
 	//spike: detect extended fields from progs
 	PR_MergeEngineFieldDefs();
+	PR_BuildNameHash(&qcvm->fieldhash, qcvm->fielddefs, sizeof(ddef_t), offsetof(ddef_t, s_name), qcvm->progs->numfielddefs);
 #define QCEXTFIELD(n,t) qcvm->extfields.n = ED_FindFieldOffset(#n);
 	QCEXTFIELDS_ALL
 	QCEXTFIELDS_GAME
@@ -1422,6 +1982,175 @@ qboolean PR_LoadProgs (const char *filename, qboolean fatal, unsigned int needcr
 }
 
 
+/*
+=============
+ED_FindBenchmark_f
+
+Times the name lookups that spawning a map's entities does, with and without the name hashes.
+=============
+*/
+static void ED_FindBenchmark_f (void)
+{
+	struct
+	{
+		char		*name;
+		qboolean	function;
+	} *names = NULL;
+	const char	*data;
+	char		*file = NULL;
+	int			numnames = 0, maxnames = 0;
+	int			i, j, pass, iterations, found;
+	qboolean	iskey = true, isclassname = false;
+	prnamehash_t	fieldhash, functionhash;
+	double		start, elapsed[2];
+
+	if (!sv.active)
+	{
+		Con_Printf("%s: server is not active\n", Cmd_Argv(0));
+		return;
+	}
+	iterations = (Cmd_Argc() > 2)?atoi(Cmd_Argv(2)):10;
+	if (iterations < 1)
+		iterations = 1;
+	if (Cmd_Argc() > 1 && *Cmd_Argv(1))
+	{
+		data = file = (char *)COM_LoadMallocFile(Cmd_Argv(1), NULL);
+		if (!file)
+		{
+			Con_Printf("%s: couldn't load %s\n", Cmd_Argv(0), Cmd_Argv(1));
+			return;
+		}
+	}
+	else
+		data = sv.qcvm.worldmodel->entities;
+
+	//gather the names that ED_LoadFromFile/ED_ParseEdict would look up.
+	//classnames are looked up twice, once as spawnfunc_foo and once as just foo.
+	while ((data = COM_Parse(data)))
+	{
+		if (com_token[0] == '{' || com_token[0] == '}')
+		{
+			iskey = true;
+			continue;
+		}
+		if (numnames+2 > maxnames)
+		{
+			maxnames = maxnames*2 + 256;
+			names = realloc(names, maxnames * sizeof(*names));
+		}
+		if (iskey)
+		{
+			isclassname = !strcmp(com_token, "classname");
+			names[numnames].name = Z_Strdup(com_token);
+			names[numnames++].function = false;
+		}
+		else if (isclassname)
+		{
+			names[numnames].name = Z_Strdup(va("spawnfunc_%s", com_token));
+			names[numnames++].function = true;
+			names[numnames].name = Z_Strdup(com_token);
+			names[numnames++].function = true;
+		}
+		iskey = !iskey;
+	}
+	free(file);
+
+	PR_SwitchQCVM(&sv.qcvm);
+	fieldhash = qcvm->fieldhash;
+	functionhash = qcvm->functionhash;
+	for (pass = 0, found = 0; pass < 2; pass++)
+	{
+		if (pass)
+		{	//hide the hashes, so we get the old linear search.
+			memset(&qcvm->fieldhash, 0, sizeof(qcvm->fieldhash));
+			memset(&qcvm->functionhash, 0, sizeof(qcvm->functionhash));
+		}
+		start = Sys_DoubleTime();
+		for (j = 0; j < iterations; j++)
+		{
+			for (i = 0; i < numnames; i++)
+			{
+				if (names[i].function)
+					found += !!ED_FindFunction(names[i].name);
+				else
+					found += !!ED_FindField(names[i].name);
+			}
+		}
+		elapsed[pass] = Sys_DoubleTime() - start;
+	}
+	qcvm->fieldhash = fieldhash;
+	qcvm->functionhash = functionhash;
+	PR_SwitchQCVM(NULL);
+
+	Con_Printf("%i lookups x %i: hashed %.3f ms, linear %.3f ms (%i found)\n", numnames, iterations, elapsed[0]*1000, elapsed[1]*1000, found/(2*iterations));
+	for (i = 0; i < numnames; i++)
+		Z_Free(names[i].name);
+	free(names);
+}
+
+/*
+=============
+ED_FindIndexTest_f
+
+Checks that find() sees a string that qc stored through a pointer, when a find() ran between
+OP_ADDRESS and the store, as happens with e.targetname = f() where f calls find().
+=============
+*/
+static void ED_FindIndexTest_f (void)
+{
+	static const char *newvalue = "ed_findindextest";
+	const char	*fieldname = (Cmd_Argc() > 1)?Cmd_Argv(1):"targetname";
+	ddef_t		*def;
+	edict_t		*ed;
+	eval_t		*val;
+	string_t	oldvalue;
+	int			i, ptr, found, failed = 0, tested = 0;
+
+	if (!sv.active)
+	{
+		Con_Printf("%s: server is not active\n", Cmd_Argv(0));
+		return;
+	}
+	PR_SwitchQCVM(&sv.qcvm);
+	def = ED_FindField(fieldname);
+	if (!def || (def->type & ~DEF_SAVEGLOBAL) != ev_string)
+	{
+		Con_Printf("%s: no string field named \"%s\"\n", Cmd_Argv(0), fieldname);
+		PR_SwitchQCVM(NULL);
+		return;
+	}
+
+	for (i = 1; i < qcvm->num_edicts; i++)
+	{
+		ed = EDICT_NUM(i);
+		if (ed->free)
+			continue;
+		tested++;
+		oldvalue = ((eval_t *)((int *)&ed->v + def->ofs))->string;
+
+		//what OP_ADDRESS hands to OP_STOREP_S
+		ptr = (byte *)((int *)&ed->v + def->ofs) - (byte *)qcvm->edicts;
+		//the value's expression calls find() in between, which syncs the index
+		ED_FindIndexLookup(def->ofs, newvalue, 0);
+		//OP_STOREP_S
+		val = (eval_t *)((byte *)qcvm->edicts + ptr);
+		val->string = PR_SetEngineString(newvalue);
+		ED_FINDINDEX_TOUCHPTR(ptr);
+
+		found = ED_FindIndexLookup(def->ofs, newvalue, 0);
+		if (found >= 0 && found != i)
+		{
+			Con_Printf("%s: edict %i: find returned %i\n", Cmd_Argv(0), i, found);
+			failed++;
+		}
+
+		val->string = oldvalue;
+		ED_FINDINDEX_TOUCHPTR(ptr);
+	}
+	Con_Printf("%s: %i edicts, %i failed\n", Cmd_Argv(0), tested, failed);
+	PR_SwitchQCVM(NULL);
+}
+
 /*
 ===============
 PR_Init
@@ -1433,7 +2162,12 @@ void PR_Init (void)
 	Cmd_AddCommand ("edicts", ED_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
 	Cmd_AddCommand ("profile", PR_Profile_f);
+	Cmd_AddCommand ("pr_benchmark", PR_Benchmark_f);
+	Cmd_AddCommand ("ed_findbenchmark", ED_FindBenchmark_f);
+	Cmd_AddCommand ("ed_findindextest", ED_FindIndexTest_f);
+	Cmd_AddCommand ("sv_findradiusbenchmark", PR_FindRadiusBenchmark_f);
 	Cmd_AddCommand ("pr_dumpplatform", PR_DumpPlatform_f);
+	Cmd_AddCommand ("pr_stringstats", PR_StringStats_f);
 	Cvar_RegisterVariable (&nomonsters);
 	Cvar_RegisterVariable (&gamecfg);
 	Cvar_RegisterVariable (&scratch1);
@@ -1445,6 +2179,11 @@ void PR_Init (void)
 	Cvar_RegisterVariable (&saved2);
 	Cvar_RegisterVariable (&saved3);
 	Cvar_RegisterVariable (&saved4);
+	Cvar_RegisterVariable (&pr_threaded);
+	Cvar_RegisterVariable (&pr_predecode);
+	Cvar_RegisterVariable (&pr_findindex);
+	PR_JIT_Init();
+	PR_ProfileInit();
 
 	PR_InitExtensions();
 }
@@ -1481,6 +2220,348 @@ static void PR_AllocStringSlots (void)
 	qcvm->knownstrings = (const char **) Z_Realloc ((void *)qcvm->knownstrings, qcvm->maxknownstrings * sizeof(char *));
 }
 
+/*
+===============================================================================
+
+TEMPSTRINGS
+
+Builtins that return new strings get them from a bump allocator that's reset a frame at a time,
+so a string stays valid for the rest of the frame it was made in and all of the next.
+Its string_t values start at PR_TEMPSTRING_BASE and encode the chunk and offset directly, so
+neither PR_GetString nor PR_SetEngineString need to search the engine string slots for them.
+
+===============================================================================
+*/
+
+static int PR_TempStringNewChunk (prtempstrings_t *ts)
+{
+	int c, g;
+
+	if (ts->freechunks >= 0)
+	{
+		c = ts->freechunks;
+		ts->freechunks = ts->chunks[c].next;
+	}
+	else if (ts->numchunks >= PR_TEMPSTRING_MAXCHUNKS)
+	{	//too many strings for one frame. reuse the oldest chunk, much like the old ring buffer overwrote its oldest slot.
+		g = (ts->head[1] >= 0) ? 1 : 0;
+		c = ts->head[g];
+		ts->head[g] = ts->chunks[c].next;
+		if (ts->head[g] < 0)
+			ts->tail[g] = -1;
+		if (!ts->recycled++)
+			Con_DWarning ("PR_TempStringNewChunk: more than %i bytes of tempstrings, reusing old ones\n", PR_TEMPSTRING_MAXCHUNKS*PR_TEMPSTRING_CHUNK);
+	}
+	else
+	{
+		if (ts->numchunks == ((0x7fffffff - PR_TEMPSTRING_BASE) >> PR_TEMPSTRING_CHUNKBITS))
+			PR_RunError ("too many tempstrings this frame");
+		if (ts->numchunks == ts->maxchunks)
+		{
+			ts->maxchunks = ts->maxchunks*2 + 8;
+			ts->chunks = (struct prtempchunk_s *) realloc(ts->chunks, ts->maxchunks * sizeof(*ts->chunks));
+			if (!ts->chunks)
+				Sys_Error ("PR_TempStringNewChunk: out of memory");
+		}
+		c = ts->numchunks++;
+		ts->chunks[c].data = (char *) malloc(PR_TEMPSTRING_CHUNK);
+		if (!ts->chunks[c].data)
+			Sys_Error ("PR_TempStringNewChunk: out of memory");
+	}
+	ts->chunks[c].used = 0;
+	ts->chunks[c].next = -1;
+	if (ts->tail[0] >= 0)
+		ts->chunks[ts->tail[0]].next = c;
+	else
+		ts->head[0] = c;
+	ts->tail[0] = c;
+	return c;
+}
+
+static char *PR_AllocTempString (int size)
+{
+	prtempstrings_t *ts = &qcvm->tempstrings;
+	struct prtempchunk_s *chunk;
+	int c;
+
+	if (!ts->chunks)
+	{	//first use
+		ts->head[0] = ts->head[1] = -1;
+		ts->tail[0] = ts->tail[1] = -1;
+		ts->freechunks = -1;
+		ts->lastchunk = -1;
+	}
+
+	c = ts->tail[0];
+	if (c < 0 || ts->chunks[c].used + size > PR_TEMPSTRING_CHUNK)
+		c = PR_TempStringNewChunk(ts);
+	chunk = &ts->chunks[c];
+
+	ts->lastchunk = c;
+	ts->lastofs = chunk->used;
+	chunk->used += size;
+
+	ts->allocs++;
+	ts->frameallocs++;
+	ts->framebytes += size;
+	return chunk->data + ts->lastofs;
+}
+
+/*
+=================
+PR_TempStringNum
+
+Returns the string_t for a pointer into the tempstring arena, or 0 if it isn't one.
+=================
+*/
+static int PR_TempStringNum (const char *s)
+{
+	prtempstrings_t *ts = &qcvm->tempstrings;
+	int c, g;
+
+	if (ts->lastchunk < 0 || !ts->chunks)
+		return 0;
+	c = ts->lastchunk;
+	if (s == ts->chunks[c].data + ts->lastofs)
+		return PR_TEMPSTRING_BASE + (c << PR_TEMPSTRING_CHUNKBITS) + ts->lastofs;
+	for (g = 0; g < 2; g++)
+	{
+		for (c = ts->head[g]; c >= 0; c = ts->chunks[c].next)
+		{
+			if (s >= ts->chunks[c].data && s < ts->chunks[c].data + ts->chunks[c].used)
+				return PR_TEMPSTRING_BASE + (c << PR_TEMPSTRING_CHUNKBITS) + (s - ts->chunks[c].data);
+		}
+	}
+	return 0;
+}
+
+char *PR_GetTempString (void)
+{
+	return PR_AllocTempString(STRINGTEMP_LENGTH);
+}
+
+/*
+=================
+PR_CommitTempString
+
+Returns the string_t for a PR_GetTempString buffer that now holds len chars and a null.
+PR_GetTempString has to reserve STRINGTEMP_LENGTH bytes without knowing how many
+will be used, so the rest of the buffer is given back if nothing was allocated since.
+=================
+*/
+int PR_CommitTempString (char *s, size_t len)
+{
+	prtempstrings_t *ts = &qcvm->tempstrings;
+	struct prtempchunk_s *chunk;
+	int used;
+
+	if (ts->lastchunk >= 0 && ts->chunks && len < STRINGTEMP_LENGTH)
+	{
+		chunk = &ts->chunks[ts->lastchunk];
+		used = ts->lastofs + len + 1;
+		if (s == chunk->data + ts->lastofs && used < chunk->used)
+		{
+			ts->framebytes -= chunk->used - used;
+			chunk->used = used;
+		}
+	}
+	return PR_SetEngineString(s);
+}
+
+int PR_MakeTempString (const char *val)
+{
+	int len = strlen(val) + 1;
+	char *tmp;
+
+	if (len > STRINGTEMP_LENGTH)
+		len = STRINGTEMP_LENGTH;
+	tmp = PR_AllocTempString(len);
+	memcpy(tmp, val, len-1);
+	tmp[len-1] = 0;
+	return PR_TEMPSTRING_BASE + (qcvm->tempstrings.lastchunk << PR_TEMPSTRING_CHUNKBITS) + qcvm->tempstrings.lastofs;
+}
+
+/*
+=================
+PR_TempStringsFrame
+
+Recycles the chunks from two frames ago.
+=================
+*/
+static void PR_TempStringsFrame (prtempstrings_t *ts)
+{
+	if (!ts->chunks)
+		return;
+	if (ts->tail[1] >= 0)
+	{
+		ts->chunks[ts->tail[1]].next = ts->freechunks;
+		ts->freechunks = ts->head[1];
+	}
+	ts->head[1] = ts->head[0];
+	ts->tail[1] = ts->tail[0];
+	ts->head[0] = ts->tail[0] = -1;
+	ts->lastchunk = -1;
+
+	ts->peakallocs = q_max(ts->peakallocs, ts->frameallocs);
+	ts->peakbytes = q_max(ts->peakbytes, ts->framebytes);
+	ts->frameallocs = ts->framebytes = 0;
+}
+
+/*
+===============================================================================
+
+STRZONE POOL
+
+strzone'd strings up to 256 bytes come from per-size slabs instead of the zone.
+Each block starts with its size class so PR_StrzoneFree knows where to return it.
+
+===============================================================================
+*/
+
+#define PR_STRZONE_HEADER	8	//keeps the string itself 8-byte aligned
+#define PR_STRZONE_SLAB		16384
+#define PR_STRZONE_ZONED	0xff	//size class for strings too big for the pool
+
+struct prstrzoneblock_s
+{
+	struct prstrzoneblock_s	*next;
+};
+struct prstrzoneslab_s
+{
+	struct prstrzoneslab_s	*next;
+};
+
+static int PR_StrzoneClass (size_t size)
+{
+	int c;
+	for (c = 0; c < PR_STRZONE_CLASSES; c++)
+	{
+		if (size <= (16u<<c))
+			return c;
+	}
+	return PR_STRZONE_ZONED;
+}
+
+char *PR_StrzoneAlloc (size_t size)
+{
+	prstrzonepool_t *pool = &qcvm->strzonepool;
+	struct prstrzoneblock_s *block;
+	byte *mem;
+	int c = PR_StrzoneClass(size);
+	size_t blocksize, i;
+
+	pool->allocs++;
+	pool->live++;
+	if (c == PR_STRZONE_ZONED)
+	{
+		mem = (byte *) Z_Malloc(PR_STRZONE_HEADER + size);
+		mem[0] = PR_STRZONE_ZONED;
+		return (char *)(mem + PR_STRZONE_HEADER);
+	}
+
+	if (!pool->freelist[c])
+	{	//carve up a new slab
+		struct prstrzoneslab_s *slab = (struct prstrzoneslab_s *) malloc(PR_STRZONE_SLAB);
+		if (!slab)
+			Sys_Error ("PR_StrzoneAlloc: out of memory");
+		slab->next = pool->slabs;
+		pool->slabs = slab;
+		pool->slabbytes += PR_STRZONE_SLAB;
+
+		blocksize = PR_STRZONE_HEADER + (16u<<c);
+		for (i = PR_STRZONE_HEADER; i + blocksize <= PR_STRZONE_SLAB; i += blocksize)
+		{
+			block = (struct prstrzoneblock_s *)((byte *)slab + i + PR_STRZONE_HEADER);
+			((byte *)block)[-PR_STRZONE_HEADER] = c;
+			block->next = pool->freelist[c];
+			pool->freelist[c] = block;
+		}
+	}
+	block = pool->freelist[c];
+	pool->freelist[c] = block->next;
+	pool->pooled++;
+	memset(block, 0, 16u<<c);
+	return (char *)block;
+}
+
+void PR_StrzoneFree (char *s)
+{
+	prstrzonepool_t *pool = &qcvm->strzonepool;
+	struct prstrzoneblock_s *block = (struct prstrzoneblock_s *)s;
+	byte c = ((byte *)s)[-PR_STRZONE_HEADER];
+
+	pool->live--;
+	if (c == PR_STRZONE_ZONED)
+	{
+		Z_Free(s - PR_STRZONE_HEADER);
+		return;
+	}
+	block->next = pool->freelist[c];
+	pool->freelist[c] = block;
+}
+
+/*
+=================
+PR_StringsFrame
+
+Called once per host frame to age every vm's tempstrings.
+=================
+*/
+void PR_StringsFrame (void)
+{
+	PR_TempStringsFrame(&sv.qcvm.tempstrings);
+	PR_TempStringsFrame(&cl.qcvm.tempstrings);
+	PR_TempStringsFrame(&cls.menu_qcvm.tempstrings);
+}
+
+static void PR_StringsShutdown (void)
+{
+	prtempstrings_t *ts = &qcvm->tempstrings;
+	prstrzonepool_t *pool = &qcvm->strzonepool;
+	struct prstrzoneslab_s *slab;
+	int c;
+
+	for (c = 0; c < ts->numchunks; c++)
+		free(ts->chunks[c].data);
+	free(ts->chunks);
+	memset(ts, 0, sizeof(*ts));
+
+	while ((slab = pool->slabs))
+	{
+		pool->slabs = slab->next;
+		free(slab);
+	}
+	memset(pool, 0, sizeof(*pool));
+}
+
+/*
+=================
+PR_StringStats_f
+=================
+*/
+static void PR_StringStats_f (void)
+{
+	qcvm_t *vms[] = {&sv.qcvm, &cl.qcvm, &cls.menu_qcvm};
+	const char *names[] = {"ssqc", "csqc", "menuqc"};
+	prtempstrings_t *ts;
+	prstrzonepool_t *pool;
+	size_t i;
+
+	for (i = 0; i < countof(vms); i++)
+	{
+		if (!vms[i]->progs)
+			continue;
+		ts = &vms[i]->tempstrings;
+		pool = &vms[i]->strzonepool;
+		Con_Printf ("%s:\n", names[i]);
+		Con_Printf ("  tempstrings: %u total, %u this frame (%u bytes), peak %u/frame (%u bytes), %i chunks of %i bytes, %u reused early\n",
+			ts->allocs, ts->frameallocs, ts->framebytes, ts->peakallocs, ts->peakbytes, ts->numchunks, PR_TEMPSTRING_CHUNK, ts->recycled);
+		Con_Printf ("  strzone: %u total, %u from the pool, %u live, %u bytes of slabs\n",
+			pool->allocs, pool->pooled, pool->live, (unsigned)pool->slabbytes);
+		Con_Printf ("  engine string slots: %i of %i\n", vms[i]->numknownstrings, vms[i]->maxknownstrings);
+	}
+}
+
 const char *PR_GetString (int num)
 {
 	if (num >= 0 && num < qcvm->stringssize)
@@ -1494,6 +2575,15 @@ const char *PR_GetString (int num)
 		}
 		return qcvm->knownstrings[-1 - num];
 	}
+	else if (num >= PR_TEMPSTRING_BASE)
+	{
+		prtempstrings_t *ts = &qcvm->tempstrings;
+		int c = (num - PR_TEMPSTRING_BASE) >> PR_TEMPSTRING_CHUNKBITS;
+		int ofs = (num - PR_TEMPSTRING_BASE) & (PR_TEMPSTRING_CHUNK-1);
+		if (c < ts->numchunks && ofs < ts->chunks[c].used)
+			return ts->chunks[c].data + ofs;
+		return qcvm->strings;	//from a generation that has since been recycled
+	}
 	else
 	{
 		return qcvm->strings;
@@ -1526,11 +2616,28 @@ int PR_SetEngineString (const char *s)
 	if (s >= qcvm->strings && s <= qcvm->strings + qcvm->stringssize - 2)
 		return (int)(s - qcvm->strings);
 #endif
+	if ((i = PR_TempStringNum(s)) > 0)
+		return i;
 	for (i = 0; i < qcvm->numknownstrings; i++)
 	{
 		if (qcvm->knownstrings[i] == s)
 			return -1 - i;
 	}
+	return PR_NewEngineString(s);
+}
+
+/*
+=================
+PR_NewEngineString
+
+Gives a string a slot without first checking whether it already has one,
+for when the caller has only just allocated it.
+=================
+*/
+int PR_NewEngineString (const char *s)
+{
+	int		i;
+
 	// new unknown engine string
 	//Con_DPrintf ("PR_SetEngineString: new engine string %p\n", s);
 	for (i = qcvm->freeknownstrings; ; i++)
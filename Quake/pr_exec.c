@@ -311,6 +311,12 @@ static int PR_EnterFunction (dfunction_t *f)
 	}
 
 	qcvm->xfunction = f;
+
+	if (pr_jit.value && qcvm->mstatements)
+		PR_JIT_EnterFunction(f);	//count calls, and maybe compile it
+	if (qcvm->profiler)
+		PR_ProfileEnter(f);
+
 	return f->first_statement - 1;	// offset the s++
 }
 
@@ -335,6 +341,9 @@ static int PR_LeaveFunction (void)
 	for (i = 0; i < c; i++)
 		((int *)qcvm->globals)[qcvm->xfunction->parm_start + i] = qcvm->localstack[qcvm->localstack_used + i];
 
+	if (qcvm->profiler)
+		PR_ProfileLeave();
+
 	// up stack
 	qcvm->depth--;
 	qcvm->xfunction = qcvm->stack[qcvm->depth].f;
@@ -349,32 +358,39 @@ PR_ExecuteProgram
 The interpretation main loop
 ====================
 */
+#define PR_RUNAWAY_LIMIT	0x10000000	//spike -- was decimal 100000
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PR_THREADED_DISPATCH	//we can use gcc's labels-as-values extension for computed gotos.
+#endif
+
+cvar_t	pr_threaded = {"pr_threaded", "1", CVAR_NONE};	//0: portable switch-based interpreter. 1: computed-goto dispatch, where supported.
+cvar_t	pr_predecode = {"pr_predecode", "1", CVAR_NONE};	//translate statements into a pre-resolved form with superinstructions when progs are loaded. requires pr_threaded.
+
+//operands of the on-disk statements are offsets into the globals
 #define OPA ((eval_t *)&qcvm->globals[(unsigned short)st->a])
 #define OPB ((eval_t *)&qcvm->globals[(unsigned short)st->b])
 #define OPC ((eval_t *)&qcvm->globals[(unsigned short)st->c])
+#define OPIFJUMP		st->b
+#define OPGOTOJUMP		st->a
+#define OPSTATEMENTS	qcvm->statements
 
-void PR_ExecuteProgram (func_t fnum)
+/*
+====================
+PR_ExecuteSwitch
+
+The portable interpreter. Checks tracing and runaway loops on every statement.
+====================
+*/
+static void PR_ExecuteSwitch (dfunction_t *f)
 {
 	eval_t		*ptr;
 	dstatement_t	*st;
-	dfunction_t	*f, *newf;
+	dfunction_t	*newf;
 	int profile, startprofile;
 	edict_t		*ed;
 	int		exitdepth;
 
-	if (!fnum || fnum >= qcvm->progs->numfunctions)
-	{
-		if (pr_global_struct->self)
-			ED_Print (PROG_TO_EDICT(pr_global_struct->self));
-		Host_Error ("PR_ExecuteProgram: NULL function");
-	}
-
-	f = &qcvm->functions[fnum];
-
-	//FIXME: if this is a builtin, then we're going to crash.
-
-	qcvm->trace = false;
-
 // make a stack frame
 	exitdepth = qcvm->depth;
 
@@ -385,7 +401,7 @@ void PR_ExecuteProgram (func_t fnum)
     {
 	st++;	/* next statement */
 
-	if (++profile > 0x10000000)	//spike -- was decimal 100000
+	if (++profile > PR_RUNAWAY_LIMIT)
 	{
 		qcvm->xstatement = st - qcvm->statements;
 		PR_RunError("runaway loop error");
@@ -396,260 +412,596 @@ void PR_ExecuteProgram (func_t fnum)
 
 	switch (st->op)
 	{
-	case OP_ADD_F:
-		OPC->_float = OPA->_float + OPB->_float;
-		break;
-	case OP_ADD_V:
-		OPC->vector[0] = OPA->vector[0] + OPB->vector[0];
-		OPC->vector[1] = OPA->vector[1] + OPB->vector[1];
-		OPC->vector[2] = OPA->vector[2] + OPB->vector[2];
-		break;
+#define OPCODE(op)		case op:
+#define OPDEFAULT		default:
+#define OPNEXT			break
+#define OPJUMPED
+#define OPBUILTINDONE
+#include "pr_execloop.h"
+#undef OPCODE
+#undef OPDEFAULT
+#undef OPNEXT
+#undef OPJUMPED
+#undef OPBUILTINDONE
+	}
+    }	/* end of while(1) loop */
+}
 
-	case OP_SUB_F:
-		OPC->_float = OPA->_float - OPB->_float;
-		break;
-	case OP_SUB_V:
-		OPC->vector[0] = OPA->vector[0] - OPB->vector[0];
-		OPC->vector[1] = OPA->vector[1] - OPB->vector[1];
-		OPC->vector[2] = OPA->vector[2] - OPB->vector[2];
-		break;
+#ifdef PR_THREADED_DISPATCH
+#define PR_NUMOPS	(OP_BITOR+1)
+
+//table entries for the regular opcodes, followed by the handler for unknown opcodes.
+#define PR_OPTABLE_ENTRIES \
+	OPLABEL(OP_DONE),	\
+	OPLABEL(OP_MUL_F), OPLABEL(OP_MUL_V), OPLABEL(OP_MUL_FV), OPLABEL(OP_MUL_VF),	\
+	OPLABEL(OP_DIV_F),	\
+	OPLABEL(OP_ADD_F), OPLABEL(OP_ADD_V),	\
+	OPLABEL(OP_SUB_F), OPLABEL(OP_SUB_V),	\
+	OPLABEL(OP_EQ_F), OPLABEL(OP_EQ_V), OPLABEL(OP_EQ_S), OPLABEL(OP_EQ_E), OPLABEL(OP_EQ_FNC),	\
+	OPLABEL(OP_NE_F), OPLABEL(OP_NE_V), OPLABEL(OP_NE_S), OPLABEL(OP_NE_E), OPLABEL(OP_NE_FNC),	\
+	OPLABEL(OP_LE), OPLABEL(OP_GE), OPLABEL(OP_LT), OPLABEL(OP_GT),	\
+	OPLABEL(OP_LOAD_F), OPLABEL(OP_LOAD_V), OPLABEL(OP_LOAD_S), OPLABEL(OP_LOAD_ENT), OPLABEL(OP_LOAD_FLD), OPLABEL(OP_LOAD_FNC),	\
+	OPLABEL(OP_ADDRESS),	\
+	OPLABEL(OP_STORE_F), OPLABEL(OP_STORE_V), OPLABEL(OP_STORE_S), OPLABEL(OP_STORE_ENT), OPLABEL(OP_STORE_FLD), OPLABEL(OP_STORE_FNC),	\
+	OPLABEL(OP_STOREP_F), OPLABEL(OP_STOREP_V), OPLABEL(OP_STOREP_S), OPLABEL(OP_STOREP_ENT), OPLABEL(OP_STOREP_FLD), OPLABEL(OP_STOREP_FNC),	\
+	OPLABEL(OP_RETURN),	\
+	OPLABEL(OP_NOT_F), OPLABEL(OP_NOT_V), OPLABEL(OP_NOT_S), OPLABEL(OP_NOT_ENT), OPLABEL(OP_NOT_FNC),	\
+	OPLABEL(OP_IF), OPLABEL(OP_IFNOT),	\
+	OPLABEL(OP_CALL0), OPLABEL(OP_CALL1), OPLABEL(OP_CALL2), OPLABEL(OP_CALL3), OPLABEL(OP_CALL4), OPLABEL(OP_CALL5), OPLABEL(OP_CALL6), OPLABEL(OP_CALL7), OPLABEL(OP_CALL8),	\
+	OPLABEL(OP_STATE),	\
+	OPLABEL(OP_GOTO),	\
+	OPLABEL(OP_AND), OPLABEL(OP_OR),	\
+	OPLABEL(OP_BITAND), OPLABEL(OP_BITOR),	\
+	[PR_NUMOPS] = &&lbl_default
 
-	case OP_MUL_F:
-		OPC->_float = OPA->_float * OPB->_float;
-		break;
-	case OP_MUL_V:
-		OPC->_float = OPA->vector[0] * OPB->vector[0] +
-			      OPA->vector[1] * OPB->vector[1] +
-			      OPA->vector[2] * OPB->vector[2];
-		break;
-	case OP_MUL_FV:
-		OPC->vector[0] = OPA->_float * OPB->vector[0];
-		OPC->vector[1] = OPA->_float * OPB->vector[1];
-		OPC->vector[2] = OPA->_float * OPB->vector[2];
-		break;
-	case OP_MUL_VF:
-		OPC->vector[0] = OPB->_float * OPA->vector[0];
-		OPC->vector[1] = OPB->_float * OPA->vector[1];
-		OPC->vector[2] = OPB->_float * OPA->vector[2];
-		break;
+/*
+====================
+PR_ExecuteThreaded
 
-	case OP_DIV_F:
-		OPC->_float = OPA->_float / OPB->_float;
-		break;
+Jumps directly from one opcode's body to the next via a table of label addresses.
+Runaway loops can only happen via backwards jumps, so that's the only place we check for them.
+Tracing swaps in a second table that prints each statement before executing it, so there's no per-statement cost when its off.
+====================
+*/
+static void PR_ExecuteThreaded (dfunction_t *f)
+{
+	eval_t		*ptr;
+	dstatement_t	*st;
+	dfunction_t	*newf;
+	int profile, startprofile;
+	edict_t		*ed;
+	int		exitdepth;
+#define OPLABEL(op) [op] = &&lbl_##op
+	static void *const optable[PR_NUMOPS+1] = {PR_OPTABLE_ENTRIES};
+#undef OPLABEL
+	static void *const tracetable[PR_NUMOPS+1] = {[0 ... PR_NUMOPS] = &&lbl_trace};
+	void *const *table;
 
-	case OP_BITAND:
-		OPC->_float = (int)OPA->_float & (int)OPB->_float;
-		break;
+// make a stack frame
+	exitdepth = qcvm->depth;
 
-	case OP_BITOR:
-		OPC->_float = (int)OPA->_float | (int)OPB->_float;
-		break;
+	st = &qcvm->statements[PR_EnterFunction(f)];
+	startprofile = profile = 0;
+	table = qcvm->trace?tracetable:optable;
+
+#define OPINDEX			((st->op < PR_NUMOPS)?st->op:PR_NUMOPS)
+#define OPCODE(op)		lbl_##op:
+#define OPDEFAULT		lbl_default:
+#define OPNEXT			do { st++; profile++; goto *table[OPINDEX]; } while(0)
+#define OPJUMPED		do { if (profile > PR_RUNAWAY_LIMIT) { qcvm->xstatement = st - OPSTATEMENTS; PR_RunError("runaway loop error"); } } while(0)
+#define OPBUILTINDONE	table = qcvm->trace?tracetable:optable
+	OPNEXT;
+
+lbl_trace:
+	PR_PrintStatement(st);
+	goto *optable[OPINDEX];
+
+#include "pr_execloop.h"
+#undef OPINDEX
+#undef OPCODE
+#undef OPDEFAULT
+#undef OPNEXT
+#undef OPJUMPED
+#undef OPBUILTINDONE
+}
+#endif
+#undef OPA
+#undef OPB
+#undef OPC
+#undef OPIFJUMP
+#undef OPGOTOJUMP
+#undef OPSTATEMENTS
 
-	case OP_GE:
-		OPC->_float = OPA->_float >= OPB->_float;
-		break;
-	case OP_LE:
-		OPC->_float = OPA->_float <= OPB->_float;
-		break;
-	case OP_GT:
-		OPC->_float = OPA->_float > OPB->_float;
-		break;
-	case OP_LT:
-		OPC->_float = OPA->_float < OPB->_float;
-		break;
-	case OP_AND:
-		OPC->_float = OPA->_float && OPB->_float;
-		break;
-	case OP_OR:
-		OPC->_float = OPA->_float || OPB->_float;
-		break;
+#ifdef PR_THREADED_DISPATCH
+/*
+====================
+Pre-decoded statements
+
+PR_DecodeStatements translates qcvm->statements into qcvm->mstatements when progs are loaded.
+Each mstatement has its operands resolved into pointers, and common pairs of statements are
+fused into superinstructions that execute both halves without a second dispatch.
+The second statement of a fused pair is still decoded normally so that branches into it still
+work, which also keeps mstatements indexed exactly like qcvm->statements for xstatement,
+stack traces, profiling and PR_RunError.
+====================
+*/
 
-	case OP_NOT_F:
-		OPC->_float = !OPA->_float;
-		break;
-	case OP_NOT_V:
-		OPC->_float = !OPA->vector[0] && !OPA->vector[1] && !OPA->vector[2];
-		break;
-	case OP_NOT_S:
-		OPC->_float = !OPA->string || !*PR_GetString(OPA->string);
-		break;
-	case OP_NOT_FNC:
-		OPC->_float = !OPA->function;
-		break;
-	case OP_NOT_ENT:
-		OPC->_float = (PROG_TO_EDICT(OPA->edict) == qcvm->edicts);
-		break;
+//comparisons that can be fused with a following IF/IFNOT that tests their result
+#define PR_FUSEDCOMPARES \
+	FUSEDCOMPARE(EQ_F,		OPA->_float == OPB->_float)	\
+	FUSEDCOMPARE(NE_F,		OPA->_float != OPB->_float)	\
+	FUSEDCOMPARE(LE,		OPA->_float <= OPB->_float)	\
+	FUSEDCOMPARE(GE,		OPA->_float >= OPB->_float)	\
+	FUSEDCOMPARE(LT,		OPA->_float < OPB->_float)	\
+	FUSEDCOMPARE(GT,		OPA->_float > OPB->_float)	\
+	FUSEDCOMPARE(EQ_E,		OPA->_int == OPB->_int)	\
+	FUSEDCOMPARE(NE_E,		OPA->_int != OPB->_int)	\
+	FUSEDCOMPARE(EQ_FNC,	OPA->function == OPB->function)	\
+	FUSEDCOMPARE(NE_FNC,	OPA->function != OPB->function)	\
+	FUSEDCOMPARE(NOT_F,		!OPA->_float)	\
+	FUSEDCOMPARE(NOT_FNC,	!OPA->function)	\
+	FUSEDCOMPARE(NOT_ENT,	PROG_TO_EDICT(OPA->edict) == qcvm->edicts)	\
+	FUSEDCOMPARE(EQ_S,		!strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string)))	\
+	FUSEDCOMPARE(NE_S,		strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string)))	\
+	FUSEDCOMPARE(NOT_S,		!OPA->string || !*PR_GetString(OPA->string))	\
+	//end
+
+enum
+{
+	OPX_BAD = PR_NUMOPS,	//unknown opcode, reported when executed
+	OPX_LOAD_STORE,			//LOAD_F/S/ENT/FLD/FNC + STORE of the loaded value
+	OPX_LOADV_STOREV,		//LOAD_V + STORE_V of the loaded value
+	OPX_STORE_CALL,			//STORE_F/S/ENT/FLD/FNC + CALLn (ie: copying the final argument)
+	OPX_STOREV_CALL,		//STORE_V + CALLn
+	OPX_NATIVE,				//the statement has been compiled by pr_jit.c
+#define FUSEDCOMPARE(n,e) OPX_##n##_IF, OPX_##n##_IFNOT,
+	PR_FUSEDCOMPARES
+#undef FUSEDCOMPARE
+	OPX_NUMOPS
+};
 
-	case OP_EQ_F:
-		OPC->_float = OPA->_float == OPB->_float;
-		break;
-	case OP_EQ_V:
-		OPC->_float = (OPA->vector[0] == OPB->vector[0]) &&
-			      (OPA->vector[1] == OPB->vector[1]) &&
-			      (OPA->vector[2] == OPB->vector[2]);
-		break;
-	case OP_EQ_S:
-		OPC->_float = !strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string));
-		break;
-	case OP_EQ_E:
-		OPC->_float = OPA->_int == OPB->_int;
-		break;
-	case OP_EQ_FNC:
-		OPC->_float = OPA->function == OPB->function;
-		break;
+/*
+====================
+PR_FuseStatements
 
-	case OP_NE_F:
-		OPC->_float = OPA->_float != OPB->_float;
-		break;
-	case OP_NE_V:
-		OPC->_float = (OPA->vector[0] != OPB->vector[0]) ||
-			      (OPA->vector[1] != OPB->vector[1]) ||
-			      (OPA->vector[2] != OPB->vector[2]);
-		break;
-	case OP_NE_S:
-		OPC->_float = strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string));
-		break;
-	case OP_NE_E:
-		OPC->_float = OPA->_int != OPB->_int;
+Returns the superinstruction that performs st followed by next, or 0 if there isn't one.
+====================
+*/
+static unsigned int PR_FuseStatements (dstatement_t *st, dstatement_t *next)
+{
+	switch (st->op)
+	{
+	case OP_LOAD_F:
+	case OP_LOAD_S:
+	case OP_LOAD_ENT:
+	case OP_LOAD_FLD:
+	case OP_LOAD_FNC:
+		if ((next->op == OP_STORE_F || next->op == OP_STORE_S || next->op == OP_STORE_ENT || next->op == OP_STORE_FLD || next->op == OP_STORE_FNC) && next->a == st->c)
+			return OPX_LOAD_STORE;
 		break;
-	case OP_NE_FNC:
-		OPC->_float = OPA->function != OPB->function;
+	case OP_LOAD_V:
+		if (next->op == OP_STORE_V && next->a == st->c)
+			return OPX_LOADV_STOREV;
 		break;
-
 	case OP_STORE_F:
-	case OP_STORE_ENT:
-	case OP_STORE_FLD:	// integers
 	case OP_STORE_S:
-	case OP_STORE_FNC:	// pointers
-		OPB->_int = OPA->_int;
+	case OP_STORE_ENT:
+	case OP_STORE_FLD:
+	case OP_STORE_FNC:
+		if (next->op >= OP_CALL0 && next->op <= OP_CALL8)
+			return OPX_STORE_CALL;
 		break;
 	case OP_STORE_V:
-		OPB->vector[0] = OPA->vector[0];
-		OPB->vector[1] = OPA->vector[1];
-		OPB->vector[2] = OPA->vector[2];
+		if (next->op >= OP_CALL0 && next->op <= OP_CALL8)
+			return OPX_STOREV_CALL;
 		break;
+#define FUSEDCOMPARE(n,e) case OP_##n: if ((next->op == OP_IF || next->op == OP_IFNOT) && next->a == st->c) return (next->op == OP_IF)?OPX_##n##_IF:OPX_##n##_IFNOT; break;
+	PR_FUSEDCOMPARES
+#undef FUSEDCOMPARE
+	}
+	return 0;
+}
 
-	case OP_STOREP_F:
-	case OP_STOREP_ENT:
-	case OP_STOREP_FLD:	// integers
-	case OP_STOREP_S:
-	case OP_STOREP_FNC:	// pointers
-		ptr = (eval_t *)((byte *)qcvm->edicts + OPB->_int);
-		ptr->_int = OPA->_int;
-		break;
-	case OP_STOREP_V:
-		ptr = (eval_t *)((byte *)qcvm->edicts + OPB->_int);
-		ptr->vector[0] = OPA->vector[0];
-		ptr->vector[1] = OPA->vector[1];
-		ptr->vector[2] = OPA->vector[2];
-		break;
+/*
+====================
+PR_DecodeStatement
+====================
+*/
+static qboolean PR_DecodeStatement (int i)
+{
+	dstatement_t	*st = &qcvm->statements[i];
+	mstatement_t	*ms = &qcvm->mstatements[i];
+	unsigned int	fused;
+
+	ms->a = (eval_t *)&qcvm->globals[(unsigned short)st->a];
+	ms->b = (eval_t *)&qcvm->globals[(unsigned short)st->b];
+	ms->c = (eval_t *)&qcvm->globals[(unsigned short)st->c];
+	if (st->op == OP_IF || st->op == OP_IFNOT)
+		ms->jump = st->b;
+	else if (st->op == OP_GOTO)
+		ms->jump = st->a;
+	else
+		ms->jump = 0;
+
+	if (st->op >= PR_NUMOPS)
+		ms->op = OPX_BAD;
+	else if (i+1 < qcvm->progs->numstatements && (fused = PR_FuseStatements(st, st+1)))
+	{
+		ms->op = fused;
+		return true;
+	}
+	else
+		ms->op = st->op;
+	return false;
+}
+
+/*
+====================
+PR_DecodeStatements
+
+Called by PR_LoadProgs once the statements and globals are byte swapped.
+====================
+*/
+void PR_DecodeStatements (void)
+{
+	int				i, numfused;
 
-	case OP_ADDRESS:
+	free(qcvm->mstatements);
+	qcvm->mstatements = NULL;
+	if (!pr_predecode.value)
+		return;
+
+	qcvm->mstatements = (mstatement_t *) malloc(qcvm->progs->numstatements * sizeof(*qcvm->mstatements));
+	if (!qcvm->mstatements)
+		return;	//we can still use the regular interpreter.
+
+	for (i = 0, numfused = 0; i < qcvm->progs->numstatements; i++)
+		numfused += PR_DecodeStatement(i);
+	Con_DPrintf("%i of %i statements fused\n", numfused, qcvm->progs->numstatements);
+}
+
+/*
+====================
+PR_SetNativeStatement
+
+Used by pr_jit.c to route a statement to its native code, or to put it back to normal.
+====================
+*/
+void PR_SetNativeStatement (int statement, qboolean native)
+{
+	if (native)
+		qcvm->mstatements[statement].op = OPX_NATIVE;
+	else
+		PR_DecodeStatement(statement);
+}
+
+//operands of decoded statements are already pointers
+#define OPA				(st->a)
+#define OPB				(st->b)
+#define OPC				(st->c)
+#define OPIFJUMP		st->jump
+#define OPGOTOJUMP		st->jump
+#define OPSTATEMENTS	qcvm->mstatements
+
+/*
+====================
+PR_ExecuteDecoded
+
+PR_ExecuteThreaded, but for qcvm->mstatements.
+Superinstructions run their first half inline and then jump straight into the second half's handler.
+====================
+*/
+static void PR_ExecuteDecoded (dfunction_t *f)
+{
+	eval_t		*ptr;
+	mstatement_t	*st;
+	dfunction_t	*newf;
+	int profile, startprofile;
+	edict_t		*ed;
+	int		exitdepth;
+	int		cond;	//not qboolean, NE_S stores strcmp's signed result like the unfused opcode does
+#define OPLABEL(op) [op] = &&lbl_##op
+	static void *const optable[OPX_NUMOPS] =
+	{
+		PR_OPTABLE_ENTRIES,
+		OPLABEL(OPX_LOAD_STORE), OPLABEL(OPX_LOADV_STOREV),
+		OPLABEL(OPX_STORE_CALL), OPLABEL(OPX_STOREV_CALL),
+		OPLABEL(OPX_NATIVE),
+#define FUSEDCOMPARE(n,e) OPLABEL(OPX_##n##_IF), OPLABEL(OPX_##n##_IFNOT),
+		PR_FUSEDCOMPARES
+#undef FUSEDCOMPARE
+	};
+#undef OPLABEL
+	static void *const tracetable[OPX_NUMOPS] = {[0 ... OPX_NUMOPS-1] = &&lbl_trace};
+	void *const *table;
+
+// make a stack frame
+	exitdepth = qcvm->depth;
+
+	st = &qcvm->mstatements[PR_EnterFunction(f)];
+	startprofile = profile = 0;
+	table = qcvm->trace?tracetable:optable;
+
+#define OPCODE(op)		lbl_##op:
+#define OPDEFAULT		lbl_default:
+#define OPNEXT			do { st++; profile++; goto *table[st->op]; } while(0)
+#define OPJUMPED		do { if (profile > PR_RUNAWAY_LIMIT) { qcvm->xstatement = st - OPSTATEMENTS; PR_RunError("runaway loop error"); } } while(0)
+#define OPBUILTINDONE	table = qcvm->trace?tracetable:optable
+	OPNEXT;
+
+lbl_trace:	//print the original statement, and run it without any fusing so every statement gets printed
+	PR_PrintStatement(&qcvm->statements[st - qcvm->mstatements]);
+	goto *optable[(qcvm->statements[st - qcvm->mstatements].op < PR_NUMOPS)?qcvm->statements[st - qcvm->mstatements].op:OPX_BAD];
+
+lbl_OPX_NATIVE:	//run until the native code hits something it can't do, then resume interpreting from there.
+	if (profile > PR_RUNAWAY_LIMIT)
+	{
+		qcvm->xstatement = st - OPSTATEMENTS;
+		PR_RunError("runaway loop error");
+	}
+	profile--;	//the native code counts the statement we're on too.
+	st = &OPSTATEMENTS[PR_JIT_Run(st - OPSTATEMENTS, &profile)];
+	profile++;
+	if (st->op == OPX_NATIVE && table == optable)	//it bailed out part way through a statement, so run the original form of that one
+		goto *optable[qcvm->statements[st - OPSTATEMENTS].op];
+	goto *table[st->op];
+
+lbl_OPX_LOAD_STORE:
+	ed = PROG_TO_EDICT(OPA->edict);
+	OPC->_int = ((eval_t *)((int *)&ed->v + OPB->_int))->_int;
+	st++; profile++;
+	goto lbl_OP_STORE_F;
+lbl_OPX_LOADV_STOREV:
+	ed = PROG_TO_EDICT(OPA->edict);
+	ptr = (eval_t *)((int *)&ed->v + OPB->_int);
+	OPC->vector[0] = ptr->vector[0];
+	OPC->vector[1] = ptr->vector[1];
+	OPC->vector[2] = ptr->vector[2];
+	st++; profile++;
+	goto lbl_OP_STORE_V;
+lbl_OPX_STORE_CALL:
+	OPB->_int = OPA->_int;
+	st++; profile++;
+	goto lbl_OP_CALL0;
+lbl_OPX_STOREV_CALL:
+	OPB->vector[0] = OPA->vector[0];
+	OPB->vector[1] = OPA->vector[1];
+	OPB->vector[2] = OPA->vector[2];
+	st++; profile++;
+	goto lbl_OP_CALL0;
+#define FUSEDCOMPARE(n,e)	\
+lbl_OPX_##n##_IF:	\
+	cond = (e);	\
+	OPC->_float = cond;	\
+	st++; profile++;	\
+	if (cond) { st += OPIFJUMP - 1; OPJUMPED; }	\
+	OPNEXT;	\
+lbl_OPX_##n##_IFNOT:	\
+	cond = (e);	\
+	OPC->_float = cond;	\
+	st++; profile++;	\
+	if (!cond) { st += OPIFJUMP - 1; OPJUMPED; }	\
+	OPNEXT;
+	PR_FUSEDCOMPARES
+#undef FUSEDCOMPARE
+
+#include "pr_execloop.h"
+#undef OPCODE
+#undef OPDEFAULT
+#undef OPNEXT
+#undef OPJUMPED
+#undef OPBUILTINDONE
+}
+#undef OPA
+#undef OPB
+#undef OPC
+#undef OPIFJUMP
+#undef OPGOTOJUMP
+#undef OPSTATEMENTS
+
+/*
+====================
+PR_ExecuteSegment
+
+Interprets the original statements from the given one for as long as they've been compiled by
+pr_jit.c, returning the statement that the native code would have stopped at.
+This is the reference that pr_jit_verify compares the native code against.
+====================
+*/
+#define OPA ((eval_t *)&qcvm->globals[(unsigned short)st->a])
+#define OPB ((eval_t *)&qcvm->globals[(unsigned short)st->b])
+#define OPC ((eval_t *)&qcvm->globals[(unsigned short)st->c])
+#define OPIFJUMP		st->b
+#define OPGOTOJUMP		st->a
+#define OPSTATEMENTS	qcvm->statements
+static void PR_ExecuteSegmentInternal (int statement, int *inoutprofile, int *end)
+{
+	eval_t		*ptr;
+	dstatement_t	*st;
+	dfunction_t	*newf;
+	int profile, startprofile;
+	edict_t		*ed;
+	int		exitdepth;
+
+	exitdepth = qcvm->depth;
+	startprofile = profile = *inoutprofile;
+	st = &qcvm->statements[statement - 1];
+
+    while (1)
+    {
+	st++;
+	if (qcvm->mstatements[st - qcvm->statements].op != OPX_NATIVE)
+		break;
+	profile++;
+	if (st->op == OP_ADDRESS)
+	{	//the native code leaves the world check to the interpreter, so stop where it does
 		ed = PROG_TO_EDICT(OPA->edict);
-#ifdef PARANOID
-		NUM_FOR_EDICT(ed);	// Make sure it's in range
-#endif
 		if (ed == (edict_t *)qcvm->edicts && qcvm->worldlocked)
-		{
-			qcvm->xstatement = st - qcvm->statements;
-			PR_RunError("assignment to world entity");
-		}
-		OPC->_int = (byte *)((int *)&ed->v + OPB->_int) - (byte *)qcvm->edicts;
-		break;
+			break;
+	}
+	if (st->op == OP_STOREP_S && qcvm->findindex.numindexes)
+		break;	//and string stores while find() has indexes to flag
 
-	case OP_LOAD_F:
-	case OP_LOAD_FLD:
-	case OP_LOAD_ENT:
-	case OP_LOAD_S:
-	case OP_LOAD_FNC:
-		ed = PROG_TO_EDICT(OPA->edict);
-#ifdef PARANOID
-		NUM_FOR_EDICT(ed);	// Make sure it's in range
+	switch (st->op)
+	{
+#define OPCODE(op)		case op:
+#define OPDEFAULT		default:
+#define OPNEXT			break
+#define OPJUMPED		do { if (profile > PR_RUNAWAY_LIMIT) { st++; goto done; } } while(0)	//native code bails out at the target
+#define OPBUILTINDONE
+#include "pr_execloop.h"
+#undef OPCODE
+#undef OPDEFAULT
+#undef OPNEXT
+#undef OPJUMPED
+#undef OPBUILTINDONE
+	}
+    }
+done:
+	*end = st - qcvm->statements;
+	*inoutprofile = profile;
+	(void)startprofile;
+	(void)exitdepth;
+}
+#undef OPA
+#undef OPB
+#undef OPC
+#undef OPIFJUMP
+#undef OPGOTOJUMP
+#undef OPSTATEMENTS
+
+int PR_ExecuteSegment (int statement, int *profile)
+{
+	int end = statement;	//returns can't be compiled, so they never leave early
+	PR_ExecuteSegmentInternal(statement, profile, &end);
+	return end;
+}
+#else
+void PR_DecodeStatements (void)
+{	//nothing to decode for, the switch interpreter always reads the original statements.
+	qcvm->mstatements = NULL;
+}
 #endif
-		OPC->_int = ((eval_t *)((int *)&ed->v + OPB->_int))->_int;
-		break;
 
-	case OP_LOAD_V:
-		ed = PROG_TO_EDICT(OPA->edict);
-#ifdef PARANOID
-		NUM_FOR_EDICT(ed);	// Make sure it's in range
+void PR_ExecuteProgram (func_t fnum)
+{
+	dfunction_t	*f;
+
+	if (!fnum || fnum >= qcvm->progs->numfunctions)
+	{
+		if (pr_global_struct->self)
+			ED_Print (PROG_TO_EDICT(pr_global_struct->self));
+		Host_Error ("PR_ExecuteProgram: NULL function");
+	}
+
+	f = &qcvm->functions[fnum];
+
+	//FIXME: if this is a builtin, then we're going to crash.
+
+	qcvm->trace = false;
+
+#ifdef PR_THREADED_DISPATCH
+	if (pr_threaded.value)
+	{
+		if (qcvm->mstatements)
+			PR_ExecuteDecoded(f);
+		else
+			PR_ExecuteThreaded(f);
+	}
+	else
 #endif
-		ptr = (eval_t *)((int *)&ed->v + OPB->_int);
-		OPC->vector[0] = ptr->vector[0];
-		OPC->vector[1] = ptr->vector[1];
-		OPC->vector[2] = ptr->vector[2];
-		break;
+		PR_ExecuteSwitch(f);
+}
 
-	case OP_IFNOT:
-		if (!OPA->_int)
-			st += st->b - 1;	/* -1 to offset the st++ */
-		break;
+/*
+============
+PR_Benchmark_f
 
-	case OP_IF:
-		if (OPA->_int)
-			st += st->b - 1;	/* -1 to offset the st++ */
-		break;
+Runs a qc function over and over with each dispatch method and reports statements per second.
+Globals are restored between runs so each method sees the same inputs, but the function should
+avoid side effects (spawning, removing, etc) if you want exactly the same work done by each.
+============
+*/
+void PR_Benchmark_f (void)
+{
+	static const char *methodname[] = {"switch", "threaded", "decoded", "jit"};
+	dfunction_t	*f;
+	int			i, method, iterations, nummethods;
+	int			*savedglobals;
+	double		start, elapsed;
+	long long	statements;
+	float		oldthreaded, oldjit, oldjitthreshold;
+	mstatement_t	*decoded;
+
+	if (Cmd_Argc() < 2)
+	{
+		Con_Printf("usage: %s <function> [iterations]\n", Cmd_Argv(0));
+		return;
+	}
+	if (!sv.active)
+	{
+		Con_Printf("%s: server is not active\n", Cmd_Argv(0));
+		return;
+	}
+	iterations = (Cmd_Argc() > 2)?atoi(Cmd_Argv(2)):1000;
+	if (iterations < 1)
+		iterations = 1;
 
-	case OP_GOTO:
-		st += st->a - 1;		/* -1 to offset the st++ */
-		break;
+	PR_SwitchQCVM(&sv.qcvm);
 
-	case OP_CALL0:
-	case OP_CALL1:
-	case OP_CALL2:
-	case OP_CALL3:
-	case OP_CALL4:
-	case OP_CALL5:
-	case OP_CALL6:
-	case OP_CALL7:
-	case OP_CALL8:
-		qcvm->xfunction->profile += profile - startprofile;
-		startprofile = profile;
-		qcvm->xstatement = st - qcvm->statements;
-		qcvm->argc = st->op - OP_CALL0;
-		if (!OPA->function)
-			PR_RunError("NULL function");
-		newf = &qcvm->functions[OPA->function];
-		if (newf->first_statement <= 0)
-		{ // Built-in function
-			int i = -newf->first_statement;
-			if (i >= qcvm->numbuiltins)
-				i = 0;	//just invoke the fixme builtin.
-			qcvm->builtins[i]();
-			break;
-		}
-		// Normal function
-		st = &qcvm->statements[PR_EnterFunction(newf)];
-		break;
+	f = ED_FindFunction(Cmd_Argv(1));
+	if (!f || f->first_statement <= 0)
+	{
+		Con_Printf("%s: no qc function named \"%s\"\n", Cmd_Argv(0), Cmd_Argv(1));
+		PR_SwitchQCVM(NULL);
+		return;
+	}
 
-	case OP_DONE:
-	case OP_RETURN:
-		qcvm->xfunction->profile += profile - startprofile;
-		startprofile = profile;
-		qcvm->xstatement = st - qcvm->statements;
-		qcvm->globals[OFS_RETURN] = qcvm->globals[(unsigned short)st->a];
-		qcvm->globals[OFS_RETURN + 1] = qcvm->globals[(unsigned short)st->a + 1];
-		qcvm->globals[OFS_RETURN + 2] = qcvm->globals[(unsigned short)st->a + 2];
-		st = &qcvm->statements[PR_LeaveFunction()];
-		if (qcvm->depth == exitdepth)
-		{ // Done
-			return;
+#ifdef PR_THREADED_DISPATCH
+	nummethods = qcvm->mstatements?(PR_JIT_Supported()?4:3):2;
+#else
+	nummethods = 1;
+	Con_Printf("threaded dispatch is not supported by this build\n");
+#endif
+
+	savedglobals = (int *) malloc(qcvm->progs->numglobals * sizeof(int));
+	memcpy(savedglobals, qcvm->globals, qcvm->progs->numglobals * sizeof(int));
+	oldthreaded = pr_threaded.value;
+	oldjit = pr_jit.value;
+	oldjitthreshold = pr_jit_threshold.value;
+	decoded = qcvm->mstatements;
+
+	for (method = 0; method < nummethods; method++)
+	{
+		pr_threaded.value = !!method;	//temporarily, without notifying anything.
+		qcvm->mstatements = (method >= 2)?decoded:NULL;
+		pr_jit.value = (method == 3);	//previously compiled code gets flushed when the decoded method hits it
+		pr_jit_threshold.value = 1;
+
+		statements = 0;
+		for (i = 0; i < qcvm->progs->numfunctions; i++)
+			statements -= qcvm->functions[i].profile;
+
+		start = Sys_DoubleTime();
+		for (i = 0; i < iterations; i++)
+		{
+			memcpy(qcvm->globals, savedglobals, qcvm->progs->numglobals * sizeof(int));
+			PR_ExecuteProgram(f - qcvm->functions);
 		}
-		break;
+		elapsed = Sys_DoubleTime() - start;
 
-	case OP_STATE:
-		ed = PROG_TO_EDICT(pr_global_struct->self);
-		ed->v.nextthink = pr_global_struct->time + 0.1;
-		ed->v.frame = OPA->_float;
-		ed->v.think = OPB->function;
-		break;
+		for (i = 0; i < qcvm->progs->numfunctions; i++)
+			statements += qcvm->functions[i].profile;
 
-	default:
-		qcvm->xstatement = st - qcvm->statements;
-		PR_RunError("Bad opcode %i", st->op);
+		Con_Printf("%-8s: %i calls, %lli statements, %.3f secs, %.0f statements/sec\n", methodname[method], iterations, statements, elapsed, elapsed>0?statements/elapsed:0);
 	}
-    }	/* end of while(1) loop */
+
+	pr_threaded.value = oldthreaded;
+	pr_jit.value = oldjit;
+	pr_jit_threshold.value = oldjitthreshold;
+	qcvm->mstatements = decoded;
+	memcpy(qcvm->globals, savedglobals, qcvm->progs->numglobals * sizeof(int));
+	free(savedglobals);
+
+	PR_SwitchQCVM(NULL);
 }
-#undef OPA
-#undef OPB
-#undef OPC
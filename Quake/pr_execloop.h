@@ -0,0 +1,301 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+// pr_execloop.h -- the opcode bodies of the qc interpreter.
+// this file is included by pr_exec.c once per dispatch method, so it has no include guard.
+// the includer must define:
+//	OPA, OPB, OPC	- the eval_t pointers of the current statement's operands
+//	OPIFJUMP		- the branch offset of an IF/IFNOT statement
+//	OPGOTOJUMP		- the branch offset of a GOTO statement
+//	OPSTATEMENTS	- the array that st points into, indexed the same as qcvm->statements
+//	OPCODE(op)		- the entry point of the given opcode (a case label or a goto label)
+//	OPDEFAULT		- the entry point for unknown opcodes
+//	OPNEXT			- continues execution with the following statement
+//	OPJUMPED		- called after a branch was taken (used for runaway loop checks)
+//	OPBUILTINDONE	- called after a builtin returns (builtins can toggle tracing)
+// as well as the st, ptr, ed, newf, profile, startprofile and exitdepth locals.
+
+	OPCODE(OP_ADD_F)
+		OPC->_float = OPA->_float + OPB->_float;
+		OPNEXT;
+	OPCODE(OP_ADD_V)
+		OPC->vector[0] = OPA->vector[0] + OPB->vector[0];
+		OPC->vector[1] = OPA->vector[1] + OPB->vector[1];
+		OPC->vector[2] = OPA->vector[2] + OPB->vector[2];
+		OPNEXT;
+
+	OPCODE(OP_SUB_F)
+		OPC->_float = OPA->_float - OPB->_float;
+		OPNEXT;
+	OPCODE(OP_SUB_V)
+		OPC->vector[0] = OPA->vector[0] - OPB->vector[0];
+		OPC->vector[1] = OPA->vector[1] - OPB->vector[1];
+		OPC->vector[2] = OPA->vector[2] - OPB->vector[2];
+		OPNEXT;
+
+	OPCODE(OP_MUL_F)
+		OPC->_float = OPA->_float * OPB->_float;
+		OPNEXT;
+	OPCODE(OP_MUL_V)
+		OPC->_float = OPA->vector[0] * OPB->vector[0] +
+			      OPA->vector[1] * OPB->vector[1] +
+			      OPA->vector[2] * OPB->vector[2];
+		OPNEXT;
+	OPCODE(OP_MUL_FV)
+		OPC->vector[0] = OPA->_float * OPB->vector[0];
+		OPC->vector[1] = OPA->_float * OPB->vector[1];
+		OPC->vector[2] = OPA->_float * OPB->vector[2];
+		OPNEXT;
+	OPCODE(OP_MUL_VF)
+		OPC->vector[0] = OPB->_float * OPA->vector[0];
+		OPC->vector[1] = OPB->_float * OPA->vector[1];
+		OPC->vector[2] = OPB->_float * OPA->vector[2];
+		OPNEXT;
+
+	OPCODE(OP_DIV_F)
+		OPC->_float = OPA->_float / OPB->_float;
+		OPNEXT;
+
+	OPCODE(OP_BITAND)
+		OPC->_float = (int)OPA->_float & (int)OPB->_float;
+		OPNEXT;
+
+	OPCODE(OP_BITOR)
+		OPC->_float = (int)OPA->_float | (int)OPB->_float;
+		OPNEXT;
+
+	OPCODE(OP_GE)
+		OPC->_float = OPA->_float >= OPB->_float;
+		OPNEXT;
+	OPCODE(OP_LE)
+		OPC->_float = OPA->_float <= OPB->_float;
+		OPNEXT;
+	OPCODE(OP_GT)
+		OPC->_float = OPA->_float > OPB->_float;
+		OPNEXT;
+	OPCODE(OP_LT)
+		OPC->_float = OPA->_float < OPB->_float;
+		OPNEXT;
+	OPCODE(OP_AND)
+		OPC->_float = OPA->_float && OPB->_float;
+		OPNEXT;
+	OPCODE(OP_OR)
+		OPC->_float = OPA->_float || OPB->_float;
+		OPNEXT;
+
+	OPCODE(OP_NOT_F)
+		OPC->_float = !OPA->_float;
+		OPNEXT;
+	OPCODE(OP_NOT_V)
+		OPC->_float = !OPA->vector[0] && !OPA->vector[1] && !OPA->vector[2];
+		OPNEXT;
+	OPCODE(OP_NOT_S)
+		OPC->_float = !OPA->string || !*PR_GetString(OPA->string);
+		OPNEXT;
+	OPCODE(OP_NOT_FNC)
+		OPC->_float = !OPA->function;
+		OPNEXT;
+	OPCODE(OP_NOT_ENT)
+		OPC->_float = (PROG_TO_EDICT(OPA->edict) == qcvm->edicts);
+		OPNEXT;
+
+	OPCODE(OP_EQ_F)
+		OPC->_float = OPA->_float == OPB->_float;
+		OPNEXT;
+	OPCODE(OP_EQ_V)
+		OPC->_float = (OPA->vector[0] == OPB->vector[0]) &&
+			      (OPA->vector[1] == OPB->vector[1]) &&
+			      (OPA->vector[2] == OPB->vector[2]);
+		OPNEXT;
+	OPCODE(OP_EQ_S)
+		OPC->_float = !strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string));
+		OPNEXT;
+	OPCODE(OP_EQ_E)
+		OPC->_float = OPA->_int == OPB->_int;
+		OPNEXT;
+	OPCODE(OP_EQ_FNC)
+		OPC->_float = OPA->function == OPB->function;
+		OPNEXT;
+
+	OPCODE(OP_NE_F)
+		OPC->_float = OPA->_float != OPB->_float;
+		OPNEXT;
+	OPCODE(OP_NE_V)
+		OPC->_float = (OPA->vector[0] != OPB->vector[0]) ||
+			      (OPA->vector[1] != OPB->vector[1]) ||
+			      (OPA->vector[2] != OPB->vector[2]);
+		OPNEXT;
+	OPCODE(OP_NE_S)
+		OPC->_float = strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string));
+		OPNEXT;
+	OPCODE(OP_NE_E)
+		OPC->_float = OPA->_int != OPB->_int;
+		OPNEXT;
+	OPCODE(OP_NE_FNC)
+		OPC->_float = OPA->function != OPB->function;
+		OPNEXT;
+
+	OPCODE(OP_STORE_F)
+	OPCODE(OP_STORE_ENT)
+	OPCODE(OP_STORE_FLD)	// integers
+	OPCODE(OP_STORE_S)
+	OPCODE(OP_STORE_FNC)	// pointers
+		OPB->_int = OPA->_int;
+		OPNEXT;
+	OPCODE(OP_STORE_V)
+		OPB->vector[0] = OPA->vector[0];
+		OPB->vector[1] = OPA->vector[1];
+		OPB->vector[2] = OPA->vector[2];
+		OPNEXT;
+
+	OPCODE(OP_STOREP_F)
+	OPCODE(OP_STOREP_ENT)
+	OPCODE(OP_STOREP_FLD)	// integers
+	OPCODE(OP_STOREP_FNC)	// pointers
+		ptr = (eval_t *)((byte *)qcvm->edicts + OPB->_int);
+		ptr->_int = OPA->_int;
+		OPNEXT;
+	OPCODE(OP_STOREP_S)
+		ptr = (eval_t *)((byte *)qcvm->edicts + OPB->_int);
+		ptr->_int = OPA->_int;
+		ED_FINDINDEX_TOUCHPTR(OPB->_int);	//not at OP_ADDRESS, qcc takes the address before evaluating the value, which may call find()
+		OPNEXT;
+	OPCODE(OP_STOREP_V)
+		ptr = (eval_t *)((byte *)qcvm->edicts + OPB->_int);
+		ptr->vector[0] = OPA->vector[0];
+		ptr->vector[1] = OPA->vector[1];
+		ptr->vector[2] = OPA->vector[2];
+		OPNEXT;
+
+	OPCODE(OP_ADDRESS)
+		ed = PROG_TO_EDICT(OPA->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		if (ed == (edict_t *)qcvm->edicts && qcvm->worldlocked)
+		{
+			qcvm->xstatement = st - OPSTATEMENTS;
+			PR_RunError("assignment to world entity");
+		}
+		OPC->_int = (byte *)((int *)&ed->v + OPB->_int) - (byte *)qcvm->edicts;
+		OPNEXT;
+
+	OPCODE(OP_LOAD_F)
+	OPCODE(OP_LOAD_FLD)
+	OPCODE(OP_LOAD_ENT)
+	OPCODE(OP_LOAD_S)
+	OPCODE(OP_LOAD_FNC)
+		ed = PROG_TO_EDICT(OPA->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		OPC->_int = ((eval_t *)((int *)&ed->v + OPB->_int))->_int;
+		OPNEXT;
+
+	OPCODE(OP_LOAD_V)
+		ed = PROG_TO_EDICT(OPA->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		ptr = (eval_t *)((int *)&ed->v + OPB->_int);
+		OPC->vector[0] = ptr->vector[0];
+		OPC->vector[1] = ptr->vector[1];
+		OPC->vector[2] = ptr->vector[2];
+		OPNEXT;
+
+	OPCODE(OP_IFNOT)
+		if (!OPA->_int)
+		{
+			st += OPIFJUMP - 1;	/* -1 to offset the st++ */
+			OPJUMPED;
+		}
+		OPNEXT;
+
+	OPCODE(OP_IF)
+		if (OPA->_int)
+		{
+			st += OPIFJUMP - 1;	/* -1 to offset the st++ */
+			OPJUMPED;
+		}
+		OPNEXT;
+
+	OPCODE(OP_GOTO)
+		st += OPGOTOJUMP - 1;		/* -1 to offset the st++ */
+		OPJUMPED;
+		OPNEXT;
+
+	OPCODE(OP_CALL0)
+	OPCODE(OP_CALL1)
+	OPCODE(OP_CALL2)
+	OPCODE(OP_CALL3)
+	OPCODE(OP_CALL4)
+	OPCODE(OP_CALL5)
+	OPCODE(OP_CALL6)
+	OPCODE(OP_CALL7)
+	OPCODE(OP_CALL8)
+		qcvm->xfunction->profile += profile - startprofile;
+		startprofile = profile;
+		qcvm->xstatement = st - OPSTATEMENTS;
+		qcvm->argc = st->op - OP_CALL0;
+		if (!OPA->function)
+			PR_RunError("NULL function");
+		newf = &qcvm->functions[OPA->function];
+		if (newf->first_statement <= 0)
+		{ // Built-in function
+			int i = -newf->first_statement;
+			if (i >= qcvm->numbuiltins)
+				i = 0;	//just invoke the fixme builtin.
+			if (qcvm->profiler)
+				PR_ProfileBuiltin(newf, qcvm->builtins[i]);
+			else
+				qcvm->builtins[i]();
+			OPBUILTINDONE;
+			OPNEXT;
+		}
+		// Normal function
+		st = &OPSTATEMENTS[PR_EnterFunction(newf)];
+		OPNEXT;
+
+	OPCODE(OP_DONE)
+	OPCODE(OP_RETURN)
+		qcvm->xfunction->profile += profile - startprofile;
+		startprofile = profile;
+		qcvm->xstatement = st - OPSTATEMENTS;
+		qcvm->globals[OFS_RETURN] = OPA->vector[0];
+		qcvm->globals[OFS_RETURN + 1] = OPA->vector[1];
+		qcvm->globals[OFS_RETURN + 2] = OPA->vector[2];
+		st = &OPSTATEMENTS[PR_LeaveFunction()];
+		if (qcvm->depth == exitdepth)
+		{ // Done
+			return;
+		}
+		OPNEXT;
+
+	OPCODE(OP_STATE)
+		ed = PROG_TO_EDICT(pr_global_struct->self);
+		ed->v.nextthink = pr_global_struct->time + 0.1;
+		ed->v.frame = OPA->_float;
+		ed->v.think = OPB->function;
+		OPNEXT;
+
+	OPDEFAULT
+		qcvm->xstatement = st - OPSTATEMENTS;
+		PR_RunError("Bad opcode %i", qcvm->statements[qcvm->xstatement].op);
@@ -71,13 +71,6 @@ static void SV_Multicast(multicast_t to, float *org, int msg_entity, unsigned in
 #define Z_StrDup(s) strcpy(Z_Malloc(strlen(s)+1), s)
 #define	RETURN_EDICT(e) (((int *)qcvm->globals)[OFS_RETURN] = EDICT_TO_PROG(e))
 
-int PR_MakeTempString (const char *val)
-{
-	char *tmp = PR_GetTempString();
-	q_strlcpy(tmp, val, STRINGTEMP_LENGTH);
-	return PR_SetEngineString(tmp);
-}
-
 #define ishex(c) ((c>='0' && c<= '9') || (c>='a' && c<='f') || (c>='A' && c<='F'))
 static int dehex(char c)
 {
@@ -433,7 +426,7 @@ static void PF_strcat(void)
 		}
 	}
 
-	G_INT(OFS_RETURN) = PR_SetEngineString(out);
+	G_INT(OFS_RETURN) = PR_CommitTempString(out, strlen(out));
 }
 static void PF_substring(void)
 {
@@ -478,7 +471,7 @@ static void PF_substring(void)
 	string = PR_GetTempString();
 	memcpy(string, s, length);
 	string[length] = '\0';
-	G_INT(OFS_RETURN) = PR_SetEngineString(string);
+	G_INT(OFS_RETURN) = PR_CommitTempString(string, length);
 }
 /*our zoned strings implementation is somewhat specific to quakespasm, so good luck porting*/
 static void PF_strzone(void)
@@ -498,8 +491,8 @@ static void PF_strzone(void)
 	}
 	len++; /*for the null*/
 
-	buf = Z_Malloc(len);
-	G_INT(OFS_RETURN) = PR_SetEngineString(buf);
+	buf = PR_StrzoneAlloc(len);
+	G_INT(OFS_RETURN) = PR_NewEngineString(buf);
 	id = -1-G_INT(OFS_RETURN);
 	if (id >= qcvm->knownzonesize)
 	{
@@ -527,7 +520,7 @@ static void PF_strunzone(void)
 	{
 		qcvm->knownzone[id>>3] &= ~(1u<<(id&7));
 		PR_ClearEngineString(G_INT(OFS_PARM0));
-		Z_Free((void*)foo);
+		PR_StrzoneFree((char*)foo);
 	}
 	else
 		Con_Warning("PF_strunzone: string wasn't strzoned\n");
@@ -542,7 +535,7 @@ static void PR_UnzoneAll(void)
 			string_t s = -1-(int)id;
 			char *ptr = (char*)PR_GetString(s);
 			PR_ClearEngineString(s);
-			Z_Free(ptr);
+			PR_StrzoneFree(ptr);
 		}
 	}	
 	if (qcvm->knownzone)
@@ -584,7 +577,7 @@ static void PF_chr2str(void)
 			*out++ = '?';	//no unicode support
 	}
 	*out = 0;
-	G_INT(OFS_RETURN) = PR_SetEngineString(ret);
+	G_INT(OFS_RETURN) = PR_CommitTempString(ret, out-ret);
 }
 //part of PF_strconv
 static int chrconv_number(int i, int base, int conv)
@@ -715,7 +708,7 @@ static void PF_strconv (void)
 	}
 	*result = '\0';
 
-	G_INT(OFS_RETURN) = PR_SetEngineString((char*)resbuf);
+	G_INT(OFS_RETURN) = PR_CommitTempString((char*)resbuf, result-resbuf);
 }
 static void PF_strpad(void)
 {
@@ -756,7 +749,7 @@ static void PF_strpad(void)
 		*dest = '\0';
 	}
 
-	G_INT(OFS_RETURN) = PR_SetEngineString(destbuf);
+	G_INT(OFS_RETURN) = PR_CommitTempString(destbuf, strlen(destbuf));
 }
 static void PF_infoadd(void)
 {
@@ -828,7 +821,7 @@ static void PF_infoadd(void)
 	}
 
 	*o = 0;
-	G_INT(OFS_RETURN) = PR_SetEngineString(destbuf);
+	G_INT(OFS_RETURN) = PR_CommitTempString(destbuf, o-destbuf);
 }
 static void PF_infoget(void)
 {
@@ -849,10 +842,10 @@ static void PF_infoget(void)
 			//this is the old value for the key. copy it to the result
 			while (*info && *info != '\\' && o < e)
 				*o++ = *info++;
-			*o++ = 0;
+			*o = 0;
 
 			//success!
-			G_INT(OFS_RETURN) = PR_SetEngineString(destbuf);
+			G_INT(OFS_RETURN) = PR_CommitTempString(destbuf, o-destbuf);
 			return;
 		}
 		else
@@ -953,12 +946,11 @@ static void PF_strtrim(void)
 	memcpy(news, str, len);
 	news[len] = 0;
 
-	G_INT(OFS_RETURN) = PR_SetEngineString(news);
+	G_INT(OFS_RETURN) = PR_CommitTempString(news, len);
 }
 static void PF_strreplace(void)
 {
-	char *resultbuf = PR_GetTempString();
-	char *result = resultbuf;
+	char *resultbuf, *result;
 	const char *search = G_STRING(OFS_PARM0);
 	const char *replace = G_STRING(OFS_PARM1);
 	const char *subject = G_STRING(OFS_PARM2);
@@ -967,6 +959,7 @@ static void PF_strreplace(void)
 
 	if (searchlen)
 	{
+		result = resultbuf = PR_GetTempString();
 		while (*subject && result < resultbuf + STRINGTEMP_LENGTH - replacelen - 2)
 		{
 			if (!strncmp(subject, search, searchlen))
@@ -979,15 +972,14 @@ static void PF_strreplace(void)
 				*result++ = *subject++;
 		}
 		*result = 0;
-		G_INT(OFS_RETURN) = PR_SetEngineString(resultbuf);
+		G_INT(OFS_RETURN) = PR_CommitTempString(resultbuf, result-resultbuf);
 	}
 	else
 		G_INT(OFS_RETURN) = PR_SetEngineString(subject);
 }
 static void PF_strireplace(void)
 {
-	char *resultbuf = PR_GetTempString();
-	char *result = resultbuf;
+	char *resultbuf, *result;
 	const char *search = G_STRING(OFS_PARM0);
 	const char *replace = G_STRING(OFS_PARM1);
 	const char *subject = G_STRING(OFS_PARM2);
@@ -996,6 +988,7 @@ static void PF_strireplace(void)
 
 	if (searchlen)
 	{
+		result = resultbuf = PR_GetTempString();
 		while (*subject && result < resultbuf + sizeof(resultbuf) - replacelen - 2)
 		{
 			//UTF-8-FIXME: case insensitivity is awkward...
@@ -1009,7 +1002,7 @@ static void PF_strireplace(void)
 				*result++ = *subject++;
 		}
 		*result = 0;
-		G_INT(OFS_RETURN) = PR_SetEngineString(resultbuf);
+		G_INT(OFS_RETURN) = PR_CommitTempString(resultbuf, result-resultbuf);
 	}
 	else
 		G_INT(OFS_RETURN) = PR_SetEngineString(subject);
@@ -1425,7 +1418,7 @@ static void PF_sprintf(void)
 {
 	char *outbuf = PR_GetTempString();
 	PF_sprintf_internal(G_STRING(OFS_PARM0), 1, outbuf, STRINGTEMP_LENGTH);
-	G_INT(OFS_RETURN) = PR_SetEngineString(outbuf);
+	G_INT(OFS_RETURN) = PR_CommitTempString(outbuf, strlen(outbuf));
 }
 
 //string tokenizing (gah)
@@ -1600,11 +1593,7 @@ static void PF_ArgV(void)
 	if ((unsigned int)idx >= qctoken_count)
 		G_INT(OFS_RETURN) = 0;
 	else
-	{
-		char *ret = PR_GetTempString();
-		q_strlcpy(ret, qctoken[idx].token, STRINGTEMP_LENGTH);
-		G_INT(OFS_RETURN) = PR_SetEngineString(ret);
-	}
+		G_INT(OFS_RETURN) = PR_MakeTempString(qctoken[idx].token);
 }
 
 //conversions (mostly string)
@@ -1615,7 +1604,7 @@ static void PF_strtoupper(void)
 	for (out = result; *in && out < result+STRINGTEMP_LENGTH-1;)
 		*out++ = q_toupper(*in++);
 	*out = 0;
-	G_INT(OFS_RETURN) = PR_SetEngineString(result);
+	G_INT(OFS_RETURN) = PR_CommitTempString(result, out-result);
 }
 static void PF_strtolower(void)
 {
@@ -1624,7 +1613,7 @@ static void PF_strtolower(void)
 	for (out = result; *in && out < result+STRINGTEMP_LENGTH-1;)
 		*out++ = q_tolower(*in++);
 	*out = 0;
-	G_INT(OFS_RETURN) = PR_SetEngineString(result);
+	G_INT(OFS_RETURN) = PR_CommitTempString(result, out-result);
 }
 #include <time.h>
 static void PF_strftime(void)
@@ -1650,9 +1639,10 @@ static void PF_strftime(void)
 		in = "%Y-%m-%d";
 #endif
 
-	strftime(result, STRINGTEMP_LENGTH, in, tm);
+	if (!strftime(result, STRINGTEMP_LENGTH, in, tm))
+		*result = 0;	//contents are undefined when it doesn't fit
 
-	G_INT(OFS_RETURN) = PR_SetEngineString(result);
+	G_INT(OFS_RETURN) = PR_CommitTempString(result, strlen(result));
 }
 static void PF_stof(void)
 {
@@ -1675,14 +1665,14 @@ static void PF_stoi(void)
 static void PF_itos(void)
 {
 	char *result = PR_GetTempString();
-	q_snprintf(result, STRINGTEMP_LENGTH, "%i", G_INT(OFS_PARM0));
-	G_INT(OFS_RETURN) = PR_SetEngineString(result);
+	int len = q_snprintf(result, STRINGTEMP_LENGTH, "%i", G_INT(OFS_PARM0));
+	G_INT(OFS_RETURN) = PR_CommitTempString(result, len);
 }
 static void PF_etos(void)
 {	//yes, this is lame
 	char *result = PR_GetTempString();
-	q_snprintf(result, STRINGTEMP_LENGTH, "entity %i", G_EDICTNUM(OFS_PARM0));
-	G_INT(OFS_RETURN) = PR_SetEngineString(result);
+	int len = q_snprintf(result, STRINGTEMP_LENGTH, "entity %i", G_EDICTNUM(OFS_PARM0));
+	G_INT(OFS_RETURN) = PR_CommitTempString(result, len);
 }
 static void PF_stoh(void)
 {
@@ -1691,8 +1681,8 @@ static void PF_stoh(void)
 static void PF_htos(void)
 {
 	char *result = PR_GetTempString();
-	q_snprintf(result, STRINGTEMP_LENGTH, "%x", G_INT(OFS_PARM0));
-	G_INT(OFS_RETURN) = PR_SetEngineString(result);
+	int len = q_snprintf(result, STRINGTEMP_LENGTH, "%x", G_INT(OFS_PARM0));
+	G_INT(OFS_RETURN) = PR_CommitTempString(result, len);
 }
 static void PF_ftoi(void)
 {
@@ -2179,6 +2169,7 @@ static void PF_sv_setmodelindex(void)
 	qmodel_t *mod = qcvm->GetModel(newidx);
 	e->v.model = (newidx<MAX_MODELS)?PR_SetEngineString(sv.model_precache[newidx]):0;
 	e->v.modelindex = newidx;
+	ED_FindIndexTouchEdict (e);
 
 	if (mod)
 	//johnfitz -- correct physics cullboxes for bmodels
@@ -2199,6 +2190,7 @@ static void PF_cl_setmodelindex(void)
 	qmodel_t *mod = qcvm->GetModel(newidx);
 	e->v.model = mod?PR_SetEngineString(mod->name):0;	//FIXME: is this going to cause issues with vid_restart?
 	e->v.modelindex = newidx;
+	ED_FindIndexTouchEdict (e);
 
 	if (mod)
 	//johnfitz -- correct physics cullboxes for bmodels
@@ -2658,6 +2650,7 @@ static void PF_spawnclient(void)
 			ent->v.colormap = NUM_FOR_EDICT(ent);
 			ent->v.team = (svs.clients[i].colors & 15) + 1;
 			ent->v.netname = PR_SetEngineString(svs.clients[i].name);
+			ED_FindIndexTouchEdict (ent);
 			RETURN_EDICT(ent);
 			return;
 		}
@@ -2693,15 +2686,11 @@ static void PF_cvar_string(void)
 		//cvars can easily change values.
 		//this would result in leaks/exploits/slowdowns if the qc spams calls to cvar_string+changes.
 		//so keep performance consistent, even if this is going to be slower.
-		char *temp = PR_GetTempString();
-		q_strlcpy(temp, var->string, STRINGTEMP_LENGTH);
-		G_INT(OFS_RETURN) = PR_SetEngineString(temp);
+		G_INT(OFS_RETURN) = PR_MakeTempString(var->string);
 	}
 	else if (!strcmp(name, "game"))
 	{	//game looks like a cvar in most other respects (and is a cvar in fte). let cvar_string work on it as a way to find out the current gamedir.
-		char *temp = PR_GetTempString();
-		q_strlcpy(temp, COM_GetGameNames(true), STRINGTEMP_LENGTH);
-		G_INT(OFS_RETURN) = PR_SetEngineString(temp);
+		G_INT(OFS_RETURN) = PR_MakeTempString(COM_GetGameNames(true));
 	}
 	else
 		G_INT(OFS_RETURN) = 0;
@@ -3421,7 +3410,7 @@ static void PF_fgets(void)
 		if (s > ret && s[-1] == '\r')
 			s--;	//terminate it on the \r of a \r\n pair.
 		*s = 0;	//terminate it
-		G_INT(OFS_RETURN) = PR_SetEngineString(ret);
+		G_INT(OFS_RETURN) = PR_CommitTempString(ret, s-ret);
 	}
 }
 static void PF_fputs(void)
@@ -3682,8 +3671,9 @@ static void PF_search_getfilemtime(void)
 		return; //erk
 
 	ret = PR_GetTempString();
-	strftime(ret, STRINGTEMP_LENGTH, "%Y-%m-%d %H:%M:%S", localtime(&searches[handle].file[index].mtime));
-	G_INT(OFS_RETURN) = PR_SetEngineString(ret);
+	if (!strftime(ret, STRINGTEMP_LENGTH, "%Y-%m-%d %H:%M:%S", localtime(&searches[handle].file[index].mtime)))
+		*ret = 0;
+	G_INT(OFS_RETURN) = PR_CommitTempString(ret, strlen(ret));
 }
 static void PF_search_getpackagename(void)
 {
@@ -3981,14 +3971,13 @@ static void PF_buf_implode(void)
 
 	//add the null and return
 	ret[retlen] = 0;
-	G_INT(OFS_RETURN) = PR_SetEngineString(ret);
+	G_INT(OFS_RETURN) = PR_CommitTempString(ret, retlen);
 }
 // #446 string(float bufhandle, float string_index) bufstr_get (DP_QC_STRINGBUFFERS)
 static void PF_bufstr_get(void)
 {
 	unsigned int bufno = G_FLOAT(OFS_PARM0)-BUFSTRBASE;
 	unsigned int index = G_FLOAT(OFS_PARM1);
-	char *ret;
 
 	if (bufno >= NUMSTRINGBUFS)
 	{
@@ -4008,11 +3997,7 @@ static void PF_bufstr_get(void)
 	}
 
 	if (strbuflist[bufno].strings[index])
-	{
-		ret = PR_GetTempString();
-		q_strlcpy(ret, strbuflist[bufno].strings[index], STRINGTEMP_LENGTH);
-		G_INT(OFS_RETURN) = PR_SetEngineString(ret);
-	}
+		G_INT(OFS_RETURN) = PR_MakeTempString(strbuflist[bufno].strings[index]);
 	else
 		G_INT(OFS_RETURN) = 0;
 }
@@ -4248,6 +4233,7 @@ static void PF_copyentity(void)
 	if (src->free || dst->free)
 		Con_Printf("PF_copyentity: entity is free\n");
 	memcpy(&dst->v, &src->v, qcvm->edict_size - sizeof(entvars_t));
+	ED_FindIndexTouchEdict (dst);
 	dst->alpha = src->alpha;
 	dst->sendinterval = src->sendinterval;
 	SV_LinkEdict(dst, false);
@@ -4278,6 +4264,18 @@ static void PF_findchain(void)
 	else
 		cfld = &ent->v.chain - (int*)&ent->v;
 
+	for (i = ED_FindIndexLookup(f, s, 0); i > 0; i = ED_FindIndexLookup(f, s, i))
+	{
+		ent = EDICT_NUM(i);
+		((int*)&ent->v)[cfld] = EDICT_TO_PROG(chain);
+		chain = ent;
+	}
+	if (i == 0)
+	{
+		RETURN_EDICT(chain);
+		return;
+	}
+
 	ent = NEXT_EDICT(qcvm->edicts);
 	for (i = 1; i < qcvm->num_edicts; i++, ent = NEXT_EDICT(ent))
 	{
@@ -4446,10 +4444,8 @@ static void PF_getentfldstr(void)
 	edict_t *ent = G_EDICT(OFS_PARM1);
 	if (fldidx < (unsigned int)qcvm->progs->numfielddefs)
 	{
-		char *ret = PR_GetTempString();
 		const char *val = PR_UglyValueString (qcvm->fielddefs[fldidx].type, (eval_t*)((float*)&ent->v + qcvm->fielddefs[fldidx].ofs));
-		q_strlcpy(ret, val, STRINGTEMP_LENGTH);
-		G_INT(OFS_RETURN) = PR_SetEngineString(ret);
+		G_INT(OFS_RETURN) = PR_MakeTempString(val);
 	}
 	else
 		G_INT(OFS_RETURN) = 0;
@@ -4460,7 +4456,10 @@ static void PF_putentfldstr(void)
 	edict_t *ent = G_EDICT(OFS_PARM1);
 	const char *value = G_STRING(OFS_PARM2);
 	if (fldidx < (unsigned int)qcvm->progs->numfielddefs)
+	{
 		G_FLOAT(OFS_RETURN) = ED_ParseEpair ((void *)&ent->v, qcvm->fielddefs+fldidx, value, true);
+		ED_FindIndexTouch (ent, qcvm->fielddefs[fldidx].ofs);
+	}
 	else
 		G_FLOAT(OFS_RETURN) = false;
 }
@@ -4653,11 +4652,7 @@ static void PF_infokey_internal(qboolean returnfloat)
 	else
 	{
 		if (r)
-		{
-			char *temp = PR_GetTempString();
-			q_strlcpy(temp, r, STRINGTEMP_LENGTH);
-			G_INT(OFS_RETURN) = PR_SetEngineString(temp);
-		}
+			G_INT(OFS_RETURN) = PR_MakeTempString(r);
 		else
 			G_INT(OFS_RETURN) = 0;
 	}
@@ -4806,7 +4801,7 @@ static void PF_uri_escape(void)
 		}
 	}
 	*o = 0;
-	G_INT(OFS_RETURN) = PR_SetEngineString(result);
+	G_INT(OFS_RETURN) = PR_CommitTempString(result, o-result);
 }
 static void PF_uri_unescape(void)
 {
@@ -4849,7 +4844,7 @@ static void PF_uri_unescape(void)
 			*o++ = *i++;
 	}
 	*o = 0;
-	G_INT(OFS_RETURN) = PR_SetEngineString(resultbuf);
+	G_INT(OFS_RETURN) = PR_CommitTempString(resultbuf, o-resultbuf);
 }
 static void PF_crc16(void)
 {
@@ -4877,6 +4872,7 @@ static void PF_digest_hex(void)
 	static const char *hex = "0123456789ABCDEF";
 	char *resultbuf;
 	byte hashdata[20];
+	size_t i;
 
 	if (!strcmp(hashtype, "CRC16"))
 	{
@@ -4898,15 +4894,14 @@ static void PF_digest_hex(void)
 	}
 
 	resultbuf = PR_GetTempString();
-	G_INT(OFS_RETURN) = PR_SetEngineString(resultbuf);
 	data = hashdata;
-	while (len --> 0)
+	for (i = 0; i < len; i++, data++)
 	{
-		*resultbuf++ = hex[*data>>4];
-		*resultbuf++ = hex[*data&0xf];
-		data++;
+		resultbuf[i*2+0] = hex[*data>>4];
+		resultbuf[i*2+1] = hex[*data&0xf];
 	}
-	*resultbuf = 0;
+	resultbuf[i*2] = 0;
+	G_INT(OFS_RETURN) = PR_CommitTempString(resultbuf, i*2);
 }
 
 static void PF_strlennocol(void)
@@ -4935,7 +4930,7 @@ static void PF_strdecolorize(void)
 	}
 	r[l] = 0;
 
-	G_INT(OFS_RETURN) = PR_SetEngineString(r);
+	G_INT(OFS_RETURN) = PR_CommitTempString(r, l);
 }
 static void PF_setattachment(void)
 {
@@ -5325,11 +5320,7 @@ static void PF_cl_getstat_string(void)
 	if (stnum < 0 || stnum > countof(cl.statss) || !cl.statss[stnum])
 		G_INT(OFS_RETURN) = 0;
 	else
-	{
-		char *result = PR_GetTempString();
-		q_strlcpy(result, cl.statss[stnum], STRINGTEMP_LENGTH);
-		G_INT(OFS_RETURN) = PR_SetEngineString(result);
-	}
+		G_INT(OFS_RETURN) = PR_MakeTempString(cl.statss[stnum]);
 }
 
 static struct
@@ -5678,11 +5669,9 @@ static void PF_cl_cprint(void)
 static void PF_cl_keynumtostring(void)
 {
 	int keynum = Key_QCToNative(G_FLOAT(OFS_PARM0));
-	char *s = PR_GetTempString();
 	if (keynum < 0)
 		keynum = -1;
-	Q_strncpy(s, Key_KeynumToString(keynum), STRINGTEMP_LENGTH);
-	G_INT(OFS_RETURN) = PR_SetEngineString(s);
+	G_INT(OFS_RETURN) = PR_MakeTempString(Key_KeynumToString(keynum));
 }
 static void PF_cl_stringtokeynum(void)
 {
@@ -5693,14 +5682,12 @@ static void PF_cl_getkeybind(void)
 {
 	int keynum = Key_QCToNative(G_FLOAT(OFS_PARM0));
 	int bindmap = (qcvm->argc<=1)?0:G_FLOAT(OFS_PARM1);
-	char *s = PR_GetTempString();
 	if (bindmap < 0 || bindmap >= MAX_BINDMAPS)
 		bindmap = 0;
 	if (keynum >= 0 && keynum < MAX_KEYS && keybindings[bindmap][keynum])
-		Q_strncpy(s, keybindings[bindmap][keynum], STRINGTEMP_LENGTH);
+		G_INT(OFS_RETURN) = PR_MakeTempString(keybindings[bindmap][keynum]);
 	else
-		Q_strncpy(s, "", STRINGTEMP_LENGTH);
-	G_INT(OFS_RETURN) = PR_SetEngineString(s);
+		G_INT(OFS_RETURN) = PR_MakeTempString("");
 }
 static void PF_cl_setkeybind(void)
 {
@@ -5775,7 +5762,7 @@ static void PF_cl_findkeysforcommand(void)
 		q_strlcat(s, gah, STRINGTEMP_LENGTH);
 	}
 
-	G_INT(OFS_RETURN) = PR_SetEngineString(s);
+	G_INT(OFS_RETURN) = PR_CommitTempString(s, strlen(s));
 }
 //this extended version returns actual key names. which modifiers can be returned.
 static void PF_cl_findkeysforcommandex(void)
@@ -5813,7 +5800,7 @@ static void PF_cl_findkeysforcommandex(void)
 		q_strlcat(s, Key_KeynumToString(keys[j]), STRINGTEMP_LENGTH);
 	}
 
-	G_INT(OFS_RETURN) = PR_SetEngineString(s);
+	G_INT(OFS_RETURN) = PR_CommitTempString(s, strlen(s));
 }
 
 static void PF_cl_setcursormode(void)
@@ -6232,7 +6219,7 @@ static void PF_getgamedirinfo(void)
 	case GGDI_LOADCOMMAND:	//loadcommand (localcmd it)
 		s = PR_GetTempString();
 		q_snprintf(s, STRINGTEMP_LENGTH, "gamedir \"%s\"\n", mod->name);
-		G_INT(OFS_RETURN) = PR_SetEngineString(s);
+		G_INT(OFS_RETURN) = PR_CommitTempString(s, strlen(s));
 		break;
 	case GGDI_DESCRIPTION:	//gamedir description
 	case GGDI_OVERRIDES:	//custom overrides
@@ -6330,12 +6317,12 @@ static void PF_gethostcachestring(void)
 	case SLKEY_MAXPLAYERS:
 		s = PR_GetTempString();
 		q_snprintf(s, STRINGTEMP_LENGTH, "%d", hostcache[idx].maxusers);
-		G_INT(OFS_RETURN) = PR_SetEngineString(s);
+		G_INT(OFS_RETURN) = PR_CommitTempString(s, strlen(s));
 		break;
 	case SLKEY_NUMPLAYERS:
 		s = PR_GetTempString();
 		q_snprintf(s, STRINGTEMP_LENGTH, "%d", hostcache[idx].users);
-		G_INT(OFS_RETURN) = PR_SetEngineString(s);
+		G_INT(OFS_RETURN) = PR_CommitTempString(s, strlen(s));
 		break;
 
 	default:
@@ -6498,7 +6485,7 @@ static void PF_cs_getentitytoken(void)
 					*new_p++ = string[i];
 			}
 			*new_p = 0;
-			G_INT(OFS_RETURN) = PR_SetEngineString(tmp);
+			G_INT(OFS_RETURN) = PR_CommitTempString(tmp, new_p-tmp);
 		}
 	}
 	else
@@ -0,0 +1,879 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// pr_jit.c -- translates hot qc functions into native x86-64 code
+
+/*
+Only the simple statements are compiled: maths, comparisons, loads, stores and branches.
+Anything else (calls, returns, state, string compares) becomes an exit back to the interpreter,
+which runs that one statement itself (builtins are thus still called via qcvm->builtins) and then
+re-enters the native code at the following statement.
+
+The interpreter finds its way into native code via pre-decoded statements: every compiled
+statement is given the OPX_NATIVE opcode, so this needs pr_predecode and pr_threaded.
+
+Native code register usage:
+	rbx		qcvm->globals
+	r12		qcvm->edicts
+	r13		pointer to the interpreter's profile counter
+	r14d	the profile counter itself, incremented once per statement
+*/
+
+#include "quakedef.h"
+
+cvar_t	pr_jit = {"pr_jit", "0", CVAR_NONE};					//compile hot functions to native code
+cvar_t	pr_jit_threshold = {"pr_jit_threshold", "64", CVAR_NONE};	//number of calls before a function is compiled
+cvar_t	pr_jit_verify = {"pr_jit_verify", "0", CVAR_NONE};		//run every native segment through the interpreter too, and complain if they differ
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && !defined(_WIN32)
+#include <sys/mman.h>
+
+#define PR_JIT_MAXSTATEMENTS	65536	//don't bother with functions larger than this
+#define PR_JIT_RUNAWAY_LIMIT	0x10000000	//matches pr_exec's.
+
+typedef int (*prjitentry_t) (void *target, float *globals, void *edicts, int *profile);
+
+typedef struct prjitcode_s
+{
+	struct prjitcode_s	*next;
+	size_t				size;
+	byte				code[1];
+} prjitcode_t;
+
+struct prjit_s
+{
+	int				*calls;		//per function
+	void			**entry;	//per statement, the native code for it
+	prjitcode_t		*code;		//every block of native code we've mapped, so we can unmap them again.
+	prjitentry_t	enter;		//the prologue of any of our functions. they're all the same.
+
+	//stats
+	int				numfunctions;
+	int				numstatements;
+	size_t			codesize;
+	unsigned int	numruns;
+	unsigned int	numverified;
+	unsigned int	nummismatches;
+
+	//pr_jit_verify buffers
+	byte			*verifybuf;
+	size_t			verifybufsize;
+};
+
+typedef struct
+{
+	int		pos;		//offset of the rel32
+	int		target;		//statement, or -1 for the epilogue
+} jitfixup_t;
+
+typedef struct
+{
+	byte		*data;
+	int			size;
+	int			maxsize;
+	jitfixup_t	*fixups;
+	int			numfixups;
+	int			maxfixups;
+	int			*stubofs;	//per statement, offset of its code or exit stub, or -1
+	int			epilogue;
+} jitbuf_t;
+
+static void J_Byte (jitbuf_t *b, int v)
+{
+	if (b->size == b->maxsize)
+	{
+		b->maxsize = b->maxsize*2 + 4096;
+		b->data = (byte *) realloc(b->data, b->maxsize);
+	}
+	b->data[b->size++] = v;
+}
+static void J_Bytes (jitbuf_t *b, int n, const byte *bytes)
+{
+	while (n --> 0)
+		J_Byte(b, *bytes++);
+}
+#define J_Emit(b,...) do { static const byte bytes_[] = {__VA_ARGS__}; J_Bytes(b, sizeof(bytes_), bytes_); } while(0)
+static void J_Int (jitbuf_t *b, int v)
+{
+	J_Byte(b, v&0xff);
+	J_Byte(b, (v>>8)&0xff);
+	J_Byte(b, (v>>16)&0xff);
+	J_Byte(b, (v>>24)&0xff);
+}
+static void J_Rel32 (jitbuf_t *b, int target)
+{	//target is a statement number, resolved once everything is emitted
+	if (b->numfixups == b->maxfixups)
+	{
+		b->maxfixups = b->maxfixups*2 + 64;
+		b->fixups = (jitfixup_t *) realloc(b->fixups, b->maxfixups * sizeof(*b->fixups));
+	}
+	b->fixups[b->numfixups].pos = b->size;
+	b->fixups[b->numfixups].target = target;
+	b->numfixups++;
+	J_Int(b, 0);
+}
+
+//[rbx+ofs*4] memory operands. reg is the register number that goes in the modrm's reg field.
+static void J_GlobalModRM (jitbuf_t *b, int reg, int ofs)
+{
+	J_Byte(b, 0x80 | (reg<<3) | 3);
+	J_Int(b, (unsigned short)ofs * 4);
+}
+static void J_SSE (jitbuf_t *b, int op, int xmm, int ofs)
+{	//movss(10/11), addss(58), mulss(59), subss(5c), divss(5e), cvttss2si(2c)
+	J_Byte(b, 0xf3);
+	J_Byte(b, 0x0f);
+	J_Byte(b, op);
+	J_GlobalModRM(b, xmm, ofs);
+}
+#define J_LoadFloat(b,xmm,ofs)		J_SSE(b, 0x10, xmm, ofs)
+#define J_StoreFloat(b,xmm,ofs)		J_SSE(b, 0x11, xmm, ofs)
+static void J_Ucomiss (jitbuf_t *b, int xmm, int ofs)
+{
+	J_Byte(b, 0x0f);
+	J_Byte(b, 0x2e);
+	J_GlobalModRM(b, xmm, ofs);
+}
+static void J_LoadInt (jitbuf_t *b, int reg, int ofs)
+{	//mov r32, [rbx+ofs]
+	J_Byte(b, 0x8b);
+	J_GlobalModRM(b, reg, ofs);
+}
+static void J_StoreInt (jitbuf_t *b, int reg, int ofs)
+{	//mov [rbx+ofs], r32
+	J_Byte(b, 0x89);
+	J_GlobalModRM(b, reg, ofs);
+}
+static void J_LoadIntSX (jitbuf_t *b, int reg, int ofs)
+{	//movsxd r64, [rbx+ofs]
+	J_Byte(b, 0x48);
+	J_Byte(b, 0x63);
+	J_GlobalModRM(b, reg, ofs);
+}
+static void J_CmpZero (jitbuf_t *b, int ofs)
+{	//cmp dword [rbx+ofs], 0
+	J_Byte(b, 0x83);
+	J_GlobalModRM(b, 7, ofs);
+	J_Byte(b, 0);
+}
+static void J_StoreBool (jitbuf_t *b, int ofs)
+{	//converts al (0 or 1) to 0.0f or 1.0f and stores it
+	J_Emit(b, 0x0f,0xb6,0xc0);					//movzx eax, al
+	J_Emit(b, 0x69,0xc0,0x00,0x00,0x80,0x3f);	//imul eax, eax, 0x3f800000
+	J_StoreInt(b, 0, ofs);
+}
+static void J_FloatIsZero (jitbuf_t *b, int ofs, int setreg)
+{	//setreg(al/dl) = (float)[ofs] == 0, false for nans. trashes cl, xmm0+xmm1
+	J_LoadFloat(b, 0, ofs);
+	J_Emit(b, 0x0f,0x57,0xc9);					//xorps xmm1, xmm1
+	J_Emit(b, 0x0f,0x2e,0xc1);					//ucomiss xmm0, xmm1
+	J_Byte(b, 0x0f); J_Byte(b, 0x94); J_Byte(b, 0xc0|setreg);	//sete al/dl
+	J_Emit(b, 0x0f,0x9b,0xc1);					//setnp cl
+	J_Byte(b, 0x20); J_Byte(b, 0xc8|setreg);	//and al/dl, cl
+}
+static void J_FloatIsNonZero (jitbuf_t *b, int ofs, int setreg)
+{	//setreg(al/dl) = (float)[ofs] != 0, true for nans. trashes cl, xmm0+xmm1
+	J_LoadFloat(b, 0, ofs);
+	J_Emit(b, 0x0f,0x57,0xc9);					//xorps xmm1, xmm1
+	J_Emit(b, 0x0f,0x2e,0xc1);					//ucomiss xmm0, xmm1
+	J_Byte(b, 0x0f); J_Byte(b, 0x95); J_Byte(b, 0xc0|setreg);	//setne al/dl
+	J_Emit(b, 0x0f,0x9a,0xc1);					//setp cl
+	J_Byte(b, 0x08); J_Byte(b, 0xc8|setreg);	//or al/dl, cl
+}
+static void J_EdictField (jitbuf_t *b, int entofs, int fldofs)
+{	//rax = (byte*)edicts + entity, rcx = field index, so the field is at [rax+rcx*4+offsetof(edict_t,v)]
+	J_LoadIntSX(b, 0, entofs);
+	J_LoadIntSX(b, 1, fldofs);
+	J_Emit(b, 0x4c,0x01,0xe0);					//add rax, r12
+}
+static void J_Jump (jitbuf_t *b, int cc, int target)
+{	//cc=-1 for an unconditional jmp, otherwise the 0f 8x condition
+	if (cc < 0)
+		J_Byte(b, 0xe9);
+	else
+	{
+		J_Byte(b, 0x0f);
+		J_Byte(b, 0x80|cc);
+	}
+	J_Rel32(b, target);
+}
+#define CC_E	0x4
+#define CC_NE	0x5
+#define CC_G	0xf
+
+static void J_BranchTo (jitbuf_t *b, int cc, int target, int skipcc)
+{	//conditionally jumps to the target statement, checking for runaway loops first.
+	//skipcc is the inverse of cc, or -1 when unconditional.
+	int skippos = 0;
+	if (skipcc >= 0)
+	{
+		J_Byte(b, 0x70|skipcc);	//jcc rel8 over the rest
+		skippos = b->size;
+		J_Byte(b, 0);
+	}
+	J_Emit(b, 0x41,0x81,0xfe);					//cmp r14d, imm32
+	J_Int(b, PR_JIT_RUNAWAY_LIMIT);
+	J_Jump(b, CC_G, -2-target);					//bail to the interpreter at the target (negative targets mean exit stubs)
+	J_Jump(b, -1, target);
+	if (skipcc >= 0)
+		b->data[skippos] = b->size - (skippos+1);
+	(void)cc;
+}
+
+/*
+====================
+PR_JIT_EmitStatement
+
+Returns false if the statement can't be compiled, in which case the caller emits an exit instead.
+====================
+*/
+static qboolean PR_JIT_EmitStatement (jitbuf_t *b, int s)
+{
+	dstatement_t *st = &qcvm->statements[s];
+	int i;
+
+	switch (st->op)
+	{
+	case OP_ADD_F:
+	case OP_SUB_F:
+	case OP_MUL_F:
+	case OP_DIV_F:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		J_LoadFloat(b, 0, st->a);
+		J_SSE(b, (st->op==OP_ADD_F)?0x58:(st->op==OP_SUB_F)?0x5c:(st->op==OP_MUL_F)?0x59:0x5e, 0, st->b);
+		J_StoreFloat(b, 0, st->c);
+		return true;
+	case OP_ADD_V:
+	case OP_SUB_V:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		for (i = 0; i < 3; i++)
+		{	//one component at a time, like the interpreter, in case the operands overlap
+			J_LoadFloat(b, 0, st->a+i);
+			J_SSE(b, (st->op==OP_ADD_V)?0x58:0x5c, 0, st->b+i);
+			J_StoreFloat(b, 0, st->c+i);
+		}
+		return true;
+	case OP_MUL_V:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		J_LoadFloat(b, 0, st->a);
+		J_SSE(b, 0x59, 0, st->b);
+		for (i = 1; i < 3; i++)
+		{
+			J_LoadFloat(b, 1, st->a+i);
+			J_SSE(b, 0x59, 1, st->b+i);
+			J_Emit(b, 0xf3,0x0f,0x58,0xc1);		//addss xmm0, xmm1
+		}
+		J_StoreFloat(b, 0, st->c);
+		return true;
+	case OP_MUL_FV:
+	case OP_MUL_VF:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		for (i = 0; i < 3; i++)
+		{
+			if (st->op == OP_MUL_FV)
+			{
+				J_LoadFloat(b, 0, st->a);
+				J_SSE(b, 0x59, 0, st->b+i);
+			}
+			else
+			{
+				J_LoadFloat(b, 0, st->b);
+				J_SSE(b, 0x59, 0, st->a+i);
+			}
+			J_StoreFloat(b, 0, st->c+i);
+		}
+		return true;
+
+	case OP_GT:
+	case OP_GE:
+	case OP_LT:
+	case OP_LE:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		if (st->op == OP_GT || st->op == OP_GE)
+		{
+			J_LoadFloat(b, 0, st->a);
+			J_Ucomiss(b, 0, st->b);
+		}
+		else
+		{	//swap the operands so that unordered (nan) results come out false.
+			J_LoadFloat(b, 0, st->b);
+			J_Ucomiss(b, 0, st->a);
+		}
+		if (st->op == OP_GT || st->op == OP_LT)
+			J_Emit(b, 0x0f,0x97,0xc0);			//seta al
+		else
+			J_Emit(b, 0x0f,0x93,0xc0);			//setae al
+		J_StoreBool(b, st->c);
+		return true;
+	case OP_EQ_F:
+	case OP_NE_F:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		J_LoadFloat(b, 0, st->a);
+		J_Ucomiss(b, 0, st->b);
+		if (st->op == OP_EQ_F)
+		{
+			J_Emit(b, 0x0f,0x94,0xc0);			//sete al
+			J_Emit(b, 0x0f,0x9b,0xc1);			//setnp cl
+			J_Emit(b, 0x20,0xc8);				//and al, cl
+		}
+		else
+		{
+			J_Emit(b, 0x0f,0x95,0xc0);			//setne al
+			J_Emit(b, 0x0f,0x9a,0xc1);			//setp cl
+			J_Emit(b, 0x08,0xc8);				//or al, cl
+		}
+		J_StoreBool(b, st->c);
+		return true;
+	case OP_EQ_E:
+	case OP_NE_E:
+	case OP_EQ_FNC:
+	case OP_NE_FNC:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		J_LoadInt(b, 0, st->a);
+		J_Byte(b, 0x3b);						//cmp eax, [rbx+b]
+		J_GlobalModRM(b, 0, st->b);
+		if (st->op == OP_EQ_E || st->op == OP_EQ_FNC)
+			J_Emit(b, 0x0f,0x94,0xc0);			//sete al
+		else
+			J_Emit(b, 0x0f,0x95,0xc0);			//setne al
+		J_StoreBool(b, st->c);
+		return true;
+	case OP_NOT_F:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		J_FloatIsZero(b, st->a, 0);
+		J_StoreBool(b, st->c);
+		return true;
+	case OP_NOT_V:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		J_FloatIsZero(b, st->a, 0);
+		for (i = 1; i < 3; i++)
+		{
+			J_FloatIsZero(b, st->a+i, 2);
+			J_Emit(b, 0x20,0xd0);				//and al, dl
+		}
+		J_StoreBool(b, st->c);
+		return true;
+	case OP_NOT_FNC:
+	case OP_NOT_ENT:	//world is always entity offset 0
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		J_CmpZero(b, st->a);
+		J_Emit(b, 0x0f,0x94,0xc0);				//sete al
+		J_StoreBool(b, st->c);
+		return true;
+	case OP_AND:
+	case OP_OR:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		J_FloatIsNonZero(b, st->a, 0);
+		J_FloatIsNonZero(b, st->b, 2);
+		if (st->op == OP_AND)
+			J_Emit(b, 0x20,0xd0);				//and al, dl
+		else
+			J_Emit(b, 0x08,0xd0);				//or al, dl
+		J_StoreBool(b, st->c);
+		return true;
+	case OP_BITAND:
+	case OP_BITOR:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		J_SSE(b, 0x2c, 0, st->a);				//cvttss2si eax, [a]
+		J_SSE(b, 0x2c, 1, st->b);				//cvttss2si ecx, [b]
+		if (st->op == OP_BITAND)
+			J_Emit(b, 0x21,0xc8);				//and eax, ecx
+		else
+			J_Emit(b, 0x09,0xc8);				//or eax, ecx
+		J_Emit(b, 0xf3,0x0f,0x2a,0xc0);			//cvtsi2ss xmm0, eax
+		J_StoreFloat(b, 0, st->c);
+		return true;
+
+	case OP_STORE_F:
+	case OP_STORE_S:
+	case OP_STORE_ENT:
+	case OP_STORE_FLD:
+	case OP_STORE_FNC:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		J_LoadInt(b, 0, st->a);
+		J_StoreInt(b, 0, st->b);
+		return true;
+	case OP_STORE_V:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		for (i = 0; i < 3; i++)
+		{
+			J_LoadInt(b, 0, st->a+i);
+			J_StoreInt(b, 0, st->b+i);
+		}
+		return true;
+	case OP_STOREP_F:
+	case OP_STOREP_S:
+	case OP_STOREP_ENT:
+	case OP_STOREP_FLD:
+	case OP_STOREP_FNC:
+	case OP_STOREP_V:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		if (st->op == OP_STOREP_S)
+		{	//ED_FINDINDEX_TOUCHPTR: string stores go back to the interpreter while find() has indexes to flag
+			J_Emit(b, 0x48,0xba);				//mov rdx, &qcvm->findindex.numindexes
+			for (i = 0; i < 8; i++)
+				J_Byte(b, ((size_t)&qcvm->findindex.numindexes)>>(i*8));
+			J_Emit(b, 0x83,0x3a,0x00);			//cmp dword [rdx], 0
+			J_Emit(b, 0x74,0x05);				//jz over the bail-out
+			J_Jump(b, -1, -2-s);
+		}
+		J_LoadIntSX(b, 0, st->b);
+		J_Emit(b, 0x4c,0x01,0xe0);				//add rax, r12
+		for (i = 0; i < ((st->op == OP_STOREP_V)?3:1); i++)
+		{
+			J_LoadInt(b, 2, st->a+i);
+			J_Emit(b, 0x89,0x50);				//mov [rax+i*4], edx
+			J_Byte(b, i*4);
+		}
+		return true;
+	case OP_LOAD_F:
+	case OP_LOAD_S:
+	case OP_LOAD_ENT:
+	case OP_LOAD_FLD:
+	case OP_LOAD_FNC:
+	case OP_LOAD_V:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		J_EdictField(b, st->a, st->b);
+		for (i = 0; i < ((st->op == OP_LOAD_V)?3:1); i++)
+		{
+			J_Emit(b, 0x8b,0x94,0x88);			//mov edx, [rax+rcx*4+disp32]
+			J_Int(b, offsetof(edict_t, v) + i*4);
+			J_StoreInt(b, 2, st->c+i);
+		}
+		return true;
+	case OP_ADDRESS:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		J_LoadInt(b, 0, st->a);
+		J_Emit(b, 0x85,0xc0);					//test eax, eax
+		J_Emit(b, 0x75,0x14);					//jnz over the world check (10+3+2+5 bytes)
+		J_Emit(b, 0x48,0xb9);					//mov rcx, &qcvm->worldlocked
+		for (i = 0; i < 8; i++)
+			J_Byte(b, ((size_t)&qcvm->worldlocked)>>(i*8));
+		J_Emit(b, 0x83,0x39,0x00);				//cmp dword [rcx], 0
+		J_Emit(b, 0x74,0x05);					//jz over the bail-out
+		J_Jump(b, -1, -2-s);					//let the interpreter throw the error
+		J_LoadInt(b, 1, st->b);
+		J_Emit(b, 0x8d,0x84,0x88);				//lea eax, [rax+rcx*4+disp32]
+		J_Int(b, offsetof(edict_t, v));
+		J_StoreInt(b, 0, st->c);
+		return true;
+
+	case OP_IF:
+	case OP_IFNOT:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		J_CmpZero(b, st->a);
+		if (st->op == OP_IF)
+			J_BranchTo(b, CC_NE, s + st->b, CC_E);
+		else
+			J_BranchTo(b, CC_E, s + st->b, CC_NE);
+		return true;
+	case OP_GOTO:
+		J_Emit(b, 0x41,0xff,0xc6);				//inc r14d
+		J_BranchTo(b, -1, s + st->a, -1);
+		return true;
+
+	default:	//calls, returns, string compares, state, and anything we don't know about
+		return false;
+	}
+}
+
+/*
+====================
+PR_JIT_CompileFunction
+
+Compiles every statement reachable from the function's entry point.
+====================
+*/
+static qboolean PR_JIT_CompileFunction (struct prjit_s *jit, dfunction_t *f)
+{
+	int			numstatements = qcvm->progs->numstatements;
+	byte		*reachable;
+	int			*todo, numtodo;
+	int			s, next, count, first, last, target;
+	qboolean	*native;
+	jitbuf_t	b;
+	prjitcode_t	*code;
+	size_t		mapsize;
+	dstatement_t *st;
+
+	if (f->first_statement <= 0 || f->first_statement >= numstatements)
+		return false;
+
+	//figure out which statements the function can reach.
+	reachable = (byte *) calloc(numstatements, sizeof(*reachable));
+	todo = (int *) malloc(numstatements * sizeof(*todo));
+	numtodo = 0;
+	count = 0;
+	first = last = f->first_statement;
+	todo[numtodo++] = f->first_statement;
+	while (numtodo)
+	{
+		s = todo[--numtodo];
+		if (s <= 0 || s >= numstatements || ++count > PR_JIT_MAXSTATEMENTS)
+		{	//falls off the end somewhere, or too big to be worth it
+			free(reachable);
+			free(todo);
+			return false;
+		}
+		if (reachable[s])
+			continue;
+		reachable[s] = true;
+		first = q_min(first, s);
+		last = q_max(last, s);
+
+		st = &qcvm->statements[s];
+		switch (st->op)
+		{
+		case OP_DONE:
+		case OP_RETURN:
+			break;
+		case OP_GOTO:
+			todo[numtodo++] = s + st->a;
+			break;
+		case OP_IF:
+		case OP_IFNOT:
+			todo[numtodo++] = s + st->b;
+			todo[numtodo++] = s + 1;
+			break;
+		default:	//including calls, so we have somewhere to resume afterwards
+			todo[numtodo++] = s + 1;
+			break;
+		}
+	}
+	free(todo);
+
+	memset(&b, 0, sizeof(b));
+	b.stubofs = (int *) malloc((last+1-first) * sizeof(*b.stubofs) * 2);
+	native = (qboolean *) calloc(last+1-first, sizeof(*native));
+	for (s = 0; s < (last+1-first)*2; s++)
+		b.stubofs[s] = -1;
+
+	//prologue: prjitentry_t(target, globals, edicts, profile)
+	J_Emit(&b, 0x53, 0x41,0x54, 0x41,0x55, 0x41,0x56, 0x41,0x57);	//push rbx, r12, r13, r14, r15
+	J_Emit(&b, 0x48,0x89,0xf3);		//mov rbx, rsi
+	J_Emit(&b, 0x49,0x89,0xd4);		//mov r12, rdx
+	J_Emit(&b, 0x49,0x89,0xcd);		//mov r13, rcx
+	J_Emit(&b, 0x45,0x8b,0x75,0x00);	//mov r14d, [r13]
+	J_Emit(&b, 0xff,0xe7);			//jmp rdi
+	//epilogue, returns the statement to resume interpreting from in eax
+	b.epilogue = b.size;
+	J_Emit(&b, 0x45,0x89,0x75,0x00);	//mov [r13], r14d
+	J_Emit(&b, 0x41,0x5f, 0x41,0x5e, 0x41,0x5d, 0x41,0x5c, 0x5b);	//pop r15, r14, r13, r12, rbx
+	J_Emit(&b, 0xc3);				//ret
+
+	for (s = first; s <= last; s++)
+	{
+		if (!reachable[s])
+			continue;
+		b.stubofs[s-first] = b.size;
+		native[s-first] = PR_JIT_EmitStatement(&b, s);
+		if (!native[s-first])
+		{	//exit to the interpreter, which will execute this statement.
+			J_Byte(&b, 0xb8);	//mov eax, imm32
+			J_Int(&b, s);
+			J_Jump(&b, -1, -1);
+			continue;
+		}
+		st = &qcvm->statements[s];
+		if (st->op == OP_GOTO)
+			continue;	//doesn't fall through
+		for (next = s+1; next <= last && !reachable[next]; next++)
+			;
+		if (next != s+1)
+			J_Jump(&b, -1, s+1);	//not laid out after us.
+	}
+
+	//exits for runaway loops and other bail-outs (encoded as -2-statement)
+	for (s = 0; s < b.numfixups; s++)
+	{
+		target = b.fixups[s].target;
+		if (target <= -2 && b.stubofs[(last+1-first) + (-2-target)-first] < 0)
+		{
+			b.stubofs[(last+1-first) + (-2-target)-first] = b.size;
+			J_Byte(&b, 0xb8);	//mov eax, imm32
+			J_Int(&b, -2-target);
+			J_Jump(&b, -1, -1);
+		}
+	}
+
+	//resolve jumps
+	for (s = 0; s < b.numfixups; s++)
+	{
+		int ofs;
+		target = b.fixups[s].target;
+		if (target == -1)
+			ofs = b.epilogue;
+		else if (target <= -2)
+			ofs = b.stubofs[(last+1-first) + (-2-target)-first];
+		else
+			ofs = b.stubofs[target-first];
+		if (ofs < 0)
+			Sys_Error("PR_JIT_CompileFunction: unresolved jump");
+		ofs -= b.fixups[s].pos+4;
+		b.data[b.fixups[s].pos+0] = ofs;
+		b.data[b.fixups[s].pos+1] = ofs>>8;
+		b.data[b.fixups[s].pos+2] = ofs>>16;
+		b.data[b.fixups[s].pos+3] = ofs>>24;
+	}
+
+	//copy it into executable memory
+	mapsize = (sizeof(*code) + b.size + 4095) & ~(size_t)4095;
+	code = (prjitcode_t *) mmap(NULL, mapsize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED)
+		code = NULL;
+	else
+	{
+		code->next = jit->code;
+		code->size = mapsize;
+		memcpy(code->code, b.data, b.size);
+		if (mprotect(code, mapsize, PROT_READ|PROT_EXEC))
+		{
+			munmap(code, mapsize);
+			code = NULL;
+		}
+	}
+
+	if (code)
+	{
+		jit->code = code;
+		if (!jit->enter)
+			jit->enter = (prjitentry_t)(void *)code->code;
+
+		for (s = first; s <= last; s++)
+		{
+			if (native[s-first])
+			{
+				jit->entry[s] = code->code + b.stubofs[s-first];
+				PR_SetNativeStatement(s, true);
+				jit->numstatements++;
+			}
+		}
+		jit->numfunctions++;
+		jit->codesize += b.size;
+	}
+
+	free(b.data);
+	free(b.fixups);
+	free(b.stubofs);
+	free(native);
+	free(reachable);
+	return code != NULL;
+}
+
+/*
+====================
+PR_JIT_Flush
+
+Forgets all native code for the active vm, putting its statements back to normal.
+====================
+*/
+static void PR_JIT_Flush (void)
+{
+	struct prjit_s *jit = qcvm->jit;
+	prjitcode_t *code;
+	int i;
+
+	if (!jit)
+		return;
+	for (i = 0; i < qcvm->progs->numstatements; i++)
+	{
+		if (jit->entry[i])
+			PR_SetNativeStatement(i, false);
+	}
+	while ((code = jit->code))
+	{
+		jit->code = code->next;
+		munmap(code, code->size);
+	}
+	free(jit->calls);
+	free(jit->entry);
+	free(jit->verifybuf);
+	free(jit);
+	qcvm->jit = NULL;
+}
+
+qboolean PR_JIT_Supported (void)
+{
+	return true;
+}
+
+/*
+====================
+PR_JIT_EnterFunction
+
+Called by the interpreter for each qc function call while pr_jit is set.
+====================
+*/
+void PR_JIT_EnterFunction (dfunction_t *f)
+{
+	struct prjit_s *jit = qcvm->jit;
+	int fnum = f - qcvm->functions;
+
+	if (!jit)
+	{
+		jit = qcvm->jit = (struct prjit_s *) calloc(1, sizeof(*jit));
+		jit->calls = (int *) calloc(qcvm->progs->numfunctions, sizeof(*jit->calls));
+		jit->entry = (void **) calloc(qcvm->progs->numstatements, sizeof(*jit->entry));
+	}
+
+	if (jit->calls[fnum] >= 0 && ++jit->calls[fnum] >= pr_jit_threshold.value)
+	{
+		if (!PR_JIT_CompileFunction(jit, f))
+			Con_DPrintf("pr_jit: unable to compile %s\n", PR_GetString(f->s_name));
+		jit->calls[fnum] = -1;	//don't try again.
+	}
+}
+
+/*
+====================
+PR_JIT_Verify
+
+Runs the native code and the interpreter on the same input, and complains if the results differ.
+====================
+*/
+static int PR_JIT_Verify (struct prjit_s *jit, int statement, int *profile)
+{
+	size_t globalssize = qcvm->progs->numglobals * sizeof(float);
+	size_t edictssize = qcvm->num_edicts * qcvm->edict_size;
+	byte *savedglobals, *savededicts, *refglobals, *refedicts;
+	int refprofile = *profile;
+	int refend, end;
+	size_t i;
+
+	if (jit->verifybufsize < (globalssize + edictssize)*2)
+	{
+		jit->verifybufsize = (globalssize + edictssize)*2;
+		free(jit->verifybuf);
+		jit->verifybuf = (byte *) malloc(jit->verifybufsize);
+	}
+	savedglobals = jit->verifybuf;
+	savededicts = savedglobals + globalssize;
+	refglobals = savededicts + edictssize;
+	refedicts = refglobals + globalssize;
+
+	memcpy(savedglobals, qcvm->globals, globalssize);
+	memcpy(savededicts, qcvm->edicts, edictssize);
+
+	refend = PR_ExecuteSegment(statement, &refprofile);
+	memcpy(refglobals, qcvm->globals, globalssize);
+	memcpy(refedicts, qcvm->edicts, edictssize);
+
+	memcpy(qcvm->globals, savedglobals, globalssize);
+	memcpy(qcvm->edicts, savededicts, edictssize);
+
+	end = jit->enter(jit->entry[statement], qcvm->globals, qcvm->edicts, profile);
+
+	jit->numverified++;
+	if (end != refend || memcmp(refglobals, qcvm->globals, globalssize) || memcmp(refedicts, qcvm->edicts, edictssize))
+	{
+		jit->nummismatches++;
+		Con_Warning("pr_jit_verify: %s, statement %i: native code stopped at %i, interpreter at %i\n", PR_GetString(qcvm->xfunction->s_name), statement, end, refend);
+		for (i = 0; i < globalssize/4; i++)
+			if (((int*)refglobals)[i] != ((int*)qcvm->globals)[i])
+				Con_Warning("  global %u: native %#x, interpreter %#x\n", (unsigned)i, ((int*)qcvm->globals)[i], ((int*)refglobals)[i]);
+		for (i = 0; i < edictssize/4; i++)
+			if (((int*)refedicts)[i] != ((int*)qcvm->edicts)[i])
+				Con_Warning("  edict %u byte %u: native %#x, interpreter %#x\n", (unsigned)((i*4)/qcvm->edict_size), (unsigned)((i*4)%qcvm->edict_size), ((int*)qcvm->edicts)[i], ((int*)refedicts)[i]);
+
+		//continue with the interpreter's results, so one bug doesn't cascade.
+		memcpy(qcvm->globals, refglobals, globalssize);
+		memcpy(qcvm->edicts, refedicts, edictssize);
+		*profile = refprofile;
+		return refend;
+	}
+	return end;
+}
+
+/*
+====================
+PR_JIT_Run
+
+Called by the interpreter when it reaches a compiled statement.
+Returns the statement to continue interpreting from.
+====================
+*/
+int PR_JIT_Run (int statement, int *profile)
+{
+	struct prjit_s *jit = qcvm->jit;
+
+	if (!pr_jit.value)
+	{	//disabled since we compiled stuff. the statement will go back to being interpreted.
+		PR_JIT_Flush();
+		return statement;
+	}
+
+	jit->numruns++;
+	if (pr_jit_verify.value)
+		return PR_JIT_Verify(jit, statement, profile);
+	return jit->enter(jit->entry[statement], qcvm->globals, qcvm->edicts, profile);
+}
+
+void PR_JIT_Shutdown (void)
+{
+	PR_JIT_Flush();
+}
+
+static void PR_JIT_Stats_f (void)
+{
+	qcvm_t *vms[] = {&sv.qcvm, &cl.qcvm, &cls.menu_qcvm};
+	const char *names[] = {"ssqc", "csqc", "menuqc"};
+	struct prjit_s *jit;
+	size_t i;
+
+	for (i = 0; i < countof(vms); i++)
+	{
+		jit = vms[i]->jit;
+		if (!jit)
+			continue;
+		Con_Printf("%s: %i functions, %i statements, %u bytes of code, %u native runs\n", names[i], jit->numfunctions, jit->numstatements, (unsigned)jit->codesize, jit->numruns);
+		if (jit->numverified)
+			Con_Printf("%s: %u runs verified, %u mismatches\n", names[i], jit->numverified, jit->nummismatches);
+	}
+}
+#else
+qboolean PR_JIT_Supported (void)
+{
+	return false;
+}
+void PR_JIT_EnterFunction (dfunction_t *f)
+{
+}
+int PR_JIT_Run (int statement, int *profile)
+{	//can't happen.
+	return statement;
+}
+void PR_JIT_Shutdown (void)
+{
+}
+static void PR_JIT_Stats_f (void)
+{
+	Con_Printf("pr_jit is not supported on this platform\n");
+}
+#endif
+
+void PR_JIT_Init (void)
+{
+	COMPILE_TIME_ASSERT(qboolean_size, sizeof(qboolean) == 4);	//the native code reads worldlocked as a dword
+
+	Cvar_RegisterVariable (&pr_jit);
+	Cvar_RegisterVariable (&pr_jit_threshold);
+	Cvar_RegisterVariable (&pr_jit_verify);
+	Cmd_AddCommand ("pr_jit_stats", PR_JIT_Stats_f);
+}
@@ -0,0 +1,459 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// pr_profile.c -- call graph profiler for qc functions and builtins
+
+/*
+"pr_profile <frames> [name]" times every qc function and builtin call in the ssqc and csqc vms for
+the given number of host frames, building a calling-context tree (one node per distinct call stack).
+When it finishes, each vm gets a report:
+	<name>_<vm>.txt		inclusive/exclusive times per function, and caller->callee edges
+	<name>_<vm>.folded	folded stacks with self time in microseconds, for flamegraph.pl and similar
+The interpreter only checks qcvm->profiler when calling or returning, so there's no cost while idle.
+*/
+
+#include "quakedef.h"
+
+typedef struct
+{
+	int			func;		//index into qcvm->functions, builtins included. -1 for the root.
+	int			parent;		//node index
+	int			firstchild;
+	int			sibling;
+	unsigned int	calls;
+	uint64_t	inclusive;	//ticks spent in this node and everything it called
+	uint64_t	self;		//ticks spent in this node only
+} prprofnode_t;
+
+typedef struct
+{
+	int			node;
+	int			qcdepth;	//qcvm->depth within this call, so we can tell when errors unwound the qc stack under us
+	qboolean	builtin;
+	uint64_t	start;
+	uint64_t	childtime;
+} prprofframe_t;
+
+struct prprofile_s
+{
+	prprofnode_t	*nodes;
+	int				numnodes;
+	int				maxnodes;
+
+	prprofframe_t	stack[MAX_STACK_DEPTH*2];	//one for each qc function, plus one for a builtin between each
+	int				depth;
+
+	uint64_t		starttime;
+};
+
+static int pr_profile_frames;				//host frames left to profile, 0 when idle
+static char pr_profile_name[MAX_QPATH];
+
+static uint64_t PR_ProfileTicks (void)
+{
+#if SDL_VERSION_ATLEAST(2,0,0)
+	return SDL_GetPerformanceCounter();
+#else
+	return Sys_DoubleTime() * 1000000.0;
+#endif
+}
+static double PR_ProfileTicksToSeconds (uint64_t ticks)
+{
+#if SDL_VERSION_ATLEAST(2,0,0)
+	return ticks / (double)SDL_GetPerformanceFrequency();
+#else
+	return ticks / 1000000.0;
+#endif
+}
+
+static int PR_ProfileNode (struct prprofile_s *p, int parent, int func)
+{
+	prprofnode_t *n;
+	int i;
+
+	for (i = p->nodes[parent].firstchild; i >= 0; i = p->nodes[i].sibling)
+	{
+		if (p->nodes[i].func == func)
+			return i;
+	}
+
+	if (p->numnodes == p->maxnodes)
+	{
+		p->maxnodes = p->maxnodes*2 + 1024;
+		p->nodes = (prprofnode_t *) realloc(p->nodes, p->maxnodes * sizeof(*p->nodes));
+	}
+	i = p->numnodes++;
+	n = &p->nodes[i];
+	memset(n, 0, sizeof(*n));
+	n->func = func;
+	n->parent = parent;
+	n->firstchild = -1;
+	n->sibling = p->nodes[parent].firstchild;
+	p->nodes[parent].firstchild = i;
+	return i;
+}
+
+static void PR_ProfilePush (struct prprofile_s *p, int func, int qcdepth, qboolean builtin)
+{
+	prprofframe_t *fr;
+
+	//discard frames that an error unwound without telling us.
+	while (p->depth && p->stack[p->depth-1].qcdepth >= qcdepth + builtin)
+		p->depth--;
+	if (p->depth == countof(p->stack))
+		return;	//shouldn't happen, the qc stack overflows first.
+
+	fr = &p->stack[p->depth];
+	fr->node = PR_ProfileNode(p, p->depth?p->stack[p->depth-1].node:0, func);
+	fr->qcdepth = qcdepth;
+	fr->builtin = builtin;
+	fr->childtime = 0;
+	p->nodes[fr->node].calls++;
+	p->depth++;
+	fr->start = PR_ProfileTicks();
+}
+
+static void PR_ProfilePop (struct prprofile_s *p)
+{
+	prprofframe_t *fr = &p->stack[--p->depth];
+	prprofnode_t *n = &p->nodes[fr->node];
+	uint64_t elapsed = PR_ProfileTicks() - fr->start;
+
+	n->inclusive += elapsed;
+	n->self += elapsed - fr->childtime;
+	if (p->depth)
+		p->stack[p->depth-1].childtime += elapsed;
+}
+
+/*
+====================
+PR_ProfileEnter
+
+Called by PR_EnterFunction while profiling, after qcvm->depth was incremented.
+====================
+*/
+void PR_ProfileEnter (dfunction_t *f)
+{
+	PR_ProfilePush(qcvm->profiler, f - qcvm->functions, qcvm->depth, false);
+}
+
+/*
+====================
+PR_ProfileLeave
+
+Called by PR_LeaveFunction while profiling, before qcvm->depth is decremented.
+====================
+*/
+void PR_ProfileLeave (void)
+{
+	struct prprofile_s *p = qcvm->profiler;
+
+	while (p->depth && (p->stack[p->depth-1].qcdepth > qcvm->depth || p->stack[p->depth-1].builtin))
+		p->depth--;	//stale
+	if (p->depth && p->stack[p->depth-1].qcdepth == qcvm->depth)
+		PR_ProfilePop(p);
+}
+
+/*
+====================
+PR_ProfileBuiltin
+
+Calls a builtin while profiling. The builtin gets its own node, so qc that it calls back into
+(eg: touch functions) shows up beneath it.
+====================
+*/
+void PR_ProfileBuiltin (dfunction_t *f, builtin_t builtin)
+{
+	struct prprofile_s *p = qcvm->profiler;
+	int depth;
+
+	PR_ProfilePush(p, f - qcvm->functions, qcvm->depth, true);
+	depth = p->depth;
+	builtin();
+	if (qcvm->profiler == p && p->depth == depth)
+		PR_ProfilePop(p);
+}
+
+static const char *PR_ProfileFuncName (int func)
+{
+	dfunction_t *f = &qcvm->functions[func];
+	if (f->first_statement <= 0)
+		return va("%s[builtin #%i]", PR_GetString(f->s_name), -f->first_statement);
+	return PR_GetString(f->s_name);
+}
+
+typedef struct
+{
+	int			caller, callee;
+	unsigned int	calls;
+	uint64_t	ticks;
+	uint64_t	self;
+} prprofedge_t;
+
+static int PR_ProfileSortEdges (const void *va, const void *vb)
+{
+	const prprofedge_t *a = va, *b = vb;
+	if (a->caller != b->caller)
+		return a->caller - b->caller;
+	return a->callee - b->callee;
+}
+static int PR_ProfileSortTicks (const void *va, const void *vb)
+{
+	const prprofedge_t *a = va, *b = vb;
+	if (a->ticks != b->ticks)
+		return (a->ticks < b->ticks) ? 1 : -1;
+	return 0;
+}
+
+/*
+====================
+PR_ProfileWrite
+
+Writes out the active vm's results.
+====================
+*/
+static void PR_ProfileWrite (struct prprofile_s *p, const char *vmname)
+{
+	char		name[MAX_OSPATH];
+	char		path[4096];
+	FILE		*f;
+	int			i, j, n, numfuncs, len;
+	prprofedge_t	*edges, *funcs;
+	int			numedges;
+	double		total = PR_ProfileTicksToSeconds(PR_ProfileTicks() - p->starttime);
+
+	//fold the nodes into per-function totals and caller->callee edges.
+	numfuncs = qcvm->progs->numfunctions;
+	funcs = (prprofedge_t *) calloc(numfuncs, sizeof(*funcs));
+	edges = (prprofedge_t *) malloc(p->numnodes * sizeof(*edges));
+	for (i = 0; i < numfuncs; i++)
+		funcs[i].callee = i;
+	for (i = 1, numedges = 0; i < p->numnodes; i++)
+	{
+		prprofnode_t *node = &p->nodes[i];
+		funcs[node->func].calls += node->calls;
+		funcs[node->func].self += node->self;
+		for (j = node->parent; j > 0 && p->nodes[j].func != node->func; j = p->nodes[j].parent)
+			;
+		if (j <= 0)	//recursion would count the same time twice
+			funcs[node->func].ticks += node->inclusive;
+
+		edges[numedges].caller = p->nodes[node->parent].func;
+		edges[numedges].callee = node->func;
+		edges[numedges].calls = node->calls;
+		edges[numedges].ticks = node->inclusive;
+		numedges++;
+	}
+	qsort(edges, numedges, sizeof(*edges), PR_ProfileSortEdges);
+	for (i = 1, j = 0; i < numedges; i++)
+	{
+		if (edges[i].caller == edges[j].caller && edges[i].callee == edges[j].callee)
+		{
+			edges[j].calls += edges[i].calls;
+			edges[j].ticks += edges[i].ticks;
+		}
+		else
+			edges[++j] = edges[i];
+	}
+	if (numedges)
+		numedges = j+1;
+	qsort(edges, numedges, sizeof(*edges), PR_ProfileSortTicks);
+	qsort(funcs, numfuncs, sizeof(*funcs), PR_ProfileSortTicks);
+
+	Con_Printf("%s: %.3f secs profiled\n", vmname, total);
+	Con_Printf("%10s %10s %10s  %s\n", "calls", "incl ms", "excl ms", "function");
+	for (i = 0; i < numfuncs && i < 10 && funcs[i].calls; i++)
+		Con_Printf("%10u %10.3f %10.3f  %s\n", funcs[i].calls, PR_ProfileTicksToSeconds(funcs[i].ticks)*1000, PR_ProfileTicksToSeconds(funcs[i].self)*1000, PR_ProfileFuncName(funcs[i].callee));
+
+	q_snprintf(name, sizeof(name), "%s/%s_%s.txt", com_gamedir, pr_profile_name, vmname);
+	f = fopen(name, "w");
+	if (f)
+	{
+		fprintf(f, "%.3f secs profiled\n\n", total);
+		fprintf(f, "%10s %10s %10s  %s\n", "calls", "incl ms", "excl ms", "function");
+		for (i = 0; i < numfuncs && funcs[i].calls; i++)
+			fprintf(f, "%10u %10.3f %10.3f  %s\n", funcs[i].calls, PR_ProfileTicksToSeconds(funcs[i].ticks)*1000, PR_ProfileTicksToSeconds(funcs[i].self)*1000, PR_ProfileFuncName(funcs[i].callee));
+		fprintf(f, "\n%10s %10s  %s\n", "calls", "incl ms", "caller -> callee");
+		for (i = 0; i < numedges; i++)
+			fprintf(f, "%10u %10.3f  %s -> %s\n", edges[i].calls, PR_ProfileTicksToSeconds(edges[i].ticks)*1000, (edges[i].caller<0)?"(engine)":PR_ProfileFuncName(edges[i].caller), PR_ProfileFuncName(edges[i].callee));
+		fclose(f);
+		Con_Printf("wrote %s\n", name);
+	}
+	else
+		Con_Printf("couldn't write %s\n", name);
+
+	q_snprintf(name, sizeof(name), "%s/%s_%s.folded", com_gamedir, pr_profile_name, vmname);
+	f = fopen(name, "w");
+	if (f)
+	{
+		for (i = 1; i < p->numnodes; i++)
+		{
+			if (!p->nodes[i].self)
+				continue;
+			//build the stack backwards from the end of the buffer
+			path[sizeof(path)-1] = 0;
+			len = sizeof(path)-1;
+			for (n = i; n > 0 && len > 0; n = p->nodes[n].parent)
+			{
+				const char *fname = PR_ProfileFuncName(p->nodes[n].func);
+				j = strlen(fname);
+				if (j+1 > len)
+					break;
+				len -= j;
+				memcpy(path+len, fname, j);
+				path[--len] = ';';
+			}
+			fprintf(f, "%s%s %.0f\n", vmname, path+len, PR_ProfileTicksToSeconds(p->nodes[i].self)*1000000);
+		}
+		fclose(f);
+		Con_Printf("wrote %s\n", name);
+	}
+	else
+		Con_Printf("couldn't write %s\n", name);
+
+	free(funcs);
+	free(edges);
+}
+
+/*
+====================
+PR_ProfileShutdown
+
+Finishes profiling the active vm, writing out what we have.
+Also called when the progs are unloaded.
+====================
+*/
+void PR_ProfileShutdown (void)
+{
+	struct prprofile_s *p = qcvm->profiler;
+	const char *vmname;
+
+	if (!p)
+		return;
+	qcvm->profiler = NULL;
+
+	if (qcvm == &sv.qcvm)
+		vmname = "ssqc";
+	else if (qcvm == &cl.qcvm)
+		vmname = "csqc";
+	else
+		vmname = "menuqc";
+	PR_ProfileWrite(p, vmname);
+
+	free(p->nodes);
+	free(p);
+}
+
+static void PR_ProfileStart (qcvm_t *vm)
+{
+	struct prprofile_s *p;
+
+	if (!vm->progs || vm->profiler)
+		return;
+	p = (struct prprofile_s *) calloc(1, sizeof(*p));
+	p->maxnodes = 1024;
+	p->nodes = (prprofnode_t *) calloc(p->maxnodes, sizeof(*p->nodes));
+	p->numnodes = 1;	//the root node, for calls from the engine
+	p->nodes[0].func = -1;
+	p->nodes[0].parent = -1;
+	p->nodes[0].firstchild = -1;
+	p->nodes[0].sibling = -1;
+	p->starttime = PR_ProfileTicks();
+	vm->profiler = p;
+}
+
+static void PR_ProfileStop (qcvm_t *vm)
+{
+	if (!vm->profiler)
+		return;
+	PR_SwitchQCVM(vm);
+	PR_ProfileShutdown();
+	PR_SwitchQCVM(NULL);
+}
+
+/*
+====================
+PR_ProfileFrame
+
+Called once per host frame.
+====================
+*/
+void PR_ProfileFrame (void)
+{
+	if (!pr_profile_frames || --pr_profile_frames)
+		return;
+	PR_ProfileStop(&sv.qcvm);
+	PR_ProfileStop(&cl.qcvm);
+}
+
+static void PR_Profile_Command_f (void)
+{
+	int frames;
+
+	if (Cmd_Argc() < 2)
+	{
+		Con_Printf("usage: %s <frames> [name]\n", Cmd_Argv(0));
+		Con_Printf("       %s stop\n", Cmd_Argv(0));
+		return;
+	}
+	if (qcvm)
+	{	//qc can't profile itself, it'd be cut off mid-call.
+		Con_Printf("%s: cannot be used from qc\n", Cmd_Argv(0));
+		return;
+	}
+
+	frames = atoi(Cmd_Argv(1));
+	if (!strcmp(Cmd_Argv(1), "stop") || frames <= 0)
+	{
+		pr_profile_frames = 0;
+		PR_ProfileStop(&sv.qcvm);
+		PR_ProfileStop(&cl.qcvm);
+		return;
+	}
+	if (pr_profile_frames)
+	{
+		Con_Printf("%s: already profiling\n", Cmd_Argv(0));
+		return;
+	}
+	if (!sv.qcvm.progs && !cl.qcvm.progs)
+	{
+		Con_Printf("%s: no progs loaded\n", Cmd_Argv(0));
+		return;
+	}
+
+	q_strlcpy(pr_profile_name, (Cmd_Argc() > 2)?Cmd_Argv(2):"qcprofile", sizeof(pr_profile_name));
+	if (strstr(pr_profile_name, "..") || strchr(pr_profile_name, '/') || strchr(pr_profile_name, '\\'))
+	{
+		Con_Printf("%s: invalid name\n", Cmd_Argv(0));
+		return;
+	}
+
+	pr_profile_frames = frames;
+	PR_ProfileStart(&sv.qcvm);
+	PR_ProfileStart(&cl.qcvm);
+	Con_Printf("profiling qc for %i frames\n", frames);
+}
+
+void PR_ProfileInit (void)
+{
+	Host_InstanceGlobal (&pr_profile_frames, sizeof(pr_profile_frames));
+	Host_InstanceGlobal (pr_profile_name, sizeof(pr_profile_name));
+	Cmd_AddCommand ("pr_profile", PR_Profile_Command_f);
+}
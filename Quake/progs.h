@@ -100,9 +100,37 @@ int PR_AllocString (int bufferlength, char **ptr);
 void PR_ClearEngineString(int num);
 
 void PR_Profile_f (void);
-
+void PR_Benchmark_f (void);
+void PR_DecodeStatements (void);
+void PR_SetNativeStatement (int statement, qboolean native);
+int PR_ExecuteSegment (int statement, int *profile);
+extern cvar_t pr_threaded, pr_predecode;
+
+//from pr_jit.c
+void PR_JIT_Init (void);
+void PR_JIT_EnterFunction (dfunction_t *f);
+int PR_JIT_Run (int statement, int *profile);
+void PR_JIT_Shutdown (void);
+qboolean PR_JIT_Supported (void);
+extern cvar_t pr_jit, pr_jit_threshold;
+
+//from pr_profile.c
+void PR_ProfileInit (void);
+void PR_ProfileEnter (dfunction_t *f);
+void PR_ProfileLeave (void);
+void PR_ProfileBuiltin (dfunction_t *f, builtin_t builtin);
+void PR_ProfileShutdown (void);
+void PR_ProfileFrame (void);
+
+void ED_FreeListInvalidate (void);
 edict_t *ED_Alloc (void);
 void ED_Free (edict_t *ed);
+int ED_FindIndexLookup (int ofs, const char *s, int after);
+void ED_FindIndexTouch (edict_t *ed, int ofs);
+void ED_FindIndexTouchEdict (edict_t *ed);
+void ED_FindIndexTouchPointer (int ptr);
+//called after qc stores a string through a pointer, so indexes know the field changed
+#define ED_FINDINDEX_TOUCHPTR(ptr)	do { if (qcvm->findindex.numindexes) ED_FindIndexTouchPointer(ptr); } while (0)
 
 void ED_Print (edict_t *ed);
 void ED_Write (FILE *f, edict_t *ed);
@@ -164,11 +192,16 @@ int ED_FindFieldOffset (const char *name);
 //from pr_cmds, no longer static so that pr_ext can use them.
 sizebuf_t *WriteDest (void);
 char *PR_GetTempString (void);
+int PR_CommitTempString (char *s, size_t len);
 int PR_MakeTempString (const char *val);
+char *PR_StrzoneAlloc (size_t size);
+void PR_StrzoneFree (char *s);
+int PR_NewEngineString (const char *s);
+void PR_StringsFrame (void);
 char *PF_VarString (int	first);
-#define	STRINGTEMP_BUFFERS		1024
 #define	STRINGTEMP_LENGTH		1024
 void PF_Fixme(void);	//the 'unimplemented' builtin. woot.
+void PR_FindRadiusBenchmark_f (void);
 
 struct pr_extfuncs_s
 {
@@ -342,6 +375,112 @@ typedef struct
 	dfunction_t	*f;
 } prstack_t;
 
+typedef struct mstatement_s
+{	//pre-decoded form of a dstatement_t, see PR_DecodeStatements
+	unsigned int	op;			//the opcode, or one of pr_exec's superinstructions
+	int				jump;		//branch offset for IF, IFNOT and GOTO
+	eval_t			*a, *b, *c;	//operands resolved to their globals
+} mstatement_t;
+
+typedef struct
+{	//tracks free edicts so ED_Alloc doesn't have to scan for them
+	struct edictpending_s
+	{
+		int		num;
+		float	freetime;	//what the edict's freetime was when it was queued, to spot stale entries
+	}		*pending;		//edicts in the order they were freed, too recent to reuse yet
+	int		pendinghead;
+	int		numpending;
+	int		maxpending;
+	int		*ready;			//min-heap of edict numbers that can be reused
+	int		numready;
+	int		maxready;
+	int		num_edicts;		//qcvm->num_edicts when we were last in sync with it
+	double	time;			//qcvm->time when we were last in sync with it
+
+	//churn counters, reset each map
+	unsigned int	allocs;		//calls to ED_Alloc
+	unsigned int	reused;		//allocations that recycled a freed edict
+	unsigned int	frees;		//calls to ED_Free
+	unsigned int	rescans;	//times we had to rebuild the lists from scratch
+} edictfreelist_t;
+
+#define MAX_FIND_INDEXES	8
+#define FINDINDEX_LINKED	1	//the edict is in one of the index's buckets
+#define FINDINDEX_DIRTY		2	//the edict's value may have changed since it was linked
+typedef struct
+{	//per-field hash of string values, so find() doesn't have to strcmp every edict
+	int		ofs;			//the field being indexed
+	int		maxedicts;		//qcvm->max_edicts when the arrays were allocated
+	unsigned int	hashmask;	//number of buckets - 1
+	int		*heads;			//first edict in each bucket, 0 for none (the world is never linked)
+	int		*tails;			//last edict in each bucket
+	int		*next;			//bucket links, kept sorted by edict number
+	int		*prev;
+	unsigned int	*hash;	//hash of the value each edict was linked with
+	byte	*flags;			//FINDINDEX_* per edict
+	int		*dirty;			//edicts flagged FINDINDEX_DIRTY, relinked on the next lookup
+	int		numdirty;
+	int		numlinked;		//edicts below this number have been looked at
+} edictfindindex_t;
+
+typedef struct
+{	//the field indexes find() has created so far, see ED_FindIndexLookup
+	byte	*fieldslot;			//1-based index number for each field offset, 0 when not indexed
+	unsigned int	numfields;	//size of fieldslot, 0 until find() is first used
+	edictfindindex_t	indexes[MAX_FIND_INDEXES];
+	int		numindexes;
+
+	//counters, reset each map
+	unsigned int	lookups;	//finds answered from an index
+	unsigned int	scans;		//finds that had to scan every edict
+	unsigned int	relinks;	//edicts re-hashed because their field was written
+} edictfindindexes_t;
+
+#define PR_TEMPSTRING_BASE		0x40000000	//string_t values from here up are in the tempstring arena, see PR_GetString
+#define PR_TEMPSTRING_CHUNKBITS	16
+#define PR_TEMPSTRING_CHUNK		(1<<PR_TEMPSTRING_CHUNKBITS)
+#define PR_TEMPSTRING_MAXCHUNKS	64	//past this, the oldest chunks get reused like the old ring buffer
+typedef struct
+{	//bump allocator for tempstrings. strings stay valid for the rest of this frame and all of the next.
+	struct prtempchunk_s
+	{
+		char	*data;
+		int		used;
+		int		next;			//next chunk in the same generation/free list, or -1
+	}		*chunks;
+	int		numchunks;
+	int		maxchunks;
+	int		head[2], tail[2];	//chunks belonging to this frame [0] and the previous one [1]
+	int		freechunks;			//chunks ready for reuse
+	int		lastchunk, lastofs;	//most recent allocation, so PR_CommitTempString can trim it
+
+	//counters
+	unsigned int	allocs;		//since the progs were loaded
+	unsigned int	frameallocs, framebytes;		//this frame so far
+	unsigned int	peakallocs, peakbytes;		//busiest frame
+	unsigned int	recycled;	//chunks reused early because the arena hit PR_TEMPSTRING_MAXCHUNKS
+} prtempstrings_t;
+
+#define PR_STRZONE_CLASSES	5	//16 to 256 bytes
+typedef struct
+{	//size-class pool for strzone, so qc that keeps rebuilding strings doesn't hammer the zone
+	struct prstrzoneblock_s *freelist[PR_STRZONE_CLASSES];
+	struct prstrzoneslab_s *slabs;
+
+	//counters
+	unsigned int	allocs;		//since the progs were loaded
+	unsigned int	pooled;		//allocations that came from the pool rather than the zone
+	unsigned int	live;		//strzoned strings that haven't been strunzoned yet
+	size_t			slabbytes;
+} prstrzonepool_t;
+
+typedef struct
+{	//open-addressed name lookup table, see PR_BuildNameHash
+	unsigned int	*indices;	//index+1 into the table it was built for, 0 for empty slots
+	unsigned int	size;
+} prnamehash_t;
+
 
 typedef struct areanode_s
 {
@@ -354,6 +493,37 @@ typedef struct areanode_s
 #define	AREA_DEPTH	4
 #define	AREA_NODES	32
 
+#define	AREA_SOLID		1
+#define	AREA_TRIGGER	2
+
+#define BROADPHASE_AREANODES	0	//the original fixed-depth binary split
+#define BROADPHASE_AABBTREE		1	//dynamic bounding volume hierarchy, see world.c
+
+typedef struct
+{
+	vec3_t	mins, maxs;		//leaves are padded so that small moves don't need to reinsert them
+	int		parent;			//-1 for roots. also chains free nodes.
+	int		children[2];	//-1 for leaves
+	int		height;			//0 for leaves, -1 for free nodes
+	int		entnum;			//leaves only
+	int		tree;			//leaves only, 0 for solids, 1 for triggers
+	uint64_t	order;		//leaves only, sorts query results into the order the areanodes would give them
+} aabbnode_t;
+
+typedef struct
+{
+	aabbnode_t	*nodes;
+	int			numnodes;
+	int			maxnodes;
+	int			freenode;		//-1 when there's none
+	int			root[2];		//solid_edicts, trigger_edicts
+	int			*entleaf;		//per edict, the leaf holding it or -1
+	int			maxents;
+	uint64_t	linkseq;		//counts links, for aabbnode_t::order
+
+	unsigned int	inserts, refits, removes, rotations;
+} aabbtree_t;
+
 #define CSIE_KEYDOWN			0
 #define CSIE_KEYUP				1
 #define CSIE_MOUSEDELTA			2
@@ -368,6 +538,9 @@ struct qcvm_s
 	dprograms_t	*progs;
 	dfunction_t	*functions;
 	dstatement_t	*statements;
+	mstatement_t	*mstatements;	//pre-decoded copy of statements, or NULL
+	struct prjit_s	*jit;			//native code state, see pr_jit.c
+	struct prprofile_s	*profiler;	//call graph profiler state while pr_profile is running, see pr_profile.c
 	float		*globals;	/* same as pr_global_struct */
 	ddef_t		*fielddefs;	//yay reflection.
 
@@ -409,8 +582,14 @@ struct qcvm_s
 	int			freeknownstrings;
 	ddef_t		*globaldefs;
 
+	prnamehash_t	fieldhash;		//for ED_FindField
+	prnamehash_t	globalhash;		//for ED_FindGlobal
+	prnamehash_t	functionhash;	//for ED_FindFunction
+
 	unsigned char *knownzone;
 	size_t knownzonesize;
+	prtempstrings_t	tempstrings;	//for PR_GetTempString
+	prstrzonepool_t	strzonepool;	//for PR_StrzoneAlloc
 
 	//originally defined in pr_exec, but moved into the switchable qcvm struct
 #define	MAX_STACK_DEPTH		1024 /*was 64*/	/* was 32 */
@@ -429,6 +608,8 @@ struct qcvm_s
 	int			reserved_edicts;
 	int			max_edicts;
 	edict_t		*edicts;			// can NOT be array indexed, because edict_t is variable sized, but can be used to reference the world ent
+	edictfreelist_t	freelist;		//for ED_Alloc
+	edictfindindexes_t	findindex;	//for find() and friends
 	qboolean	worldlocked;
 	struct qmodel_s	*worldmodel;
 	struct qmodel_s	*(*GetModel)(int modelindex);	//returns the model for the given index, or null.
@@ -436,6 +617,10 @@ struct qcvm_s
 	//originally from world.c
 	areanode_t	areanodes[AREA_NODES];
 	int			numareanodes;
+	int			broadphase;		//BROADPHASE_*, which one the edicts are currently linked into
+	aabbtree_t	aabbtree;
+	edict_t		**findradiuslist;	//scratch for findradius's areanode query
+	int			findradiuslistsize;
 
 
 #define QCEXTGLOBAL_FLOAT(n)	float fallback_##n;
@@ -375,6 +375,16 @@ void Host_InitCommands (void);
 void Host_Init (void);
 void Host_Shutdown(void);
 void Host_Callback_Notify (cvar_t *var);	/* callback function for CVAR_NOTIFY */
+
+extern	int		host_instance;		// which of the -instances servers is switched in
+extern	int		host_numinstances;
+void Host_InstanceGlobal (void *global, size_t size);
+void Host_SwitchInstance (int inst);
+
+#define MAX_HOST_WORKERS	16
+typedef void (*hostjobfunc_t) (void *ctx, int first, int count, int worker);
+void Host_ParallelFor (hostjobfunc_t func, void *ctx, int count, int grain);
+qboolean Host_JobsRunning (void);	//true while a Host_ParallelFor is in progress, so don't print etc
 FUNC_NORETURN void Host_Error (const char *error, ...) FUNC_PRINTF(1,2);
 FUNC_NORETURN void Host_EndGame (const char *message, ...) FUNC_PRINTF(1,2);
 #ifdef __WATCOMC__
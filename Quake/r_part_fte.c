@@ -491,171 +491,6 @@ static unsigned int cl_numstrisidx;
 static unsigned int cl_maxstrisidx;
 
 
-/*
-Q1BSP_RecursiveHullTrace
-Optimised version of vanilla's SV_RecursiveHullCheck that avoids the excessive pointcontents calls by using the traceline itself to check for contents.
-call Q1BSP_RecursiveHullCheck for a drop-in replacement of SV_RecursiveHullCheck, if desired.
-*/
-enum
-{
-	rht_solid,
-	rht_empty,
-	rht_impact
-};
-struct rhtctx_s
-{
-	vec3_t start, end;
-	mclipnode_t	*clipnodes;
-	mplane_t	*planes;
-};
-static int Q1BSP_RecursiveHullTrace (struct rhtctx_s *ctx, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace)
-{
-	mclipnode_t	*node;
-	mplane_t	*plane;
-	float		t1, t2;
-	vec3_t		mid;
-	int			side;
-	float		midf;
-	int rht;
-
-reenter:
-
-	if (num < 0)
-	{
-		/*hit a leaf*/
-		if (num == CONTENTS_SOLID)
-		{
-			if (trace->allsolid)
-				trace->startsolid = true;
-			return rht_solid;
-		}
-		else
-		{
-			trace->allsolid = false;
-			if (num == CONTENTS_EMPTY)
-				trace->inopen = true;
-			else
-				trace->inwater = true;
-			return rht_empty;
-		}
-	}
-
-	/*its a node*/
-
-	/*get the node info*/
-	node = ctx->clipnodes + num;
-	plane = ctx->planes + node->planenum;
-
-	if (plane->type < 3)
-	{
-		t1 = p1[plane->type] - plane->dist;
-		t2 = p2[plane->type] - plane->dist;
-	}
-	else
-	{
-		t1 = DotProduct (plane->normal, p1) - plane->dist;
-		t2 = DotProduct (plane->normal, p2) - plane->dist;
-	}
-
-	/*if its completely on one side, resume on that side*/
-	if (t1 >= 0 && t2 >= 0)
-	{
-		//return Q1BSP_RecursiveHullTrace (hull, node->children[0], p1f, p2f, p1, p2, trace);
-		num = node->children[0];
-		goto reenter;
-	}
-	if (t1 < 0 && t2 < 0)
-	{
-		//return Q1BSP_RecursiveHullTrace (hull, node->children[1], p1f, p2f, p1, p2, trace);
-		num = node->children[1];
-		goto reenter;
-	}
-
-	if (plane->type < 3)
-	{
-		t1 = ctx->start[plane->type] - plane->dist;
-		t2 = ctx->end[plane->type] - plane->dist;
-	}
-	else
-	{
-		t1 = DotProduct (plane->normal, ctx->start) - plane->dist;
-		t2 = DotProduct (plane->normal, ctx->end) - plane->dist;
-	}
-
-	side = t1 < 0;
-
-	midf = t1 / (t1 - t2);
-	if (midf < p1f) midf = p1f;
-	if (midf > p2f) midf = p2f;
-	VectorInterpolate(ctx->start, midf, ctx->end, mid);
-
-	rht = Q1BSP_RecursiveHullTrace(ctx, node->children[side], p1f, midf, p1, mid, trace);
-	if (rht != rht_empty && !trace->allsolid)
-		return rht;
-	rht = Q1BSP_RecursiveHullTrace(ctx, node->children[side^1], midf, p2f, mid, p2, trace);
-	if (rht != rht_solid)
-		return rht;
-
-	if (side)
-	{
-		/*we impacted the back of the node, so flip the plane*/
-		trace->plane.dist = -plane->dist;
-		VectorScale(plane->normal, -1, trace->plane.normal);
-		midf = (t1 + DIST_EPSILON) / (t1 - t2);
-	}
-	else
-	{
-		/*we impacted the front of the node*/
-		trace->plane.dist = plane->dist;
-		VectorCopy(plane->normal, trace->plane.normal);
-		midf = (t1 - DIST_EPSILON) / (t1 - t2);
-	}
-
-	t1 = DotProduct (trace->plane.normal, ctx->start) - trace->plane.dist;
-	t2 = DotProduct (trace->plane.normal, ctx->end) - trace->plane.dist;
-	midf = (t1 - DIST_EPSILON) / (t1 - t2);
-	if (midf < 0)
-		midf = 0;
-	if (midf > 1)
-		midf = 1;
-	trace->fraction = midf;
-	VectorCopy (mid, trace->endpos);
-	VectorInterpolate(ctx->start, midf, ctx->end, trace->endpos);
-
-	return rht_impact;
-}
-static qboolean Q1BSP_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace)
-{	//this function is basicall meant as a drop-in replacement for fte's SV_RecursiveHullCheck. p1f and p2f must be 0+1 respectively, num must be hull->firstclipnode
-	/*if (VectorEquals(p1, p2))
-	{
-		//points cannot cross planes, so do it faster
-		switch(Q1_HullPointContents(hull, num, p1))
-		{
-		case CONTENTS_SOLID:
-			trace->startsolid = true;
-			break;
-		case CONTENTS_EMPTY:
-			trace->allsolid = false;
-			trace->inopen = true;
-			break;
-		default:
-			trace->allsolid = false;
-			trace->inwater = true;
-			break;
-		}
-		return true;
-	}
-	else*/
-	{
-		struct rhtctx_s ctx;
-		VectorCopy(p1, ctx.start);
-		VectorCopy(p2, ctx.end);
-		ctx.clipnodes = hull->clipnodes;
-		ctx.planes = hull->planes;
-		return Q1BSP_RecursiveHullTrace(&ctx, num, p1f, p2f, p1, p2, trace) != rht_impact;
-	}
-}
-
 float CL_TraceLine (vec3_t start, vec3_t end, vec3_t impact, vec3_t normal, int *entnum)
 {	//FIXME: not sure what to do about startsolid.
 	int i;
@@ -679,7 +514,7 @@ float CL_TraceLine (vec3_t start, vec3_t end, vec3_t impact, vec3_t normal, int
 
 		memset (&trace, 0, sizeof(trace));
 		trace.fraction = 1;
-		Q1BSP_RecursiveHullCheck(&ent->model->hulls[0], ent->model->hulls[0].firstclipnode, 0, 1, relstart, relend, &trace);
+		World_HullTrace(&ent->model->hulls[0], relstart, relend, &trace, CONTENTMASK_FROMQ1(CONTENTS_SOLID));
 //		SV_RecursiveHullCheck (ent->model->hulls, ent->model->hulls[0].firstclipnode, 0, 1, relstart, relend, &trace);
 
 		if (frac > trace.fraction)
@@ -49,6 +49,8 @@ typedef struct
 
 	int			lastcheck;			// used by PF_checkclient
 	double		lastchecktime;
+	byte		*checkpvs;			// lastcheck's pvs. ericw -- changed to malloc
+	int			checkpvs_capacity;
 
 	qcvm_t		qcvm;				// Spike: entire qcvm state
 
@@ -102,6 +104,11 @@ typedef struct
 
 	qboolean skyroom_pos_known;
 	vec4_t skyroom_pos;
+
+	struct entdirty_s	*entdirty;	// [maxentdirty] see SV_UpdateEntityDirty
+	unsigned int	numentdirty;
+	unsigned int	maxentdirty;
+	unsigned int	entdirtytick;
 } server_t;
 
 
@@ -178,7 +185,11 @@ typedef struct client_s
 	} *previousentities;
 	size_t numpreviousentities;
 	size_t maxpreviousentities;
+	struct entity_num_state_s *nextentities;	//the snapshot being built, swapped with previousentities by SVFTE_CalcEntityDeltas
+	size_t numnextentities;
+	size_t maxnextentities;
 	unsigned int snapshotresume;
+	unsigned int snapshottick;	//sv.entdirtytick when previousentities was built
 	unsigned int *pendingentities_bits;	//UF_ flags for each entity
 	size_t numpendingentities;	//realloc if too small
 	unsigned int *pendingcsqcentities_bits;	//SendFlags bitflags for each entity
@@ -308,8 +319,10 @@ extern	cvar_t	coop;
 extern	cvar_t	fraglimit;
 extern	cvar_t	timelimit;
 
-extern	server_static_t	svs;				// persistant server info
-extern	server_t		sv;					// local server
+extern	server_static_t	*svs_current;
+extern	server_t		*sv_current;
+#define	svs		(*svs_current)			// persistant server info
+#define	sv		(*sv_current)			// local server
 
 extern	client_t	*host_client;
 
@@ -330,6 +343,7 @@ void SVFTE_Ack(client_t *client, int sequence);
 void SVFTE_DestroyFrames(client_t *client);
 void SV_BuildEntityState(client_t *client, edict_t *ent, entity_state_t *state);
 void SV_SendClientMessages (void);
+void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg);
 void SV_ClearDatagram (void);
 
 int SV_ModelIndex (const char *name);
@@ -361,5 +375,26 @@ void SV_SpawnServer (const char *server);
 
 void SV_SetupSkyRoom(char *value);
 
+// sv_profile.c
+typedef enum
+{
+	SVPROF_OTHER,		// anything not in one of the others
+	SVPROF_CLIENTS,		// new connections and client messages, including player movement
+	SVPROF_THINK,		// thinks, StartFrame, PlayerPreThink etc
+	SVPROF_PUSH,		// MOVETYPE_PUSH
+	SVPROF_TOSS,		// tosses, bounces, flies and missiles
+	SVPROF_WALK,		// players and monsters
+	SVPROF_LINK,		// SV_LinkEdict, including trigger touches
+	SVPROF_PVS,			// SV_FatPVS
+	SVPROF_SNAPSHOT,	// working out what each client can see
+	SVPROF_SEND,		// writing and sending everything else
+	SVPROF_NUMPHASES
+} svprofphase_t;
+void SV_ProfileInit (void);
+void SV_ProfileBeginFrame (void);
+void SV_ProfileEndFrame (void);
+void SV_ProfileEnter (svprofphase_t phase);	// time is charged to the innermost phase only
+void SV_ProfileLeave (void);
+
 #endif	/* _QUAKE_SERVER_H */
 
@@ -25,8 +25,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 #include "pmove.h"
 
-server_t	sv;
-server_static_t	svs;
+static server_t			sv_local;
+static server_static_t	svs_local;
+server_t			*sv_current = &sv_local;	//-instances switch these around, see Host_SwitchInstance
+server_static_t		*svs_current = &svs_local;
 
 static char	localmodels[MAX_MODELS][8];	// inline model names for precache
 
@@ -593,9 +595,256 @@ static void MSGFTE_WriteEntityUpdate(unsigned int bits, entity_state_t *state, s
 */
 }
 
-static struct entity_num_state_s *snapshot_entstate;
-static size_t snapshot_numents;
-static size_t snapshot_maxents;
+/*
+=============================================================================
+
+ENTITY UPDATE CACHE
+
+Clients that see an entity change the same way in the same frame are sent the same bytes,
+so each distinct update is only encoded for the first of them and copied for the rest.
+FTE updates are keyed by entity, delta bits and extensions, and the entity's state must
+match too. Vanilla updates are relative to the baseline, so there's only one per entity
+per frame. Everything is forgotten at the start of each frame.
+
+=============================================================================
+*/
+
+static cvar_t sv_entcache = {"sv_entcache", "1", CVAR_NONE};	//0 to encode every update for every client, 2 to do both and complain if they differ
+
+#define ENTCACHE_BUCKETS	4096	//power of two
+
+struct entcacheent_s
+{
+	int				next;		//next in the bucket's chain, or -1
+	unsigned int	entnum;
+	unsigned int	bits;
+	unsigned int	pext2;
+	entity_state_t	state;
+	size_t			ofs, len;	//into entcache.data
+};
+static struct
+{
+	unsigned int	frame;
+	int				buckets[ENTCACHE_BUCKETS];
+	struct entcacheent_s *ents;
+	size_t			numents, maxents;
+
+	struct
+	{
+		unsigned int	frame;	//valid if this matches entcache.frame
+		qboolean		send;
+		size_t			ofs, len;
+	} *nq;	//per edict
+	unsigned int	maxnq;
+
+	byte			*data;
+	size_t			datasize, maxdata;
+
+	unsigned int	hits, misses, mismatches;
+	size_t			bytessaved;
+} entcache;
+
+static qboolean SV_WriteEntityUpdate (edict_t *ent, unsigned int e, sizebuf_t *msg);
+
+static void SV_EntCacheBeginFrame (void)
+{
+	int i;
+	entcache.frame++;
+	entcache.numents = 0;
+	entcache.datasize = 0;
+	for (i = 0; i < ENTCACHE_BUCKETS; i++)
+		entcache.buckets[i] = -1;
+}
+
+//copies the bytes that were just written to msg since start into the cache
+static size_t SV_EntCacheStore (sizebuf_t *msg, int start)
+{
+	size_t ofs = entcache.datasize, len = msg->cursize - start;
+	if (ofs + len > entcache.maxdata)
+	{
+		entcache.maxdata = (ofs + len)*2;
+		entcache.data = (byte *) realloc (entcache.data, entcache.maxdata);
+		if (!entcache.data)
+			Sys_Error ("SV_EntCacheStore: realloc() failed on %u bytes", (unsigned int)entcache.maxdata);
+	}
+	memcpy (entcache.data + ofs, msg->data + start, len);
+	entcache.datasize += len;
+	return ofs;
+}
+
+//in verify mode, writes it again the slow way to make sure the cached version was right
+static void SV_EntCacheVerify (sizebuf_t *msg, int start, size_t ofs, size_t len, unsigned int entnum)
+{
+	int cached = msg->cursize;
+	SZ_Write (msg, entcache.data + ofs, len);
+	if ((size_t)(msg->cursize - cached) != (size_t)(cached - start) || memcmp(msg->data + start, msg->data + cached, len))
+	{
+		entcache.mismatches++;
+		Con_Warning ("entity %u: cached update differs\n", entnum);
+	}
+	msg->cursize = cached;	//keep the fresh one
+}
+
+/*
+=============
+SVFTE_WriteCachedEntityUpdate
+=============
+*/
+static void SVFTE_WriteCachedEntityUpdate (unsigned int entnum, unsigned int bits, entity_state_t *state, sizebuf_t *msg, unsigned int pext2)
+{
+	unsigned int bucket = (entnum*2654435761u ^ bits*40503u ^ pext2) & (ENTCACHE_BUCKETS-1);
+	struct entcacheent_s *c;
+	int i, start = msg->cursize;
+
+	if (!sv_entcache.value)
+	{
+		MSGFTE_WriteEntityUpdate(bits, state, msg, pext2, sv.protocolflags);
+		return;
+	}
+
+	for (i = entcache.buckets[bucket]; i >= 0; i = c->next)
+	{
+		c = &entcache.ents[i];
+		if (c->entnum == entnum && c->bits == bits && c->pext2 == pext2 && !memcmp(&c->state, state, sizeof(*state)))
+		{
+			entcache.hits++;
+			entcache.bytessaved += c->len;
+			if (sv_entcache.value >= 2)
+			{
+				MSGFTE_WriteEntityUpdate(bits, state, msg, pext2, sv.protocolflags);
+				SV_EntCacheVerify (msg, start, c->ofs, c->len, entnum);
+			}
+			else
+				SZ_Write (msg, entcache.data + c->ofs, c->len);
+			return;
+		}
+	}
+
+	entcache.misses++;
+	MSGFTE_WriteEntityUpdate(bits, state, msg, pext2, sv.protocolflags);
+	if (entcache.numents == entcache.maxents)
+	{
+		entcache.maxents += 256;
+		entcache.ents = (struct entcacheent_s *) realloc (entcache.ents, entcache.maxents*sizeof(*entcache.ents));
+		if (!entcache.ents)
+			Sys_Error ("SVFTE_WriteCachedEntityUpdate: realloc() failed on %u entities", (unsigned int)entcache.maxents);
+	}
+	c = &entcache.ents[entcache.numents];
+	c->entnum = entnum;
+	c->bits = bits;
+	c->pext2 = pext2;
+	c->state = *state;
+	c->len = msg->cursize - start;
+	c->ofs = SV_EntCacheStore (msg, start);
+	c->next = entcache.buckets[bucket];
+	entcache.buckets[bucket] = entcache.numents++;
+}
+
+/*
+=============
+SV_WriteCachedEntityUpdate
+
+SV_WriteEntityUpdate, but only the first time each frame. Returns false if the entity isn't sent.
+Entities with customizeentityforclient may look different to each client, so are never cached.
+=============
+*/
+static qboolean SV_WriteCachedEntityUpdate (edict_t *ent, unsigned int e, sizebuf_t *msg, qboolean customized)
+{
+	int start = msg->cursize;
+	qboolean send;
+
+	if (!sv_entcache.value || customized)
+		return SV_WriteEntityUpdate (ent, e, msg);
+
+	if (e >= entcache.maxnq)
+	{
+		entcache.maxnq = qcvm->max_edicts;
+		entcache.nq = realloc (entcache.nq, entcache.maxnq*sizeof(*entcache.nq));
+		if (!entcache.nq)
+			Sys_Error ("SV_WriteCachedEntityUpdate: realloc() failed on %u edicts", entcache.maxnq);
+		memset (entcache.nq, 0, entcache.maxnq*sizeof(*entcache.nq));
+	}
+
+	if (entcache.nq[e].frame == entcache.frame)
+	{
+		entcache.hits++;
+		if (!entcache.nq[e].send)
+			return false;
+		entcache.bytessaved += entcache.nq[e].len;
+		if (sv_entcache.value >= 2)
+		{
+			SV_WriteEntityUpdate (ent, e, msg);
+			SV_EntCacheVerify (msg, start, entcache.nq[e].ofs, entcache.nq[e].len, e);
+		}
+		else
+			SZ_Write (msg, entcache.data + entcache.nq[e].ofs, entcache.nq[e].len);
+		return true;
+	}
+
+	entcache.misses++;
+	send = SV_WriteEntityUpdate (ent, e, msg);
+	entcache.nq[e].frame = entcache.frame;
+	entcache.nq[e].send = send;
+	entcache.nq[e].len = msg->cursize - start;
+	entcache.nq[e].ofs = SV_EntCacheStore (msg, start);
+	return send;
+}
+
+/*
+=============
+SV_EntCacheStats_f
+=============
+*/
+static void SV_EntCacheStats_f (void)
+{
+	unsigned int total = entcache.hits + entcache.misses;
+	if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset"))
+	{
+		entcache.hits = entcache.misses = entcache.mismatches = 0;
+		entcache.bytessaved = 0;
+		return;
+	}
+	Con_Printf ("entity update cache: %u hits, %u misses (%.1f%% hit)\n", entcache.hits, entcache.misses, total?100.0*entcache.hits/total:0);
+	Con_Printf ("%u kb not re-encoded, %u kb cached last frame\n", (unsigned int)(entcache.bytessaved/1024), (unsigned int)(entcache.datasize/1024));
+	if (entcache.mismatches)
+		Con_Warning ("%u cached updates were wrong\n", entcache.mismatches);
+}
+
+//an entity whose customizeentityforclient was already run for a client, see SV_PresendClientDatagrams
+struct snapshotcustom_s
+{
+	unsigned int	num;
+	qboolean		visible;
+	entity_state_t	state;
+};
+
+/*
+once per frame, before any snapshots are built, SV_UpdateEntityDirty builds every edict's
+entity state without any client-specific tweaks and notes which ones actually changed.
+snapshots copy these instead of rebuilding them per client, and deltas skip entities that
+have not changed since the client's previous snapshot, as those would have had no bits anyway.
+*/
+struct entdirty_s
+{
+	entity_state_t	state;			//as built by SV_BuildEntityState with no client
+	int				owner;			//plus the other fields that affect the per-client state
+	int				viewmodelforclient;
+	int				exteriormodeltoclient;
+	unsigned int	changedtick;	//sv.entdirtytick when any of the above last changed
+	qboolean		valid;			//false if the edict was free
+	qboolean		customized;		//had a customizeentityforclient, so snapshots may have differed from state
+};
+static cvar_t sv_entdirty = {"sv_entdirty", "1", CVAR_NONE};	//0 to build+compare everything per client, 2 to do both and complain if they disagree
+static cvar_t sv_parallelsnapshots = {"sv_parallelsnapshots", "1", CVAR_NONE};	//build client snapshots on host_workers' threads
+
+static qboolean SV_EntityUnchangedSince (client_t *client, unsigned int num)
+{
+	struct entdirty_s *d;
+	if (num >= sv.numentdirty)
+		return false;
+	d = &sv.entdirty[num];
+	return d->valid && d->changedtick <= client->snapshottick && num != (unsigned int)NUM_FOR_EDICT(client->edict);
+}
 
 void SVFTE_DestroyFrames(client_t *client)
 {
@@ -612,6 +861,11 @@ void SVFTE_DestroyFrames(client_t *client)
 	client->previousentities = NULL;
 	client->numpreviousentities = 0;
 	client->maxpreviousentities = 0;
+	client->snapshottick = 0;
+	free(client->nextentities);
+	client->nextentities = NULL;
+	client->numnextentities = 0;
+	client->maxnextentities = 0;
 
 
 	if (client->pendingentities_bits)
@@ -644,6 +898,7 @@ static void SVFTE_SetupFrames(client_t *client)
 	memset(client->oldstats_i, 0, sizeof(client->oldstats_i));
 	memset(client->oldstats_f, 0, sizeof(client->oldstats_f));
 	client->lastmovemessage = 0;	//it'll clear this too
+	client->snapshottick = 0;
 
 	if (!client->protocol_pext2)
 	{
@@ -831,8 +1086,8 @@ static void SVFTE_CalcEntityDeltas(client_t *client)
 		client->pendingentities_bits[0] = UF_REMOVE;
 	}
 
-	news = snapshot_entstate;
-	newstop = news + snapshot_numents;
+	news = client->nextentities;
+	newstop = news + client->numnextentities;
 	olds = client->previousentities;
 	oldstop = olds+client->numpreviousentities;
 
@@ -860,7 +1115,10 @@ static void SVFTE_CalcEntityDeltas(client_t *client)
 			//its flagged for removing, that's weird... must be some killer packetloss. turn that back into a reset or something
 			if (client->pendingentities_bits[news->num] & UF_REMOVE)
 				client->pendingentities_bits[news->num] = (client->pendingentities_bits[news->num] & ~UF_REMOVE) | UF_RESET2;
-			client->pendingentities_bits[news->num] |= MSGFTE_DeltaCalcBits(&olds->state, &news->state);
+			if (!SV_EntityUnchangedSince(client, news->num))
+				client->pendingentities_bits[news->num] |= MSGFTE_DeltaCalcBits(&olds->state, &news->state);
+			else if (sv_entdirty.value >= 2 && MSGFTE_DeltaCalcBits(&olds->state, &news->state) && !Host_JobsRunning())
+				Con_Warning("SVFTE_CalcEntityDeltas: entity %u changed without being flagged\n", news->num);
 			news++;
 			olds++;
 		}
@@ -872,13 +1130,14 @@ static void SVFTE_CalcEntityDeltas(client_t *client)
 	olds = client->previousentities;
 	oldstop = olds + client->maxpreviousentities;
 
-	client->previousentities = snapshot_entstate;
-	client->numpreviousentities = snapshot_numents;
-	client->maxpreviousentities = snapshot_maxents;
+	client->previousentities = client->nextentities;
+	client->numpreviousentities = client->numnextentities;
+	client->maxpreviousentities = client->maxnextentities;
+	client->snapshottick = sv.entdirtytick;
 
-	snapshot_entstate = olds;
-	snapshot_numents = 0;
-	snapshot_maxents = oldstop-olds;
+	client->nextentities = olds;
+	client->numnextentities = 0;
+	client->maxnextentities = oldstop-olds;
 }
 static void SVFTE_WriteEntitiesToClient(client_t *client, sizebuf_t *msg, size_t overflowsize)
 {
@@ -955,7 +1214,7 @@ static void SVFTE_WriteEntitiesToClient(client_t *client, sizebuf_t *msg, size_t
 				else
 					MSG_WriteShort(msg, entnum);
 //				SV_EmitDeltaEntIndex(msg, j, false, true);
-				MSGFTE_WriteEntityUpdate(netbits, &state->state, msg, client->protocol_pext2, sv.protocolflags);
+				SVFTE_WriteCachedEntityUpdate(entnum, netbits, &state->state, msg, client->protocol_pext2);
 			}
 		}
 
@@ -1185,35 +1444,109 @@ void SV_BuildEntityState(client_t *client, edict_t *ent, entity_state_t *state)
 		state->solidsize = 0;
 }
 
-byte *SV_FatPVS (vec3_t org, qmodel_t *worldmodel);
-static void SV_AddToFatPVS (vec3_t org, mnode_t *node, qmodel_t *worldmodel);
-static void SVFTE_BuildSnapshotForClient (client_t *client)
+/*
+=============
+SV_UpdateEntityDirty
+
+Builds the client-independent state of every edict, and flags the ones that changed since last time.
+Entities with customizeentityforclient are always flagged, as their state can change per client.
+=============
+*/
+static void SV_UpdateEntityDirty (void)
 {
-	unsigned int	e, i;
-	byte			*pvs;
-	vec3_t			org;
-	edict_t			*ent, *parent;
-	unsigned int	maxentities = client->limit_entities;
-	edict_t			*clent = client->edict;
+	unsigned int	e, num = qcvm->num_edicts;
+	edict_t			*ent;
 	eval_t			*val;
-	unsigned char	eflags;
-	int proged = EDICT_TO_PROG(clent);
+	struct entdirty_s *d;
+	entity_state_t	state;
+	int				viewmodelforclient, exteriormodeltoclient;
+	qboolean		customized;
 
-	struct entity_num_state_s *ents = snapshot_entstate;
-	size_t numents = 0;
-	size_t maxents = snapshot_maxents;
-	int emiteffect;
-	int iscsqc;
-	qboolean cancsqc = GetEdictFieldValid(SendEntity) && GetEdictFieldValid(SendFlags) && client->csqcactive;
+	if (!sv_entdirty.value)
+	{
+		sv.numentdirty = 0;	//everything gets flagged again if its reenabled.
+		return;
+	}
+	if (num > sv.maxentdirty)
+	{
+		sv.maxentdirty = qcvm->max_edicts;
+		sv.entdirty = (struct entdirty_s *) realloc (sv.entdirty, sv.maxentdirty*sizeof(*sv.entdirty));
+		if (!sv.entdirty)
+			Sys_Error ("SV_UpdateEntityDirty: realloc() failed on %u edicts", sv.maxentdirty);
+	}
 
-// find the client's PVS
-	VectorAdd (clent->v.origin, clent->v.view_ofs, org);
+	sv.entdirtytick++;
+	memset (&state, 0, sizeof(state));	//don't let padding look like changes
+	for (e = 0, ent = qcvm->edicts; e < num; e++, ent = NEXT_EDICT(ent))
+	{
+		d = &sv.entdirty[e];
+		if (e >= sv.numentdirty)
+			d->valid = false;
+		if (ent->free)
+		{
+			d->valid = false;
+			d->changedtick = sv.entdirtytick;
+			continue;
+		}
+
+		SV_BuildEntityState(NULL, ent, &state);
+		val = GetEdictFieldValue(ent, qcvm->extfields.viewmodelforclient);
+		viewmodelforclient = val?val->edict:0;
+		val = GetEdictFieldValue(ent, qcvm->extfields.exteriormodeltoclient);
+		exteriormodeltoclient = val?val->edict:0;
+		val = GetEdictFieldValue(ent, qcvm->extfields.customizeentityforclient);
+		customized = val && val->function;
+
+		if (!d->valid || customized || d->customized || memcmp(&d->state, &state, sizeof(state)) ||
+			d->owner != ent->v.owner || d->viewmodelforclient != viewmodelforclient || d->exteriormodeltoclient != exteriormodeltoclient)
+		{
+			d->state = state;
+			d->owner = ent->v.owner;
+			d->viewmodelforclient = viewmodelforclient;
+			d->exteriormodeltoclient = exteriormodeltoclient;
+			d->changedtick = sv.entdirtytick;
+			d->valid = true;
+			d->customized = customized;
+		}
+	}
+	sv.numentdirty = num;
+}
+
+byte *SV_FatPVS (vec3_t org, qmodel_t *worldmodel);
+static void SV_AddToFatPVS (vec3_t org, mnode_t *node, qmodel_t *worldmodel);
+
+/*
+=============
+SVFTE_SnapshotPVS
+
+Returns the pvs used to cull the client's snapshot. This is SV_FatPVS's shared buffer.
+=============
+*/
+static byte *SVFTE_SnapshotPVS (client_t *client)
+{
+	byte	*pvs;
+	vec3_t	org;
+
+	VectorAdd (client->edict->v.origin, client->edict->v.view_ofs, org);
 	pvs = SV_FatPVS (org, qcvm->worldmodel);
 	if (sv.skyroom_pos_known)
 	{
 		VectorMA(sv.skyroom_pos, sv.skyroom_pos[3], org, org);
 		SV_AddToFatPVS (org, qcvm->worldmodel->nodes, qcvm->worldmodel); //spike -- allow _skyroom term to punch a hole through the server's pvs. FIXME: no paralax considered here.
 	}
+	return pvs;
+}
+
+/*
+=============
+SVFTE_SnapshotEntities
+
+How many edicts the client's snapshot may consider. Makes sure the csqc bits cover them.
+=============
+*/
+static unsigned int SVFTE_SnapshotEntities (client_t *client)
+{
+	unsigned int	maxentities = client->limit_entities;
 
 	if (maxentities > (unsigned int)qcvm->num_edicts)
 		maxentities = (unsigned int)qcvm->num_edicts;
@@ -1225,129 +1558,191 @@ static void SVFTE_BuildSnapshotForClient (client_t *client)
 		memset(client->pendingcsqcentities_bits+client->numpendingcsqcentities, 0, sizeof(*client->pendingcsqcentities_bits)*(newmax-client->numpendingcsqcentities));
 		client->numpendingcsqcentities = newmax;
 	}
-	
-// send over all entities (excpet the client) that touch the pvs
-	ent = NEXT_EDICT(qcvm->edicts);
-	for (e=1 ; e<maxentities ; e++, ent = NEXT_EDICT(ent))
+	return maxentities;
+}
+
+/*
+=============
+SVFTE_SnapshotEntity
+
+Decides whether entity e belongs in the client's snapshot, filling in its state if so.
+Only runs customizeentityforclient if allowqc is set, so this is safe to call from worker
+threads for other entities.
+=============
+*/
+static qboolean SVFTE_SnapshotEntity (client_t *client, const byte *pvs, unsigned int e, edict_t *ent, qboolean allowqc, entity_state_t *state)
+{
+	unsigned int	i;
+	edict_t			*parent;
+	edict_t			*clent = client->edict;
+	eval_t			*val;
+	unsigned char	eflags;
+	int proged = EDICT_TO_PROG(clent);
+	int emiteffect;
+	int iscsqc;
+	qboolean customized = false;
+	qboolean cancsqc = GetEdictFieldValid(SendEntity) && GetEdictFieldValid(SendFlags) && client->csqcactive;
+
+	if (ent->free)
+		goto invisible;
+	val = GetEdictFieldValue(ent, qcvm->extfields.customizeentityforclient);
+	if (val && val->function && allowqc)
 	{
-		if (ent->free)
+		customized = true;
+		pr_global_struct->self = EDICT_TO_PROG(ent);	//ent being customised
+		pr_global_struct->other = proged;				//player they're being customised for
+		PR_ExecuteProgram(val->function);
+		if (!G_FLOAT(OFS_RETURN))
 			goto invisible;
-		val = GetEdictFieldValue(ent, qcvm->extfields.customizeentityforclient);
-		if (val && val->function)
-		{
-			pr_global_struct->self = EDICT_TO_PROG(ent);	//ent being customised
-			pr_global_struct->other = proged;				//player they're being customised for
-			PR_ExecuteProgram(val->function);
-			if (!G_FLOAT(OFS_RETURN))
-				goto invisible;
-		}
+	}
 
-		eflags = 0;
-		emiteffect = GetEdictFieldEval(ent, emiteffectnum)->_float;
-		iscsqc = cancsqc && GetEdictFieldEval(ent, SendEntity)->function;
-		if (ent != clent)	// clent is ALLWAYS sent
+	eflags = 0;
+	emiteffect = GetEdictFieldEval(ent, emiteffectnum)->_float;
+	iscsqc = cancsqc && GetEdictFieldEval(ent, SendEntity)->function;
+	if (ent != clent)	// clent is ALLWAYS sent
+	{
+		// ignore ents without visible models
+		if ((!ent->v.modelindex || !PR_GetString(ent->v.model)[0]) && !emiteffect && !iscsqc)
 		{
-			// ignore ents without visible models
-			if ((!ent->v.modelindex || !PR_GetString(ent->v.model)[0]) && !emiteffect && !iscsqc)
-			{
 invisible:
-				if (client->pendingcsqcentities_bits[e] && !((int)GetEdictFieldEval(ent, pvsflags)->_float & PVSF_NOREMOVE))
-					client->pendingcsqcentities_bits[e] |= SENDFLAG_REMOVE;
-				continue;
-			}
+			if (client->pendingcsqcentities_bits[e] && !((int)GetEdictFieldEval(ent, pvsflags)->_float & PVSF_NOREMOVE))
+				client->pendingcsqcentities_bits[e] |= SENDFLAG_REMOVE;
+			return false;
+		}
 
-			val = GetEdictFieldValue(ent, qcvm->extfields.viewmodelforclient);
-			if (val && val->edict == proged)
-				eflags |= EFLAGS_VIEWMODEL;
-			else if (val && val->edict)
-				goto invisible;
-			else switch((int)GetEdictFieldEval(ent, pvsflags)->_float&PVSF_MODE_MASK)
+		val = GetEdictFieldValue(ent, qcvm->extfields.viewmodelforclient);
+		if (val && val->edict == proged)
+			eflags |= EFLAGS_VIEWMODEL;
+		else if (val && val->edict)
+			goto invisible;
+		else switch((int)GetEdictFieldEval(ent, pvsflags)->_float&PVSF_MODE_MASK)
+		{
+		case PVSF_NOTRACECHECK:	//we don't do trace checks anyway, oh well.
+		case PVSF_NORMALPVS:
+			//attached entities should use the pvs of the parent rather than the child (because the child will typically be bugging out around '0 0 0', so won't be useful)
+			parent = ent;
+			while (GetEdictFieldEval(parent, tag_entity)->edict)
+				parent = PROG_TO_EDICT(GetEdictFieldEval(parent, tag_entity)->edict);
+			if (parent->num_leafs < MAX_ENT_LEAFS)	//assumed to be in all leafs, if there's an overflow.
 			{
-			case PVSF_NOTRACECHECK:	//we don't do trace checks anyway, oh well.
-			case PVSF_NORMALPVS:
-				//attached entities should use the pvs of the parent rather than the child (because the child will typically be bugging out around '0 0 0', so won't be useful)
-				parent = ent;
-				while (GetEdictFieldEval(parent, tag_entity)->edict)
-					parent = PROG_TO_EDICT(GetEdictFieldEval(parent, tag_entity)->edict);
-				if (parent->num_leafs < MAX_ENT_LEAFS)	//assumed to be in all leafs, if there's an overflow.
-				{
-					// ignore if not touching a PV leaf
-					for (i=0 ; i < parent->num_leafs ; i++)
-						if (pvs[parent->leafnums[i] >> 3] & (1 << (parent->leafnums[i]&7) ))
-							break;
-					if (i == parent->num_leafs)
-						goto invisible;		// not visible
-				}
-				break;
-			case PVSF_USEPHS:	//we don't support PHS. expand it wider than asked
-			case PVSF_IGNOREPVS:
-				break;
+				// ignore if not touching a PV leaf
+				for (i=0 ; i < parent->num_leafs ; i++)
+					if (pvs[parent->leafnums[i] >> 3] & (1 << (parent->leafnums[i]&7) ))
+						break;
+				if (i == parent->num_leafs)
+					goto invisible;		// not visible
 			}
+			break;
+		case PVSF_USEPHS:	//we don't support PHS. expand it wider than asked
+		case PVSF_IGNOREPVS:
+			break;
 		}
+	}
 
-		val = GetEdictFieldValue(ent, qcvm->extfields.nodrawtoclient);
-		if (val && val->edict == proged)
-			goto invisible;
-		val = GetEdictFieldValue(ent, qcvm->extfields.drawonlytoclient);
-		if (val && val->edict && val->edict != proged)
-			goto invisible;
+	val = GetEdictFieldValue(ent, qcvm->extfields.nodrawtoclient);
+	if (val && val->edict == proged)
+		goto invisible;
+	val = GetEdictFieldValue(ent, qcvm->extfields.drawonlytoclient);
+	if (val && val->edict && val->edict != proged)
+		goto invisible;
 
-		//okay, we care about this entity.
+	//okay, we care about this entity.
 
-		if (iscsqc)
-		{
-			if (!(client->pendingcsqcentities_bits[e] & SENDFLAG_PRESENT))
-				client->pendingcsqcentities_bits[e] |= SENDFLAG_USABLE;	//this ent is new. be sure to flag ALL bits.
-			else
-				client->pendingcsqcentities_bits[e] |= (int)GetEdictFieldEval(ent, SendFlags)->_float & SENDFLAG_USABLE;	//let the SendEntity function know which fields need to be updated.
-			continue;
+	if (iscsqc)
+	{
+		if (!(client->pendingcsqcentities_bits[e] & SENDFLAG_PRESENT))
+			client->pendingcsqcentities_bits[e] |= SENDFLAG_USABLE;	//this ent is new. be sure to flag ALL bits.
+		else
+			client->pendingcsqcentities_bits[e] |= (int)GetEdictFieldEval(ent, SendFlags)->_float & SENDFLAG_USABLE;	//let the SendEntity function know which fields need to be updated.
+		return false;
+	}
+	if (client->pendingcsqcentities_bits[e])
+		client->pendingcsqcentities_bits[e] |= SENDFLAG_REMOVE;
+
+	if (e < sv.numentdirty && sv.entdirty[e].valid && !customized)
+	{	//SV_UpdateEntityDirty already built it, only the client-specific part needs redoing
+		*state = sv.entdirty[e].state;
+		if (ent->v.owner == proged)
+			state->solidsize = 0;
+	}
+	else
+		SV_BuildEntityState(client, ent, state);
+	if ((unsigned int)state->modelindex >= client->limit_models)
+		state->modelindex = 0;
+	if (ent == clent)	//add velocity, but we only care for the local player (should add prediction for other entities some time too).
+	{
+		if (client->usingpmove)
+			state->pmovetype = ent->v.movetype;	//looks like prediction is available. assuming SV_RunClientCommand just calls runstandardplayerphysics then we can predict it with matching clientside stuff.
+		else
+			state->pmovetype = 0;	//fixme: we don't do prediction, so don't tell the client that it can try
+		if (state->pmovetype)
+		{	//add some extra pmove flags...
+			eval_t *pmflags = GetEdictFieldValue(ent, qcvm->extfields.pmove_flags);
+			if ((int)ent->v.flags & FL_ONGROUND)	//nq likes to know this for bob states.
+				state->pmovetype |= 0x80;
+			if ((int)pmflags->_float & 1)	//'jump_held' so no pogostick surprises.
+				state->pmovetype |= 0x40;
 		}
-		if (client->pendingcsqcentities_bits[e])
-			client->pendingcsqcentities_bits[e] |= SENDFLAG_REMOVE;
+		state->velocity[0] = ent->v.velocity[0]*8;
+		state->velocity[1] = ent->v.velocity[1]*8;
+		state->velocity[2] = ent->v.velocity[2]*8;
+	}
+	/*TODO: other players *should* provide movetype+msec+v_angle+movement+velocity info so they can be extrapolated by fancy clients*/
+	else if (ent->alpha == ENTALPHA_ZERO && !ent->v.effects)	//don't send invisible entities unless they have effects
+		return false;
+	val = GetEdictFieldValue(ent, qcvm->extfields.exteriormodeltoclient);
+	if (val && val->edict == proged)
+		eflags |= EFLAGS_EXTERIORMODEL;
+	//EFLAGS_VIEWMODEL was handled above
+	state->eflags |= eflags;
+	return true;
+}
 
+/*
+=============
+SVFTE_BuildSnapshotForClient
+
+Fills client->nextentities with everything the client can see.
+custom lists the entities whose customizeentityforclient already ran for this client (in
+ascending order), which are taken as-is instead of being looked at again.
+=============
+*/
+static void SVFTE_BuildSnapshotForClient (client_t *client, const byte *pvs, unsigned int maxentities, const struct snapshotcustom_s *custom, size_t numcustom, qboolean allowqc)
+{
+	unsigned int	e;
+	edict_t			*ent;
+	struct entity_num_state_s *ents = client->nextentities;
+	size_t numents = 0;
+	size_t maxents = client->maxnextentities;
+	const struct snapshotcustom_s *customend = custom + numcustom;
+
+// send over all entities (excpet the client) that touch the pvs
+	ent = NEXT_EDICT(qcvm->edicts);
+	for (e=1 ; e<maxentities ; e++, ent = NEXT_EDICT(ent))
+	{
 		if (numents == maxents)
 		{
 			maxents += 64;
 			ents = realloc(ents, maxents*sizeof(*ents));
 		}
 
-		ents[numents].num = e;
-		SV_BuildEntityState(client, ent, &ents[numents].state);
-		if ((unsigned int)ents[numents].state.modelindex >= client->limit_models)
-			ents[numents].state.modelindex = 0;
-		if (ent == clent)	//add velocity, but we only care for the local player (should add prediction for other entities some time too).
+		if (custom < customend && custom->num == e)
 		{
-			if (client->usingpmove)
-				ents[numents].state.pmovetype = ent->v.movetype;	//looks like prediction is available. assuming SV_RunClientCommand just calls runstandardplayerphysics then we can predict it with matching clientside stuff.
-			else
-				ents[numents].state.pmovetype = 0;	//fixme: we don't do prediction, so don't tell the client that it can try
-			if (ents[numents].state.pmovetype)
-			{	//add some extra pmove flags...
-				eval_t *pmflags = GetEdictFieldValue(ent, qcvm->extfields.pmove_flags);
-				if ((int)ent->v.flags & FL_ONGROUND)	//nq likes to know this for bob states.
-					ents[numents].state.pmovetype |= 0x80;
-				if ((int)pmflags->_float & 1)	//'jump_held' so no pogostick surprises.
-					ents[numents].state.pmovetype |= 0x40;
+			if (custom->visible)
+			{
+				ents[numents].num = e;
+				ents[numents].state = custom->state;
+				numents++;
 			}
-			ents[numents].state.velocity[0] = ent->v.velocity[0]*8;
-			ents[numents].state.velocity[1] = ent->v.velocity[1]*8;
-			ents[numents].state.velocity[2] = ent->v.velocity[2]*8;
+			custom++;
 		}
-		/*TODO: other players *should* provide movetype+msec+v_angle+movement+velocity info so they can be extrapolated by fancy clients*/
-		else if (ent->alpha == ENTALPHA_ZERO && !ent->v.effects)	//don't send invisible entities unless they have effects
-			continue;
-		val = GetEdictFieldValue(ent, qcvm->extfields.exteriormodeltoclient);
-		if (val && val->edict == proged)
-			eflags |= EFLAGS_EXTERIORMODEL;
-		//EFLAGS_VIEWMODEL was handled above
-		ents[numents].state.eflags |= eflags;
-
-		numents++;
+		else if (SVFTE_SnapshotEntity(client, pvs, e, ent, allowqc, &ents[numents].state))
+			ents[numents++].num = e;
 	}
 
-	snapshot_entstate = ents;
-	snapshot_numents = numents;
-	snapshot_maxents = maxents;
+	client->nextentities = ents;
+	client->numnextentities = numents;
+	client->maxnextentities = maxents;
 }
 
 void MSG_WriteStaticOrBaseLine(sizebuf_t *buf, int idx, entity_state_t *state, unsigned int protocol_pext2, unsigned int protocol, unsigned int protocolflags)
@@ -1520,6 +1915,375 @@ static void SV_Protocol_f (void)
 	}
 }
 
+/*
+===============
+SV_TickBenchmark_f
+
+Runs extra server ticks back to back and reports what they cost, so edict layout changes
+and the like can be compared. Optionally pads the world out with idle edicts first so the
+per-edict loops have something to chew on, eg: max_edicts 8192; map start; sv_tickbenchmark 1000 8000
+Entity updates are encoded for every client but never sent.
+===============
+*/
+static void SV_TickBenchmark_f (void)
+{
+	static byte	buf[65536];
+	sizebuf_t	msg;
+	int			ticks, pad, *padded, numpadded, live, i, j;
+	double		t, physics, encode;
+	client_t	*client;
+	edict_t		*ed;
+
+	if (!sv.active)
+	{
+		Con_Printf ("no server running\n");
+		return;
+	}
+	ticks = (Cmd_Argc() > 1) ? atoi(Cmd_Argv(1)) : 1000;
+	pad = (Cmd_Argc() > 2) ? atoi(Cmd_Argv(2)) : 0;
+	if (ticks < 1)
+	{
+		Con_Printf ("usage: sv_tickbenchmark [ticks] [edicts]\n");
+		return;
+	}
+
+	PR_SwitchQCVM(&sv.qcvm);
+	pad = q_min(pad, qcvm->max_edicts);
+	padded = (int *) malloc (q_max(pad, 1) * sizeof(*padded));
+	// count live edicts, a previous run's padding is free but still in num_edicts
+	for (i = live = 0; i < qcvm->num_edicts; i++)
+		if (!EDICT_NUM(i)->free)
+			live++;
+	for (numpadded = 0; live < pad && qcvm->num_edicts < qcvm->max_edicts; numpadded++, live++)
+	{
+		ed = ED_Alloc ();
+		ed->v.classname = PR_SetEngineString("tickbenchmark");
+		padded[numpadded] = NUM_FOR_EDICT(ed);
+	}
+
+	physics = encode = 0;
+	for (i = 0; i < ticks; i++)
+	{
+		SV_ClearDatagram ();
+
+		t = Sys_DoubleTime ();
+		pr_global_struct->frametime = 1.0/72;
+		SV_Physics (1.0/72);
+		physics += Sys_DoubleTime () - t;
+
+		t = Sys_DoubleTime ();
+		SV_EntCacheBeginFrame ();	//otherwise every tick would replay the last real frame's updates from the cache
+		for (j = 0, client = svs.clients; j < svs.maxclients; j++, client++)
+		{
+			if (!client->active || !client->spawned)
+				continue;
+			memset (&msg, 0, sizeof(msg));
+			msg.data = buf;
+			msg.maxsize = sizeof(buf);
+			msg.allowoverflow = true;
+			SV_WriteEntitiesToClient (client, &msg);
+		}
+		encode += Sys_DoubleTime () - t;
+	}
+	SV_ClearDatagram ();
+
+	for (i = 0; i < numpadded; i++)
+		ED_Free (EDICT_NUM(padded[i]));
+	free (padded);
+
+	Con_Printf ("%i ticks with %i edicts (max_edicts %i):\n", ticks, live, qcvm->max_edicts);
+	Con_Printf ("physics: %.3f ms/tick\n", physics * 1000 / ticks);
+	Con_Printf ("entity encoding: %.3f ms/tick\n", encode * 1000 / ticks);
+	PR_SwitchQCVM(NULL);
+}
+
+/*
+=============================================================================
+
+SERVER BENCHMARK
+
+Connects a bunch of in-process clients that send scripted input through the
+normal network paths, then runs whole server frames back to back and reports
+what they cost. The report is one "benchmark <key> <value>" per line so that
+scripts can diff runs, eg: quakespasm -dedicated -benchmark_server e1m1 2000 16
+
+=============================================================================
+*/
+
+#define BENCHMARK_TICKRATE		(1.0/72)
+#define BENCHMARK_CONNECTTICKS	(72*10)	//give up if they're not all in after this many
+
+typedef struct
+{
+	client_t			*client;
+	struct qsocket_s	*sock;
+	int					stage;			//how far through the signon it got
+	unsigned int		ackedsequence;	//for fte's entity deltas
+	unsigned int		movemessages;
+	int					reliablebytes, unreliablebytes, packets;
+} benchclient_t;
+
+static double SV_BenchmarkTime (void)
+{	//Sys_DoubleTime may only be good for a millisecond, which is most of a tick.
+#if SDL_VERSION_ATLEAST(2,0,0)
+	return (double)SDL_GetPerformanceCounter () / SDL_GetPerformanceFrequency ();
+#else
+	return Sys_DoubleTime ();
+#endif
+}
+
+static int SV_BenchmarkCompareTimes (const void *a, const void *b)
+{
+	double da = *(const double *)a, db = *(const double *)b;
+	return (da > db) - (da < db);
+}
+
+/*
+===============
+SV_BenchmarkInput
+
+Writes whatever the client would have sent this tick. Movement is scripted from
+the client and tick numbers so every run sees the same thing.
+===============
+*/
+static void SV_BenchmarkInput (benchclient_t *bc, int clientnum, int tick, qboolean nq)
+{
+	byte		buf[MAX_DATAGRAM];
+	sizebuf_t	msg;
+	client_t	*client = bc->client;
+	unsigned int seq;
+	vec3_t		angles;
+	int			i, buttons;
+
+	memset (&msg, 0, sizeof(msg));
+	msg.data = buf;
+	msg.maxsize = sizeof(buf);
+
+	switch (bc->stage)
+	{
+	case 0:
+		if (!client->pextknown)
+		{	//the server stuffs 'cmd pext' at us and waits.
+			MSG_WriteByte (&msg, clc_stringcmd);
+			if (nq)
+				MSG_WriteString (&msg, "pext");
+			else
+				MSG_WriteString (&msg, va("pext 0x%x 0x%x 0x%x 0x%x", PROTOCOL_FTE_PEXT1, PEXT1_SUPPORTED_SERVER, PROTOCOL_FTE_PEXT2, PEXT2_SUPPORTED_SERVER));
+			bc->stage = 1;
+			break;
+		}
+		bc->stage = 1;
+		//fallthrough
+	case 1:
+		if (!client->pextknown)
+			break;
+		MSG_WriteByte (&msg, clc_stringcmd);
+		MSG_WriteString (&msg, "prespawn");
+		bc->stage = 2;
+		break;
+	case 2:
+		if (client->sendsignon != PRESPAWN_DONE)
+			break;
+		MSG_WriteByte (&msg, clc_stringcmd);
+		MSG_WriteString (&msg, "spawn");
+		bc->stage = 3;
+		break;
+	case 3:
+		MSG_WriteByte (&msg, clc_stringcmd);
+		MSG_WriteString (&msg, "begin");
+		bc->stage = 4;
+		break;
+	default:
+		if (!client->spawned)
+			break;
+
+		if (client->protocol_pext2 & PEXT2_REPLACEMENTDELTAS)
+		{	//ack everything it sent, as though nothing was ever lost
+			seq = NET_QSocketGetSequenceOut (bc->sock);
+			for (; bc->ackedsequence+1 < seq; bc->ackedsequence++)
+			{
+				MSG_WriteByte (&msg, clcdp_ackframe);
+				MSG_WriteLong (&msg, bc->ackedsequence+1);
+			}
+		}
+
+		angles[0] = 15 * sin (tick * 0.05 + clientnum);
+		angles[1] = anglemod (clientnum * 45 + tick * 2);
+		angles[2] = 0;
+		buttons = ((tick + clientnum*13) % 144 < 24) ? 1 : 0;	//attack in bursts
+		if ((tick + clientnum*7) % 200 == 0)
+			buttons |= 2;	//jump
+
+		MSG_WriteByte (&msg, clc_move);
+		if (client->protocol_pext2 & PEXT2_PREDINFO)
+			MSG_WriteShort (&msg, ++bc->movemessages & 0xffff);
+		MSG_WriteFloat (&msg, qcvm->time);
+		for (i = 0; i < 3; i++)
+		{
+			if (sv.protocol == PROTOCOL_NETQUAKE && !(client->protocol_pext2 & PEXT2_PREDINFO) && !NET_QSocketGetProQuakeAngleHack (bc->sock))
+				MSG_WriteAngle (&msg, angles[i], sv.protocolflags);
+			else
+				MSG_WriteAngle16 (&msg, angles[i], sv.protocolflags);
+		}
+		MSG_WriteShort (&msg, ((tick / 288 + clientnum) & 1) ? -320 : 320);
+		MSG_WriteShort (&msg, ((tick / 100 + clientnum) & 1) ? -350 : 350);
+		MSG_WriteShort (&msg, 0);
+		if (client->protocol_pext2 & PEXT2_PRYDONCURSOR)
+			MSG_WriteLong (&msg, buttons);
+		else
+			MSG_WriteByte (&msg, buttons);
+		MSG_WriteByte (&msg, ((tick + clientnum) % 720 == 0) ? 10 : 0);	//cycle weapons now and then
+		break;
+	}
+
+	if (msg.cursize)
+		NET_FakeInput (bc->sock, &msg);
+}
+
+/*
+===============
+SV_Benchmark_f
+===============
+*/
+static void SV_Benchmark_f (void)
+{
+	benchclient_t	*bc;
+	double			*times, t, total, oldframetime = host_frametime;
+	int				ticks, numclients, i, tick, spawned = 0;
+	qboolean		nq;
+	unsigned long long statements;
+	unsigned int	traces;
+
+	if (Cmd_Argc() < 3 || (ticks = atoi(Cmd_Argv(1))) < 1 || (numclients = atoi(Cmd_Argv(2))) < 1)
+	{
+		Con_Printf ("usage: sv_benchmark <ticks> <clients> [nq]\n");
+		return;
+	}
+	nq = Cmd_Argc() > 3 && !strcmp(Cmd_Argv(3), "nq");
+	if (!sv.active)
+	{
+		Con_Printf ("no server running\n");
+		return;
+	}
+
+	bc = (benchclient_t *) calloc (numclients, sizeof(*bc));
+	times = (double *) malloc (ticks * sizeof(*times));
+	srand (0);
+
+	PR_SwitchQCVM(&sv.qcvm);
+	for (i = 0; i < numclients; i++)
+	{
+		int slot;
+		for (slot = 0; slot < svs.maxclients; slot++)
+			if (!svs.clients[slot].active)
+				break;
+		if (slot == svs.maxclients)
+			break;
+		bc[i].sock = NET_FakeConnection (va("benchmark%i", i));
+		if (!bc[i].sock)
+			break;
+		bc[i].client = &svs.clients[slot];
+		bc[i].client->netconnection = bc[i].sock;
+		SV_ConnectClient (slot);
+	}
+	if (i < numclients)
+		Con_Printf ("only room for %i of %i clients (maxplayers is %i)\n", i, numclients, svs.maxclients);
+	numclients = i;
+
+	//get everyone in the game
+	for (tick = 0; tick < BENCHMARK_CONNECTTICKS && sv.active; tick++)
+	{
+		for (i = spawned = 0; i < numclients; i++)
+		{
+			if (!bc[i].client->active || bc[i].client->netconnection != bc[i].sock)
+				continue;
+			spawned += bc[i].client->spawned;
+			SV_BenchmarkInput (&bc[i], i, tick, nq);
+		}
+		if (spawned == numclients)
+			break;
+		host_frametime = BENCHMARK_TICKRATE;
+		Host_ServerFrame ();
+	}
+	if (tick == BENCHMARK_CONNECTTICKS)
+		Con_Printf ("only %i of %i clients spawned\n", spawned, numclients);
+
+	statements = 0;
+	for (i = 0; i < qcvm->progs->numfunctions; i++)
+		statements -= qcvm->functions[i].profile;
+	traces = sv_tracecount;
+	for (i = 0; i < numclients; i++)
+		NET_FakeTraffic (bc[i].sock, &bc[i].reliablebytes, &bc[i].unreliablebytes, &bc[i].packets);
+
+	for (tick = 0; tick < ticks && sv.active; tick++)
+	{
+		for (i = 0; i < numclients; i++)
+		{
+			if (bc[i].client->active && bc[i].client->netconnection == bc[i].sock)
+				SV_BenchmarkInput (&bc[i], i, tick, nq);
+		}
+		host_frametime = BENCHMARK_TICKRATE;
+		t = SV_BenchmarkTime ();
+		Host_ServerFrame ();
+		times[tick] = SV_BenchmarkTime () - t;
+	}
+	host_frametime = oldframetime;
+	ticks = tick;
+	if (!ticks)
+	{	//map changed or something
+		Con_Printf ("server went away\n");
+		PR_SwitchQCVM(NULL);
+		free (times);
+		free (bc);
+		return;
+	}
+
+	traces = sv_tracecount - traces;
+	for (i = 0; i < qcvm->progs->numfunctions; i++)
+		statements += qcvm->functions[i].profile;
+	for (i = 0; i < numclients; i++)
+	{
+		int reliable, unreliable, packets;
+		NET_FakeTraffic (bc[i].sock, &reliable, &unreliable, &packets);
+		bc[i].reliablebytes = reliable - bc[i].reliablebytes;
+		bc[i].unreliablebytes = unreliable - bc[i].unreliablebytes;
+		bc[i].packets = packets - bc[i].packets;
+	}
+
+	//kick them before anything else can go wrong
+	for (i = 0; i < numclients; i++)
+	{
+		if (!bc[i].client->active || bc[i].client->netconnection != bc[i].sock)
+			continue;
+		host_client = bc[i].client;
+		SV_DropClient (false);
+	}
+	PR_SwitchQCVM(NULL);
+
+	for (i = 0, total = 0; i < ticks; i++)
+		total += times[i];
+	qsort (times, ticks, sizeof(*times), SV_BenchmarkCompareTimes);
+
+	Con_Printf ("benchmark map %s\n", sv.name);
+	Con_Printf ("benchmark ticks %i\n", ticks);
+	Con_Printf ("benchmark clients %i\n", numclients);
+	Con_Printf ("benchmark protocol %i 0x%x 0x%x\n", sv.protocol, nq?0:sv_protocol_pext1, nq?0:sv_protocol_pext2);
+	Con_Printf ("benchmark tick_ms_mean %.4f\n", total * 1000 / ticks);
+	Con_Printf ("benchmark tick_ms_p50 %.4f\n", times[(ticks-1) * 50 / 100] * 1000);
+	Con_Printf ("benchmark tick_ms_p90 %.4f\n", times[(ticks-1) * 90 / 100] * 1000);
+	Con_Printf ("benchmark tick_ms_p99 %.4f\n", times[(ticks-1) * 99 / 100] * 1000);
+	Con_Printf ("benchmark tick_ms_max %.4f\n", times[ticks-1] * 1000);
+	Con_Printf ("benchmark qc_statements %llu\n", statements);
+	Con_Printf ("benchmark qc_statements_per_tick %.1f\n", (double)statements / ticks);
+	Con_Printf ("benchmark traces %u\n", traces);
+	Con_Printf ("benchmark traces_per_tick %.1f\n", (double)traces / ticks);
+	for (i = 0; i < numclients; i++)
+		Con_Printf ("benchmark client %i reliable_bytes %i unreliable_bytes %i packets %i\n", i, bc[i].reliablebytes, bc[i].unreliablebytes, bc[i].packets);
+
+	free (times);
+	free (bc);
+}
+
 /*
 ===============
 SV_Init
@@ -1536,6 +2300,7 @@ void SV_Init (void)
 	extern	cvar_t	sv_gameplayfix_spawnbeforethinks;
 	extern	cvar_t	sv_gameplayfix_bouncedownslopes;
 	extern	cvar_t	sv_gameplayfix_setmodelrealbox;	//spike: 1 to replicate a quakespasm bug, 0 for actual vanilla compat.
+	extern	cvar_t	sv_findradius_areanodes;
 	extern	cvar_t	sv_friction;
 	extern	cvar_t	sv_edgefriction;
 	extern	cvar_t	sv_stopspeed;
@@ -1554,6 +2319,7 @@ void SV_Init (void)
 	extern	cvar_t	sv_sound_land;			//spike - and also mutable...
 
 	PM_Register();
+	World_Init();
 	Cvar_RegisterVariable (&sv_maxvelocity);
 	Cvar_RegisterVariable (&sv_gravity);
 	Cvar_RegisterVariable (&sv_friction);
@@ -1571,9 +2337,13 @@ void SV_Init (void)
 	Cvar_RegisterVariable (&sv_gameplayfix_spawnbeforethinks);
 	Cvar_RegisterVariable (&sv_gameplayfix_bouncedownslopes);
 	Cvar_RegisterVariable (&sv_gameplayfix_setmodelrealbox);
+	Cvar_RegisterVariable (&sv_findradius_areanodes);
 	Cvar_RegisterVariable (&pr_checkextension);
 	Cvar_RegisterVariable (&sv_altnoclip); //johnfitz
 	Cvar_RegisterVariable (&sv_nqplayerphysics);	//spike
+	Cvar_RegisterVariable (&sv_entdirty);
+	Cvar_RegisterVariable (&sv_parallelsnapshots);
+	Cvar_RegisterVariable (&sv_entcache);
 
 	Cvar_RegisterVariable (&sv_sound_watersplash); //spike
 	Cvar_RegisterVariable (&sv_sound_land); //spike
@@ -1592,6 +2362,10 @@ void SV_Init (void)
 
 	Cmd_AddCommand_ClientCommand("pext", SV_Pext_f);
 	Cmd_AddCommand ("sv_protocol", &SV_Protocol_f); //johnfitz
+	Cmd_AddCommand ("sv_tickbenchmark", SV_TickBenchmark_f);
+	Cmd_AddCommand ("sv_entcachestats", SV_EntCacheStats_f);
+	Cmd_AddCommand ("sv_benchmark", SV_Benchmark_f);
+	SV_ProfileInit ();
 
 	for (i=0 ; i<MAX_MODELS ; i++)
 		sprintf (localmodels[i], "*%i", i);
@@ -2424,6 +3198,47 @@ static void SV_AddToFatPVS (vec3_t org, mnode_t *node, qmodel_t *worldmodel) //j
 	}
 }
 
+/*
+=============
+SV_FatPVSLeafs
+
+Lists the non-solid leafs that SV_AddToFatPVS would merge, in the same order.
+Returns false if there are too many to list.
+=============
+*/
+static qboolean SV_FatPVSLeafs (vec3_t org, mnode_t *node, qmodel_t *worldmodel, int *leafnums, int *numleafs)
+{
+	mplane_t	*plane;
+	float	d;
+
+	while (1)
+	{
+		if (node->contents < 0)
+		{
+			if (node->contents != CONTENTS_SOLID)
+			{
+				if (*numleafs == MAX_FATPVS_LEAFS)
+					return false;
+				leafnums[(*numleafs)++] = (mleaf_t *)node - worldmodel->leafs;
+			}
+			return true;
+		}
+
+		plane = node->plane;
+		d = DotProduct (org, plane->normal) - plane->dist;
+		if (d > 8)
+			node = node->children[0];
+		else if (d < -8)
+			node = node->children[1];
+		else
+		{	// go down both
+			if (!SV_FatPVSLeafs (org, node->children[0], worldmodel, leafnums, numleafs))
+				return false;
+			node = node->children[1];
+		}
+	}
+}
+
 /*
 =============
 SV_FatPVS
@@ -2434,6 +3249,9 @@ given point.
 */
 byte *SV_FatPVS (vec3_t org, qmodel_t *worldmodel) //johnfitz -- added worldmodel as a parameter
 {
+	int		leafnums[MAX_FATPVS_LEAFS], numleafs = 0;
+
+	SV_ProfileEnter (SVPROF_PVS);
 	fatbytes = (worldmodel->numleafs+7)>>3; // ericw -- was +31, assumed to be a bug/typo
 	if (fatpvs == NULL || fatbytes > fatpvs_capacity)
 	{
@@ -2443,8 +3261,15 @@ byte *SV_FatPVS (vec3_t org, qmodel_t *worldmodel) //johnfitz -- added worldmode
 			Sys_Error ("SV_FatPVS: realloc() failed on %d bytes", fatpvs_capacity);
 	}
 	
-	Q_memset (fatpvs, 0, fatbytes);
-	SV_AddToFatPVS (org, worldmodel->nodes, worldmodel); //johnfitz -- worldmodel as a parameter
+	//the same few leafs keep coming up, so let the model remember what they merge to.
+	if (SV_FatPVSLeafs (org, worldmodel->nodes, worldmodel, leafnums, &numleafs))
+		Mod_MergeLeafPVS (worldmodel, leafnums, numleafs, fatpvs);
+	else
+	{
+		Q_memset (fatpvs, 0, fatbytes);
+		SV_AddToFatPVS (org, worldmodel->nodes, worldmodel); //johnfitz -- worldmodel as a parameter
+	}
+	SV_ProfileLeave ();
 	return fatpvs;
 }
 
@@ -2473,6 +3298,198 @@ qboolean SV_VisibleToClient (edict_t *client, edict_t *test, qmodel_t *worldmode
 
 //=============================================================================
 
+/*
+=============
+SV_WriteEntityUpdate
+
+Writes an entity's vanilla-style update (relative to its baseline). This depends only on the
+entity and the server's protocol, so the result is the same for every client that sees it.
+Returns false if the entity should not be sent at all.
+=============
+*/
+static qboolean SV_WriteEntityUpdate (edict_t *ent, unsigned int e, sizebuf_t *msg)
+{
+	unsigned int	i;
+	int		bits;
+	float	miss;
+	eval_t	*val;
+	int effects;
+	int scale = ENTSCALE_DEFAULT;
+
+	bits = 0;
+
+	for (i=0 ; i<3 ; i++)
+	{
+		miss = ent->v.origin[i] - ent->baseline.origin[i];
+		if ( miss < -0.1 || miss > 0.1 )
+			bits |= U_ORIGIN1<<i;
+	}
+
+	if ( ent->v.angles[0] != ent->baseline.angles[0] )
+		bits |= U_ANGLE1;
+
+	if ( ent->v.angles[1] != ent->baseline.angles[1] )
+		bits |= U_ANGLE2;
+
+	if ( ent->v.angles[2] != ent->baseline.angles[2] )
+		bits |= U_ANGLE3;
+
+	if (ent->v.movetype == MOVETYPE_STEP)
+		bits |= U_STEP;	// don't mess up the step animation
+
+	if (ent->baseline.colormap != ent->v.colormap)
+		bits |= U_COLORMAP;
+
+	if (ent->baseline.skin != ent->v.skin)
+		bits |= U_SKIN;
+
+	if (ent->baseline.frame != ent->v.frame)
+		bits |= U_FRAME;
+
+	effects = ent->v.effects;
+	if (qcvm->brokeneffects && (effects & 0xf0u))
+	{	//translate qe effects to something more standard.
+		effects &= ~0xf0u;
+		if ((int)ent->v.effects & EFQE_QUADLIGHT)
+			effects |= EF_BLUE;
+		if ((int)ent->v.effects & EFQE_PENTLIGHT)
+			effects |= EF_RED;
+	}
+	if (ent->baseline.effects ^ effects)
+		bits |= U_EFFECTS;
+
+	if (ent->baseline.modelindex != ent->v.modelindex)
+		bits |= U_MODEL;
+
+	//johnfitz -- alpha
+	// TODO: find a cleaner place to put this code
+	val = GetEdictFieldValue(ent, qcvm->extfields.alpha);
+	if (val)
+		ent->alpha = ENTALPHA_ENCODE(val->_float);
+
+	//don't send invisible entities unless they have effects
+	if (ent->alpha == ENTALPHA_ZERO && !effects)
+		return false;
+	//johnfitz
+
+	val = GetEdictFieldValue(ent, qcvm->extfields.scale);
+	if (val)
+		scale = ENTSCALE_ENCODE(val->_float);
+
+	//spike -- PROTOCOL_VERSION_BJP3
+	if (sv.protocol == PROTOCOL_VERSION_BJP3)
+	{
+		//alpha+fullbright can be sent, but they're too hideous...
+		if (ent->baseline.alpha != ent->alpha) bits |= U_TRANS;
+	}
+	else
+	//johnfitz -- PROTOCOL_FITZQUAKE
+	if (sv.protocol != PROTOCOL_NETQUAKE)
+	{
+		if (ent->baseline.alpha != ent->alpha) bits |= U_ALPHA;
+		if (bits & U_FRAME && (int)ent->v.frame & 0xFF00) bits |= U_FRAME2;
+		if (bits & U_MODEL && (int)ent->v.modelindex & 0xFF00) bits |= U_MODEL2;
+		if (ent->sendinterval) bits |= U_LERPFINISH;
+		if (ent->baseline.scale != scale && sv.protocol == PROTOCOL_RMQ) bits |= U_SCALE;
+		if (bits >= 65536) bits |= U_EXTEND1;
+		if (bits >= 16777216) bits |= U_EXTEND2;
+	}
+	//johnfitz
+
+	if (e >= 256)
+		bits |= U_LONGENTITY;
+
+	if (bits >= 256)
+		bits |= U_MOREBITS;
+
+//
+// write the message
+//
+	MSG_WriteByte (msg, bits | U_SIGNAL);
+
+	if (bits & U_MOREBITS)
+		MSG_WriteByte (msg, bits>>8);
+
+	//spike -- nehahra protocols are awkward
+	if (sv.protocol == PROTOCOL_VERSION_BJP3)
+		;
+	else
+	{
+		//johnfitz -- PROTOCOL_FITZQUAKE
+		if (bits & U_EXTEND1)
+			MSG_WriteByte(msg, bits>>16);
+		if (bits & U_EXTEND2)
+			MSG_WriteByte(msg, bits>>24);
+		//johnfitz
+	}
+
+	if (bits & U_LONGENTITY)
+		MSG_WriteShort (msg,e);
+	else
+		MSG_WriteByte (msg,e);
+
+	if (bits & U_MODEL)
+	{
+		if (sv.protocol == PROTOCOL_VERSION_BJP3)
+			MSG_WriteShort(msg,	ent->v.modelindex);
+		else
+			MSG_WriteByte (msg,	ent->v.modelindex);
+	}
+	if (bits & U_FRAME)
+		MSG_WriteByte (msg, ent->v.frame);
+	if (bits & U_COLORMAP)
+		MSG_WriteByte (msg, ent->v.colormap);
+	if (bits & U_SKIN)
+		MSG_WriteByte (msg, ent->v.skin);
+	if (bits & U_EFFECTS)
+		MSG_WriteByte (msg, effects);
+	if (bits & U_ORIGIN1)
+		MSG_WriteCoord (msg, ent->v.origin[0], sv.protocolflags);
+	if (bits & U_ANGLE1)
+		MSG_WriteAngle(msg, ent->v.angles[0], sv.protocolflags);
+	if (bits & U_ORIGIN2)
+		MSG_WriteCoord (msg, ent->v.origin[1], sv.protocolflags);
+	if (bits & U_ANGLE2)
+		MSG_WriteAngle(msg, ent->v.angles[1], sv.protocolflags);
+	if (bits & U_ORIGIN3)
+		MSG_WriteCoord (msg, ent->v.origin[2], sv.protocolflags);
+	if (bits & U_ANGLE3)
+		MSG_WriteAngle(msg, ent->v.angles[2], sv.protocolflags);
+
+	//spike -- nehahra protocols are awkward
+	if (sv.protocol == PROTOCOL_VERSION_BJP3)
+	{
+		//this protocol is shite
+		if ((int)ent->v.effects & EF_FULLBRIGHT)
+		{
+			MSG_WriteFloat(msg, 2);
+			MSG_WriteFloat(msg, ENTALPHA_DECODE(ent->alpha));
+			MSG_WriteFloat(msg, 1);
+		}
+		else if (bits & U_TRANS)
+		{
+			MSG_WriteFloat(msg, 1);
+			MSG_WriteFloat(msg, ENTALPHA_DECODE(ent->alpha));
+		}
+	}
+	else
+	{
+		//johnfitz -- PROTOCOL_FITZQUAKE
+		if (bits & U_ALPHA)
+			MSG_WriteByte(msg, ent->alpha);
+		if (bits & U_SCALE)
+			MSG_WriteByte(msg, scale);
+		if (bits & U_FRAME2)
+			MSG_WriteByte(msg, (int)ent->v.frame >> 8);
+		if (bits & U_MODEL2)
+			MSG_WriteByte(msg, (int)ent->v.modelindex >> 8);
+		if (bits & U_LERPFINISH)
+			MSG_WriteByte(msg, (byte)(Q_rint((ent->v.nextthink-qcvm->time)*255)));
+		//johnfitz
+	}
+	return true;
+}
+
 /*
 =============
 SV_WriteEntitiesToClient
@@ -2483,15 +3500,12 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg)
 {
 	edict_t	*clent = client->edict;
 	unsigned int		e, i, maxedict=qcvm->num_edicts;
-	int		bits;
 	byte	*pvs;
 	vec3_t	org;
-	float	miss;
 	edict_t	*ent;
 	eval_t	*val;
 	int maxsize = msg->maxsize;
-	int effects;
-	int scale = ENTSCALE_DEFAULT;
+	qboolean customized;
 
 	//try to avoid sounds getting lost. flickering entities are weird, but missing sounds+particles are just eerie.
 	maxsize -= client->datagram.cursize;
@@ -2516,7 +3530,8 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg)
 		if (ent->free)
 			continue;
 		val = GetEdictFieldValue(ent, qcvm->extfields.customizeentityforclient);
-		if (val && val->function)
+		customized = val && val->function;
+		if (customized)
 		{
 			pr_global_struct->self = EDICT_TO_PROG(ent);	//ent being customised
 			pr_global_struct->other = EDICT_TO_PROG(client);//player they're being customised for
@@ -2580,177 +3595,7 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg)
 		}
 
 // send an update
-		bits = 0;
-
-		for (i=0 ; i<3 ; i++)
-		{
-			miss = ent->v.origin[i] - ent->baseline.origin[i];
-			if ( miss < -0.1 || miss > 0.1 )
-				bits |= U_ORIGIN1<<i;
-		}
-
-		if ( ent->v.angles[0] != ent->baseline.angles[0] )
-			bits |= U_ANGLE1;
-
-		if ( ent->v.angles[1] != ent->baseline.angles[1] )
-			bits |= U_ANGLE2;
-
-		if ( ent->v.angles[2] != ent->baseline.angles[2] )
-			bits |= U_ANGLE3;
-
-		if (ent->v.movetype == MOVETYPE_STEP)
-			bits |= U_STEP;	// don't mess up the step animation
-
-		if (ent->baseline.colormap != ent->v.colormap)
-			bits |= U_COLORMAP;
-
-		if (ent->baseline.skin != ent->v.skin)
-			bits |= U_SKIN;
-
-		if (ent->baseline.frame != ent->v.frame)
-			bits |= U_FRAME;
-
-		effects = ent->v.effects;
-		if (qcvm->brokeneffects && (effects & 0xf0u))
-		{	//translate qe effects to something more standard.
-			effects &= ~0xf0u;
-			if ((int)ent->v.effects & EFQE_QUADLIGHT)
-				effects |= EF_BLUE;
-			if ((int)ent->v.effects & EFQE_PENTLIGHT)
-				effects |= EF_RED;
-		}
-		if (ent->baseline.effects ^ effects)
-			bits |= U_EFFECTS;
-
-		if (ent->baseline.modelindex != ent->v.modelindex)
-			bits |= U_MODEL;
-
-		//johnfitz -- alpha
-		// TODO: find a cleaner place to put this code
-		val = GetEdictFieldValue(ent, qcvm->extfields.alpha);
-		if (val)
-			ent->alpha = ENTALPHA_ENCODE(val->_float);
-
-		//don't send invisible entities unless they have effects
-		if (ent->alpha == ENTALPHA_ZERO && !effects)
-			continue;
-		//johnfitz
-
-		val = GetEdictFieldValue(ent, qcvm->extfields.scale);
-		if (val)
-			scale = ENTSCALE_ENCODE(val->_float);
-
-		//spike -- PROTOCOL_VERSION_BJP3
-		if (sv.protocol == PROTOCOL_VERSION_BJP3)
-		{
-			//alpha+fullbright can be sent, but they're too hideous...
-			if (ent->baseline.alpha != ent->alpha) bits |= U_TRANS;
-		}
-		else
-		//johnfitz -- PROTOCOL_FITZQUAKE
-		if (sv.protocol != PROTOCOL_NETQUAKE)
-		{
-			if (ent->baseline.alpha != ent->alpha) bits |= U_ALPHA;
-			if (bits & U_FRAME && (int)ent->v.frame & 0xFF00) bits |= U_FRAME2;
-			if (bits & U_MODEL && (int)ent->v.modelindex & 0xFF00) bits |= U_MODEL2;
-			if (ent->sendinterval) bits |= U_LERPFINISH;
-			if (ent->baseline.scale != scale && sv.protocol == PROTOCOL_RMQ) bits |= U_SCALE;
-			if (bits >= 65536) bits |= U_EXTEND1;
-			if (bits >= 16777216) bits |= U_EXTEND2;
-		}
-		//johnfitz
-
-		if (e >= 256)
-			bits |= U_LONGENTITY;
-
-		if (bits >= 256)
-			bits |= U_MOREBITS;
-
-	//
-	// write the message
-	//
-		MSG_WriteByte (msg, bits | U_SIGNAL);
-
-		if (bits & U_MOREBITS)
-			MSG_WriteByte (msg, bits>>8);
-
-		//spike -- nehahra protocols are awkward
-		if (sv.protocol == PROTOCOL_VERSION_BJP3)
-			;
-		else
-		{
-			//johnfitz -- PROTOCOL_FITZQUAKE
-			if (bits & U_EXTEND1)
-				MSG_WriteByte(msg, bits>>16);
-			if (bits & U_EXTEND2)
-				MSG_WriteByte(msg, bits>>24);
-			//johnfitz
-		}
-
-		if (bits & U_LONGENTITY)
-			MSG_WriteShort (msg,e);
-		else
-			MSG_WriteByte (msg,e);
-
-		if (bits & U_MODEL)
-		{
-			if (sv.protocol == PROTOCOL_VERSION_BJP3)
-				MSG_WriteShort(msg,	ent->v.modelindex);
-			else
-				MSG_WriteByte (msg,	ent->v.modelindex);
-		}
-		if (bits & U_FRAME)
-			MSG_WriteByte (msg, ent->v.frame);
-		if (bits & U_COLORMAP)
-			MSG_WriteByte (msg, ent->v.colormap);
-		if (bits & U_SKIN)
-			MSG_WriteByte (msg, ent->v.skin);
-		if (bits & U_EFFECTS)
-			MSG_WriteByte (msg, effects);
-		if (bits & U_ORIGIN1)
-			MSG_WriteCoord (msg, ent->v.origin[0], sv.protocolflags);
-		if (bits & U_ANGLE1)
-			MSG_WriteAngle(msg, ent->v.angles[0], sv.protocolflags);
-		if (bits & U_ORIGIN2)
-			MSG_WriteCoord (msg, ent->v.origin[1], sv.protocolflags);
-		if (bits & U_ANGLE2)
-			MSG_WriteAngle(msg, ent->v.angles[1], sv.protocolflags);
-		if (bits & U_ORIGIN3)
-			MSG_WriteCoord (msg, ent->v.origin[2], sv.protocolflags);
-		if (bits & U_ANGLE3)
-			MSG_WriteAngle(msg, ent->v.angles[2], sv.protocolflags);
-
-		//spike -- nehahra protocols are awkward
-		if (sv.protocol == PROTOCOL_VERSION_BJP3)
-		{
-			//this protocol is shite
-			if ((int)ent->v.effects & EF_FULLBRIGHT)
-			{
-				MSG_WriteFloat(msg, 2);
-				MSG_WriteFloat(msg, ENTALPHA_DECODE(ent->alpha));
-				MSG_WriteFloat(msg, 1);
-			}
-			else if (bits & U_TRANS)
-			{
-				MSG_WriteFloat(msg, 1);
-				MSG_WriteFloat(msg, ENTALPHA_DECODE(ent->alpha));
-			}
-		}
-		else
-		{
-			//johnfitz -- PROTOCOL_FITZQUAKE
-			if (bits & U_ALPHA)
-				MSG_WriteByte(msg, ent->alpha);
-			if (bits & U_SCALE)
-				MSG_WriteByte(msg, scale);
-			if (bits & U_FRAME2)
-				MSG_WriteByte(msg, (int)ent->v.frame >> 8);
-			if (bits & U_MODEL2)
-				MSG_WriteByte(msg, (int)ent->v.modelindex >> 8);
-			if (bits & U_LERPFINISH)
-				MSG_WriteByte(msg, (byte)(Q_rint((ent->v.nextthink-qcvm->time)*255)));
-			//johnfitz
-		}
+		SV_WriteCachedEntityUpdate (ent, e, msg, customized);
 	}
 
 	//johnfitz -- devstats
@@ -2996,19 +3841,143 @@ void SV_WriteClientdataToMessage (client_t *client, sizebuf_t *msg)
 }
 
 
-void SV_PresendClientDatagram (client_t *client)
+static qboolean SV_ClientWantsSnapshot (client_t *client)
 {
 	if (!client->netconnection)
-		return;	//botclient
+		return false;	//botclient
 	if (!client->spawned)
-		return;	//not ready yet.
+		return false;	//not ready yet.
 	if (!(client->protocol_pext2 & PEXT2_REPLACEMENTDELTAS))
-		return; //brute force networking.
-	SVFTE_BuildSnapshotForClient(client);
+		return false; //brute force networking.
+	return true;
+}
+
+void SV_PresendClientDatagram (client_t *client)
+{
+	if (!SV_ClientWantsSnapshot(client))
+		return;
+	SVFTE_BuildSnapshotForClient(client, SVFTE_SnapshotPVS(client), SVFTE_SnapshotEntities(client), NULL, 0, true);
 	SVFTE_CalcEntityDeltas(client);
 	client->snapshotresume = 0;
 }
 
+static struct snapshotjob_s
+{
+	client_t		*client;
+	byte			*pvs;	//copied, as SV_FatPVS only has the one buffer
+	unsigned int	maxentities;
+	struct snapshotcustom_s *custom;
+	size_t			numcustom, maxcustom;
+} *snapshotjobs;
+static int			maxsnapshotjobs;
+static int			snapshotpvsbytes;
+static unsigned int	*snapshotcustomized;
+static unsigned int	maxsnapshotcustomized;
+
+static void SV_PresendClientJobs (void *ctx, int first, int count, int worker)
+{
+	struct snapshotjob_s *job = (struct snapshotjob_s *)ctx + first;
+
+	for (; count > 0; count--, job++)
+	{
+		SVFTE_BuildSnapshotForClient(job->client, job->pvs, job->maxentities, job->custom, job->numcustom, false);
+		SVFTE_CalcEntityDeltas(job->client);
+		job->client->snapshotresume = 0;
+	}
+}
+
+/*
+=======================
+SV_PresendClientDatagrams
+
+Builds every client's snapshot.
+The parts that can run qc (customizeentityforclient) or that use shared buffers (the fatpvs)
+are done here on the main thread, then each client's culling and deltas are handed to
+host_workers.
+=======================
+*/
+static void SV_PresendClientDatagrams (void)
+{
+	int				i, numjobs, pvsbytes;
+	unsigned int	e, c, numcustomized;
+	client_t		*client;
+	edict_t			*ent;
+	eval_t			*val;
+	struct snapshotjob_s *job;
+	struct snapshotcustom_s *custom;
+
+	if (!sv_parallelsnapshots.value)
+	{
+		for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
+		{
+			if (!host_client->active)
+				continue;
+
+			SV_PresendClientDatagram (host_client);	//generates client snapshots (and updates csqc pending flags)
+		}
+		return;
+	}
+
+	//these are the only ents that might run qc, so find them once rather than per client.
+	numcustomized = 0;
+	for (e = 1, ent = NEXT_EDICT(qcvm->edicts); e < (unsigned int)qcvm->num_edicts; e++, ent = NEXT_EDICT(ent))
+	{
+		if (ent->free)
+			continue;
+		val = GetEdictFieldValue(ent, qcvm->extfields.customizeentityforclient);
+		if (!val || !val->function)
+			continue;
+		if (numcustomized == maxsnapshotcustomized)
+		{
+			maxsnapshotcustomized += 64;
+			snapshotcustomized = (unsigned int *) realloc (snapshotcustomized, maxsnapshotcustomized*sizeof(*snapshotcustomized));
+		}
+		snapshotcustomized[numcustomized++] = e;
+	}
+
+	pvsbytes = (qcvm->worldmodel->numleafs+7)>>3;
+	if (svs.maxclients > maxsnapshotjobs || pvsbytes > snapshotpvsbytes)
+	{
+		for (i = 0; i < maxsnapshotjobs; i++)
+			free (snapshotjobs[i].pvs);
+		if (svs.maxclients > maxsnapshotjobs)
+		{
+			snapshotjobs = (struct snapshotjob_s *) realloc (snapshotjobs, svs.maxclients*sizeof(*snapshotjobs));
+			memset (snapshotjobs+maxsnapshotjobs, 0, (svs.maxclients-maxsnapshotjobs)*sizeof(*snapshotjobs));
+			maxsnapshotjobs = svs.maxclients;
+		}
+		snapshotpvsbytes = pvsbytes;
+		for (i = 0; i < maxsnapshotjobs; i++)
+			snapshotjobs[i].pvs = (byte *) malloc (snapshotpvsbytes);
+	}
+
+	numjobs = 0;
+	for (i=0, client = svs.clients ; i<svs.maxclients ; i++, client++)
+	{
+		if (!client->active || !SV_ClientWantsSnapshot(client))
+			continue;
+
+		job = &snapshotjobs[numjobs++];
+		job->client = client;
+		memcpy (job->pvs, SVFTE_SnapshotPVS(client), pvsbytes);
+		job->maxentities = SVFTE_SnapshotEntities(client);
+		job->numcustom = 0;
+		for (c = 0; c < numcustomized && snapshotcustomized[c] < job->maxentities; c++)
+		{
+			if (job->numcustom == job->maxcustom)
+			{
+				job->maxcustom += 16;
+				job->custom = (struct snapshotcustom_s *) realloc (job->custom, job->maxcustom*sizeof(*job->custom));
+			}
+			custom = &job->custom[job->numcustom++];
+			custom->num = snapshotcustomized[c];
+			custom->visible = SVFTE_SnapshotEntity(client, job->pvs, custom->num, EDICT_NUM(custom->num), true, &custom->state);
+		}
+	}
+
+	Host_ParallelFor (SV_PresendClientJobs, snapshotjobs, numjobs, 1);
+}
+
 /*
 =======================
 SV_SendClientDatagram
@@ -3070,7 +4039,9 @@ qboolean SV_SendClientDatagram (client_t *client)
 			SV_WriteDamageToMessage (client->edict, &msg);
 			SV_WriteClientdataToMessage (client, &msg);
 
+			SV_ProfileEnter (SVPROF_SNAPSHOT);
 			SV_WriteEntitiesToClient (client, &msg);
+			SV_ProfileLeave ();
 		}
 
 	// copy the private datagram if there is space
@@ -3280,20 +4251,18 @@ int SV_SendAmbientSounds(int idx)
 }
 int SV_SendPrespawnBaselines(int idx)
 {
-	edict_t *svent;
 	int maxsize = host_client->message.maxsize - 128;	//we can go quite large
 
 	while (1)
 	{
 		if (idx >= qcvm->num_edicts)
 			return -1;
-		svent = EDICT_NUM(idx);
 
 		if (host_client->message.cursize > maxsize)
 			break;
 
-		if (memcmp(&nullentitystate, &svent->baseline, sizeof(nullentitystate)))
-			MSG_WriteStaticOrBaseLine(&host_client->message, idx, &svent->baseline, host_client->protocol_pext2, sv.protocol, sv.protocolflags);
+		if (memcmp(&nullentitystate, &EDICT_NUM(idx)->baseline, sizeof(nullentitystate)))
+			MSG_WriteStaticOrBaseLine(&host_client->message, idx, &EDICT_NUM(idx)->baseline, host_client->protocol_pext2, sv.protocol, sv.protocolflags);
 
 		idx++;
 	}
@@ -3312,13 +4281,18 @@ void SV_SendClientMessages (void)
 // update frags, names, etc
 	SV_UpdateToReliableMessages ();
 
-	for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
-	{
-		if (!host_client->active)
-			continue;
+	SV_ProfileEnter (SVPROF_SNAPSHOT);
 
-		SV_PresendClientDatagram (host_client);	//generates client snapshots (and updates csqc pending flags)
-	}
+// see which entities changed, so the snapshots don't need to check them all again per client
+	SV_UpdateEntityDirty ();
+
+// generate client snapshots (and update csqc pending flags)
+	SV_PresendClientDatagrams ();
+
+	SV_ProfileLeave ();
+
+// updates encoded for one client this frame can be reused for the rest
+	SV_EntCacheBeginFrame ();
 
 // build individual updates
 	for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
@@ -164,7 +164,9 @@ qboolean SV_RunThink (edict_t *ent)
 	pr_global_struct->time = thinktime;
 	pr_global_struct->self = EDICT_TO_PROG(ent);
 	pr_global_struct->other = EDICT_TO_PROG(qcvm->edicts);
+	SV_ProfileEnter (SVPROF_THINK);
 	PR_ExecuteProgram (ent->v.think);
+	SV_ProfileLeave ();
 
 //johnfitz -- PROTOCOL_FITZQUAKE
 //capture interval to nextthink here and send it to client for better
@@ -1212,7 +1214,9 @@ void SV_Physics_Client (edict_t	*ent, int num)
 //
 	pr_global_struct->time = qcvm->time;
 	pr_global_struct->self = EDICT_TO_PROG(ent);
+	SV_ProfileEnter (SVPROF_THINK);
 	PR_ExecuteProgram (pr_global_struct->PlayerPreThink);
+	SV_ProfileLeave ();
 
 //
 // do a move
@@ -1274,7 +1278,9 @@ void SV_Physics_Client (edict_t	*ent, int num)
 
 	pr_global_struct->time = qcvm->time;
 	pr_global_struct->self = EDICT_TO_PROG(ent);
+	SV_ProfileEnter (SVPROF_THINK);
 	PR_ExecuteProgram (pr_global_struct->PlayerPostThink);
+	SV_ProfileLeave ();
 }
 
 //============================================================================
@@ -1532,6 +1538,33 @@ SV_Physics
 
 ================
 */
+/*
+================
+SV_PhysicsPhase
+
+Which sv_tickprofile phase an entity's physics counts towards.
+================
+*/
+static svprofphase_t SV_PhysicsPhase (edict_t *ent)
+{
+	switch ((int)ent->v.movetype)
+	{
+	case MOVETYPE_PUSH:
+		return SVPROF_PUSH;
+	case MOVETYPE_TOSS:
+	case MOVETYPE_EXT_BOUNCEMISSILE:
+	case MOVETYPE_BOUNCE:
+	case MOVETYPE_FLY:
+	case MOVETYPE_FLYMISSILE:
+		return SVPROF_TOSS;
+	case MOVETYPE_WALK:
+	case MOVETYPE_STEP:
+		return SVPROF_WALK;
+	default:	//the rest don't do much besides thinking
+		return SVPROF_THINK;
+	}
+}
+
 void SV_Physics (double frametime)
 {
 	int	i;
@@ -1574,7 +1607,9 @@ void SV_Physics (double frametime)
 		pr_global_struct->self = EDICT_TO_PROG(qcvm->edicts);
 		pr_global_struct->other = EDICT_TO_PROG(qcvm->edicts);
 		pr_global_struct->time = qcvm->time;
+		SV_ProfileEnter (SVPROF_THINK);
 		PR_ExecuteProgram (pr_global_struct->StartFrame);
+		SV_ProfileLeave ();
 	}
 
 //SV_CheckAllEnts ();
@@ -1600,6 +1635,7 @@ void SV_Physics (double frametime)
 			SV_LinkEdict (ent, true);	// force retouch even for stationary
 		}
 
+		SV_ProfileEnter (SV_PhysicsPhase (ent));
 		if (i > 0 && i <= svs.maxclients && qcvm == &sv.qcvm)
 			SV_Physics_Client (ent, i);
 		else if ((val = GetEdictFieldValue(ent, qcvm->extfields.customphysics)) && val->function)
@@ -1636,6 +1672,7 @@ void SV_Physics (double frametime)
 		}
 		else
 			Host_EndGame ("SV_Physics: bad movetype %i", (int)ent->v.movetype);
+		SV_ProfileLeave ();
 	}
 
 	if (pr_global_struct->force_retouch)
@@ -1647,7 +1684,9 @@ void SV_Physics (double frametime)
 		pr_global_struct->self = EDICT_TO_PROG(qcvm->edicts);
 		pr_global_struct->other = EDICT_TO_PROG(qcvm->edicts);
 		pr_global_struct->time = qcvm->time;
+		SV_ProfileEnter (SVPROF_THINK);
 		PR_ExecuteProgram (qcvm->extfuncs.EndFrame);
+		SV_ProfileLeave ();
 	}
 
 	if (!(sv_freezenonclients.value && qcvm == &sv.qcvm))	//FIXME: this breaks input_timelength
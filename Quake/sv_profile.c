@@ -0,0 +1,332 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// sv_profile.c -- per-phase server tick timers
+
+/*
+With sv_tickprofile 1, each server frame is split into phases (see svprofphase_t) and the
+last SVPROF_WINDOW frames are kept, so "sv_tickstats" can show where the time is going
+right now without attaching a profiler. Phases nest, and each only counts the time that
+wasn't spent in a phase inside it, so they add up to the whole frame.
+Running with -tickprofile turns it on and also appends the stats to tickprofile.log in
+the base directory every sv_tickprofile_loginterval seconds, like -condebug does.
+Each of the -instances servers keeps its own frames, and tags its lines in the log.
+*/
+
+#include "quakedef.h"
+
+#define SVPROF_WINDOW	1024	//frames kept. about 14 seconds at 72 ticks a second.
+#define SVPROF_BUCKETS	22		//powers of two from 1us up to 1s, with everything else at the ends
+#define SVPROF_MAXDEPTH	16
+
+static const char *svprof_names[SVPROF_NUMPHASES+1] =
+{
+	"other",
+	"clients",
+	"think",
+	"push",
+	"toss",
+	"walk",
+	"link",
+	"pvs",
+	"snapshot",
+	"send",
+	"total"
+};
+
+static cvar_t sv_tickprofile = {"sv_tickprofile", "0", CVAR_NONE};
+static cvar_t sv_tickprofile_loginterval = {"sv_tickprofile_loginterval", "60", CVAR_NONE};
+
+typedef struct
+{
+	qboolean		active;		//timing the current frame
+	int				depth;
+	svprofphase_t	stack[SVPROF_MAXDEPTH];
+	uint64_t		last;		//when the top of the stack started counting
+	uint64_t		ticks[SVPROF_NUMPHASES];
+
+	float			samples[SVPROF_WINDOW][SVPROF_NUMPHASES+1];	//microseconds. the last one is the whole frame
+	int				head;		//next sample to write
+	int				count;
+
+	double			lastlog;
+} svprofstate_t;
+
+static svprofstate_t	*svprof;	//the switched in server's, allocated the first time it's timed
+static FILE				*svprof_log;
+
+static uint64_t SV_ProfileTicks (void)
+{
+#if SDL_VERSION_ATLEAST(2,0,0)
+	return SDL_GetPerformanceCounter();
+#else
+	return Sys_DoubleTime() * 1000000.0;
+#endif
+}
+static double SV_ProfileTicksToMicroseconds (uint64_t ticks)
+{
+#if SDL_VERSION_ATLEAST(2,0,0)
+	return ticks * 1000000.0 / SDL_GetPerformanceFrequency();
+#else
+	return ticks;
+#endif
+}
+
+static void SV_ProfileCharge (uint64_t now)
+{
+	svprof->ticks[svprof->stack[q_min(svprof->depth, SVPROF_MAXDEPTH)-1]] += now - svprof->last;
+	svprof->last = now;
+}
+
+/*
+====================
+SV_ProfileEnter / SV_ProfileLeave
+
+Charge the time so far to the enclosing phase and start counting for the new one.
+Only the main thread may call these.
+====================
+*/
+void SV_ProfileEnter (svprofphase_t phase)
+{
+	if (!svprof || !svprof->active)
+		return;
+	SV_ProfileCharge (SV_ProfileTicks());
+	if (svprof->depth < SVPROF_MAXDEPTH)
+		svprof->stack[svprof->depth] = phase;
+	svprof->depth++;
+}
+
+void SV_ProfileLeave (void)
+{
+	if (!svprof || !svprof->active)
+		return;
+	SV_ProfileCharge (SV_ProfileTicks());
+	if (svprof->depth > 1)
+		svprof->depth--;
+}
+
+/*
+====================
+SV_ProfileBeginFrame
+====================
+*/
+void SV_ProfileBeginFrame (void)
+{
+	if (!sv_tickprofile.value && !svprof_log)
+	{
+		if (svprof)
+			svprof->active = false;
+		return;
+	}
+	if (!svprof)
+	{
+		svprof = (svprofstate_t *) calloc (1, sizeof(*svprof));
+		if (!svprof)
+			Sys_Error ("SV_ProfileBeginFrame: out of memory");
+	}
+	svprof->active = true;
+	memset (svprof->ticks, 0, sizeof(svprof->ticks));
+	svprof->depth = 1;	//anything left over from a Host_Error is gone
+	svprof->stack[0] = SVPROF_OTHER;
+	svprof->last = SV_ProfileTicks();
+}
+
+static int SV_ProfileCompareFloats (const void *a, const void *b)
+{
+	float fa = *(const float *)a, fb = *(const float *)b;
+	return (fa > fb) - (fa < fb);
+}
+
+typedef struct
+{
+	float	mean, p50, p90, p99, max;
+	int		buckets[SVPROF_BUCKETS];
+} svprofstats_t;
+
+static int SV_ProfileBucket (float us)
+{
+	int b;
+	for (b = 0; b < SVPROF_BUCKETS-1 && us >= (1<<b); b++)
+		;
+	return b;
+}
+
+static void SV_ProfileStats (int phase, svprofstats_t *out)
+{
+	static float sorted[SVPROF_WINDOW];
+	double	total = 0;
+	int		i;
+
+	memset (out, 0, sizeof(*out));
+	if (!svprof->count)
+		return;
+	for (i = 0; i < svprof->count; i++)
+	{
+		sorted[i] = svprof->samples[i][phase];
+		total += sorted[i];
+		out->buckets[SV_ProfileBucket(sorted[i])]++;
+	}
+	qsort (sorted, svprof->count, sizeof(*sorted), SV_ProfileCompareFloats);
+	out->mean = total / svprof->count;
+	out->p50 = sorted[(svprof->count-1) * 50 / 100];
+	out->p90 = sorted[(svprof->count-1) * 90 / 100];
+	out->p99 = sorted[(svprof->count-1) * 99 / 100];
+	out->max = sorted[svprof->count-1];
+}
+
+static void SV_ProfileWriteLog (void)
+{
+	svprofstats_t	s;
+	int				i, b;
+
+	for (i = 0; i <= SVPROF_NUMPHASES; i++)
+	{
+		SV_ProfileStats (i, &s);
+		fprintf (svprof_log, "%.1f ", realtime);
+		if (host_numinstances > 1)
+			fprintf (svprof_log, "instance %i ", host_instance);
+		fprintf (svprof_log, "%s frames %i mean %.1f p50 %.1f p90 %.1f p99 %.1f max %.1f hist",
+				svprof_names[i], svprof->count, s.mean, s.p50, s.p90, s.p99, s.max);
+		for (b = 0; b < SVPROF_BUCKETS; b++)
+			fprintf (svprof_log, "%c%i", b?',':' ', s.buckets[b]);
+		fprintf (svprof_log, "\n");
+	}
+	fflush (svprof_log);
+}
+
+/*
+====================
+SV_ProfileEndFrame
+====================
+*/
+void SV_ProfileEndFrame (void)
+{
+	float	*sample, total;
+	int		i;
+
+	if (!svprof || !svprof->active)
+		return;
+	SV_ProfileCharge (SV_ProfileTicks());	//should be back down to SVPROF_OTHER
+	svprof->active = false;
+
+	sample = svprof->samples[svprof->head];
+	for (i = 0, total = 0; i < SVPROF_NUMPHASES; i++)
+		total += sample[i] = SV_ProfileTicksToMicroseconds (svprof->ticks[i]);
+	sample[SVPROF_NUMPHASES] = total;
+	svprof->head = (svprof->head + 1) % SVPROF_WINDOW;
+	if (svprof->count < SVPROF_WINDOW)
+		svprof->count++;
+
+	if (svprof_log && realtime - svprof->lastlog >= q_max(1, sv_tickprofile_loginterval.value))
+	{
+		svprof->lastlog = realtime;
+		SV_ProfileWriteLog ();
+	}
+}
+
+/*
+====================
+SV_TickStats_f
+
+"sv_tickstats" shows each phase over the last SVPROF_WINDOW frames,
+"sv_tickstats <phase>" shows that phase's histogram, and "sv_tickstats reset" starts again.
+====================
+*/
+static void SV_TickStats_f (void)
+{
+	svprofstats_t	s, total;
+	int				i, b;
+	const char		*arg = Cmd_Argv(1);
+
+	if (!strcmp(arg, "reset"))
+	{
+		if (svprof)
+			svprof->head = svprof->count = 0;
+		return;
+	}
+	if (!svprof || !svprof->count)
+	{
+		Con_Printf ("no frames recorded%s\n", sv_tickprofile.value ? "" : ", set sv_tickprofile 1");
+		return;
+	}
+
+	if (*arg)
+	{
+		for (i = 0; i <= SVPROF_NUMPHASES; i++)
+			if (!strcmp(arg, svprof_names[i]))
+				break;
+		if (i > SVPROF_NUMPHASES)
+		{
+			Con_Printf ("unknown phase \"%s\"\n", arg);
+			return;
+		}
+		SV_ProfileStats (i, &s);
+		Con_Printf ("%s over the last %i frames:\n", svprof_names[i], svprof->count);
+		for (b = 0; b < SVPROF_BUCKETS; b++)
+		{
+			if (!s.buckets[b])
+				continue;
+			if (!b)
+				Con_Printf ("%18s", "< 1us");
+			else if (b == SVPROF_BUCKETS-1)
+				Con_Printf ("%11s%7i", ">= ", 1<<(b-1));
+			else
+				Con_Printf ("%7i - %7i", 1<<(b-1), 1<<b);
+			Con_Printf (" %6i %5.1f%%\n", s.buckets[b], 100.0 * s.buckets[b] / svprof->count);
+		}
+		return;
+	}
+
+	SV_ProfileStats (SVPROF_NUMPHASES, &total);
+	if (host_numinstances > 1)
+		Con_Printf ("instance %i, ", host_instance);
+	Con_Printf ("last %i frames, in ms:\n", svprof->count);
+	Con_Printf ("phase        mean    p50    p90    p99    max  share\n");
+	for (i = 0; i <= SVPROF_NUMPHASES; i++)
+	{
+		SV_ProfileStats (i, &s);
+		Con_Printf ("%-9s %7.3f%7.3f%7.3f%7.3f%7.3f %5.1f%%\n", svprof_names[i],
+				s.mean/1000, s.p50/1000, s.p90/1000, s.p99/1000, s.max/1000,
+				total.mean ? 100 * s.mean / total.mean : 0);
+	}
+}
+
+/*
+====================
+SV_ProfileInit
+====================
+*/
+void SV_ProfileInit (void)
+{
+	char name[MAX_OSPATH];
+
+	Cvar_RegisterVariable (&sv_tickprofile);
+	Cvar_RegisterVariable (&sv_tickprofile_loginterval);
+	Cmd_AddCommand ("sv_tickstats", SV_TickStats_f);
+	Host_InstanceGlobal (&svprof, sizeof(svprof));	//-instances each time their own frames
+
+	if (COM_CheckParm("-tickprofile"))
+	{
+		q_snprintf (name, sizeof(name), "%s/tickprofile.log", host_parms->basedir);
+		svprof_log = fopen (name, "w");
+		if (!svprof_log)
+			Con_Printf ("Unable to create %s\n", name);
+	}
+}
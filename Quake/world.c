@@ -45,6 +45,9 @@ typedef struct
 	edict_t		*passedict;
 } moveclip_t;
 
+cvar_t	sv_broadphase = {"sv_broadphase", "0", CVAR_NONE};	//0 for the original areanodes, 1 for an aabb tree (same results, in the same order)
+cvar_t	sv_hulltrace = {"sv_hulltrace", "1", CVAR_NONE};	//0 for the recursive hull trace, 1 for the iterative one, 2 to run both and complain about differences
+
 
 int SV_HullPointContents (hull_t *hull, int num, vec3_t p);
 
@@ -61,6 +64,12 @@ static	hull_t		box_hull;
 static	mclipnode_t	box_clipnodes[6]; //johnfitz -- was dclipnode_t
 static	mplane_t	box_planes[6];
 
+typedef struct
+{
+	hull_t		hull;
+	mplane_t	planes[6];
+} boxhull_t;
+
 /*
 ===================
 SV_InitBoxHull
@@ -104,18 +113,22 @@ SV_HullForBox
 
 To keep everything totally uniform, bounding boxes are turned into small
 BSP trees instead of being compared directly.
+The hull is built in the caller's storage, so traces can run on several threads.
 ===================
 */
-hull_t	*SV_HullForBox (vec3_t mins, vec3_t maxs)
+hull_t	*SV_HullForBox (vec3_t mins, vec3_t maxs, boxhull_t *box)
 {
-	box_planes[0].dist = maxs[0];
-	box_planes[1].dist = mins[0];
-	box_planes[2].dist = maxs[1];
-	box_planes[3].dist = mins[1];
-	box_planes[4].dist = maxs[2];
-	box_planes[5].dist = mins[2];
-
-	return &box_hull;
+	box->hull = box_hull;
+	box->hull.planes = box->planes;
+	memcpy (box->planes, box_planes, sizeof(box->planes));
+	box->planes[0].dist = maxs[0];
+	box->planes[1].dist = mins[0];
+	box->planes[2].dist = maxs[1];
+	box->planes[3].dist = mins[1];
+	box->planes[4].dist = maxs[2];
+	box->planes[5].dist = mins[2];
+
+	return &box->hull;
 }
 
 
@@ -130,7 +143,7 @@ Offset is filled in to contain the adjustment that must be added to the
 testing object's origin to get a point to use with the returned hull.
 ================
 */
-hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
+hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset, boxhull_t *box)
 {
 	qmodel_t	*model;
 	vec3_t		size;
@@ -140,7 +153,7 @@ hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
 // decide which clipping hull to use, based on the size
 	if (ent->v.solid == SOLID_BSP || ent->v.solid == SOLID_EXT_BSPTRIGGER)
 	{	// explicit hulls in the BSP model
-		if (ent->v.movetype != MOVETYPE_PUSH && !pr_checkextension.value)
+		if (ent->v.movetype != MOVETYPE_PUSH && !pr_checkextension.value && !Host_JobsRunning ())
 			Con_Warning ("SOLID_BSP without MOVETYPE_PUSH (%s at %f %f %f)\n",
 				    PR_GetString(ent->v.classname), ent->v.origin[0], ent->v.origin[1], ent->v.origin[2]);
 
@@ -148,9 +161,10 @@ hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
 
 		if (!model || model->type != mod_brush)
 		{
-			Con_Warning ("SOLID_BSP%s with a non bsp model (%s at %f %f %f)\n",
-					(ent->v.solid == SOLID_EXT_BSPTRIGGER)?"TRIGGER":"",
-				    PR_GetString(ent->v.classname), ent->v.origin[0], ent->v.origin[1], ent->v.origin[2]);
+			if (!Host_JobsRunning ())
+				Con_Warning ("SOLID_BSP%s with a non bsp model (%s at %f %f %f)\n",
+						(ent->v.solid == SOLID_EXT_BSPTRIGGER)?"TRIGGER":"",
+					    PR_GetString(ent->v.classname), ent->v.origin[0], ent->v.origin[1], ent->v.origin[2]);
 			goto nohitmeshsupport;
 		}
 
@@ -171,7 +185,7 @@ hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
 nohitmeshsupport:
 		VectorSubtract (ent->v.mins, maxs, hullmins);
 		VectorSubtract (ent->v.maxs, mins, hullmaxs);
-		hull = SV_HullForBox (hullmins, hullmaxs);
+		hull = SV_HullForBox (hullmins, hullmaxs, box);
 
 		VectorCopy (ent->v.origin, offset);
 	}
@@ -241,96 +255,640 @@ SV_ClearWorld
 */
 void SV_ClearWorld (void)
 {
+	aabbtree_t *t = &qcvm->aabbtree;
+
 	SV_InitBoxHull ();
 
 	memset (qcvm->areanodes, 0, sizeof(qcvm->areanodes));
 	qcvm->numareanodes = 0;
 	SV_CreateAreaNode (0, qcvm->worldmodel->mins, qcvm->worldmodel->maxs);
+
+	qcvm->broadphase = (sv_broadphase.value)?BROADPHASE_AABBTREE:BROADPHASE_AREANODES;
+	t->numnodes = 0;
+	t->freenode = -1;
+	t->root[0] = t->root[1] = -1;
+	t->inserts = t->refits = t->removes = t->rotations = 0;
+	t->linkseq = 0;
+	if (t->maxents != qcvm->max_edicts)
+	{
+		t->maxents = qcvm->max_edicts;
+		t->entleaf = (int *) realloc(t->entleaf, sizeof(*t->entleaf)*t->maxents);
+		if (!t->entleaf && t->maxents)
+			Sys_Error ("SV_ClearWorld: out of memory");
+	}
+	if (t->maxents)
+		memset (t->entleaf, 0xff, sizeof(*t->entleaf)*t->maxents);	//-1: not linked
+}
+
+/*
+===============================================================================
+
+AABB TREE BROADPHASE
+
+A dynamic bounding volume hierarchy, kept balanced with tree rotations.
+The areanodes only ever split the map in half a few times, so anything
+sitting on one of the split planes lands in a list that almost every query
+has to walk. The tree's leaves are padded by AABBTREE_MARGIN, so an entity
+that only moved a little since it was last linked keeps its leaf as-is.
+
+Traces and touches depend on the order entities are visited in (startsolid
+and allsolid results stick), so queries sort what the tree finds into the
+order the areanodes would have visited it: by areanode, solids before
+triggers, then by when each entity was linked.
+
+===============================================================================
+*/
+
+#define AABBTREE_MARGIN	8
+
+//the first areanode that the ent's box crosses
+static areanode_t *World_AreaNodeForEdict (edict_t *ent)
+{
+	areanode_t *node = qcvm->areanodes;
+	while (1)
+	{
+		if (node->axis == -1)
+			break;
+		if (ent->v.absmin[node->axis] > node->dist)
+			node = node->children[0];
+		else if (ent->v.absmax[node->axis] < node->dist)
+			node = node->children[1];
+		else
+			break;		// crosses the node
+	}
+	return node;
+}
+
+//areanodes are numbered in the order World_AreaNodeQuery visits them, and
+//relinking always moves an entity to the end of its node's list.
+static uint64_t World_AABBOrder (edict_t *ent, int tree)
+{
+	uint64_t areanode = World_AreaNodeForEdict (ent) - qcvm->areanodes;
+	return (areanode<<59) | ((uint64_t)tree<<58) | ++qcvm->aabbtree.linkseq;
+}
+
+static int World_AABBAllocNode (aabbtree_t *t)
+{
+	int n;
+
+	if (t->freenode != -1)
+	{
+		n = t->freenode;
+		t->freenode = t->nodes[n].parent;
+	}
+	else
+	{
+		if (t->numnodes == t->maxnodes)
+		{
+			t->maxnodes = t->maxnodes?t->maxnodes*2:256;
+			t->nodes = (aabbnode_t *) realloc(t->nodes, sizeof(*t->nodes)*t->maxnodes);
+			if (!t->nodes)
+				Sys_Error ("World_AABBAllocNode: out of memory");
+		}
+		n = t->numnodes++;
+	}
+	t->nodes[n].parent = -1;
+	t->nodes[n].children[0] = t->nodes[n].children[1] = -1;
+	t->nodes[n].height = 0;
+	return n;
+}
+
+static void World_AABBFreeNode (aabbtree_t *t, int n)
+{
+	t->nodes[n].parent = t->freenode;
+	t->nodes[n].height = -1;
+	t->freenode = n;
+}
+
+static float World_AABBCost (const vec3_t mins1, const vec3_t maxs1, const vec3_t mins2, const vec3_t maxs2)
+{	//half the surface area of the box enclosing both
+	vec3_t size;
+	int i;
+	for (i = 0; i < 3; i++)
+		size[i] = q_max(maxs1[i], maxs2[i]) - q_min(mins1[i], mins2[i]);
+	return size[0]*size[1] + size[1]*size[2] + size[2]*size[0];
 }
 
+//recomputes an internal node's box and height from its children
+static void World_AABBRefit (aabbnode_t *nodes, int n)
+{
+	aabbnode_t *a = &nodes[nodes[n].children[0]];
+	aabbnode_t *b = &nodes[nodes[n].children[1]];
+	int i;
+	for (i = 0; i < 3; i++)
+	{
+		nodes[n].mins[i] = q_min(a->mins[i], b->mins[i]);
+		nodes[n].maxs[i] = q_max(a->maxs[i], b->maxs[i]);
+	}
+	nodes[n].height = 1 + q_max(a->height, b->height);
+}
+
+static void World_AABBReplaceChild (aabbtree_t *t, int tree, int parent, int oldchild, int newchild)
+{
+	t->nodes[newchild].parent = parent;
+	if (parent == -1)
+		t->root[tree] = newchild;
+	else if (t->nodes[parent].children[0] == oldchild)
+		t->nodes[parent].children[0] = newchild;
+	else
+		t->nodes[parent].children[1] = newchild;
+}
 
 /*
 ===============
-SV_UnlinkEdict
+World_AABBBalance
 
+If one side of n is more than one level deeper than the other, lifts that
+side's child into n's place. Returns whichever node is now in n's place.
 ===============
 */
-void SV_UnlinkEdict (edict_t *ent)
+static int World_AABBBalance (aabbtree_t *t, int tree, int n)
 {
-	if (!ent->area.prev)
+	aabbnode_t *nodes = t->nodes;
+	int side, up, other, keep, give;
+
+	if (nodes[n].height < 2)
+		return n;
+	side = nodes[nodes[n].children[1]].height - nodes[nodes[n].children[0]].height;
+	if (side > 1)
+		side = 1;
+	else if (side < -1)
+		side = 0;
+	else
+		return n;
+
+	up = nodes[n].children[side];
+	other = nodes[n].children[!side];
+	keep = nodes[up].children[0];
+	give = nodes[up].children[1];
+	if (nodes[keep].height < nodes[give].height)
+	{	//the lifted node keeps its taller child, n gets the shorter one
+		keep = give;
+		give = nodes[up].children[0];
+	}
+
+	World_AABBReplaceChild (t, tree, nodes[n].parent, n, up);
+	nodes[up].children[0] = n;
+	nodes[up].children[1] = keep;
+	nodes[n].parent = up;
+	nodes[n].children[side] = give;
+	nodes[n].children[!side] = other;
+	nodes[give].parent = n;
+
+	World_AABBRefit (nodes, n);
+	World_AABBRefit (nodes, up);
+	t->rotations++;
+	return up;
+}
+
+static void World_AABBInsertLeaf (aabbtree_t *t, int tree, int leaf)
+{
+	aabbnode_t	*nodes;
+	int			n, sibling, parent;
+	float		area, cost, inherit, childcost[2];
+	int			i;
+
+	if (t->root[tree] == -1)
+	{
+		t->root[tree] = leaf;
+		t->nodes[leaf].parent = -1;
+		return;
+	}
+
+	parent = World_AABBAllocNode (t);
+	nodes = t->nodes;	//may have moved
+
+	//walk down, picking the sibling that grows the total surface area the least
+	sibling = t->root[tree];
+	while (nodes[sibling].children[0] != -1)
+	{
+		area = World_AABBCost (nodes[sibling].mins, nodes[sibling].maxs, nodes[sibling].mins, nodes[sibling].maxs);
+		cost = 2 * World_AABBCost (nodes[sibling].mins, nodes[sibling].maxs, nodes[leaf].mins, nodes[leaf].maxs);
+		inherit = cost - 2*area;	//every node below here grows by this much too
+		for (i = 0; i < 2; i++)
+		{
+			aabbnode_t *c = &nodes[nodes[sibling].children[i]];
+			childcost[i] = World_AABBCost (c->mins, c->maxs, nodes[leaf].mins, nodes[leaf].maxs) + inherit;
+			if (c->children[0] != -1)
+				childcost[i] -= World_AABBCost (c->mins, c->maxs, c->mins, c->maxs);
+		}
+		if (cost < childcost[0] && cost < childcost[1])
+			break;
+		sibling = nodes[sibling].children[childcost[1] < childcost[0]];
+	}
+
+	World_AABBReplaceChild (t, tree, nodes[sibling].parent, sibling, parent);
+	nodes[parent].children[0] = sibling;
+	nodes[parent].children[1] = leaf;
+	nodes[sibling].parent = parent;
+	nodes[leaf].parent = parent;
+
+	for (n = parent; n != -1; n = nodes[n].parent)
+	{
+		World_AABBRefit (nodes, n);
+		n = World_AABBBalance (t, tree, n);
+	}
+}
+
+static void World_AABBRemoveLeaf (aabbtree_t *t, int leaf)
+{
+	aabbnode_t	*nodes = t->nodes;
+	int			tree = nodes[leaf].tree;
+	int			parent, sibling, n;
+
+	parent = nodes[leaf].parent;
+	if (parent == -1)
+	{
+		t->root[tree] = -1;
+		return;
+	}
+	sibling = nodes[parent].children[nodes[parent].children[0] == leaf];
+	n = nodes[parent].parent;
+	World_AABBReplaceChild (t, tree, n, parent, sibling);
+	World_AABBFreeNode (t, parent);
+
+	for (; n != -1; n = nodes[n].parent)
+	{
+		World_AABBRefit (nodes, n);
+		n = World_AABBBalance (t, tree, n);
+	}
+}
+
+static void World_AABBLink (edict_t *ent, int tree)
+{
+	aabbtree_t	*t = &qcvm->aabbtree;
+	aabbnode_t	*l;
+	int			num = NUM_FOR_EDICT(ent);
+	int			leaf, i;
+
+	if (num >= t->maxents)
+	{	//shouldn't happen, max_edicts doesn't normally change mid-map.
+		t->entleaf = (int *) realloc(t->entleaf, sizeof(*t->entleaf)*(num+1));
+		if (!t->entleaf)
+			Sys_Error ("World_AABBLink: out of memory");
+		while (t->maxents <= num)
+			t->entleaf[t->maxents++] = -1;
+	}
+
+	leaf = t->entleaf[num];
+	if (leaf != -1)
+	{
+		l = &t->nodes[leaf];
+		if (l->tree == tree
+		&& ent->v.absmin[0] >= l->mins[0] && ent->v.absmin[1] >= l->mins[1] && ent->v.absmin[2] >= l->mins[2]
+		&& ent->v.absmax[0] <= l->maxs[0] && ent->v.absmax[1] <= l->maxs[1] && ent->v.absmax[2] <= l->maxs[2])
+		{	//still within its padding, so only its place in the visit order changes.
+			l->order = World_AABBOrder (ent, tree);
+			t->refits++;
+			return;
+		}
+		World_AABBRemoveLeaf (t, leaf);
+	}
+	else
+	{
+		leaf = World_AABBAllocNode (t);
+		t->entleaf[num] = leaf;
+	}
+
+	l = &t->nodes[leaf];
+	l->entnum = num;
+	l->tree = tree;
+	l->children[0] = l->children[1] = -1;
+	l->height = 0;
+	l->order = World_AABBOrder (ent, tree);
+	for (i = 0; i < 3; i++)
+	{
+		l->mins[i] = ent->v.absmin[i] - AABBTREE_MARGIN;
+		l->maxs[i] = ent->v.absmax[i] + AABBTREE_MARGIN;
+	}
+	World_AABBInsertLeaf (t, tree, leaf);
+	t->inserts++;
+}
+
+static void World_AABBUnlink (edict_t *ent)
+{
+	aabbtree_t	*t = &qcvm->aabbtree;
+	int			num = NUM_FOR_EDICT(ent);
+	int			leaf;
+
+	if (num >= t->maxents || (leaf = t->entleaf[num]) == -1)
 		return;		// not linked in anywhere
-	RemoveLink (&ent->area);
-	ent->area.prev = ent->area.next = NULL;
+	World_AABBRemoveLeaf (t, leaf);
+	World_AABBFreeNode (t, leaf);
+	t->entleaf[num] = -1;
+	t->removes++;
 }
 
-#include "pmove.h"
-static void
-World_AreaAddEntsToPmove ( edict_t *ignore, areanode_t *node, vec3_t boxminmax[2] )
+/*
+===============================================================================
+
+AREA QUERIES
+
+Both broadphases hand every linked entity whose (possibly padded) bounds
+might touch the box to a callback, which does the exact tests. The
+callback returns false to stop early.
+
+===============================================================================
+*/
+
+typedef qboolean (*areacallback_t) (edict_t *touch, void *ctx);
+
+static qboolean World_AreaNodeQuery (areanode_t *node, int lists, const vec3_t mins, const vec3_t maxs, areacallback_t callback, void *ctx)
 {
-	link_t		*l, *next;
-	edict_t		*other;
+	link_t		*l, *next, *start;
+	int			i;
 
-// touch linked edicts
-	for (l = node->solid_edicts.next ; l != &node->solid_edicts ; l = next)
+	for (i = 0; i < 2; i++)
 	{
-		next = l->next;
-		other = EDICT_FROM_AREA(l);
-		if (other == ignore)
-			continue;
-		if (other->v.solid != SOLID_BBOX && other->v.solid != SOLID_SLIDEBOX && other->v.solid != SOLID_BSP)
-			continue;
-		if (boxminmax[0][0] > other->v.absmax[0]
-		|| boxminmax[0][1] > other->v.absmax[1]
-		|| boxminmax[0][2] > other->v.absmax[2]
-		|| boxminmax[1][0] < other->v.absmin[0]
-		|| boxminmax[1][1] < other->v.absmin[1]
-		|| boxminmax[1][2] < other->v.absmin[2] )
+		if (!(lists & (AREA_SOLID<<i)))
 			continue;
+		start = i?&node->trigger_edicts:&node->solid_edicts;
+		for (l = start->next ; l != start ; l = next)
+		{
+			next = l->next;
+			if (!callback (EDICT_FROM_AREA(l), ctx))
+				return false;
+		}
+	}
+
+// recurse down both sides
+	if (node->axis == -1)
+		return true;
+
+	if ( maxs[node->axis] > node->dist )
+		if (!World_AreaNodeQuery (node->children[0], lists, mins, maxs, callback, ctx))
+			return false;
+	if ( mins[node->axis] < node->dist )
+		if (!World_AreaNodeQuery (node->children[1], lists, mins, maxs, callback, ctx))
+			return false;
+	return true;
+}
+
+typedef struct
+{
+	uint64_t	order;
+	int			entnum;
+} aabbhit_t;
+static int World_AABBCompareHits (const void *a, const void *b)
+{
+	uint64_t oa = ((const aabbhit_t *)a)->order, ob = ((const aabbhit_t *)b)->order;
+	return (oa < ob)?-1:(oa > ob);
+}
+
+//grows one of a query's buffers, which start out on the stack. traces can run on worker threads, so nothing is shared.
+static void *World_AABBGrow (void *buf, void *localbuf, int *max, size_t size)
+{
+	void *n = malloc (size * *max * 2);
+	if (!n)
+		Sys_Error ("World_AABBQuery: out of memory");
+	memcpy (n, buf, size * *max);
+	if (buf != localbuf)
+		free (buf);
+	*max *= 2;
+	return n;
+}
 
-		if (ignore)
+static void World_AABBQuery (int lists, const vec3_t mins, const vec3_t maxs, areacallback_t callback, void *ctx)
+{
+	aabbtree_t	*t = &qcvm->aabbtree;
+	aabbnode_t	*node;
+	int			localstack[128], *stack = localstack, maxstack = countof(localstack), sp;
+	aabbhit_t	localhits[256], *hits = localhits;
+	int			maxhits = countof(localhits), numhits = 0;
+	int			i, tree;
+
+	for (tree = 0; tree < 2; tree++)
+	{
+		if (!(lists & (AREA_SOLID<<tree)) || t->root[tree] == -1)
+			continue;
+		sp = 0;
+		stack[sp++] = t->root[tree];
+		while (sp)
 		{
-			if (PROG_TO_EDICT(other->v.owner) == ignore)
-				continue;	// don't clip against own missiles
-			if (PROG_TO_EDICT(ignore->v.owner) == other)
-				continue;	// don't clip against owner
+			node = &t->nodes[stack[--sp]];
+			if (mins[0] > node->maxs[0] || mins[1] > node->maxs[1] || mins[2] > node->maxs[2]
+			|| maxs[0] < node->mins[0] || maxs[1] < node->mins[1] || maxs[2] < node->mins[2])
+				continue;
+			if (node->children[0] == -1)
+			{
+				if (numhits == maxhits)
+					hits = World_AABBGrow (hits, localhits, &maxhits, sizeof(*hits));
+				hits[numhits].order = node->order;
+				hits[numhits++].entnum = node->entnum;
+			}
+			else
+			{
+				if (sp+2 > maxstack)
+					stack = World_AABBGrow (stack, localstack, &maxstack, sizeof(*stack));
+				stack[sp++] = node->children[1];
+				stack[sp++] = node->children[0];
+			}
 		}
+	}
+
+	//startsolid and allsolid results depend on the order ents are clipped in, as does touch order, so match the areanodes.
+	qsort (hits, numhits, sizeof(*hits), World_AABBCompareHits);
+	for (i = 0; i < numhits; i++)
+		if (!callback (EDICT_NUM(hits[i].entnum), ctx))
+			break;
+
+	if (stack != localstack)
+		free (stack);
+	if (hits != localhits)
+		free (hits);
+}
+
+static void World_AreaQuery (int lists, const vec3_t mins, const vec3_t maxs, areacallback_t callback, void *ctx)
+{
+	if (qcvm->broadphase == BROADPHASE_AABBTREE)
+		World_AABBQuery (lists, mins, maxs, callback, ctx);
+	else if (qcvm->numareanodes)
+		World_AreaNodeQuery (qcvm->areanodes, lists, mins, maxs, callback, ctx);
+}
+
+//links an edict (whose absmin/absmax are already set) into the current broadphase.
+static void World_AreaLink (edict_t *ent, qboolean trigger)
+{
+	areanode_t *node;
+
+	if (qcvm->broadphase == BROADPHASE_AABBTREE)
+	{
+		World_AABBLink (ent, trigger);
+		return;
+	}
+
+	node = World_AreaNodeForEdict (ent);
+
+// link it in
+	if (trigger)
+		InsertLinkBefore (&ent->area, &node->trigger_edicts);
+	else
+		InsertLinkBefore (&ent->area, &node->solid_edicts);
+}
 
-		if (pmove.numphysent == countof(pmove.physents))
-			return; //too many... ooer.
+/*
+===============
+World_SetBroadphase
 
-		pmove.physents[pmove.numphysent].info = NUM_FOR_EDICT(other);
-		pmove.physents[pmove.numphysent].model = (other->v.solid == SOLID_BSP)?qcvm->GetModel(other->v.modelindex):NULL;
-		VectorCopy(other->v.origin, pmove.physents[pmove.numphysent].origin);
-		VectorCopy(other->v.mins, pmove.physents[pmove.numphysent].mins);
-		VectorCopy(other->v.maxs, pmove.physents[pmove.numphysent].maxs);
-		VectorCopy(other->v.angles, pmove.physents[pmove.numphysent].angles);
+Moves every linked edict over to the other broadphase, keeping them in the
+same solid/trigger list they were in.
+===============
+*/
+static void World_SetBroadphase (int broadphase)
+{
+	aabbtree_t	*t = &qcvm->aabbtree;
+	link_t		*l;
+	edict_t		*ent;
+	int			i, j, tree;
 
-		pmove.physents[pmove.numphysent].forcecontentsmask = 0;
-		if (other->v.skin < 0)
-			switch((int)other->v.skin)
+	if (qcvm->broadphase == broadphase)
+		return;
+	if (broadphase == BROADPHASE_AABBTREE)
+	{
+		qcvm->broadphase = broadphase;
+		for (i = 0; i < qcvm->numareanodes; i++)
+		{
+			for (j = 0; j < 2; j++)
 			{
-			case CONTENTS_WATER:	pmove.physents[pmove.numphysent].forcecontentsmask = CONTENTBIT_WATER; break;
-			case CONTENTS_LAVA:		pmove.physents[pmove.numphysent].forcecontentsmask = CONTENTBIT_LAVA; break;
-			case CONTENTS_SLIME:	pmove.physents[pmove.numphysent].forcecontentsmask = CONTENTBIT_SLIME; break;
-			case CONTENTS_SKY:		pmove.physents[pmove.numphysent].forcecontentsmask = CONTENTBIT_SKY; break;
-			case CONTENTS_CLIP:		pmove.physents[pmove.numphysent].forcecontentsmask = CONTENTBIT_CLIP; break;
-			case CONTENTS_LADDER:	pmove.physents[pmove.numphysent].forcecontentsmask = CONTENTBIT_LADDER; break;
+				l = j?&qcvm->areanodes[i].trigger_edicts:&qcvm->areanodes[i].solid_edicts;
+				while (l->next != l)
+				{
+					ent = EDICT_FROM_AREA(l->next);
+					RemoveLink (&ent->area);
+					ent->area.prev = ent->area.next = NULL;
+					World_AABBLink (ent, j);
+				}
 			}
+		}
+	}
+	else
+	{	//relink in the order the tree would have visited them, so the areanode lists come out the same
+		aabbhit_t *hits = (aabbhit_t *) malloc (sizeof(*hits) * q_max(t->maxents, 1));
+		int numhits = 0;
+		if (!hits)
+			Sys_Error ("World_SetBroadphase: out of memory");
+		qcvm->broadphase = broadphase;
+		for (i = 0; i < t->maxents && i < qcvm->num_edicts; i++)
+		{
+			if (t->entleaf[i] == -1)
+				continue;
+			hits[numhits].order = t->nodes[t->entleaf[i]].order;
+			hits[numhits++].entnum = i;
+		}
+		qsort (hits, numhits, sizeof(*hits), World_AABBCompareHits);
+		for (i = 0; i < numhits; i++)
+		{
+			ent = EDICT_NUM(hits[i].entnum);
+			tree = t->nodes[t->entleaf[hits[i].entnum]].tree;
+			t->entleaf[hits[i].entnum] = -1;
+			World_AreaLink (ent, tree);
+		}
+		free (hits);
+		t->numnodes = 0;
+		t->freenode = -1;
+		t->root[0] = t->root[1] = -1;
+	}
+}
 
-		pmove.numphysent++;
+static void World_Broadphase_f (cvar_t *var)
+{
+	qcvm_t *oldvm = qcvm;
+	qcvm_t *vms[] = {&sv.qcvm, &cl.qcvm};
+	size_t i;
+
+	for (i = 0; i < countof(vms); i++)
+	{
+		if (!vms[i]->progs || !vms[i]->numareanodes)
+			continue;	//will be picked up by SV_ClearWorld.
+		qcvm = NULL;
+		PR_SwitchQCVM (vms[i]);
+		World_SetBroadphase (var->value?BROADPHASE_AABBTREE:BROADPHASE_AREANODES);
 	}
+	qcvm = NULL;
+	PR_SwitchQCVM (oldvm);
+}
 
-// recurse down both sides
-	if (node->axis == -1)
+
+/*
+===============
+SV_UnlinkEdict
+
+===============
+*/
+void SV_UnlinkEdict (edict_t *ent)
+{
+	if (qcvm->broadphase == BROADPHASE_AABBTREE)
+	{
+		World_AABBUnlink (ent);
 		return;
+	}
+	if (!ent->area.prev)
+		return;		// not linked in anywhere
+	RemoveLink (&ent->area);
+	ent->area.prev = ent->area.next = NULL;
+}
 
-	if ( boxminmax[1][node->axis] > node->dist )
-		World_AreaAddEntsToPmove ( ignore, node->children[0], boxminmax );
-	if ( boxminmax[0][node->axis] < node->dist )
-		World_AreaAddEntsToPmove ( ignore, node->children[1], boxminmax );
+#include "pmove.h"
+struct pmovequery_s
+{
+	edict_t		*ignore;
+	vec3_t		*boxminmax;
+};
+static qboolean World_AddEntToPmove (edict_t *other, void *ctx)
+{
+	struct pmovequery_s *q = ctx;
+	edict_t		*ignore = q->ignore;
+	vec3_t		*boxminmax = q->boxminmax;
+
+	if (other == ignore)
+		return true;
+	if (other->v.solid != SOLID_BBOX && other->v.solid != SOLID_SLIDEBOX && other->v.solid != SOLID_BSP)
+		return true;
+	if (boxminmax[0][0] > other->v.absmax[0]
+	|| boxminmax[0][1] > other->v.absmax[1]
+	|| boxminmax[0][2] > other->v.absmax[2]
+	|| boxminmax[1][0] < other->v.absmin[0]
+	|| boxminmax[1][1] < other->v.absmin[1]
+	|| boxminmax[1][2] < other->v.absmin[2] )
+		return true;
+
+	if (ignore)
+	{
+		if (PROG_TO_EDICT(other->v.owner) == ignore)
+			return true;	// don't clip against own missiles
+		if (PROG_TO_EDICT(ignore->v.owner) == other)
+			return true;	// don't clip against owner
+	}
+
+	if (pmove.numphysent == countof(pmove.physents))
+		return false; //too many... ooer.
+
+	pmove.physents[pmove.numphysent].info = NUM_FOR_EDICT(other);
+	pmove.physents[pmove.numphysent].model = (other->v.solid == SOLID_BSP)?qcvm->GetModel(other->v.modelindex):NULL;
+	VectorCopy(other->v.origin, pmove.physents[pmove.numphysent].origin);
+	VectorCopy(other->v.mins, pmove.physents[pmove.numphysent].mins);
+	VectorCopy(other->v.maxs, pmove.physents[pmove.numphysent].maxs);
+	VectorCopy(other->v.angles, pmove.physents[pmove.numphysent].angles);
+
+	pmove.physents[pmove.numphysent].forcecontentsmask = 0;
+	if (other->v.skin < 0)
+		switch((int)other->v.skin)
+		{
+		case CONTENTS_WATER:	pmove.physents[pmove.numphysent].forcecontentsmask = CONTENTBIT_WATER; break;
+		case CONTENTS_LAVA:		pmove.physents[pmove.numphysent].forcecontentsmask = CONTENTBIT_LAVA; break;
+		case CONTENTS_SLIME:	pmove.physents[pmove.numphysent].forcecontentsmask = CONTENTBIT_SLIME; break;
+		case CONTENTS_SKY:		pmove.physents[pmove.numphysent].forcecontentsmask = CONTENTBIT_SKY; break;
+		case CONTENTS_CLIP:		pmove.physents[pmove.numphysent].forcecontentsmask = CONTENTBIT_CLIP; break;
+		case CONTENTS_LADDER:	pmove.physents[pmove.numphysent].forcecontentsmask = CONTENTBIT_LADDER; break;
+		}
+
+	pmove.numphysent++;
+	return true;
 }
 void World_AddEntsToPmove(edict_t *ignore, vec3_t boxminmax[2])
 {
+	struct pmovequery_s q;
+
 	if (ignore)
 		pmove.skipent = NUM_FOR_EDICT(ignore);
 	pmove.physents[0].model = qcvm->worldmodel;
@@ -339,7 +897,9 @@ void World_AddEntsToPmove(edict_t *ignore, vec3_t boxminmax[2])
 	pmove.physents[0].forcecontentsmask = 0;
 	pmove.physents[0].info = 0;
 	pmove.numphysent = 1;
-	World_AreaAddEntsToPmove (ignore, qcvm->areanodes, boxminmax);
+	q.ignore = ignore;
+	q.boxminmax = boxminmax;
+	World_AreaQuery (AREA_SOLID, boxminmax[0], boxminmax[1], World_AddEntToPmove, &q);
 
 	//csqc needs to be able to clip against the server's ents, too
 	if (qcvm == &cl.qcvm)
@@ -405,44 +965,71 @@ Spike -- just builds a list of entities within the area, rather than walking
 them and risking the list getting corrupt.
 ====================
 */
-static void
-SV_AreaTriggerEdicts ( edict_t *ent, areanode_t *node, edict_t **list, int *listcount, const int listspace )
+struct arealist_s
 {
-	link_t		*l, *next;
-	edict_t		*touch;
+	float		*mins, *maxs;
+	edict_t		*ent;		//if set, only list triggers that it would touch
+	edict_t		**list;
+	int			listcount;
+	int			listspace;
+};
+static qboolean SV_AreaListEdict (edict_t *touch, void *ctx)
+{
+	struct arealist_s *q = ctx;
 
-// touch linked edicts
-	for (l = node->trigger_edicts.next ; l != &node->trigger_edicts ; l = next)
+	if (q->ent)
 	{
-		next = l->next;
-		touch = EDICT_FROM_AREA(l);
-		if (touch == ent)
-			continue;
+		if (touch == q->ent)
+			return true;
 		if (!touch->v.touch || (touch->v.solid != SOLID_TRIGGER && touch->v.solid != SOLID_EXT_BSPTRIGGER))
-			continue;
-		if (ent->v.absmin[0] > touch->v.absmax[0]
-		|| ent->v.absmin[1] > touch->v.absmax[1]
-		|| ent->v.absmin[2] > touch->v.absmax[2]
-		|| ent->v.absmax[0] < touch->v.absmin[0]
-		|| ent->v.absmax[1] < touch->v.absmin[1]
-		|| ent->v.absmax[2] < touch->v.absmin[2] )
-			continue;
-
-		if (*listcount == listspace)
-			return; // should never happen
-
-		list[*listcount] = touch;
-		(*listcount)++;
+			return true;
 	}
+	if (q->mins[0] > touch->v.absmax[0]
+	|| q->mins[1] > touch->v.absmax[1]
+	|| q->mins[2] > touch->v.absmax[2]
+	|| q->maxs[0] < touch->v.absmin[0]
+	|| q->maxs[1] < touch->v.absmin[1]
+	|| q->maxs[2] < touch->v.absmin[2] )
+		return true;
 
-// recurse down both sides
-	if (node->axis == -1)
-		return;
+	if (q->listcount == q->listspace)
+		return false; // should never happen
+	q->list[q->listcount++] = touch;
+	return true;
+}
+static int SV_AreaTriggerEdicts (edict_t *ent, edict_t **list, int listspace)
+{
+	struct arealist_s q;
+	q.mins = ent->v.absmin;
+	q.maxs = ent->v.absmax;
+	q.ent = ent;
+	q.list = list;
+	q.listcount = 0;
+	q.listspace = listspace;
+	World_AreaQuery (AREA_TRIGGER, q.mins, q.maxs, SV_AreaListEdict, &q);
+	return q.listcount;
+}
+
+/*
+====================
+SV_AreaEdicts
 
-	if ( ent->v.absmax[node->axis] > node->dist )
-		SV_AreaTriggerEdicts ( ent, node->children[0], list, listcount, listspace );
-	if ( ent->v.absmin[node->axis] < node->dist )
-		SV_AreaTriggerEdicts ( ent, node->children[1], list, listcount, listspace );
+Lists the linked entities whose absolute bounds touch the given box.
+Entities that are SOLID_NOT are never linked into the areanodes, so they won't be found.
+Returns the number of entities written to list.
+====================
+*/
+int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list, int listspace)
+{
+	struct arealist_s q;
+	q.mins = mins;
+	q.maxs = maxs;
+	q.ent = NULL;
+	q.list = list;
+	q.listcount = 0;
+	q.listspace = listspace;
+	World_AreaQuery (AREA_SOLID|AREA_TRIGGER, mins, maxs, SV_AreaListEdict, &q);
+	return q.listcount;
 }
 
 /*
@@ -466,8 +1053,7 @@ void SV_TouchLinks (edict_t *ent)
 	mark = Hunk_LowMark ();
 	list = (edict_t **) Hunk_Alloc (qcvm->num_edicts*sizeof(edict_t *));
 	
-	listcount = 0;
-	SV_AreaTriggerEdicts (ent, qcvm->areanodes, list, &listcount, qcvm->num_edicts);
+	listcount = SV_AreaTriggerEdicts (ent, list, qcvm->num_edicts);
 
 	for (i = 0; i < listcount; i++)
 	{
@@ -559,18 +1145,20 @@ SV_LinkEdict
 
 ===============
 */
-void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
+static void SV_DoLinkEdict (edict_t *ent, qboolean touch_triggers)
 {
-	areanode_t	*node;
-
 	if (ent->area.prev)
 		SV_UnlinkEdict (ent);	// unlink from old position
+	// the aabb tree is left alone for now, World_AABBLink can often keep its old leaf
 
 	if (ent == qcvm->edicts)
 		return;		// don't add the world
 
 	if (ent->free)
+	{
+		SV_UnlinkEdict (ent);
 		return;
+	}
 
 // set the abs box
 	VectorAdd (ent->v.origin, ent->v.mins, ent->v.absmin);
@@ -631,33 +1219,24 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 		SV_FindTouchedLeafs (ent, qcvm->worldmodel->nodes);
 
 	if (ent->v.solid == SOLID_NOT)
-		return;
-
-// find the first node that the ent's box crosses
-	node = qcvm->areanodes;
-	while (1)
 	{
-		if (node->axis == -1)
-			break;
-		if (ent->v.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if (ent->v.absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
+		SV_UnlinkEdict (ent);
+		return;
 	}
 
 // link it in
-
-	if (ent->v.solid == SOLID_TRIGGER || ent->v.solid == SOLID_EXT_BSPTRIGGER)
-		InsertLinkBefore (&ent->area, &node->trigger_edicts);
-	else
-		InsertLinkBefore (&ent->area, &node->solid_edicts);
+	World_AreaLink (ent, ent->v.solid == SOLID_TRIGGER || ent->v.solid == SOLID_EXT_BSPTRIGGER);
 
 // if touch_triggers, touch all entities at this node and decend for more
 	if (touch_triggers)
 		SV_TouchLinks ( ent );
 }
+void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
+{
+	SV_ProfileEnter (SVPROF_LINK);
+	SV_DoLinkEdict (ent, touch_triggers);
+	SV_ProfileLeave ();
+}
 
 
 
@@ -883,29 +1462,219 @@ reenter:
 
 	if (side)
 	{
-		/*we impacted the back of the node, so flip the plane*/
-		trace->plane.dist = -plane->dist;
-		VectorNegate(plane->normal, trace->plane.normal);
-		midf = (t1 + DIST_EPSILON) / (t1 - t2);
-	}
-	else
+		/*we impacted the back of the node, so flip the plane*/
+		trace->plane.dist = -plane->dist;
+		VectorNegate(plane->normal, trace->plane.normal);
+		midf = (t1 + DIST_EPSILON) / (t1 - t2);
+	}
+	else
+	{
+		/*we impacted the front of the node*/
+		trace->plane.dist = plane->dist;
+		VectorCopy(plane->normal, trace->plane.normal);
+		midf = (t1 - DIST_EPSILON) / (t1 - t2);
+	}
+
+	t1 = DoublePrecisionDotProduct (trace->plane.normal, ctx->start) - trace->plane.dist;
+	t2 = DoublePrecisionDotProduct (trace->plane.normal, ctx->end) - trace->plane.dist;
+	midf = (t1 - DIST_EPSILON) / (t1 - t2);
+
+	midf = CLAMP(0, midf, 1);
+	trace->fraction = midf;
+	VectorCopy (mid, trace->endpos);
+	VectorInterpolate(ctx->start, midf, ctx->end, trace->endpos);
+
+	return rht_impact;
+}
+
+
+/*
+==================
+Q1BSP_HullTrace
+
+Same results as Q1BSP_RecursiveHullTrace, bit for bit, but walks the clipnodes
+with an explicit stack. Only nodes that actually split the trace get a frame,
+and the two endpoints' plane distances are found together (with SSE2 where
+available) using the same operations in the same order as the scalar code.
+Returns rht_overflow if the hull is too deep for the stack.
+==================
+*/
+#define RHT_MAXDEPTH 256
+#define rht_overflow (rht_impact+1)
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//*d1 = DoublePrecisionDotProduct(n,p1)-dist; *d2 likewise for p2.
+static inline void RHT_PlaneDistances (const mplane_t *plane, const float *p1, const float *p2, float *d1, float *d2)
+{
+#if defined(__SSE2__)
+	__m128d d = _mm_mul_pd (_mm_set_pd (p2[0], p1[0]), _mm_set1_pd (plane->normal[0]));
+	d = _mm_add_pd (d, _mm_mul_pd (_mm_set_pd (p2[1], p1[1]), _mm_set1_pd (plane->normal[1])));
+	d = _mm_add_pd (d, _mm_mul_pd (_mm_set_pd (p2[2], p1[2]), _mm_set1_pd (plane->normal[2])));
+	d = _mm_sub_pd (d, _mm_set1_pd (plane->dist));
+	*d1 = _mm_cvtsd_f64 (d);
+	*d2 = _mm_cvtsd_f64 (_mm_unpackhi_pd (d, d));
+#else
+	*d1 = DoublePrecisionDotProduct (plane->normal, p1) - plane->dist;
+	*d2 = DoublePrecisionDotProduct (plane->normal, p2) - plane->dist;
+#endif
+}
+
+//*d1 = DotProduct(n,p1)-dist; *d2 likewise for p2, all in single precision.
+static inline void RHT_PlaneDistancesF (const mplane_t *plane, const float *p1, const float *p2, float *d1, float *d2)
+{
+#if defined(__SSE2__)
+	__m128 d = _mm_mul_ps (_mm_setr_ps (p1[0], p2[0], 0, 0), _mm_set1_ps (plane->normal[0]));
+	d = _mm_add_ps (d, _mm_mul_ps (_mm_setr_ps (p1[1], p2[1], 0, 0), _mm_set1_ps (plane->normal[1])));
+	d = _mm_add_ps (d, _mm_mul_ps (_mm_setr_ps (p1[2], p2[2], 0, 0), _mm_set1_ps (plane->normal[2])));
+	d = _mm_sub_ps (d, _mm_set1_ps (plane->dist));
+	*d1 = _mm_cvtss_f32 (d);
+	*d2 = _mm_cvtss_f32 (_mm_shuffle_ps (d, d, _MM_SHUFFLE(1,1,1,1)));
+#else
+	*d1 = DotProduct (plane->normal, p1) - plane->dist;
+	*d2 = DotProduct (plane->normal, p2) - plane->dist;
+#endif
+}
+
+static int Q1BSP_HullTrace (struct rhtctx_s *ctx, int num, trace_t *trace)
+{
+	struct
+	{
+		int		num;		//the node that split the trace
+		int		side;
+		int		stage;		//0 while in the near child, 1 while in the far one
+		float	t1, t2;		//ctx->start and ctx->end's distance from its plane
+		float	midf, p2f;
+		vec3_t	mid, p2;
+	} stack[RHT_MAXDEPTH], *f;
+	int			depth = 0;
+	mclipnode_t	*node;
+	mplane_t	*plane;
+	float		p1f = 0, p2f = 1, t1, t2, midf;
+	vec3_t		p1, p2;
+	int			rht;
+
+	VectorCopy (ctx->start, p1);
+	VectorCopy (ctx->end, p2);
+	for (;;)
 	{
-		/*we impacted the front of the node*/
-		trace->plane.dist = plane->dist;
-		VectorCopy(plane->normal, trace->plane.normal);
-		midf = (t1 - DIST_EPSILON) / (t1 - t2);
-	}
+		/*walk down until we either reach a leaf or the trace crosses a plane*/
+		while (num >= 0)
+		{
+			node = ctx->clipnodes + num;
+			plane = ctx->planes + node->planenum;
+			if (plane->type < 3)
+			{
+				t1 = p1[plane->type] - plane->dist;
+				t2 = p2[plane->type] - plane->dist;
+			}
+			else
+				RHT_PlaneDistances (plane, p1, p2, &t1, &t2);
 
-	t1 = DoublePrecisionDotProduct (trace->plane.normal, ctx->start) - trace->plane.dist;
-	t2 = DoublePrecisionDotProduct (trace->plane.normal, ctx->end) - trace->plane.dist;
-	midf = (t1 - DIST_EPSILON) / (t1 - t2);
+			if (t1 >= 0 && t2 >= 0)
+				num = node->children[0];
+			else if (t1 < 0 && t2 < 0)
+				num = node->children[1];
+			else
+			{
+				if (depth == RHT_MAXDEPTH)
+					return rht_overflow;
+				f = &stack[depth++];
+				if (plane->type < 3)
+				{
+					f->t1 = ctx->start[plane->type] - plane->dist;
+					f->t2 = ctx->end[plane->type] - plane->dist;
+				}
+				else
+					RHT_PlaneDistancesF (plane, ctx->start, ctx->end, &f->t1, &f->t2);
+				f->num = num;
+				f->side = f->t1 < 0;
+				f->stage = 0;
+
+				midf = f->t1 / (f->t1 - f->t2);
+				if (midf < p1f) midf = p1f;
+				if (midf > p2f) midf = p2f;
+				VectorInterpolate(ctx->start, midf, ctx->end, f->mid);
+				f->midf = midf;
+				f->p2f = p2f;
+				VectorCopy (p2, f->p2);
+
+				/*near side first*/
+				num = node->children[f->side];
+				p2f = midf;
+				VectorCopy (f->mid, p2);
+			}
+		}
 
-	midf = CLAMP(0, midf, 1);
-	trace->fraction = midf;
-	VectorCopy (mid, trace->endpos);
-	VectorInterpolate(ctx->start, midf, ctx->end, trace->endpos);
+		/*hit a leaf*/
+		trace->contents = num;
+		if (ctx->hitcontents & CONTENTMASK_FROMQ1(num))
+		{
+			if (trace->allsolid)
+				trace->startsolid = true;
+			rht = rht_solid;
+		}
+		else
+		{
+			trace->allsolid = false;
+			if (num == CONTENTS_EMPTY)
+				trace->inopen = true;
+			else if (num != CONTENTS_SOLID)
+				trace->inwater = true;
+			rht = rht_empty;
+		}
 
-	return rht_impact;
+		/*pass the result back up until some node wants to look at its far side*/
+		for (;;)
+		{
+			if (!depth)
+				return rht;
+			f = &stack[depth-1];
+			if (!f->stage)
+			{
+				if (rht != rht_empty && !trace->allsolid)
+				{
+					depth--;
+					continue;
+				}
+				f->stage = 1;
+				num = ctx->clipnodes[f->num].children[f->side^1];
+				p1f = f->midf;
+				p2f = f->p2f;
+				VectorCopy (f->mid, p1);
+				VectorCopy (f->p2, p2);
+				break;
+			}
+			depth--;
+			if (rht != rht_solid)
+				continue;
+
+			plane = ctx->planes + ctx->clipnodes[f->num].planenum;
+			if (f->side)
+			{
+				/*we impacted the back of the node, so flip the plane*/
+				trace->plane.dist = -plane->dist;
+				VectorNegate(plane->normal, trace->plane.normal);
+			}
+			else
+			{
+				/*we impacted the front of the node*/
+				trace->plane.dist = plane->dist;
+				VectorCopy(plane->normal, trace->plane.normal);
+			}
+
+			t1 = DoublePrecisionDotProduct (trace->plane.normal, ctx->start) - trace->plane.dist;
+			t2 = DoublePrecisionDotProduct (trace->plane.normal, ctx->end) - trace->plane.dist;
+			midf = (t1 - DIST_EPSILON) / (t1 - t2);
+
+			midf = CLAMP(0, midf, 1);
+			trace->fraction = midf;
+			VectorInterpolate(ctx->start, midf, ctx->end, trace->endpos);
+			rht = rht_impact;
+		}
+	}
 }
 
 
@@ -1071,15 +1840,148 @@ qboolean SV_RecursiveHullCheck (hull_t *hull, vec3_t p1, vec3_t p2, trace_t *tra
 		return true;
 	}
 	else
-	{
-		struct rhtctx_s ctx;
-		VectorCopy(p1, ctx.start);
-		VectorCopy(p2, ctx.end);
-		ctx.clipnodes = hull->clipnodes;
-		ctx.planes = hull->planes;
-		ctx.hitcontents = hitcontents;
+		return World_HullTrace (hull, p1, p2, trace, hitcontents);
+}
+
+static qboolean World_SameHullTrace (const trace_t *a, const trace_t *b)
+{
+	return a->allsolid == b->allsolid && a->startsolid == b->startsolid && a->inopen == b->inopen && a->inwater == b->inwater &&
+		a->fraction == b->fraction && VectorCompare(a->endpos, b->endpos) &&
+		VectorCompare(a->plane.normal, b->plane.normal) && a->plane.dist == b->plane.dist && a->contents == b->contents;
+}
+
+/*
+==================
+World_HullTrace
+
+Traces a line through a hull with Q1BSP_HullTrace, or the recursive version
+depending on sv_hulltrace. Returns false if it hit something.
+==================
+*/
+qboolean World_HullTrace (hull_t *hull, vec3_t p1, vec3_t p2, trace_t *trace, unsigned int hitcontents)
+{
+	struct rhtctx_s ctx;
+	trace_t	in, ref;
+	int		rht, refrht;
+
+	VectorCopy(p1, ctx.start);
+	VectorCopy(p2, ctx.end);
+	ctx.clipnodes = hull->clipnodes;
+	ctx.planes = hull->planes;
+	ctx.hitcontents = hitcontents;
+
+	if (!sv_hulltrace.value)
 		return Q1BSP_RecursiveHullTrace(&ctx, hull->firstclipnode, 0, 1, p1, p2, trace) != rht_impact;
+
+	in = *trace;
+	rht = Q1BSP_HullTrace(&ctx, hull->firstclipnode, trace);
+	if (rht == rht_overflow)
+	{	//absurdly deep hull, let the recursive version deal with it instead.
+		*trace = in;
+		rht = Q1BSP_RecursiveHullTrace(&ctx, hull->firstclipnode, 0, 1, p1, p2, trace);
+	}
+	else if (sv_hulltrace.value >= 2)
+	{
+		ref = in;
+		refrht = Q1BSP_RecursiveHullTrace(&ctx, hull->firstclipnode, 0, 1, p1, p2, &ref);
+		if ((rht != refrht || !World_SameHullTrace(trace, &ref)) && !Host_JobsRunning ())
+			Con_Warning ("World_HullTrace: (%g %g %g) -> (%g %g %g) gave %g, expected %g\n",
+				p1[0], p1[1], p1[2], p2[0], p2[1], p2[2], trace->fraction, ref.fraction);
+	}
+	return rht != rht_impact;
+}
+
+/*
+==================
+World_HullTraceTest_f
+
+Compares Q1BSP_HullTrace against Q1BSP_RecursiveHullTrace with random
+traces through every hull of every brush model in the current map.
+==================
+*/
+static void World_HullTraceTest_f (void)
+{
+	int		count = (Cmd_Argc() > 1)?atoi(Cmd_Argv(1)):100000;
+	static const unsigned int masks[] = {CONTENTMASK_FROMQ1(CONTENTS_SOLID), CONTENTMASK_ANYSOLID, ~CONTENTMASK_FROMQ1(CONTENTS_EMPTY)};
+	qmodel_t	*model;
+	hull_t		*hull;
+	struct rhtctx_s ctx;
+	trace_t		a, b;
+	vec3_t		mins, maxs;
+	int			i, j, m, h, ra, rb, tested = 0, differ = 0, overflows = 0;
+	double		start, elapsed[2] = {0,0};
+
+	if (!sv.active)
+	{
+		Con_Printf("%s: server is not active\n", Cmd_Argv(0));
+		return;
+	}
+
+	for (m = 1; m < MAX_MODELS && sv.models[m]; m++)
+	{
+		model = sv.models[m];
+		if (model->type != mod_brush)
+			continue;
+		for (h = 0; h < MAX_MAP_HULLS; h++)
+		{
+			hull = &model->hulls[h];
+			if (!hull->clipnodes || hull->firstclipnode > hull->lastclipnode)
+				continue;
+			for (j = 0; j < 3; j++)
+			{	//reach a little past the edges too
+				mins[j] = model->mins[j] - 64;
+				maxs[j] = model->maxs[j] + 64;
+			}
+			ctx.clipnodes = hull->clipnodes;
+			ctx.planes = hull->planes;
+			for (i = 0; i < count; i++)
+			{
+				for (j = 0; j < 3; j++)
+				{
+					ctx.start[j] = mins[j] + (maxs[j]-mins[j]) * (rand()/(float)RAND_MAX);
+					if (i & 3)	//mostly short ones, like movement
+						ctx.end[j] = ctx.start[j] + 64 * (rand()/(float)RAND_MAX - 0.5);
+					else
+						ctx.end[j] = mins[j] + (maxs[j]-mins[j]) * (rand()/(float)RAND_MAX);
+				}
+				if ((i & 7) == 1)	//sometimes axial
+					ctx.end[0] = ctx.start[0], ctx.end[1] = ctx.start[1];
+				ctx.hitcontents = masks[i % countof(masks)];
+
+				memset (&a, 0, sizeof(a));
+				a.fraction = 1;
+				a.allsolid = true;
+				VectorCopy (ctx.end, a.endpos);
+				b = a;
+
+				start = Sys_DoubleTime();
+				ra = Q1BSP_RecursiveHullTrace(&ctx, hull->firstclipnode, 0, 1, ctx.start, ctx.end, &a);
+				elapsed[0] += Sys_DoubleTime() - start;
+				start = Sys_DoubleTime();
+				rb = Q1BSP_HullTrace(&ctx, hull->firstclipnode, &b);
+				elapsed[1] += Sys_DoubleTime() - start;
+
+				tested++;
+				if (rb == rht_overflow)
+					overflows++;
+				else if (ra != rb || !World_SameHullTrace(&a, &b))
+				{
+					if (differ++ < 5)
+						Con_Printf("model %i hull %i: (%g %g %g) -> (%g %g %g): %g/%g %i/%i vs %g/%g %i/%i\n", m, h,
+							ctx.start[0], ctx.start[1], ctx.start[2], ctx.end[0], ctx.end[1], ctx.end[2],
+							a.fraction, a.plane.dist, a.allsolid, a.startsolid, b.fraction, b.plane.dist, b.allsolid, b.startsolid);
+				}
+			}
+		}
 	}
+
+	Con_Printf("%i traces: recursive %.3f ms, iterative %.3f ms\n", tested, elapsed[0]*1000, elapsed[1]*1000);
+	if (overflows)
+		Con_Printf("%i traces were too deep for the iterative version\n", overflows);
+	if (differ)
+		Con_Warning("%i traces differ!\n", differ);
+	else
+		Con_Printf("all identical\n");
 }
 
 /*
@@ -1096,6 +1998,7 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 	vec3_t		offset;
 	vec3_t		start_l, end_l;
 	hull_t		*hull;
+	boxhull_t	box;
 
 // fill in a default trace
 	memset (&trace, 0, sizeof(trace_t));
@@ -1104,7 +2007,7 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 	VectorCopy (end, trace.endpos);
 
 // get the clipping hull
-	hull = SV_HullForEntity (ent, mins, maxs, offset);
+	hull = SV_HullForEntity (ent, mins, maxs, offset, &box);
 
 	VectorSubtract (start, offset, start_l);
 	VectorSubtract (end, offset, end_l);
@@ -1136,7 +2039,7 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 		}
 		else
 		{
-			if (!qcvm->warned_rotatingbmodel)
+			if (!qcvm->warned_rotatingbmodel && !Host_JobsRunning ())
 			{
 				Con_Warning("%s(\"%s\") has angles set, but DP_SV_ROTATINGBMODEL is not enabled\n", (ent->v.solid == SOLID_EXT_BSPTRIGGER)?"SOLID_BSPTRIGGER":"SOLID_BSP", PR_GetString(ent->v.classname));
 				qcvm->warned_rotatingbmodel = true;
@@ -1162,107 +2065,92 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 
 /*
 ====================
-SV_ClipToLinks
+SV_ClipToLink
 
-Mins and maxs enclose the entire area swept by the move
+clip->boxmins and boxmaxs enclose the entire area swept by the move
 ====================
 */
-static void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
+static qboolean SV_ClipToLink ( edict_t *touch, void *ctx )
 {
-	link_t		*l, *next;
-	edict_t		*touch;
+	moveclip_t	*clip = ctx;
 	trace_t		trace;
 
-// touch linked edicts
-	for (l = node->solid_edicts.next ; l != &node->solid_edicts ; l = next)
-	{
-		next = l->next;
-		touch = EDICT_FROM_AREA(l);
-		if (touch->v.solid == SOLID_NOT)
-			continue;
-		if (touch == clip->passedict)
-			continue;
-		if (touch->v.solid == SOLID_TRIGGER || touch->v.solid == SOLID_EXT_BSPTRIGGER)
-			Sys_Error ("Trigger in clipping list");
+	if (touch->v.solid == SOLID_NOT)
+		return true;
+	if (touch == clip->passedict)
+		return true;
+	if (touch->v.solid == SOLID_TRIGGER || touch->v.solid == SOLID_EXT_BSPTRIGGER)
+		Sys_Error ("Trigger in clipping list");
 
-		if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
-			continue;
+	if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
+		return true;
 
-		if (clip->boxmins[0] > touch->v.absmax[0]
-		|| clip->boxmins[1] > touch->v.absmax[1]
-		|| clip->boxmins[2] > touch->v.absmax[2]
-		|| clip->boxmaxs[0] < touch->v.absmin[0]
-		|| clip->boxmaxs[1] < touch->v.absmin[1]
-		|| clip->boxmaxs[2] < touch->v.absmin[2] )
-			continue;
+	if (clip->boxmins[0] > touch->v.absmax[0]
+	|| clip->boxmins[1] > touch->v.absmax[1]
+	|| clip->boxmins[2] > touch->v.absmax[2]
+	|| clip->boxmaxs[0] < touch->v.absmin[0]
+	|| clip->boxmaxs[1] < touch->v.absmin[1]
+	|| clip->boxmaxs[2] < touch->v.absmin[2] )
+		return true;
 
-		if (clip->passedict && clip->passedict->v.size[0] && !touch->v.size[0])
-			continue;	// points never interact
+	if (clip->passedict && clip->passedict->v.size[0] && !touch->v.size[0])
+		return true;	// points never interact
 
-		if (pr_checkextension.value)
-		{
-			//corpses are nonsolid to slidebox
-			if (clip->passedict->v.solid == SOLID_SLIDEBOX && touch->v.solid == SOLID_EXT_CORPSE)
-				continue;
-			//corpses ignore slidebox or corpses
-			if (clip->passedict->v.solid == SOLID_EXT_CORPSE && (touch->v.solid == SOLID_SLIDEBOX || touch->v.solid == SOLID_EXT_CORPSE))
-				continue;
-		}
+	if (pr_checkextension.value)
+	{
+		//corpses are nonsolid to slidebox
+		if (clip->passedict->v.solid == SOLID_SLIDEBOX && touch->v.solid == SOLID_EXT_CORPSE)
+			return true;
+		//corpses ignore slidebox or corpses
+		if (clip->passedict->v.solid == SOLID_EXT_CORPSE && (touch->v.solid == SOLID_SLIDEBOX || touch->v.solid == SOLID_EXT_CORPSE))
+			return true;
+	}
 
-	// might intersect, so do an exact clip
-		if (clip->trace.allsolid)
-			return;
-		if (clip->passedict)
-		{
-		 	if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
-				continue;	// don't clip against own missiles
-			if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
-				continue;	// don't clip against owner
-		}
+// might intersect, so do an exact clip
+	if (clip->trace.allsolid)
+		return false;
+	if (clip->passedict)
+	{
+	 	if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
+			return true;	// don't clip against own missiles
+		if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
+			return true;	// don't clip against owner
+	}
 
-		if (touch->v.skin < 0)
-		{
-			if (!(clip->hitcontents & (1<<-(int)touch->v.skin)))
-				continue;	//not solid, don't bother trying to clip.
-			if ((int)touch->v.flags & FL_MONSTER)
-				trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end, ~(1<<-CONTENTS_EMPTY));
-			else
-				trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end, ~(1<<-CONTENTS_EMPTY));
-			if (trace.contents != CONTENTS_EMPTY)
-				trace.contents = touch->v.skin;
-		}
+	if (touch->v.skin < 0)
+	{
+		if (!(clip->hitcontents & (1<<-(int)touch->v.skin)))
+			return true;	//not solid, don't bother trying to clip.
+		if ((int)touch->v.flags & FL_MONSTER)
+			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end, ~(1<<-CONTENTS_EMPTY));
 		else
-		{
-			if ((int)touch->v.flags & FL_MONSTER)
-				trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end, clip->hitcontents);
-			else
-				trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end, clip->hitcontents);
-		}
+			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end, ~(1<<-CONTENTS_EMPTY));
+		if (trace.contents != CONTENTS_EMPTY)
+			trace.contents = touch->v.skin;
+	}
+	else
+	{
+		if ((int)touch->v.flags & FL_MONSTER)
+			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end, clip->hitcontents);
+		else
+			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end, clip->hitcontents);
+	}
 
-		if (trace.allsolid || trace.startsolid ||
-		trace.fraction < clip->trace.fraction)
+	if (trace.allsolid || trace.startsolid ||
+	trace.fraction < clip->trace.fraction)
+	{
+		trace.ent = touch;
+	 	if (clip->trace.startsolid)
 		{
-			trace.ent = touch;
-		 	if (clip->trace.startsolid)
-			{
-				clip->trace = trace;
-				clip->trace.startsolid = true;
-			}
-			else
-				clip->trace = trace;
-		}
-		else if (trace.startsolid)
+			clip->trace = trace;
 			clip->trace.startsolid = true;
+		}
+		else
+			clip->trace = trace;
 	}
-
-// recurse down both sides
-	if (node->axis == -1)
-		return;
-
-	if ( clip->boxmaxs[node->axis] > node->dist )
-		SV_ClipToLinks ( node->children[0], clip );
-	if ( clip->boxmins[node->axis] < node->dist )
-		SV_ClipToLinks ( node->children[1], clip );
+	else if (trace.startsolid)
+		clip->trace.startsolid = true;
+	return true;
 }
 
 static void World_ClipToNetwork ( moveclip_t *clip )
@@ -1310,6 +2198,7 @@ static void World_ClipToNetwork ( moveclip_t *clip )
 			vec3_t		offset;
 			vec3_t		start_l, end_l;
 			hull_t		*hull;
+			boxhull_t	box;
 
 		// fill in a default trace
 			memset (&trace, 0, sizeof(trace_t));
@@ -1347,7 +2236,7 @@ static void World_ClipToNetwork ( moveclip_t *clip )
 
 					VectorSubtract (touch_mins, clip->maxs, hullmins);
 					VectorSubtract (touch_maxs, clip->mins, hullmaxs);
-					hull = SV_HullForBox (hullmins, hullmaxs);
+					hull = SV_HullForBox (hullmins, hullmaxs, &box);
 
 					VectorCopy (touch->origin, offset);
 				}
@@ -1414,6 +2303,159 @@ static void World_ClipToNetwork ( moveclip_t *clip )
 	}
 }
 
+/*
+==================
+World_TraceBenchmark_f
+
+Scatters extra boxes around the map, then times the same set of traces and
+relinks against each broadphase, and checks that both give the same results.
+==================
+*/
+static void World_TraceBenchmark_f (void)
+{
+	int		numtraces = (Cmd_Argc() > 1)?atoi(Cmd_Argv(1)):100000;
+	int		numedicts = (Cmd_Argc() > 2)?atoi(Cmd_Argv(2)):2048;
+	int		*spawned, numspawned = 0;
+	vec3_t	*starts, *ends, *origins;
+	trace_t	*results[2], tr;
+	int		i, j, method, differ = 0, different = 0, hits[2], numlisted;
+	unsigned int	listorder[2];
+	edict_t	**list;
+	double	start, elapsed[2], linktime[2];
+	vec3_t	boxmins = {-16,-16,-24}, boxmaxs = {16,16,32}, span;
+	edict_t	*ent, *tracer;
+	aabbtree_t	*t;
+
+	if (!sv.active)
+	{
+		Con_Printf("%s: server is not active\n", Cmd_Argv(0));
+		return;
+	}
+	if (numtraces < 1)
+		numtraces = 1;
+
+	PR_SwitchQCVM(&sv.qcvm);
+	t = &qcvm->aabbtree;
+	if (numedicts > qcvm->max_edicts)
+		numedicts = qcvm->max_edicts;
+	VectorSubtract(qcvm->worldmodel->maxs, qcvm->worldmodel->mins, span);
+
+	spawned = (int *) malloc(sizeof(*spawned) * qcvm->max_edicts);
+	tracer = ED_Alloc();	//something to pass as the passedict that isn't linked anywhere
+	VectorCopy(boxmins, tracer->v.mins);
+	VectorCopy(boxmaxs, tracer->v.maxs);
+	VectorSubtract(boxmaxs, boxmins, tracer->v.size);
+	while (qcvm->num_edicts < numedicts)
+	{
+		ent = ED_Alloc();
+		spawned[numspawned++] = NUM_FOR_EDICT(ent);
+		for (j = 0; j < 3; j++)
+		{
+			ent->v.origin[j] = qcvm->worldmodel->mins[j] + span[j] * (rand()/(float)RAND_MAX);
+			ent->v.mins[j] = -16;
+			ent->v.maxs[j] = 16;
+			ent->v.size[j] = 32;
+		}
+		ent->v.solid = (numspawned & 3)?SOLID_BBOX:SOLID_TRIGGER;
+		SV_LinkEdict(ent, false);
+	}
+
+	starts = (vec3_t *) malloc(sizeof(*starts) * numtraces);
+	ends = (vec3_t *) malloc(sizeof(*ends) * numtraces);
+	origins = (vec3_t *) malloc(sizeof(*origins) * (numspawned+1));
+	results[0] = (trace_t *) malloc(sizeof(trace_t) * numtraces);
+	results[1] = (trace_t *) malloc(sizeof(trace_t) * numtraces);
+	list = (edict_t **) malloc(sizeof(*list) * qcvm->max_edicts);
+	for (i = 0; i < numtraces; i++)
+		for (j = 0; j < 3; j++)
+		{
+			starts[i][j] = qcvm->worldmodel->mins[j] + span[j] * (rand()/(float)RAND_MAX);
+			ends[i][j] = starts[i][j] + 512 * (rand()/(float)RAND_MAX - 0.5);
+		}
+	for (i = 0; i < numspawned; i++)
+		VectorCopy(EDICT_NUM(spawned[i])->v.origin, origins[i]);
+
+	for (method = 0; method < 2; method++)
+	{
+		World_SetBroadphase (method?BROADPHASE_AABBTREE:BROADPHASE_AREANODES);
+
+		hits[method] = 0;
+		start = Sys_DoubleTime();
+		for (i = 0; i < numtraces; i++)
+		{
+			results[method][i] = tr = SV_Move(starts[i], (i&1)?boxmins:vec3_origin, (i&1)?boxmaxs:vec3_origin, ends[i], MOVE_NORMAL, tracer);
+			if (tr.ent && tr.ent != qcvm->edicts)
+				hits[method]++;
+		}
+		elapsed[method] = Sys_DoubleTime() - start;
+
+		//touch order comes from the same lists, so check they're handed out in the same order too
+		for (i = 0, listorder[method] = 0; i < numtraces; i += 16)
+		{
+			vec3_t mins, maxs;
+			VectorSubtract(starts[i], boxmaxs, mins);
+			VectorAdd(ends[i], boxmaxs, maxs);
+			numlisted = SV_AreaEdicts(mins, maxs, list, qcvm->max_edicts);
+			for (j = 0; j < numlisted; j++)
+				listorder[method] = listorder[method]*31 + NUM_FOR_EDICT(list[j]);
+		}
+
+		//nudge everything around a bit, like monsters walking about.
+		srand(numspawned);
+		start = Sys_DoubleTime();
+		for (j = 0; j < 16; j++)
+			for (i = 0; i < numspawned; i++)
+			{
+				ent = EDICT_NUM(spawned[i]);
+				ent->v.origin[0] += (rand()&15) - 7.5;
+				ent->v.origin[1] += (rand()&15) - 7.5;
+				SV_LinkEdict(ent, false);
+			}
+		linktime[method] = Sys_DoubleTime() - start;
+		for (i = 0; i < numspawned; i++)
+		{
+			ent = EDICT_NUM(spawned[i]);
+			VectorCopy(origins[i], ent->v.origin);
+			SV_LinkEdict(ent, false);
+		}
+	}
+
+	for (i = 0; i < numtraces; i++)
+	{
+		trace_t *a = &results[0][i], *b = &results[1][i];
+		if (a->fraction != b->fraction || a->startsolid != b->startsolid || a->allsolid != b->allsolid)
+			differ++;
+		else if (a->ent != b->ent || !VectorCompare(a->plane.normal, b->plane.normal) || a->plane.dist != b->plane.dist)
+			different++;	//same distance, but something else won the tie
+	}
+
+	Con_Printf("%i edicts, %i traces, %i relinks\n", qcvm->num_edicts, numtraces, numspawned*16);
+	Con_Printf("areanodes: %.3f ms tracing (%i hit ents), %.3f ms linking\n", elapsed[0]*1000, hits[0], linktime[0]*1000);
+	Con_Printf("aabb tree: %.3f ms tracing (%i hit ents), %.3f ms linking\n", elapsed[1]*1000, hits[1], linktime[1]*1000);
+	Con_Printf("aabb tree: %i nodes, depth %i, %u inserts, %u kept, %u removes, %u rotations\n", t->numnodes,
+		q_max((t->root[0]==-1)?0:t->nodes[t->root[0]].height, (t->root[1]==-1)?0:t->nodes[t->root[1]].height),
+		t->inserts, t->refits, t->removes, t->rotations);
+	if (differ)
+		Con_Warning("%i traces differ!\n", differ);
+	if (different)
+		Con_Warning("%i traces hit a different entity or plane at the same fraction!\n", different);
+	if (listorder[0] != listorder[1])
+		Con_Warning("area lists came out in a different order!\n");
+
+	World_SetBroadphase (sv_broadphase.value?BROADPHASE_AABBTREE:BROADPHASE_AREANODES);
+	for (i = 0; i < numspawned; i++)
+		ED_Free(EDICT_NUM(spawned[i]));
+	ED_Free(tracer);
+	free(spawned);
+	free(starts);
+	free(ends);
+	free(origins);
+	free(results[0]);
+	free(list);
+	free(results[1]);
+	PR_SwitchQCVM(NULL);
+}
+
 /*
 ==================
 SV_MoveBounds
@@ -1449,7 +2491,9 @@ boxmaxs[0] = boxmaxs[1] = boxmaxs[2] = 9999;
 SV_Move
 ==================
 */
-trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+unsigned int	sv_tracecount;
+
+static trace_t SV_DoMove (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
 {
 	moveclip_t	clip;
 	int			i;
@@ -1489,11 +2533,122 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 	SV_MoveBounds ( start, clip.mins2, clip.maxs2, end, clip.boxmins, clip.boxmaxs );
 
 // clip to entities
-	SV_ClipToLinks ( qcvm->areanodes, &clip );
+	World_AreaQuery (AREA_SOLID, clip.boxmins, clip.boxmaxs, SV_ClipToLink, &clip);
 
 	if (qcvm == &cl.qcvm)
 		World_ClipToNetwork(&clip);
 
 	return clip.trace;
 }
+trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+{
+	sv_tracecount++;
+	return SV_DoMove (start, mins, maxs, end, type, passedict);
+}
+
+/*
+==================
+SV_MoveBatch
+==================
+*/
+static void SV_MoveBatchItems (void *ctx, int first, int count, int worker)
+{
+	tracerequest_t *r = (tracerequest_t *)ctx + first;
+	for (; count > 0; count--, r++)
+		r->trace = SV_DoMove (r->start, r->mins, r->maxs, r->end, r->type, r->passedict);
+}
+void SV_MoveBatch (tracerequest_t *requests, int count)
+{
+	sv_tracecount += count;	//counted here rather than racing on the workers
+	Host_ParallelFor (SV_MoveBatchItems, requests, count, 64);
+}
+
+/*
+==================
+World_TraceBatchBenchmark_f
+
+Fires random traces around the map, one at a time and then as a batch,
+and checks that both give the same results.
+==================
+*/
+static void World_TraceBatchBenchmark_f (void)
+{
+	int		numtraces = (Cmd_Argc() > 1)?atoi(Cmd_Argv(1)):100000;
+	tracerequest_t	*req;
+	trace_t	*serial, *a, *b;
+	vec3_t	boxmins = {-16,-16,-24}, boxmaxs = {16,16,32}, span;
+	int		i, j, differ = 0;
+	double	start, elapsed[2];
+
+	if (!sv.active)
+	{
+		Con_Printf("%s: server is not active\n", Cmd_Argv(0));
+		return;
+	}
+	if (numtraces < 1)
+		numtraces = 1;
+
+	PR_SwitchQCVM(&sv.qcvm);
+	VectorSubtract(qcvm->worldmodel->maxs, qcvm->worldmodel->mins, span);
+	req = (tracerequest_t *) calloc(numtraces, sizeof(*req));
+	serial = (trace_t *) malloc(sizeof(*serial) * numtraces);
+	for (i = 0; i < numtraces; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			req[i].start[j] = qcvm->worldmodel->mins[j] + span[j] * (rand()/(float)RAND_MAX);
+			req[i].end[j] = req[i].start[j] + 1024 * (rand()/(float)RAND_MAX - 0.5);
+		}
+		if (i & 1)
+		{
+			VectorCopy(boxmins, req[i].mins);
+			VectorCopy(boxmaxs, req[i].maxs);
+		}
+		req[i].type = (i%3)?MOVE_NORMAL:MOVE_NOMONSTERS;
+		req[i].passedict = qcvm->edicts;
+	}
+
+	start = Sys_DoubleTime();
+	for (i = 0; i < numtraces; i++)
+		serial[i] = SV_Move(req[i].start, req[i].mins, req[i].maxs, req[i].end, req[i].type, req[i].passedict);
+	elapsed[0] = Sys_DoubleTime() - start;
+
+	start = Sys_DoubleTime();
+	SV_MoveBatch(req, numtraces);
+	elapsed[1] = Sys_DoubleTime() - start;
+
+	for (i = 0; i < numtraces; i++)
+	{
+		a = &serial[i];
+		b = &req[i].trace;
+		if (a->allsolid != b->allsolid || a->startsolid != b->startsolid || a->inopen != b->inopen || a->inwater != b->inwater ||
+			a->fraction != b->fraction || !VectorCompare(a->endpos, b->endpos) || !VectorCompare(a->plane.normal, b->plane.normal) ||
+			a->plane.dist != b->plane.dist || a->ent != b->ent || a->contents != b->contents)
+			differ++;
+	}
+
+	Con_Printf("%i traces\n", numtraces);
+	Con_Printf("serial: %.3f ms\n", elapsed[0]*1000);
+	Con_Printf("batch : %.3f ms\n", elapsed[1]*1000);
+	if (differ)
+		Con_Warning("%i traces differ!\n", differ);
 
+	free(req);
+	free(serial);
+	PR_SwitchQCVM(NULL);
+}
+
+/*
+===============
+World_Init
+===============
+*/
+void World_Init (void)
+{
+	Cvar_RegisterVariable (&sv_broadphase);
+	Cvar_SetCallback (&sv_broadphase, World_Broadphase_f);
+	Cmd_AddCommand ("sv_tracebenchmark", World_TraceBenchmark_f);
+	Cmd_AddCommand ("sv_tracebatchbenchmark", World_TraceBatchBenchmark_f);
+	Cvar_RegisterVariable (&sv_hulltrace);
+	Cmd_AddCommand ("sv_hulltracetest", World_HullTraceTest_f);
+}
@@ -51,6 +51,9 @@ typedef struct trace_s
 #define MOVE_HITALLCONTENTS (1<<9)
 
 
+void World_Init (void);
+// registers the broadphase cvar and benchmark
+
 void SV_ClearWorld (void);
 // called after the world model has been loaded, before linking any entities
 
@@ -65,6 +68,10 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers);
 // sets ent->v.absmin and ent->v.absmax
 // if touchtriggers, calls prog functions for the intersected triggers
 
+int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list, int listspace);
+// fills list with the linked entities whose absmin/absmax touch the box, returning how many.
+// only as up to date as each entity's last SV_LinkEdict.
+
 int SV_PointContentsAllBsps(vec3_t p, edict_t *forent); //check all SOLID_BSP ents
 int SV_PointContents (vec3_t p);
 int SV_TruePointContents (vec3_t p);
@@ -79,6 +86,19 @@ edict_t	*SV_TestEntityPosition (edict_t *ent);
 trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, unsigned int hitcontents);
 trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict);
 // mins and maxs are reletive
+extern unsigned int sv_tracecount;	// SV_Moves so far, for benchmarks
+
+typedef struct
+{
+	vec3_t	start, mins, maxs, end;
+	int		type;
+	edict_t	*passedict;
+	trace_t	trace;		// filled in by SV_MoveBatch
+} tracerequest_t;
+void SV_MoveBatch (tracerequest_t *requests, int count);
+// does an SV_Move for each request, spread over the worker threads.
+// the results are the same as calling SV_Move for each in turn, but nothing
+// may be linked, unlinked or moved until it returns.
 
 // if the entire move stays in a solid volume, trace.allsolid will be set
 
@@ -91,6 +111,9 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
 qboolean SV_RecursiveHullCheck (hull_t *hull, vec3_t p1, vec3_t p2, trace_t *trace, unsigned int hitcontents);
+qboolean World_HullTrace (hull_t *hull, vec3_t p1, vec3_t p2, trace_t *trace, unsigned int hitcontents);
+// like SV_RecursiveHullCheck, but always FTE's more stable version rather than vanilla's
+// (and without the point shortcut). returns false if it hit something.
 
 qmodel_t *PR_CSQC_GetModel(int idx);
 #endif	/* _QUAKE_WORLD_H */
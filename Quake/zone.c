@@ -310,6 +310,35 @@ int		hunk_high_used;
 qboolean	hunk_tempactive;
 int		hunk_tempmark;
 
+struct hunkstate_s
+{
+	byte		*base;
+	int			size;
+	int			low_used;
+	int			high_used;
+	qboolean	tempactive;
+	int			tempmark;
+};
+static hunkstate_t	hunk_main;		// the one Memory_Init was given, which the cache lives in
+static hunkstate_t	*hunk_current;	// NULL while that's the one in use
+
+#define HUNK_ARENABLOCK		(256*1024)
+#define HUNK_BLOCKHEADER	((sizeof(hunkblock_t)+15)&~15)
+typedef struct hunkblock_s
+{
+	struct hunkblock_s	*prev;
+	int		start;		// arena offset of the first byte, so marks stay unique across blocks
+	int		size;
+	int		used;
+} hunkblock_t;
+
+struct hunkarena_s
+{
+	hunkblock_t	*blocks;	// newest first
+	int			total;
+};
+static hunkarena_t	*hunk_arena;	// low allocations go here instead of the hunk while set
+
 /*
 ==============
 Hunk_Check
@@ -427,6 +456,185 @@ void Hunk_Print_f (void)
 	Hunk_Print (false);
 }
 
+/*
+===============================================================================
+
+HUNK SWITCHING AND ARENAS
+
+-instances gives each server a hunk of its own, so that clearing one server's memory
+doesn't take the others' with it. Models are shared between them, so they can't live
+in any of those, and get an arena instead: a chain of malloced blocks that stands in
+for the low hunk while the model loads, and is freed when the last server lets go of it.
+
+===============================================================================
+*/
+
+/*
+===================
+Hunk_Create
+===================
+*/
+hunkstate_t *Hunk_Create (int size)
+{
+	hunkstate_t *hunk = (hunkstate_t *) calloc (1, sizeof(hunkstate_t));
+
+	if (hunk)
+		hunk->base = (byte *) malloc (size);
+	if (!hunk || !hunk->base)
+		Sys_Error ("Hunk_Create: failed on %i bytes", size);
+	hunk->size = size;
+	return hunk;
+}
+
+/*
+===================
+Hunk_Switch
+
+Makes hunk (or the main hunk, for NULL) the one that the Hunk_ functions work on.
+Returns the previous one. The cache always stays in the main hunk.
+===================
+*/
+hunkstate_t *Hunk_Switch (hunkstate_t *hunk)
+{
+	hunkstate_t	*old = hunk_current;
+	hunkstate_t	*save = old ? old : &hunk_main;
+	hunkstate_t	*load = hunk ? hunk : &hunk_main;
+
+	if (hunk == old)
+		return old;
+
+	save->base = hunk_base;
+	save->size = hunk_size;
+	save->low_used = hunk_low_used;
+	save->high_used = hunk_high_used;
+	save->tempactive = hunk_tempactive;
+	save->tempmark = hunk_tempmark;
+
+	hunk_base = load->base;
+	hunk_size = load->size;
+	hunk_low_used = load->low_used;
+	hunk_high_used = load->high_used;
+	hunk_tempactive = load->tempactive;
+	hunk_tempmark = load->tempmark;
+
+	hunk_current = hunk;
+	return old;
+}
+
+/*
+===================
+Hunk_Used
+===================
+*/
+int Hunk_Used (hunkstate_t *hunk)
+{
+	if (hunk == hunk_current)
+		return hunk_low_used + hunk_high_used;
+	if (!hunk)
+		hunk = &hunk_main;
+	return hunk->low_used + hunk->high_used;
+}
+
+static void Hunk_ArenaBlock (hunkarena_t *arena, int size)
+{
+	hunkblock_t	*b = (hunkblock_t *) malloc (HUNK_BLOCKHEADER + size);
+
+	if (!b)
+		Sys_Error ("Hunk_ArenaBlock: failed on %i bytes", size);
+	b->prev = arena->blocks;
+	b->start = b->prev ? b->prev->start + b->prev->size : 0;
+	b->size = size;
+	b->used = 0;
+	arena->blocks = b;
+	arena->total += size;
+}
+
+static void *Hunk_ArenaAlloc (int size)
+{
+	hunkblock_t	*b = hunk_arena->blocks;
+	byte		*p;
+
+	size = (size+15)&~15;
+	if (b->size - b->used < size)
+	{
+		Hunk_ArenaBlock (hunk_arena, q_max(size, HUNK_ARENABLOCK));
+		b = hunk_arena->blocks;
+	}
+	p = (byte *)b + HUNK_BLOCKHEADER + b->used;
+	b->used += size;
+	memset (p, 0, size);
+	return p;
+}
+
+static void Hunk_ArenaFreeToMark (int mark)
+{
+	hunkblock_t	*b;
+
+	while ((b = hunk_arena->blocks)->prev && b->start >= mark)
+	{
+		hunk_arena->blocks = b->prev;
+		hunk_arena->total -= b->size;
+		free (b);
+	}
+	if (mark < b->start || mark > b->start + b->used)
+		Sys_Error ("Hunk_FreeToLowMark: bad mark %i", mark);
+	b->used = mark - b->start;
+}
+
+/*
+===================
+Hunk_NewArena
+
+sizehint is a guess at how much it'll need, more blocks get added if it's wrong.
+===================
+*/
+hunkarena_t *Hunk_NewArena (int sizehint)
+{
+	hunkarena_t	*arena = (hunkarena_t *) calloc (1, sizeof(hunkarena_t));
+
+	if (!arena)
+		Sys_Error ("Hunk_NewArena: out of memory");
+	Hunk_ArenaBlock (arena, q_max(sizehint, HUNK_ARENABLOCK));
+	return arena;
+}
+
+/*
+===================
+Hunk_SwitchArena
+
+Sends low hunk allocations to arena until switched back with NULL. Returns the previous one.
+High and temp allocations still come from the hunk.
+===================
+*/
+hunkarena_t *Hunk_SwitchArena (hunkarena_t *arena)
+{
+	hunkarena_t	*old = hunk_arena;
+
+	hunk_arena = arena;
+	return old;
+}
+
+void Hunk_FreeArena (hunkarena_t *arena)
+{
+	hunkblock_t	*b;
+
+	if (!arena)
+		return;
+	if (arena == hunk_arena)
+		Sys_Error ("Hunk_FreeArena: arena is in use");
+	while ((b = arena->blocks))
+	{
+		arena->blocks = b->prev;
+		free (b);
+	}
+	free (arena);
+}
+
+int Hunk_ArenaSize (hunkarena_t *arena)
+{
+	return arena ? arena->total : 0;
+}
+
 /*
 ===================
 Hunk_AllocName
@@ -443,6 +651,9 @@ void *Hunk_AllocName (int size, const char *name)
 	if (size < 0)
 		Sys_Error ("Hunk_Alloc: bad size: %i", size);
 
+	if (hunk_arena)
+		return Hunk_ArenaAlloc (size);
+
 	size = sizeof(hunk_t) + ((size+15)&~15);
 
 	if (hunk_size - hunk_low_used - hunk_high_used < size)
@@ -474,11 +685,18 @@ void *Hunk_Alloc (int size)
 
 int	Hunk_LowMark (void)
 {
+	if (hunk_arena)
+		return hunk_arena->blocks->start + hunk_arena->blocks->used;
 	return hunk_low_used;
 }
 
 void Hunk_FreeToLowMark (int mark)
 {
+	if (hunk_arena)
+	{
+		Hunk_ArenaFreeToMark (mark);
+		return;
+	}
 	if (mark < 0 || mark > hunk_low_used)
 		Sys_Error ("Hunk_FreeToLowMark: bad mark %i", mark);
 	memset (hunk_base + mark, 0, hunk_low_used - mark);
@@ -652,6 +870,8 @@ void Cache_FreeLow (int new_low_hunk)
 {
 	cache_system_t	*c;
 
+	if (hunk_current)
+		return;		// the cache is only in the main hunk
 	while (1)
 	{
 		c = cache_head.next;
@@ -674,6 +894,8 @@ void Cache_FreeHigh (int new_high_hunk)
 {
 	cache_system_t	*c, *prev;
 
+	if (hunk_current)
+		return;		// the cache is only in the main hunk
 	prev = NULL;
 	while (1)
 	{
@@ -911,6 +1133,7 @@ Cache_Alloc
 void *Cache_Alloc (cache_user_t *c, int size, const char *name)
 {
 	cache_system_t	*cs;
+	hunkstate_t		*hunk;
 
 	if (c->data)
 		Sys_Error ("Cache_Alloc: already allocated");
@@ -920,6 +1143,7 @@ void *Cache_Alloc (cache_user_t *c, int size, const char *name)
 
 	size = (size + sizeof(cache_system_t) + 15) & ~15;
 
+	hunk = Hunk_Switch (NULL);
 // find memory for it
 	while (1)
 	{
@@ -938,6 +1162,7 @@ void *Cache_Alloc (cache_user_t *c, int size, const char *name)
 
 		Cache_Free (cache_head.lru_prev->user, true); //johnfitz -- added second argument
 	}
+	Hunk_Switch (hunk);
 
 	return Cache_Check (c);
 }
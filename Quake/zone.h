@@ -115,6 +115,17 @@ void *Hunk_TempAlloc (int size);
 
 void Hunk_Check (void);
 
+typedef struct hunkstate_s hunkstate_t;
+hunkstate_t *Hunk_Create (int size);
+hunkstate_t *Hunk_Switch (hunkstate_t *hunk);	// NULL for the main hunk, returns the previous one
+int Hunk_Used (hunkstate_t *hunk);
+
+typedef struct hunkarena_s hunkarena_t;
+hunkarena_t *Hunk_NewArena (int sizehint);
+hunkarena_t *Hunk_SwitchArena (hunkarena_t *arena);	// NULL to go back to the hunk, returns the previous one
+void Hunk_FreeArena (hunkarena_t *arena);
+int Hunk_ArenaSize (hunkarena_t *arena);
+
 typedef struct cache_user_s
 {
 	void	*data;